@@ -0,0 +1,341 @@
+/*
+    Headless test of the device memory allocator, needs no window or GPU.
+
+    The Vulkan calls of vk::DeviceAllocator and vk::GeometryHeap are
+    defined below on host memory, so the binary is linked without the
+    Vulkan loader. Every memory type is host visible, allocations can be
+    filled and read back:
+    - range: random alloc() and free() on a vk::TlsfRange. Ranges must keep
+      their alignment, never overlap and be reported by
+      forEachAllocation() with the alignment they were requested with.
+      Freeing everything must leave one free range, grow() must keep the
+      offsets of live ranges
+    - defragment: resources with 64 KiB and 16 byte alignments, most of
+      the first block freed. defragment() must empty it, every move must
+      keep the alignment of its resource and the content must survive
+    - geometry heap: the buffers of a vk::GeometryHeap alone in a block,
+      moved by defragment() through GeometryHeap::moveBuffer() like
+      Renderer::defragmentMemory() does
+
+    make allocator_test && ./build/allocator_test [range ops] [seed]
+*/
+
+//ext
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <memory>
+#include <random>
+#include <algorithm>
+
+//int
+#include <vulkan_allocator.h>
+#include <vulkan_geometry_heap.h>
+
+using namespace ale;
+
+
+// Stub device, handles of memories point to their host bytes
+const VkDeviceSize STUB_HEAP_SIZE = 4ull * 1024 * 1024 * 1024;
+const VkDeviceSize STUB_GRANULARITY = 1024;
+const VkDeviceSize STUB_BUFFER_ALIGNMENT = 256;
+
+struct StubBuffer {
+    VkDeviceSize size = 0;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+};
+
+static std::map<VkDeviceMemory, std::unique_ptr<char[]>> g_memories;
+static std::map<VkBuffer, StubBuffer> g_buffers;
+static uintptr_t g_nextBuffer = 1;
+
+extern "C" {
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice,
+                                                               VkPhysicalDeviceMemoryProperties* out_props) {
+    *out_props = {};
+    out_props->memoryTypeCount = 1;
+    out_props->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    out_props->memoryTypes[0].heapIndex = 0;
+    out_props->memoryHeapCount = 1;
+    out_props->memoryHeaps[0].size = STUB_HEAP_SIZE;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* out_props) {
+    *out_props = {};
+    out_props->limits.bufferImageGranularity = STUB_GRANULARITY;
+    out_props->limits.maxMemoryAllocationCount = 4096;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* info,
+                                                const VkAllocationCallbacks*, VkDeviceMemory* out_memory) {
+    auto bytes = std::make_unique<char[]>(info->allocationSize);
+    *out_memory = reinterpret_cast<VkDeviceMemory>(bytes.get());
+    g_memories[*out_memory] = std::move(bytes);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*) {
+    g_memories.erase(memory);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize,
+                                           VkMemoryMapFlags, void** out_data) {
+    *out_data = g_memories.at(memory).get() + offset;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo* info,
+                                              const VkAllocationCallbacks*, VkBuffer* out_buffer) {
+    *out_buffer = reinterpret_cast<VkBuffer>(g_nextBuffer++);
+    g_buffers[*out_buffer].size = info->size;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*) {
+    g_buffers.erase(buffer);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer,
+                                                         VkMemoryRequirements* out_requirements) {
+    VkDeviceSize size = g_buffers.at(buffer).size;
+    out_requirements->size = (size + STUB_BUFFER_ALIGNMENT - 1) / STUB_BUFFER_ALIGNMENT * STUB_BUFFER_ALIGNMENT;
+    out_requirements->alignment = STUB_BUFFER_ALIGNMENT;
+    out_requirements->memoryTypeBits = 1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer buffer, VkDeviceMemory memory,
+                                                  VkDeviceSize offset) {
+    auto& b = g_buffers.at(buffer);
+    b.memory = memory;
+    b.offset = offset;
+    return VK_SUCCESS;
+}
+
+} // extern "C"
+
+
+static char* getBufferBytes(VkBuffer buffer) {
+    auto& b = g_buffers.at(buffer);
+    return g_memories.at(b.memory).get() + b.offset;
+}
+
+
+static bool testRange(size_t ops, uint32_t seed) {
+    const uint64_t SIZE = 1ull << 24;
+    vk::TlsfRange range;
+    range.init(SIZE);
+
+    struct Live {
+        uint32_t node;
+        uint64_t offset, size, alignment;
+    };
+    std::vector<Live> live;
+    std::mt19937 rng(seed);
+    bool bValid = true;
+
+    for (size_t i = 0; i < ops; i++) {
+        if (!live.empty() && rng() % 5 < 2) {
+            size_t k = rng() % live.size();
+            range.free(live[k].node);
+            live[k] = live.back();
+            live.pop_back();
+            continue;
+        }
+        uint64_t size = 1 + rng() % 20000;
+        uint64_t alignment = uint64_t(1) << (rng() % 17);
+        Live l {.size = size, .alignment = alignment};
+        if (range.alloc(size, alignment, l.offset, l.node)) {
+            bValid &= l.offset % alignment == 0 && l.offset + size <= SIZE;
+            live.push_back(l);
+        }
+    }
+
+    // Used ranges in offset order must not overlap and must match
+    std::sort(live.begin(), live.end(), [](const Live& a, const Live& b) { return a.offset < b.offset; });
+    size_t k = 0;
+    uint64_t end = 0;
+    range.forEachAllocation([&](uint32_t node, uint64_t offset, uint64_t size, uint64_t alignment) {
+        bValid &= k < live.size() && live[k].node == node && live[k].offset == offset &&
+                  live[k].size == size && live[k].alignment == alignment && offset >= end;
+        end = offset + size;
+        k++;
+    });
+    bValid &= k == live.size() && range.getAllocationCount() == live.size();
+    std::printf("range        | %zu live ranges after %zu ops, %.1f of %.1f MiB used\n", live.size(), ops,
+                range.getUsedSize() / 1048576.0, SIZE / 1048576.0);
+
+    for (auto& l : live) {
+        range.free(l.node);
+    }
+    bValid &= range.isEmpty() && range.getLargestFreeRange() == SIZE;
+
+    // A full range grows at its end, live ranges stay where they are
+    range.init(64 * 1024);
+    std::vector<uint64_t> offsets;
+    uint64_t offset;
+    uint32_t node;
+    while (range.alloc(1024, 1024, offset, node)) {
+        offsets.push_back(offset);
+    }
+    range.grow(128 * 1024);
+    bool bGrown = offsets.size() == 64 && range.alloc(1024, 1024, offset, node) && offset == 64 * 1024;
+    size_t kept = 0;
+    range.forEachAllocation([&](uint32_t, uint64_t offset, uint64_t, uint64_t) {
+        kept += kept < offsets.size() && offsets[kept] == offset;
+    });
+    bValid &= bGrown && kept == offsets.size();
+    std::printf("             | grow: %zu ranges kept, %s\n", kept, bGrown ? "allocates past the old end" : "FAILED");
+    return bValid;
+}
+
+
+static bool testDefragment() {
+    vk::DeviceAllocator allocator;
+    allocator.init(VK_NULL_HANDLE, VK_NULL_HANDLE, 1024 * 1024);
+
+    // Every second resource needs 64 KiB alignment
+    struct Resource {
+        vk::Allocation allocation;
+        VkDeviceSize alignment;
+    };
+    std::vector<Resource> resources;
+    for (size_t i = 0; i < 40; i++) {
+        VkMemoryRequirements req {
+            .size = i % 2 ? 65536u : 1000u,
+            .alignment = i % 2 ? 65536u : 16u,
+            .memoryTypeBits = 1,
+        };
+        resources.push_back({allocator.allocate(req, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vk::ResourceKind::LINEAR),
+                             req.alignment});
+        std::memset(resources.back().allocation.mapped, int(i), req.size);
+    }
+
+    // Most of the first block and every fifth resource of the others go
+    VkDeviceMemory first = resources[0].allocation.memory;
+    for (size_t i = 0; i < resources.size(); i++) {
+        auto& a = resources[i].allocation;
+        if (a.memory == first ? i % 3 != 0 : i % 5 == 0) {
+            allocator.free(a);
+        }
+    }
+
+    // defragment() empties the least used block
+    std::map<VkDeviceMemory, VkDeviceSize> used;
+    for (auto& r : resources) {
+        if (r.allocation.isValid()) {
+            used[r.allocation.memory] += r.allocation.size;
+        }
+    }
+    VkDeviceMemory sparse = std::min_element(used.begin(), used.end(), [](const auto& a, const auto& b) {
+        return a.second < b.second;
+    })->first;
+
+    size_t moves = 0;
+    size_t misaligned = 0;
+    VkDeviceSize moved = allocator.defragment([&](const vk::Allocation& src, const vk::Allocation& dst) {
+        for (auto& r : resources) {
+            if (r.allocation.isValid() && r.allocation.memory == src.memory && r.allocation.offset == src.offset) {
+                misaligned += dst.offset % r.alignment != 0 || dst.memory == src.memory;
+                std::memcpy(dst.mapped, src.mapped, src.size);
+                r.allocation = dst;
+                moves++;
+                return true;
+            }
+        }
+        return false;
+    });
+
+    size_t damaged = 0;
+    for (size_t i = 0; i < resources.size(); i++) {
+        auto& a = resources[i].allocation;
+        if (a.isValid()) {
+            auto bytes = static_cast<const unsigned char*>(a.mapped);
+            damaged += std::any_of(bytes, bytes + a.size, [&](unsigned char b) { return b != i; });
+        }
+    }
+    bool bEmptied = allocator.getStats().pools[0].largestFreeRange == 1024 * 1024;
+    for (auto& r : resources) {
+        bEmptied &= !r.allocation.isValid() || r.allocation.memory != sparse;
+    }
+
+    std::printf("defragment   | moved %llu bytes in %zu moves, %zu misaligned, %zu damaged, "
+                "least used block %s\n",
+                static_cast<unsigned long long>(moved), moves, misaligned, damaged,
+                bEmptied ? "emptied" : "NOT EMPTIED");
+
+    for (auto& r : resources) {
+        allocator.free(r.allocation);
+    }
+    allocator.destroy();
+    return moves > 0 && misaligned == 0 && damaged == 0 && bEmptied;
+}
+
+
+static bool testGeometryHeap() {
+    vk::DeviceAllocator allocator;
+    allocator.init(VK_NULL_HANDLE, VK_NULL_HANDLE, 1024 * 1024);
+    auto allocate = [&](VkDeviceSize size) {
+        VkMemoryRequirements req {.size = size, .alignment = 256, .memoryTypeBits = 1};
+        return allocator.allocate(req, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vk::ResourceKind::LINEAR);
+    };
+
+    // The heap buffers end up alone in the first block
+    vk::Allocation before = allocate(400 * 1024);
+    vk::GeometryHeap heap;
+    heap.init(VK_NULL_HANDLE, allocator, 16, 2, 1000, 1000, 1000);
+    vk::Allocation filler = allocate(500 * 1024);
+    vk::Allocation other = allocate(500 * 1024);
+    allocator.free(before);
+    allocator.free(filler);
+
+    std::vector<VkBuffer> buffers = {heap.getVertexBuffer(), heap.getIndexBuffer(VK_INDEX_TYPE_UINT32),
+                                     heap.getIndexBuffer(VK_INDEX_TYPE_UINT16)};
+    for (size_t i = 0; i < buffers.size(); i++) {
+        std::memset(getBufferBytes(buffers[i]), int(i + 1), g_buffers.at(buffers[i]).size);
+    }
+    VkDeviceMemory first = g_buffers.at(buffers[0]).memory;
+
+    size_t copies = 0;
+    VkDeviceSize moved = allocator.defragment([&](const vk::Allocation& src, const vk::Allocation& dst) {
+        return heap.moveBuffer(src, dst, [&](VkBuffer from, VkBuffer to, VkDeviceSize size) {
+            std::memcpy(getBufferBytes(to), getBufferBytes(from), size);
+            copies++;
+        });
+    });
+
+    buffers = {heap.getVertexBuffer(), heap.getIndexBuffer(VK_INDEX_TYPE_UINT32),
+               heap.getIndexBuffer(VK_INDEX_TYPE_UINT16)};
+    size_t damaged = 0;
+    size_t left = 0;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        auto& b = g_buffers.at(buffers[i]);
+        auto bytes = reinterpret_cast<const unsigned char*>(getBufferBytes(buffers[i]));
+        damaged += std::any_of(bytes, bytes + b.size, [&](unsigned char c) { return c != i + 1; });
+        left += b.memory == first || b.memory != other.memory;
+    }
+    std::printf("geometry heap| moved %llu bytes in %zu copies, %zu damaged, %zu buffers left behind\n",
+                static_cast<unsigned long long>(moved), copies, damaged, left);
+
+    heap.destroy();
+    allocator.free(other);
+    allocator.destroy();
+    return copies == buffers.size() && damaged == 0 && left == 0 && g_buffers.empty();
+}
+
+
+int main(int argc, char** argv) {
+    size_t ops = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    uint32_t seed = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 1;
+
+    bool bValid = testRange(ops, seed);
+    bValid &= testDefragment();
+    bValid &= testGeometryHeap();
+    std::printf("%s\n", bValid ? "all valid" : "FAILED");
+    return bValid ? 0 : 1;
+}
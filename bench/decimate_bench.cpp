@@ -0,0 +1,217 @@
+/*
+    Headless test and benchmark of geo::decimate(), needs no window or
+    GPU.
+
+    Decimates three triangle meshes and checks each result:
+    - closed: a torus with a UV seam around both rings
+    - open: a grid, its border must stay
+    - non-manifold: a grid with fins on some inner edges, three faces on
+      one edge, and a second grid touching it at one corner
+    After decimation the mesh must pass geo::validate() and every vertex
+    on a border, a seam or a non-manifold edge must still be there at its
+    position. Prints the time of each decimation.
+
+    The torus has the given number of faces, so a scanned mesh can be
+    timed too, e.g. 5000000 faces to 100000 needs about 3.9 GB.
+
+    make decimate_bench && ./build/decimate_bench [torus faces] [target faces]
+*/
+
+//ext
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+//int
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <re_mesh_iterators.h>
+#include <re_mesh_decimate.h>
+#include <re_mesh_validate.h>
+#include <ale_thread_pool.h>
+
+using namespace ale;
+
+using Clock = std::chrono::steady_clock;
+
+static double getMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+static void reserveMesh(size_t verts, size_t faces, geo::REMesh& out_mesh) {
+    out_mesh.vertsPool.reserve(verts);
+    out_mesh.edgesPool.reserve(2 * faces);
+    out_mesh.disksPool.reserve(4 * faces);
+    out_mesh.facesPool.reserve(faces);
+    out_mesh.loopsPool.reserve(3 * faces);
+}
+
+
+// Two triangles per quad of a sizeX x sizeY grid of vertices. Corners take
+// the UV of their grid position, wrapped grids get a seam
+static void addTriangles(geo::REMesh& mesh, const std::vector<geo::Vert*>& grid,
+                         size_t sizeX, size_t sizeY, bool bWrap) {
+    size_t quadsX = bWrap ? sizeX : sizeX - 1;
+    size_t quadsY = bWrap ? sizeY : sizeY - 1;
+    auto addTriangle = [&](std::array<size_t, 2> a, std::array<size_t, 2> b, std::array<size_t, 2> c) {
+        auto getVert = [&](std::array<size_t, 2> p) {
+            return grid[(p[1] % sizeY) * sizeX + p[0] % sizeX];
+        };
+        auto f = geo::makeFace(mesh, {getVert(a), getVert(b), getVert(c)});
+        const std::array<size_t, 2>* corners[3] = {&a, &b, &c};
+        auto l = f->loop;
+        for (auto p : corners) {
+            l->texCoord = glm::vec2((*p)[0], (*p)[1]) / glm::vec2(quadsX, quadsY);
+            l = l->next;
+        }
+    };
+    for (size_t y = 0; y < quadsY; y++) {
+        for (size_t x = 0; x < quadsX; x++) {
+            addTriangle({x, y}, {x, y + 1}, {x + 1, y + 1});
+            addTriangle({x, y}, {x + 1, y + 1}, {x + 1, y});
+        }
+    }
+}
+
+
+const float TAU = 6.2831853f;
+
+
+static void buildTorus(size_t faces, geo::REMesh& out_mesh) {
+    size_t size = std::max<size_t>(size_t(std::sqrt(double(faces) / 2)), 3);
+    reserveMesh(size * size, 2 * size * size, out_mesh);
+    std::vector<geo::Vert*> grid(size * size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            float u = TAU * float(x) / float(size);
+            float v = TAU * float(y) / float(size);
+            // A little noise, so collapses have different costs
+            float r = 1 + 0.002f * float((x * 7 + y * 13) % 5);
+            glm::vec3 pos((3 + r * std::cos(v)) * std::cos(u), r * std::sin(v), (3 + r * std::cos(v)) * std::sin(u));
+            grid[y * size + x] = geo::makeVert(out_mesh, pos);
+        }
+    }
+    addTriangles(out_mesh, grid, size, size, true);
+}
+
+
+static std::vector<geo::Vert*> buildGrid(size_t size, glm::vec3 origin, geo::REMesh& out_mesh) {
+    std::vector<geo::Vert*> grid(size * size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            float height = 0.01f * float((x * 7 + y * 13) % 5);
+            grid[y * size + x] = geo::makeVert(out_mesh, origin + glm::vec3(x, height, y));
+        }
+    }
+    addTriangles(out_mesh, grid, size, size, false);
+    return grid;
+}
+
+
+static void buildNonManifold(size_t size, geo::REMesh& out_mesh) {
+    reserveMesh(3 * size * size, 6 * size * size, out_mesh);
+    auto grid = buildGrid(size, glm::vec3(0), out_mesh);
+
+    // Fins stand on every 16th inner horizontal edge
+    for (size_t y = 1; y + 1 < size; y += 4) {
+        for (size_t x = 1; x + 2 < size; x += 4) {
+            auto tip = geo::makeVert(out_mesh, grid[y * size + x]->pos + glm::vec3(0.5f, 1, 0));
+            geo::makeFace(out_mesh, {grid[y * size + x], grid[y * size + x + 1], tip});
+        }
+    }
+
+    // The second grid shares the last corner of the first one
+    auto other = buildGrid(size, grid.back()->pos, out_mesh);
+    geo::spliceVerts(out_mesh, grid.back(), other.front());
+}
+
+
+// Vertices that decimation must keep: on borders, UV seams and
+// non-manifold edges
+static std::vector<std::pair<size_t, glm::vec3>> getKeptVerts(geo::REMesh& mesh) {
+    std::vector<std::pair<size_t, glm::vec3>> kept;
+    std::vector<uint8_t> bKept(mesh.vertsPool.getCapacity(), 0);
+    for (auto e : mesh.edges) {
+        auto getCorner = [](const geo::Loop* l, const geo::Vert* v) {
+            return l->v == v ? l : l->next;
+        };
+        size_t faces = 0;
+        bool bSeam = false;
+        for (auto l : geo::edgeLoops(e)) {
+            faces++;
+            for (auto v : {e->v1, e->v2}) {
+                bSeam |= getCorner(l, v)->texCoord != getCorner(e->loop, v)->texCoord;
+            }
+        }
+        if (faces != 2 || bSeam) {
+            bKept[e->v1->id] = 1;
+            bKept[e->v2->id] = 1;
+        }
+    }
+    for (auto v : mesh.verts) {
+        if (bKept[v->id]) {
+            kept.push_back({v->id, v->pos});
+        }
+    }
+    return kept;
+}
+
+
+static bool run(const char* name, geo::REMesh& mesh, size_t targetFaces, ThreadPool& threads) {
+    auto kept = getKeptVerts(mesh);
+    size_t progressCalls = 0;
+    auto start = Clock::now();
+    auto result = geo::decimate(mesh, targetFaces, threads, [&](float) { progressCalls++; });
+    double ms = getMs(start);
+
+    auto validateStart = Clock::now();
+    auto report = geo::validate(mesh, threads);
+    double validateMs = getMs(validateStart);
+
+    std::vector<const geo::Vert*> byId(mesh.vertsPool.getCapacity(), nullptr);
+    for (auto v : mesh.verts) {
+        byId[v->id] = v;
+    }
+    size_t lost = 0;
+    for (auto [id, pos] : kept) {
+        lost += !byId[id] || byId[id]->pos != pos;
+    }
+
+    std::printf("%-12s | %9zu -> %8zu faces in %8.1f ms, error %.4g, %zu progress calls\n",
+                name, result.facesBefore, result.facesAfter, ms, result.error, progressCalls);
+    std::printf("%-12s | validate %.1f ms: %s, %zu of %zu border/seam/non-manifold verts lost\n",
+                "", validateMs, report.isValid() ? "valid" : report.toString().c_str(), lost, kept.size());
+    return report.isValid() && lost == 0;
+}
+
+
+int main(int argc, char** argv) {
+    size_t torusFaces = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t targetFaces = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : torusFaces / 10;
+
+    ThreadPool threads;
+    bool bValid = true;
+    {
+        geo::REMesh mesh;
+        buildTorus(torusFaces, mesh);
+        bValid &= run("closed", mesh, targetFaces, threads);
+    }
+    {
+        geo::REMesh mesh;
+        buildGrid(301, glm::vec3(0), mesh);
+        bValid &= run("open", mesh, mesh.faces.size() / 20, threads);
+    }
+    {
+        geo::REMesh mesh;
+        buildNonManifold(201, mesh);
+        bValid &= run("non-manifold", mesh, mesh.faces.size() / 20, threads);
+    }
+    std::printf("%s\n", bValid ? "all valid" : "INVALID");
+    return bValid ? 0 : 1;
+}
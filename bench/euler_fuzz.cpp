@@ -0,0 +1,253 @@
+/*
+    Headless fuzz test of the Euler operators, needs no window or GPU.
+
+    Starts from a grid of quads and applies random operators with random
+    arguments: makeEdgeVert, killEdgeVert, splitEdge, makeEdgeFace,
+    killEdgeFace, joinFaces, makeFace, killFace, spliceVerts and
+    spliceEdges. Operators that would break the mesh must refuse, so the
+    arguments are not filtered. compactMesh() runs
+    after every operator and geo::validate() every few operators. The
+    mesh is kept small: growing operators pause while it has more faces
+    than twice the grid, and it is built again once wire edges pile up or
+    too few vertices are left.
+
+    Stops at the first invalid mesh and prints the operator, its number
+    and the report. Asserts stay on, build without NDEBUG.
+
+    make euler_fuzz && ./build/euler_fuzz [ops] [seed] [validate every]
+*/
+
+//ext
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+//int
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <re_mesh_validate.h>
+#include <ale_thread_pool.h>
+
+using namespace ale;
+
+using Clock = std::chrono::steady_clock;
+
+static double getMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+const size_t GRID_SIZE = 8;
+
+enum FuzzOp {
+    OP_MAKE_EDGE_VERT,
+    OP_KILL_EDGE_VERT,
+    OP_SPLIT_EDGE,
+    OP_MAKE_EDGE_FACE,
+    OP_KILL_EDGE_FACE,
+    OP_JOIN_FACES,
+    OP_MAKE_FACE,
+    OP_KILL_FACE,
+    OP_SPLICE_VERTS,
+    OP_SPLICE_EDGES,
+    OP_MAX,
+};
+
+const std::array<const char*, OP_MAX> FuzzOp_Names {
+    "makeEdgeVert", "killEdgeVert", "splitEdge", "makeEdgeFace", "killEdgeFace",
+    "joinFaces", "makeFace", "killFace", "spliceVerts", "spliceEdges",
+};
+
+
+static void buildGrid(size_t size, geo::REMesh& out_mesh) {
+    std::vector<geo::Vert*> grid(size * size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            grid[y * size + x] = geo::makeVert(out_mesh, glm::vec3(x, 0, y));
+        }
+    }
+    for (size_t y = 0; y + 1 < size; y++) {
+        for (size_t x = 0; x + 1 < size; x++) {
+            size_t i = y * size + x;
+            geo::makeFace(out_mesh, {grid[i], grid[i + size], grid[i + size + 1], grid[i + 1]});
+        }
+    }
+}
+
+
+class Fuzzer {
+public:
+    explicit Fuzzer(uint32_t seed) : _rng(seed) {}
+
+    // Applies one random operator, returns true if it changed the mesh
+    bool apply(geo::REMesh& mesh, FuzzOp op) {
+        switch (op) {
+        case OP_MAKE_EDGE_VERT: {
+            auto v = _pick(mesh.verts);
+            geo::Edge* e = nullptr;
+            return v && geo::makeEdgeVert(mesh, v, v->pos + glm::vec3(0, 1, 0), e);
+        }
+        case OP_KILL_EDGE_VERT: {
+            auto v = _pick(mesh.verts);
+            return v && v->edge && geo::killEdgeVert(mesh, v->edge, v);
+        }
+        case OP_SPLIT_EDGE: {
+            auto e = _pick(mesh.edges);
+            geo::Edge* ne = nullptr;
+            return e && geo::splitEdge(mesh, e, _getFloat(), ne);
+        }
+        case OP_MAKE_EDGE_FACE: {
+            auto f = _pick(mesh.faces);
+            if (!f) {
+                return false;
+            }
+            geo::Edge* e = nullptr;
+            return geo::makeEdgeFace(mesh, _pickCorner(f), _pickCorner(f), e);
+        }
+        case OP_KILL_EDGE_FACE: {
+            auto e = _pick(mesh.edges);
+            return e && geo::killEdgeFace(mesh, e);
+        }
+        case OP_JOIN_FACES: {
+            auto f = _pick(mesh.faces);
+            if (!f) {
+                return false;
+            }
+            auto l = _pickCorner(f);
+            return geo::joinFaces(mesh, f, l->radial_next->f);
+        }
+        case OP_MAKE_FACE: {
+            std::vector<geo::Vert*> verts(3 + _getIndex(2));
+            for (auto& v : verts) {
+                v = _pick(mesh.verts);
+            }
+            return verts[0] && geo::makeFace(mesh, verts);
+        }
+        case OP_KILL_FACE: {
+            auto f = _pick(mesh.faces);
+            if (f) {
+                geo::killFace(mesh, f);
+            }
+            return f;
+        }
+        case OP_SPLICE_VERTS: {
+            auto keep = _pick(mesh.verts);
+            auto v = _pick(mesh.verts);
+            return keep && geo::spliceVerts(mesh, keep, v);
+        }
+        case OP_SPLICE_EDGES: {
+            // A second edge between the same vertices, spliceVerts() leaves them
+            auto e = _pick(mesh.edges);
+            if (!e) {
+                return false;
+            }
+            for (auto other : geo::vertEdges(e->v1)) {
+                if (other != e && geo::getOtherVert(other, e->v1) == e->v2) {
+                    return geo::spliceEdges(mesh, e, other);
+                }
+            }
+            return false;
+        }
+        default:
+            return false;
+        }
+    }
+
+    FuzzOp pickOp(bool bGrow) {
+        const std::array<FuzzOp, 4> shrinking {
+            OP_KILL_EDGE_VERT, OP_KILL_EDGE_FACE, OP_JOIN_FACES, OP_KILL_FACE,
+        };
+        if (bGrow) {
+            return FuzzOp(_getIndex(OP_MAX));
+        }
+        return shrinking[_getIndex(shrinking.size())];
+    }
+
+private:
+    std::mt19937 _rng;
+
+    size_t _getIndex(size_t count) {
+        return std::uniform_int_distribution<size_t>(0, count - 1)(_rng);
+    }
+
+    float _getFloat() {
+        return std::uniform_real_distribution<float>(0.05f, 0.95f)(_rng);
+    }
+
+    template <class T>
+    T* _pick(const std::vector<T*>& elems) {
+        return elems.empty() ? nullptr : elems[_getIndex(elems.size())];
+    }
+
+    geo::Loop* _pickCorner(geo::Face* f) {
+        auto l = f->loop;
+        for (size_t i = _getIndex(f->size); i > 0; i--) {
+            l = l->next;
+        }
+        return l;
+    }
+};
+
+
+int main(int argc, char** argv) {
+    size_t ops = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000000;
+    uint32_t seed = argc > 2 ? uint32_t(std::strtoul(argv[2], nullptr, 10)) : 1;
+    size_t validateEvery = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 16;
+    validateEvery = std::max<size_t>(validateEvery, 1);
+
+    ThreadPool threads;
+    Fuzzer fuzzer(seed);
+    geo::REMesh mesh;
+    buildGrid(GRID_SIZE, mesh);
+    const size_t maxFaces = 2 * mesh.faces.size();
+    const size_t maxEdges = 4 * mesh.edges.size();
+
+    std::array<size_t, OP_MAX> tried {};
+    std::array<size_t, OP_MAX> applied {};
+    size_t validations = 0;
+    size_t resets = 0;
+    double validateMs = 0;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        // No operator removes wire edges between faces, and shrinking
+        // operators can leave too little to work with
+        if (mesh.verts.size() < 3 || mesh.edges.size() > maxEdges) {
+            mesh = geo::REMesh();
+            buildGrid(GRID_SIZE, mesh);
+            resets++;
+        }
+
+        FuzzOp op = fuzzer.pickOp(mesh.faces.size() < maxFaces);
+        tried[op]++;
+        applied[op] += fuzzer.apply(mesh, op);
+        geo::compactMesh(mesh);
+
+        if ((i + 1) % validateEvery != 0 && i + 1 != ops) {
+            continue;
+        }
+        auto validateStart = Clock::now();
+        auto report = geo::validate(mesh, threads);
+        validateMs += getMs(validateStart);
+        validations++;
+        if (!report.isValid()) {
+            std::printf("INVALID MESH after op %zu (%s), seed %u: %s\n",
+                        i, FuzzOp_Names[op], seed, report.toString().c_str());
+            return 1;
+        }
+    }
+    double totalMs = getMs(start);
+
+    std::printf("%zu ops, seed %u, %zu validations, %zu resets in %.0f ms (validate %.0f ms)\n",
+                ops, seed, validations, resets, totalMs, validateMs);
+    for (size_t op = 0; op < OP_MAX; op++) {
+        std::printf("%-14s tried %9zu | applied %9zu\n", FuzzOp_Names[op], tried[op], applied[op]);
+    }
+    std::printf("final mesh: %zu verts, %zu edges, %zu faces, all valid\n",
+                mesh.verts.size(), mesh.edges.size(), mesh.faces.size());
+    return 0;
+}
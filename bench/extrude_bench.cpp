@@ -0,0 +1,211 @@
+/*
+    Headless benchmark of face extrusion, needs no window or GPU.
+
+    Builds a grid of quads with two primitives and a UV seam between
+    them, selects a square of faces and extrudes it:
+    - incremental: extrudeFaceRegion(), updateExtrudeView() and the undo
+      step, what the editor does
+    - rebuild: extrudeFaceRegion(), rebuildViewMesh() and the undo step
+    Both are timed on their own copy of the mesh, once with the square
+    inside the last primitive if it fits and once across the seam. Side
+    faces are added at the end of their primitive, so in the second case
+    the indices of the primitive after it move and are uploaded again.
+
+    After the incremental path the mesh must pass geo::validate() and
+    every face must be drawn by its triangles in the ViewMesh with its
+    positions and UVs. The vertex count must match the one of the rebuilt
+    view. Also prints how much of the view the incremental path uploads.
+
+    By default about 500k of 1M faces are extruded. The best incremental
+    time must stay within EXTRUDE_BUDGET_MS, else the exit code is 1.
+
+    make extrude_bench && ./build/extrude_bench [grid size] [selection size] [repeats]
+*/
+
+//ext
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <algorithm>
+
+//int
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <re_mesh_extrude.h>
+#include <re_mesh_validate.h>
+#include <ale_geo_utils.h>
+#include <ale_history.h>
+#include <ale_thread_pool.h>
+
+using namespace ale;
+
+using Clock = std::chrono::steady_clock;
+
+static double getMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+// Left half is primitive 0, the right half primitive 1 with its UVs
+// shifted, so vertices on the seam have two view vertices
+static void buildGrid(size_t size, geo::REMesh& out_mesh, ViewMesh& out_view) {
+    out_mesh.vertsPool.reserve(size * size);
+    out_mesh.edgesPool.reserve(2 * size * size);
+    out_mesh.disksPool.reserve(4 * size * size);
+    out_mesh.facesPool.reserve(size * size);
+    out_mesh.loopsPool.reserve(4 * size * size);
+
+    std::vector<geo::Vert*> grid(size * size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            grid[y * size + x] = geo::makeVert(out_mesh, glm::vec3(x, 0, y));
+        }
+    }
+    for (size_t y = 0; y + 1 < size; y++) {
+        for (size_t x = 0; x + 1 < size; x++) {
+            size_t i = y * size + x;
+            auto f = geo::makeFace(out_mesh, {grid[i], grid[i + size], grid[i + size + 1], grid[i + 1]});
+            f->primitiveId = x < size / 2 ? 0 : 1;
+            for (auto l : geo::faceLoops(f)) {
+                l->texCoord = glm::vec2(l->v->pos.x, l->v->pos.z) / float(size);
+                l->texCoord.x += float(f->primitiveId);
+            }
+        }
+    }
+    out_view.primitives = {{.materialID = 0, .offsetIdx = 0, .size = 0},
+                           {.materialID = 1, .offsetIdx = 0, .size = 0}};
+    geo::rebuildViewMesh(out_mesh, out_view);
+}
+
+
+static std::vector<geo::Face*> selectSquare(geo::REMesh& mesh, size_t size, size_t selection,
+                                           size_t centerX) {
+    // Faces were made row by row
+    std::vector<geo::Face*> faces;
+    size_t first = (size - 1 - selection) / 2;
+    size_t firstX = std::min(centerX - std::min(centerX, selection / 2), size - 1 - selection);
+    for (size_t y = first; y < first + selection; y++) {
+        for (size_t x = firstX; x < firstX + selection; x++) {
+            faces.push_back(mesh.faces[y * (size - 1) + x]);
+        }
+    }
+    return faces;
+}
+
+
+// Every face must be drawn by its fan in its primitive, every triangle
+// must belong to a face
+static bool checkView(geo::REMesh& mesh, const ViewMesh& view) {
+    using Triangle = std::array<uint32_t, 3>;
+    auto rotate = [](Triangle t) {
+        std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        return t;
+    };
+    std::vector<std::vector<Triangle>> expected(view.primitives.size());
+    for (auto f : mesh.faces) {
+        std::vector<uint32_t> corners;
+        for (auto l : geo::faceLoops(f)) {
+            if (l->viewId >= view.vertices.size() || view.vertices[l->viewId].pos != l->v->pos ||
+                view.vertices[l->viewId].texCoord != l->texCoord) {
+                return false;
+            }
+            corners.push_back(static_cast<uint32_t>(l->viewId));
+        }
+        for (size_t i = 1; i + 1 < corners.size(); i++) {
+            expected[f->primitiveId].push_back(rotate({corners[0], corners[i], corners[i + 1]}));
+        }
+    }
+    for (size_t p = 0; p < view.primitives.size(); p++) {
+        auto& prim = view.primitives[p];
+        std::vector<Triangle> drawn;
+        for (size_t i = prim.offsetIdx; i < prim.offsetIdx + prim.size; i += 3) {
+            drawn.push_back(rotate({view.indices[i], view.indices[i + 1], view.indices[i + 2]}));
+        }
+        std::sort(drawn.begin(), drawn.end());
+        std::sort(expected[p].begin(), expected[p].end());
+        if (drawn != expected[p]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv) {
+    size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1001;
+    size_t selection = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 708;
+    size_t repeats = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 3;
+    const double EXTRUDE_BUDGET_MS = 500;
+    size = std::max<size_t>(size, 4);
+    selection = std::clamp<size_t>(selection, 1, size - 2);
+
+    ThreadPool threads;
+    bool bValid = true;
+    bool bOverBudget = false;
+    std::printf("%zu faces, %zux%zu faces extruded, best of %zu\n",
+                (size - 1) * (size - 1), selection, selection, repeats);
+
+    const std::array<const char*, 2> placeNames {"last primitive", "across seam"};
+    const std::array<size_t, 2> centers {3 * size / 4, size / 2};
+    for (size_t place = 0; place < centers.size(); place++) {
+        double bestIncremental = std::numeric_limits<double>::max();
+        double bestRebuild = std::numeric_limits<double>::max();
+        size_t uploadedVerts = 0;
+        size_t uploadedIndices = 0;
+        size_t indexCount = 0;
+
+        for (size_t r = 0; r < repeats; r++) {
+            geo::REMesh mesh;
+            ViewMesh view;
+            buildGrid(size, mesh, view);
+            History history;
+
+            std::vector<std::pair<size_t, size_t>> vertexRanges;
+            std::vector<std::pair<size_t, size_t>> indexRanges;
+            auto start = Clock::now();
+            auto before = mesh.snapshot();
+            ViewMesh beforeView = view;
+            auto result = geo::extrudeFaceRegion(mesh, selectSquare(mesh, size, selection, centers[place]));
+            bool bUpdated = geo::updateExtrudeView(mesh, view, result, vertexRanges, indexRanges);
+            history.pushTopologyStep(0, "Extrude", std::move(before), mesh, beforeView, view);
+            bestIncremental = std::min(bestIncremental, getMs(start));
+
+            uploadedVerts = 0;
+            uploadedIndices = 0;
+            for (auto& range : vertexRanges) {
+                uploadedVerts += range.second;
+            }
+            for (auto& range : indexRanges) {
+                uploadedIndices += range.second;
+            }
+            indexCount = view.indices.size();
+            bValid &= bUpdated && geo::validate(mesh, threads).isValid() && checkView(mesh, view);
+            size_t vertexCount = view.vertices.size();
+            geo::rebuildViewMesh(mesh, view);
+            bValid &= vertexCount == view.vertices.size();
+
+            geo::REMesh rebuildMesh;
+            ViewMesh rebuildView;
+            buildGrid(size, rebuildMesh, rebuildView);
+            History rebuildHistory;
+            start = Clock::now();
+            before = rebuildMesh.snapshot();
+            beforeView = rebuildView;
+            geo::extrudeFaceRegion(rebuildMesh, selectSquare(rebuildMesh, size, selection, centers[place]));
+            geo::rebuildViewMesh(rebuildMesh, rebuildView);
+            rebuildHistory.pushTopologyStep(0, "Extrude", std::move(before), rebuildMesh, beforeView, rebuildView);
+            bestRebuild = std::min(bestRebuild, getMs(start));
+        }
+        bOverBudget |= bestIncremental > EXTRUDE_BUDGET_MS;
+
+        std::printf("%-14s | incremental %8.2f ms, uploads %zu verts, %zu of %zu indices\n",
+                    placeNames[place], bestIncremental, uploadedVerts, uploadedIndices, indexCount);
+        std::printf("%-14s | rebuild     %8.2f ms, uploads the whole view\n", "", bestRebuild);
+    }
+    std::printf("%s\n", bValid ? "all valid" : "INVALID");
+    std::printf("%s the %.0f ms extrude budget\n", bOverBudget ? "OVER" : "within", EXTRUDE_BUDGET_MS);
+    return bValid && !bOverBudget ? 0 : 1;
+}
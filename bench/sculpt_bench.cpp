@@ -0,0 +1,200 @@
+/*
+    Headless sculpt benchmark, needs no window or GPU.
+
+    Builds a grid mesh of about 2M vertices, replays a stroke of every
+    brush across it and times each frame of the stroke: the cursor
+    raycast, the dabs, the history records and the CPU side of the
+    vertex upload (sync of the view mesh and packing of the dirty
+    ranges). Frames are compared to the 8 ms frame cap of App::run(),
+    the exit code is 1 if the p99 frame of a brush is over it. After the
+    strokes the normals kept by the session and written to the view must
+    match a full MeshNormals::compute().
+
+    make sculpt_bench && ./build/sculpt_bench [grid size] [threads] [frames]
+*/
+
+//ext
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+//int
+#include <primitives.h>
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <re_mesh_normals.h>
+#include <re_mesh_sculpt.h>
+#include <ale_geo_utils.h>
+#include <ale_history.h>
+#include <ale_thread_pool.h>
+#include <vulkan_vertex_format.h>
+
+using namespace ale;
+
+using Clock = std::chrono::steady_clock;
+
+static double getMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+// Quads on a wavy height field, size x size vertices
+static void buildGrid(size_t size, geo::REMesh& out_mesh, ViewMesh& out_view,
+                      geo::MeshNormals& out_normals, ThreadPool& threads) {
+    size_t verts = size * size;
+    size_t faces = (size - 1) * (size - 1);
+    out_mesh.vertsPool.reserve(verts);
+    out_mesh.edgesPool.reserve(2 * verts);
+    out_mesh.disksPool.reserve(4 * verts);
+    out_mesh.facesPool.reserve(faces);
+    out_mesh.loopsPool.reserve(4 * faces);
+
+    std::vector<geo::Vert*> grid(verts);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            float u = float(x) / float(size - 1);
+            float v = float(y) / float(size - 1);
+            float h = 0.02f * std::sin(u * 40.0f) * std::cos(v * 30.0f);
+            grid[y * size + x] = geo::makeVert(out_mesh, glm::vec3(u, h, v));
+            grid[y * size + x]->color = glm::vec3(1);
+        }
+    }
+    for (size_t y = 0; y + 1 < size; y++) {
+        for (size_t x = 0; x + 1 < size; x++) {
+            size_t i = y * size + x;
+            geo::makeFace(out_mesh, {grid[i], grid[i + size], grid[i + size + 1], grid[i + 1]});
+        }
+    }
+
+    out_view.primitives.resize(1);
+    out_normals.compute(out_mesh, geo::NormalSettings{}, threads);
+    geo::rebuildViewMesh(out_mesh, out_view,
+                         [&](const geo::Loop* l) { return out_normals.getCornerNormal(l); });
+}
+
+
+int main(int argc, char** argv) {
+    size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1415;
+    size_t threadCount = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    size_t frames = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 240;
+    const double FRAME_BUDGET_MS = 8;
+
+    ThreadPool threads(threadCount);
+    History history;
+    Model model;
+    model.reMeshes.resize(1);
+    model.viewMeshes.resize(1);
+    auto& mesh = model.reMeshes[0];
+    auto& view = model.viewMeshes[0];
+
+    geo::MeshNormals normals;
+    auto start = Clock::now();
+    buildGrid(std::max<size_t>(size, 2), mesh, view, normals, threads);
+    std::printf("mesh: %zu verts, %zu faces, built in %.0f ms, %zu worker slots\n",
+                mesh.verts.size(), mesh.faces.size(), getMs(start), threads.getSlotCount());
+
+    start = Clock::now();
+    geo::SculptSession session;
+    session.begin(mesh, normals, threads);
+    std::printf("session: BVH in %.0f ms\n", getMs(start));
+
+    auto quantization = vk::getVertexQuantization(view.vertices);
+    std::vector<char> packed;
+    std::vector<std::pair<size_t, size_t>> ranges;
+
+    bool bOverBudget = false;
+    for (int b = 0; b < geo::SCULPT_BRUSH_MAX; b++) {
+        geo::SculptBrushSettings brush;
+        brush.type = static_cast<geo::SculptBrush>(b);
+        brush.radius = 0.05f;
+        brush.strength = 0.5f;
+
+        std::vector<double> times;
+        std::vector<double> uploadTimes;
+        size_t dabs = 0;
+        size_t uploaded = 0;
+        glm::vec3 grabPlane(0);
+        for (size_t frame = 0; frame < frames; frame++) {
+            auto frameStart = Clock::now();
+
+            // The cursor sweeps a sine across the mesh, rays come from above
+            float t = float(frame) / float(frames);
+            glm::vec3 cursor(0.1f + 0.8f * t, 1.0f, 0.5f + 0.3f * std::sin(t * 6.28f) + 0.05f * b);
+            glm::vec3 hit;
+            if (brush.type == geo::GRAB_BRUSH && session.isStroking()) {
+                // Grab follows the cursor on the plane of the stroke start
+                hit = glm::vec3(cursor.x, grabPlane.y, cursor.z);
+            } else if (!session.raycast(cursor, glm::vec3(0, -1, 0), hit)) {
+                continue;
+            }
+            if (!session.isStroking()) {
+                session.beginStroke(hit, brush);
+                grabPlane = hit;
+            }
+            dabs += session.stroke(mesh, view, hit, brush, threads,
+                                   [&](const std::vector<geo::Vert*>& verts) {
+                                       history.beginVertexEdit(0, verts);
+                                   });
+
+            // What Renderer::updateDirtyVertices() does before the copy
+            auto uploadStart = Clock::now();
+            geo::syncDirtyVerts(mesh, view, ranges);
+            for (auto [first, count] : ranges) {
+                if (!vk::isQuantizationValid(quantization, view.vertices.data() + first, count)) {
+                    quantization = vk::getVertexQuantization(view.vertices,
+                                                             vk::QUANTIZATION_EDIT_MARGIN);
+                    ranges = {{0, view.vertices.size()}};
+                    break;
+                }
+            }
+            for (auto [first, count] : ranges) {
+                vk::packVertices(vk::VERTEX_FORMAT_PACKED, quantization,
+                                 view.vertices.data() + first, count, packed);
+                uploaded += count;
+            }
+            uploadTimes.push_back(getMs(uploadStart));
+            times.push_back(getMs(frameStart));
+        }
+        session.endStroke();
+        start = Clock::now();
+        history.endVertexEdit(model);
+        double historyMs = getMs(start);
+
+        if (times.empty()) {
+            std::printf("%-8s missed the mesh\n", geo::SculptBrush_Names[b].c_str());
+            continue;
+        }
+        std::sort(times.begin(), times.end());
+        std::sort(uploadTimes.begin(), uploadTimes.end());
+        double sum = 0;
+        for (auto t : times) {
+            sum += t;
+        }
+        double p99 = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+        bOverBudget |= p99 > FRAME_BUDGET_MS;
+        std::printf("%-8s frames %zu dabs %zu | frame ms mean %.2f p99 %.2f max %.2f | "
+                    "sync and pack p99 %.2f ms, %.1f verts/frame | history %.1f ms\n",
+                    geo::SculptBrush_Names[b].c_str(), times.size(), dabs, sum / times.size(),
+                    p99, times.back(), uploadTimes[std::min(uploadTimes.size() - 1, uploadTimes.size() * 99 / 100)],
+                    double(uploaded) / times.size(), historyMs);
+    }
+
+    // Dabs update the normals the moves changed, the rest must still hold
+    geo::MeshNormals full;
+    full.compute(mesh, normals.getSettings(), threads);
+    float maxError = 0;
+    for (auto v : mesh.verts) {
+        maxError = std::max(maxError, glm::length(normals.getVertNormal(v) - full.getVertNormal(v)));
+        if (v->viewId < view.vertices.size()) {
+            maxError = std::max(maxError, glm::length(view.vertices[v->viewId].normal - full.getVertNormal(v)));
+        }
+    }
+    bool bNormals = maxError < 1e-4f;
+    std::printf("normals: max error %.2g against compute(), %s\n", maxError, bNormals ? "ok" : "WRONG");
+
+    std::printf("%s the %.0f ms frame budget\n", bOverBudget ? "OVER" : "within", FRAME_BUDGET_MS);
+    return bOverBudget || !bNormals ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/*
+    Headless benchmark of subdivision, needs no window or GPU.
+
+    Builds a grid of about 1M quads and one of about 1M triangles and
+    times one Catmull-Clark level of the first and one Loop level of the
+    second with thread pools of 1 to 4 worker slots:
+    - alloc: subdiv::allocElements() of all new elements, pages are added
+      at once and ids handed out as one range
+    - total: subdivideOnce() including the allocation
+    Results must pass geo::validate(). Slots beyond the cores of the
+    machine only add switching, compare the rows up to the core count.
+
+    make subdivide_bench && ./build/subdivide_bench [base faces] [repeats]
+*/
+
+//ext
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+//int
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <re_mesh_subdivide.h>
+#include <re_mesh_validate.h>
+#include <ale_thread_pool.h>
+
+using namespace ale;
+
+using Clock = std::chrono::steady_clock;
+
+static double getMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+static void buildGrid(size_t size, bool bTriangles, geo::REMesh& out_mesh) {
+    out_mesh.vertsPool.reserve(size * size);
+    out_mesh.edgesPool.reserve(3 * size * size);
+    out_mesh.disksPool.reserve(6 * size * size);
+    out_mesh.facesPool.reserve(2 * size * size);
+    out_mesh.loopsPool.reserve(6 * size * size);
+
+    std::vector<geo::Vert*> grid(size * size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            grid[y * size + x] = geo::makeVert(out_mesh, glm::vec3(x, 0.1f * float((x * y) % 7), y));
+        }
+    }
+    for (size_t y = 0; y + 1 < size; y++) {
+        for (size_t x = 0; x + 1 < size; x++) {
+            size_t i = y * size + x;
+            if (bTriangles) {
+                geo::makeFace(out_mesh, {grid[i], grid[i + size], grid[i + size + 1]});
+                geo::makeFace(out_mesh, {grid[i], grid[i + size + 1], grid[i + 1]});
+            } else {
+                geo::makeFace(out_mesh, {grid[i], grid[i + size], grid[i + size + 1], grid[i + 1]});
+            }
+        }
+    }
+}
+
+
+// Element counts of one level, see subdivideOnce()
+static size_t allocLevel(const geo::REMesh& in, bool bLoop, geo::REMesh& out, ThreadPool& threads) {
+    size_t V = in.verts.size();
+    size_t E = in.edges.size();
+    size_t C = in.loops.size();
+    size_t F = in.faces.size();
+    geo::subdiv::allocElements(out.vertsPool, out.verts, V + E + (bLoop ? 0 : F), threads);
+    geo::subdiv::allocElements(out.edgesPool, out.edges, 2 * E + C, threads);
+    geo::subdiv::allocElements(out.loopsPool, out.loops, 4 * C, threads);
+    geo::subdiv::allocElements(out.facesPool, out.faces, bLoop ? C + F : C, threads);
+    geo::subdiv::allocElements(out.disksPool, out.disks, 2 * (2 * E + C), threads);
+    return out.verts.size() + out.edges.size() + out.loops.size() + out.faces.size() + out.disks.size();
+}
+
+
+int main(int argc, char** argv) {
+    size_t baseFaces = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    size_t repeats = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 3;
+
+    std::printf("%zu base faces, %u cores, best of %zu\n",
+                baseFaces, std::thread::hardware_concurrency(), repeats);
+
+    bool bValid = true;
+    for (auto scheme : {geo::CATMULL_CLARK, geo::LOOP_SUBDIVISION}) {
+        bool bLoop = scheme == geo::LOOP_SUBDIVISION;
+        // A cell is one quad or two triangles
+        double cells = double(baseFaces) / (bLoop ? 2.0 : 1.0);
+        size_t size = std::max<size_t>(2, size_t(std::lround(std::sqrt(cells))) + 1);
+        geo::REMesh mesh;
+        buildGrid(size, bLoop, mesh);
+
+        for (size_t slots = 1; slots <= 4; slots++) {
+            ThreadPool threads(slots - 1);
+            double bestAlloc = std::numeric_limits<double>::max();
+            double bestTotal = std::numeric_limits<double>::max();
+            size_t elements = 0;
+            size_t faces = 0;
+            for (size_t r = 0; r < repeats; r++) {
+                // Meshes are freed outside of the timed parts
+                {
+                    geo::REMesh allocated;
+                    auto start = Clock::now();
+                    elements = allocLevel(mesh, bLoop, allocated, threads);
+                    bestAlloc = std::min(bestAlloc, getMs(start));
+                }
+
+                geo::REMesh result;
+                auto start = Clock::now();
+                bValid &= geo::subdivideOnce(mesh, result, scheme, threads);
+                bestTotal = std::min(bestTotal, getMs(start));
+                faces = result.faces.size();
+                if (r == 0 && slots == 1) {
+                    bValid &= geo::validate(result, threads).isValid();
+                }
+            }
+            std::printf("%-13s | %zu slots | %zu -> %zu faces | alloc %7.1f ms (%zu elements) | total %7.1f ms\n",
+                        bLoop ? "Loop" : "Catmull-Clark", slots, mesh.faces.size(), faces,
+                        bestAlloc, elements, bestTotal);
+        }
+    }
+    std::printf("%s\n", bValid ? "all valid" : "INVALID");
+    return bValid ? 0 : 1;
+}
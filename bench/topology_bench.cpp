@@ -0,0 +1,233 @@
+/*
+    Headless benchmark of the REMesh topology walks, needs no window or
+    GPU.
+
+    Builds a grid of quads and times three read patterns over all of it
+    on the calling thread:
+    - face loops: sum of the corner positions of every face
+    - one-ring verts: mean of the neighbours of every vertex, a smoothing
+      pass
+    - one-ring faces: sum of the face centers around every vertex, like
+      a normal pass
+    each done by the hand written pointer walk, the iterators of
+    re_mesh_iterators.h and the MeshAdjacency cache. The results of the
+    three must match, so the compiler cannot drop the loops. Also times
+    geo::validate() of the whole mesh.
+
+    make topology_bench && ./build/topology_bench [grid size] [repeats]
+*/
+
+//ext
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+//int
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <re_mesh_iterators.h>
+#include <re_mesh_validate.h>
+#include <ale_geo_utils.h>
+#include <ale_thread_pool.h>
+
+using namespace ale;
+
+using Clock = std::chrono::steady_clock;
+
+static double getMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+static void buildGrid(size_t size, geo::REMesh& out_mesh) {
+    out_mesh.vertsPool.reserve(size * size);
+    out_mesh.edgesPool.reserve(2 * size * size);
+    out_mesh.disksPool.reserve(4 * size * size);
+    out_mesh.facesPool.reserve(size * size);
+    out_mesh.loopsPool.reserve(4 * size * size);
+
+    std::vector<geo::Vert*> grid(size * size);
+    for (size_t y = 0; y < size; y++) {
+        for (size_t x = 0; x < size; x++) {
+            grid[y * size + x] = geo::makeVert(out_mesh, glm::vec3(x, 0.1f * float((x * y) % 7), y));
+        }
+    }
+    for (size_t y = 0; y + 1 < size; y++) {
+        for (size_t x = 0; x + 1 < size; x++) {
+            size_t i = y * size + x;
+            geo::makeFace(out_mesh, {grid[i], grid[i + size], grid[i + size + 1], grid[i + 1]});
+        }
+    }
+}
+
+
+// Best time of the repeats in ns per element, fn returns a checksum
+static double measure(size_t repeats, size_t count, glm::vec3& out_sum,
+                      const std::function<glm::vec3()>& fn) {
+    double best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < repeats; i++) {
+        auto start = Clock::now();
+        out_sum = fn();
+        best = std::min(best, getMs(start));
+    }
+    return best * 1e6 / double(count);
+}
+
+
+static bool report(const char* name, double walk, double iter, double cache,
+                   const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    bool bSame = a == b && (c == a || std::isnan(cache));
+    std::printf("%-16s ns per element | pointer walk %6.1f | iterators %6.1f | ",
+                name, walk, iter);
+    if (std::isnan(cache)) {
+        std::printf("cache      - |");
+    } else {
+        std::printf("cache %6.1f |", cache);
+    }
+    std::printf(" %s\n", bSame ? "same result" : "RESULTS DIFFER");
+    return bSame;
+}
+
+
+int main(int argc, char** argv) {
+    size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    size_t repeats = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+    size = std::max<size_t>(size, 2);
+
+    geo::REMesh mesh;
+    auto start = Clock::now();
+    buildGrid(size, mesh);
+    std::printf("mesh: %zu verts, %zu faces, built in %.0f ms\n",
+                mesh.verts.size(), mesh.faces.size(), getMs(start));
+
+    ThreadPool threads;
+    geo::MeshAdjacency adjacency;
+    start = Clock::now();
+    adjacency.build(mesh, threads);
+    std::printf("adjacency cache: built in %.0f ms on %zu worker slots\n",
+                getMs(start), threads.getSlotCount());
+
+    start = Clock::now();
+    auto validation = geo::validate(mesh, threads);
+    std::printf("validate: %.0f ms, %s\n", getMs(start), validation.toString().c_str());
+
+    size_t faces = mesh.faces.size();
+    size_t verts = mesh.verts.size();
+    glm::vec3 a, b, c;
+    bool bSame = true;
+
+    // Face loops, getBoundingLoops() is the allocating walk
+    double walk = measure(repeats, faces, a, [&]() {
+        glm::vec3 sum(0);
+        std::vector<geo::Loop*> loops;
+        for (auto f : mesh.faces) {
+            geo::getBoundingLoops(f, loops);
+            for (auto l : loops) {
+                sum += l->v->pos;
+            }
+        }
+        return sum;
+    });
+    double iter = measure(repeats, faces, b, [&]() {
+        glm::vec3 sum(0);
+        for (auto f : mesh.faces) {
+            for (auto l : geo::faceLoops(f)) {
+                sum += l->v->pos;
+            }
+        }
+        return sum;
+    });
+    bSame &= report("face loops", walk, iter, std::nan(""), a, b, b);
+
+    walk = measure(repeats, verts, a, [&]() {
+        glm::vec3 sum(0);
+        for (auto v : mesh.verts) {
+            glm::vec3 mean(0);
+            size_t n = 0;
+            if (auto e = v->edge) {
+                do {
+                    mean += geo::getOtherVert(e, v)->pos;
+                    n++;
+                    e = geo::getDisk(e, v)->next;
+                } while (e != v->edge);
+            }
+            sum += n > 0 ? mean / float(n) : v->pos;
+        }
+        return sum;
+    });
+    iter = measure(repeats, verts, b, [&]() {
+        glm::vec3 sum(0);
+        for (auto v : mesh.verts) {
+            glm::vec3 mean(0);
+            size_t n = 0;
+            for (auto u : geo::vertVerts(v)) {
+                mean += u->pos;
+                n++;
+            }
+            sum += n > 0 ? mean / float(n) : v->pos;
+        }
+        return sum;
+    });
+    double cache = measure(repeats, verts, c, [&]() {
+        glm::vec3 sum(0);
+        for (auto v : mesh.verts) {
+            glm::vec3 mean(0);
+            auto ring = adjacency.getVerts(v);
+            for (auto u : ring) {
+                mean += u->pos;
+            }
+            sum += ring.empty() ? v->pos : mean / float(ring.size());
+        }
+        return sum;
+    });
+    bSame &= report("one-ring verts", walk, iter, cache, a, b, c);
+
+    auto center = [](const geo::Face* f) {
+        return f->loop->v->pos + f->loop->next->next->v->pos;
+    };
+    walk = measure(repeats, verts, a, [&]() {
+        glm::vec3 sum(0);
+        for (auto v : mesh.verts) {
+            if (auto e = v->edge) {
+                do {
+                    if (auto l = e->loop) {
+                        do {
+                            if (l->v == v) {
+                                sum += center(l->f);
+                            }
+                            l = l->radial_next;
+                        } while (l != e->loop);
+                    }
+                    e = geo::getDisk(e, v)->next;
+                } while (e != v->edge);
+            }
+        }
+        return sum;
+    });
+    iter = measure(repeats, verts, b, [&]() {
+        glm::vec3 sum(0);
+        for (auto v : mesh.verts) {
+            for (auto f : geo::vertFaces(v)) {
+                sum += center(f);
+            }
+        }
+        return sum;
+    });
+    cache = measure(repeats, verts, c, [&]() {
+        glm::vec3 sum(0);
+        for (auto v : mesh.verts) {
+            for (auto f : adjacency.getFaces(v)) {
+                sum += center(f);
+            }
+        }
+        return sum;
+    });
+    bSame &= report("one-ring faces", walk, iter, cache, a, b, c);
+
+    return bSame && validation.isValid() ? 0 : 1;
+}
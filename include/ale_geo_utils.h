@@ -14,6 +14,10 @@
 #include <glm/gtx/intersect.hpp>
 
 #include <limits>
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <bit>
 
 //int
 #include <primitives.h>
@@ -33,26 +37,31 @@ namespace geo {
 */
 
 
-// FIXME: This function does not return corect output
-// Generates frustum planes for a ModelViewProjection matrix
+// Generates normalized frustum planes for a ViewProjection matrix with
+// a [0, 1] depth range. Plane normals point inside the frustum
 [[maybe_unused]]
 static std::vector<glm::vec4> getFrustumPlanes(const glm::mat4& mvp) {
-    glm::transpose(mvp);
+    // GLM matrices are column major, planes are built from rows
+    glm::mat4 rows = glm::transpose(mvp);
     std::vector<glm::vec4> frustum;
     frustum.resize(6);
 
     // Right
-    frustum[0] = glm::vec4(mvp[3] - mvp[0]);
+    frustum[0] = glm::vec4(rows[3] - rows[0]);
     // Left
-    frustum[1] = glm::vec4(mvp[3] + mvp[0]);
+    frustum[1] = glm::vec4(rows[3] + rows[0]);
     // Bottom
-    frustum[2] = glm::vec4(mvp[3] + mvp[1]);
+    frustum[2] = glm::vec4(rows[3] + rows[1]);
     // Top
-    frustum[3] = glm::vec4(mvp[3] - mvp[1]);
+    frustum[3] = glm::vec4(rows[3] - rows[1]);
     // Far
-    frustum[4] = glm::vec4(mvp[3] - mvp[2]);
+    frustum[4] = glm::vec4(rows[3] - rows[2]);
     // Near
-    frustum[5] = glm::vec4(mvp[3] + mvp[2]);
+    frustum[5] = glm::vec4(rows[2]);
+
+    for (auto& plane : frustum) {
+        plane /= glm::length(glm::vec3(plane));
+    }
 
     return frustum;
 }
@@ -69,28 +78,43 @@ static float getDistanceToPlane(const glm::vec3& point, const glm::vec4& plane)
 [[maybe_unused]]
 static bool isPointInFrustum(glm::vec3 point,
                              std::vector<glm::vec4>& frustum) {
-for (auto plane : frustum) {
-    if (getDistanceToPlane(point, plane) > 0.0f) {
-        return false;
+    for (auto plane : frustum) {
+        if (getDistanceToPlane(point, plane) < 0.0f) {
+            return false;
+        }
     }
+    return true;
 }
+
+// Checks if a sphere intersects frustum planes. Same test as cull.comp
+[[maybe_unused]]
+static bool isSphereInFrustum(glm::vec3 center, float radius,
+                              const std::vector<glm::vec4>& frustum) {
+    for (auto plane : frustum) {
+        if (getDistanceToPlane(center, plane) < -radius) {
+            return false;
+        }
+    }
     return true;
 }
 
 
 
 /*
-    Following functions manage REMesh primitives.
+    Following functions manage REMesh primitives. They prepare every
+    element they write, so snapshots of the mesh keep their data.
 */
 
 // Append a geo::Loop to the geo::Edge's radial loop cycle
 [[maybe_unused]]
-static void addLoopToEdge(geo::Edge* e, geo::Loop* l) {
+static void addLoopToEdge(REMesh& mesh, geo::Edge* e, geo::Loop* l) {
     assert(e);
     assert(l);
+    mesh.prepareWrite(l);
     // If an edge does not have a loop, add l as e->loop
     // and make l loop to itself
     if (!e->loop) {
+        mesh.prepareWrite(e);
         l->radial_next = l;
         l->radial_prev = l;
         e->loop = l;
@@ -100,6 +124,7 @@ static void addLoopToEdge(geo::Edge* e, geo::Loop* l) {
     auto* _l = e->loop;
     // e->loop loops to itself
     assert(_l);
+    mesh.prepareWrite(_l);
 
     if (_l->radial_next == _l) {
         // Make e->loop to loop back to l
@@ -111,12 +136,102 @@ static void addLoopToEdge(geo::Edge* e, geo::Loop* l) {
     }
     // There is a radial cycle and it is not just one loop
     // Insert l between e->loop and its radial_next
+    mesh.prepareWrite(_l->radial_next);
     l->radial_prev = _l;
     l->radial_next = _l->radial_next;
     _l->radial_next->radial_prev = l;
     _l->radial_next = l;
 }
 
+// Remove a geo::Loop from the geo::Edge's radial loop cycle
+[[maybe_unused]]
+static void removeLoopFromEdge(REMesh& mesh, geo::Edge* e, geo::Loop* l) {
+    assert(e);
+    assert(l);
+    mesh.prepareWrite(l);
+    if (l->radial_next == l) {
+        mesh.prepareWrite(e);
+        e->loop = nullptr;
+    } else {
+        mesh.prepareWrite(l->radial_prev);
+        mesh.prepareWrite(l->radial_next);
+        l->radial_prev->radial_next = l->radial_next;
+        l->radial_next->radial_prev = l->radial_prev;
+        if (e->loop == l) {
+            mesh.prepareWrite(e);
+            e->loop = l->radial_next;
+        }
+    }
+    l->radial_next = l;
+    l->radial_prev = l;
+}
+
+// Get the disk link of an edge around one of its vertices
+[[maybe_unused]]
+static geo::Disk* getDisk(const geo::Edge* e, const geo::Vert* v) {
+    assert(e->v1 == v || e->v2 == v);
+    return e->v1 == v ? e->d1 : e->d2;
+}
+
+// Get the vertex of an edge that is not v
+[[maybe_unused]]
+static geo::Vert* getOtherVert(const geo::Edge* e, const geo::Vert* v) {
+    return e->v1 == v ? e->v2 : e->v1;
+}
+
+// Append a geo::Edge to the disk cycle of its vertex v. v->edge is
+// the first edge of the cycle
+[[maybe_unused]]
+static void addEdgeToDisk(REMesh& mesh, geo::Edge* e, geo::Vert* v) {
+    assert(e);
+    assert(v);
+    auto* d = getDisk(e, v);
+    mesh.prepareWrite(d);
+
+    if (!v->edge) {
+        mesh.prepareWrite(v);
+        d->prev = e;
+        d->next = e;
+        v->edge = e;
+        return;
+    }
+
+    // Insert e between v->edge and its disk next
+    auto* first = v->edge;
+    auto* firstDisk = getDisk(first, v);
+    mesh.prepareWrite(firstDisk);
+    mesh.prepareWrite(getDisk(firstDisk->next, v));
+    d->prev = first;
+    d->next = firstDisk->next;
+    getDisk(firstDisk->next, v)->prev = e;
+    firstDisk->next = e;
+}
+
+// Remove a geo::Edge from the disk cycle of its vertex v
+[[maybe_unused]]
+static void removeEdgeFromDisk(REMesh& mesh, geo::Edge* e, geo::Vert* v) {
+    assert(e);
+    assert(v);
+    auto* d = getDisk(e, v);
+    mesh.prepareWrite(d);
+
+    if (d->next == e) {
+        mesh.prepareWrite(v);
+        v->edge = nullptr;
+    } else {
+        mesh.prepareWrite(getDisk(d->prev, v));
+        mesh.prepareWrite(getDisk(d->next, v));
+        getDisk(d->prev, v)->next = d->next;
+        getDisk(d->next, v)->prev = d->prev;
+        if (v->edge == e) {
+            mesh.prepareWrite(v);
+            v->edge = d->next;
+        }
+    }
+    d->prev = nullptr;
+    d->next = nullptr;
+}
+
 // Get bounding loops of geo::Face
 // TODO: Assumes the face has 3 triangles. Handling full Radial Edge
 // structures is WIP
@@ -149,27 +264,234 @@ static bool getBoundingLoops(const Face* face,
 }
 
 
-// https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
-// Checks intersection of a ray and a triangle
+/*
+    Rebuilds vertices and indices of a ViewMesh after the topology of its
+    REMesh changed. Corners keep the attributes of their view vertex,
+    positions and UVs come from the REMesh. Corners of one vertex share
+    a view vertex if they have the same source view vertex and UV.
+    Faces are fan triangulated into their primitives. LODs are dropped,
+    they refer to old vertices. Vertices without faces get NO_VIEW_ID.
+    getNormal replaces the normals with the normal of each corner, corners
+    with other normals get their own view vertices, see MeshNormals
+*/
 [[maybe_unused]]
-static bool rayIntersectsTriangle(const glm::vec3& rayOrigin,
-                                 const glm::vec3& rayDir,
-                                 const Face* face,
-                                 glm::vec2& out_intersection_point,
-                                 float& distance) {
+static void rebuildViewMesh(REMesh& mesh, ale::ViewMesh& out_mesh,
+                            const std::function<glm::vec3(const Loop*)>& getNormal = nullptr) {
+    const uint32_t NONE = UINT32_MAX;
+    std::vector<ale::Vertex> vertices;
+    std::vector<std::vector<uint32_t>> primIndices(out_mesh.primitives.size());
+    std::vector<uint32_t> corners;
+    // View ids of all elements change
+    mesh.prepareTopologyWrite();
+
+    size_t maxVertId = 0;
+    for (auto v : mesh.verts) {
+        maxVertId = std::max(maxVertId, v->id);
+        v->viewId = NO_VIEW_ID;
+    }
+
+    // View vertices of a REMesh vertex form a list, one per UV wedge
+    struct Wedge {
+        size_t viewId;
+        uint32_t next;
+    };
+    std::vector<uint32_t> firstWedge(maxVertId + 1, NONE);
+    std::vector<Wedge> wedges;
+
+    auto getIndex = [&](Loop* l) {
+        assert(l->viewId == NO_VIEW_ID || l->viewId < out_mesh.vertices.size());
+        glm::vec3 normal = getNormal ? getNormal(l) : glm::vec3(0);
+        uint32_t idx = firstWedge[l->v->id];
+        while (idx != NONE) {
+            if (wedges[idx].viewId == l->viewId &&
+                vertices[idx].texCoord == l->texCoord &&
+                (!getNormal || vertices[idx].normal == normal)) {
+                break;
+            }
+            idx = wedges[idx].next;
+        }
+
+        if (idx == NONE) {
+            idx = static_cast<uint32_t>(vertices.size());
+            // New corners without a source take the vertex color
+            ale::Vertex v{};
+            if (l->viewId == NO_VIEW_ID) {
+                v.color = l->v->color;
+            } else {
+                v = out_mesh.vertices[l->viewId];
+            }
+            v.pos = l->v->pos;
+            v.texCoord = l->texCoord;
+            if (getNormal) {
+                v.normal = normal;
+            }
+            vertices.push_back(v);
+            wedges.push_back({l->viewId, firstWedge[l->v->id]});
+            firstWedge[l->v->id] = idx;
+        }
+        l->v->viewId = idx;
+        // Corners point to the new vertices from now on
+        l->viewId = idx;
+        return idx;
+    };
+
+    for (auto f : mesh.faces) {
+        assert(f->primitiveId < primIndices.size());
+        auto& indices = primIndices[f->primitiveId];
+
+        corners.clear();
+        auto l = f->loop;
+        do {
+            corners.push_back(getIndex(l));
+            l = l->next;
+        } while (l != f->loop);
+
+        for (size_t i = 1; i + 1 < corners.size(); i++) {
+            indices.push_back(corners[0]);
+            indices.push_back(corners[i]);
+            indices.push_back(corners[i + 1]);
+        }
+    }
+
+    out_mesh.indices.clear();
+    for (size_t p = 0; p < out_mesh.primitives.size(); p++) {
+        auto& prim = out_mesh.primitives[p];
+        prim.offsetIdx = out_mesh.indices.size();
+        prim.size = primIndices[p].size();
+        prim.lods.clear();
+        out_mesh.indices.insert(out_mesh.indices.end(), primIndices[p].begin(), primIndices[p].end());
+    }
+    out_mesh.lodIndices.clear();
+    out_mesh.vertices = std::move(vertices);
+    // The whole mesh is uploaded again
+    mesh.dirtyVerts.clear();
+    mesh.dirtyViewIds.clear();
+
+    if (!out_mesh.vertices.empty()) {
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(std::numeric_limits<float>::lowest());
+        for (auto& v : out_mesh.vertices) {
+            min = glm::min(min, v.pos);
+            max = glm::max(max, v.pos);
+        }
+        out_mesh.minPos = {min.x, min.y, min.z};
+        out_mesh.maxPos = {max.x, max.y, max.z};
+    }
+}
+
+
+// Calls fn(size_t viewId) for the view vertex of the vertex and of its
+// face corners, corners on UV seams have their own. Ids may repeat
+template <class Fn>
+static void forEachViewId(const Vert* v, Fn&& fn) {
+    fn(v->viewId);
+    auto e = v->edge;
+    if (!e) {
+        return;
+    }
+    do {
+        if (auto l = e->loop) {
+            do {
+                if (l->v == v) {
+                    fn(l->viewId);
+                }
+                l = l->radial_next;
+            } while (l != e->loop);
+        }
+        e = getDisk(e, v)->next;
+    } while (e != v->edge);
+}
 
-    std::vector<Loop*> loops = {};
 
-    bool bHasLoops = getBoundingLoops(face, loops);
+// Unchanged view vertices between two dirty ones up to which the ranges
+// are merged, another upload costs more than a few extra vertices
+const size_t DIRTY_RANGE_GAP = 64;
 
-    // Works only with triangle faces
-    assert(bHasLoops && loops.size() == 3);
+/*
+    Copies positions of REMesh::dirtyVerts to every view vertex of their
+    face corners and clears the list. out_ranges are sorted (first, count)
+    ranges of view vertices to upload with REMesh::dirtyViewIds, empty if
+    nothing changed
+*/
+[[maybe_unused]]
+static void syncDirtyVerts(REMesh& mesh, ale::ViewMesh& out_mesh,
+                           std::vector<std::pair<size_t, size_t>>& out_ranges) {
+    out_ranges.clear();
+    std::vector<size_t> ids;
+    ids.reserve(mesh.dirtyVerts.size() + mesh.dirtyViewIds.size());
+    size_t minId = std::numeric_limits<size_t>::max();
+    size_t maxId = 0;
+    auto add = [&](size_t viewId) {
+        ids.push_back(viewId);
+        minId = std::min(minId, viewId);
+        maxId = std::max(maxId, viewId);
+    };
+    for (auto viewId : mesh.dirtyViewIds) {
+        if (viewId < out_mesh.vertices.size()) {
+            add(viewId);
+        }
+    }
+    mesh.dirtyViewIds.clear();
+    for (auto v : mesh.dirtyVerts) {
+        forEachViewId(v, [&](size_t viewId) {
+            if (viewId < out_mesh.vertices.size()) {
+                out_mesh.vertices[viewId].pos = v->pos;
+                add(viewId);
+            }
+        });
+    }
+    mesh.dirtyVerts.clear();
+    if (ids.empty()) {
+        return;
+    }
+
+    // Ids repeat for every dab and corner, a bitmap over their span sorts
+    // and dedups them in linear time
+    std::vector<uint64_t> bits((maxId - minId) / 64 + 1);
+    for (auto id : ids) {
+        bits[(id - minId) / 64] |= uint64_t(1) << ((id - minId) % 64);
+    }
+    size_t first = minId;
+    size_t last = minId;
+    for (size_t w = 0; w < bits.size(); w++) {
+        for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+            size_t id = minId + w * 64 + std::countr_zero(word);
+            if (id > last + DIRTY_RANGE_GAP) {
+                out_ranges.push_back({first, last - first + 1});
+                first = id;
+            }
+            last = id;
+        }
+    }
+    out_ranges.push_back({first, last - first + 1});
+}
 
-    glm::vec3 a = loops[0]->v->pos;
-    glm::vec3 b = loops[1]->v->pos;
-    glm::vec3 c = loops[2]->v->pos;
 
-    return glm::intersectRayTriangle(rayOrigin, rayDir, a, b, c, out_intersection_point,distance);
+// https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
+// Checks intersection of a ray and a face. N-gons are tested as a fan of
+// triangles like MeshBVH::raycast(), the nearest hit of the fan is kept.
+// Picking tests every face, so the loops are read in place
+[[maybe_unused]]
+static bool rayIntersectsFace(const glm::vec3& rayOrigin,
+                              const glm::vec3& rayDir,
+                              const Face* face,
+                              glm::vec2& out_intersection_point,
+                              float& distance) {
+    assert(face->loop && face->size >= 3);
+
+    bool bHit = false;
+    const glm::vec3& a = face->loop->v->pos;
+    for (auto l = face->loop->next; l->next != face->loop; l = l->next) {
+        glm::vec2 bary;
+        float dist;
+        if (glm::intersectRayTriangle(rayOrigin, rayDir, a, l->v->pos, l->next->v->pos, bary, dist) &&
+            (!bHit || dist < distance)) {
+            bHit = true;
+            out_intersection_point = bary;
+            distance = dist;
+        }
+    }
+    return bHit;
 }
 
 
@@ -0,0 +1,1007 @@
+/*
+    Undo history of mesh edits.
+
+    Steps store what an edit changed instead of copies of the model:
+    - VertexStep: positions of the vertices an edit moved, before and
+      after the edit. Vertices are referenced by pool id, so undo and redo
+      cost O(moved vertices)
+    - TopologyStep: the pages of the REMesh pools an edit changed and the
+      runs of the ViewMesh that differ, on the other side of the edit.
+      The pages are the ones the edit copied for the snapshot taken before
+      it, so recording costs O(pool pages) and undo writes back only
+      those. Restored pages keep the pool ids of all elements, so vertex
+      steps around it stay valid
+
+    Steps are undone and redone strictly in order, every step finds the
+    mesh in the state it was recorded in.
+
+    New steps are packed on a worker thread of the history, packing never
+    holds up parallelFor() jobs of the shared pool: integers are delta
+    coded, 32-bit words of floats are XORed with a reference word and both
+    are written as varints. The oldest steps are dropped when the history
+    grows over its memory budget.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <bit>
+#include <type_traits>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <primitives.h>
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <ale_thread_pool.h>
+#include <tracer.h>
+
+#ifndef ALE_HISTORY
+#define ALE_HISTORY
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+
+const size_t DEFAULT_HISTORY_BUDGET = size_t(256) << 20;
+
+namespace history {
+
+static uint64_t zigzag(uint64_t d) {
+    return (d << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(d) >> 63);
+}
+
+static uint64_t unzigzag(uint64_t z) {
+    return (z >> 1) ^ (0 - (z & 1));
+}
+
+
+// Writes values as varints. Reader mirrors every method, so one code()
+// function of a struct both packs and unpacks it
+struct Writer {
+    static constexpr bool bWriting = true;
+    std::vector<uint8_t> bytes;
+
+    void value(uint64_t x) {
+        while (x >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(x) | 0x80);
+            x >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(x));
+    }
+
+    template <class T>
+    void number(T& x) {
+        if constexpr (std::is_floating_point_v<T>) {
+            static_assert(sizeof(T) == 4);
+            uint32_t w;
+            std::memcpy(&w, &x, 4);
+            value(w);
+        } else {
+            value(zigzag(static_cast<uint64_t>(x)));
+        }
+    }
+
+    // Differences of consecutive values
+    template <class I>
+    void ints(std::vector<I>& v) {
+        size_t n = v.size();
+        number(n);
+        uint64_t prev = 0;
+        for (auto x : v) {
+            value(zigzag(static_cast<uint64_t>(x) - prev));
+            prev = static_cast<uint64_t>(x);
+        }
+    }
+
+    // Every word is XORed with the same word of ref[i] or of the previous
+    // element. Similar floats share the high bits, so the varints get short
+    template <class T>
+    void words(std::vector<T>& v, const std::vector<T>* ref = nullptr) {
+        static_assert(sizeof(T) % 4 == 0 && std::is_trivially_copyable_v<T>);
+        constexpr size_t W = sizeof(T) / 4;
+        size_t n = v.size();
+        number(n);
+        uint32_t prev[W] = {};
+        uint32_t cur[W];
+        for (size_t i = 0; i < n; i++) {
+            if (ref) {
+                std::memcpy(prev, &(*ref)[i], sizeof(T));
+            }
+            std::memcpy(cur, &v[i], sizeof(T));
+            for (size_t w = 0; w < W; w++) {
+                value(cur[w] ^ prev[w]);
+            }
+            if (!ref) {
+                std::memcpy(prev, cur, sizeof(T));
+            }
+        }
+    }
+};
+
+
+struct Reader {
+    static constexpr bool bWriting = false;
+    const uint8_t* p;
+
+    uint64_t value() {
+        uint64_t x = 0;
+        int shift = 0;
+        uint8_t b;
+        do {
+            b = *p++;
+            x |= static_cast<uint64_t>(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+        return x;
+    }
+
+    template <class T>
+    void number(T& x) {
+        if constexpr (std::is_floating_point_v<T>) {
+            uint32_t w = static_cast<uint32_t>(value());
+            std::memcpy(&x, &w, 4);
+        } else {
+            x = static_cast<T>(unzigzag(value()));
+        }
+    }
+
+    template <class I>
+    void ints(std::vector<I>& v) {
+        size_t n;
+        number(n);
+        v.resize(n);
+        uint64_t prev = 0;
+        for (auto& x : v) {
+            prev += unzigzag(value());
+            x = static_cast<I>(prev);
+        }
+    }
+
+    template <class T>
+    void words(std::vector<T>& v, const std::vector<T>* ref = nullptr) {
+        constexpr size_t W = sizeof(T) / 4;
+        size_t n;
+        number(n);
+        v.resize(n);
+        uint32_t prev[W] = {};
+        for (size_t i = 0; i < n; i++) {
+            if (ref) {
+                std::memcpy(prev, &(*ref)[i], sizeof(T));
+            }
+            for (size_t w = 0; w < W; w++) {
+                prev[w] ^= static_cast<uint32_t>(value());
+            }
+            std::memcpy(&v[i], prev, sizeof(T));
+        }
+    }
+};
+
+
+template <class Coder>
+static void codePrimitives(Coder& c, std::vector<Primitive>& prims) {
+    size_t n = prims.size();
+    c.number(n);
+    prims.resize(n);
+    for (auto& p : prims) {
+        c.number(p.materialID);
+        c.number(p.offsetIdx);
+        c.number(p.size);
+        size_t lodCount = p.lods.size();
+        c.number(lodCount);
+        p.lods.resize(lodCount);
+        for (auto& lod : p.lods) {
+            c.number(lod.offsetIdx);
+            c.number(lod.size);
+            c.number(lod.error);
+        }
+    }
+}
+
+
+template <class T>
+static size_t getVectorBytes(const std::vector<T>& v) {
+    return v.size() * sizeof(T);
+}
+
+
+const size_t VIEW_RUN_BLOCK = 64;
+
+// Runs of elements of from that differ from to, as begin, end pairs and
+// their values. Elements from has past the end of to are one run
+template <class T>
+static void findRuns(const std::vector<T>& from, const std::vector<T>& to,
+                     std::vector<size_t>& out_runs, std::vector<T>& out_values) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    auto addRun = [&](size_t b, size_t e) {
+        if (!out_runs.empty() && out_runs.back() == b) {
+            out_runs.back() = e;
+        } else {
+            out_runs.push_back(b);
+            out_runs.push_back(e);
+        }
+        out_values.insert(out_values.end(), from.begin() + b, from.begin() + e);
+    };
+    size_t shared = std::min(from.size(), to.size());
+    for (size_t b = 0; b < shared; b += VIEW_RUN_BLOCK) {
+        size_t e = std::min(b + VIEW_RUN_BLOCK, shared);
+        if (std::memcmp(&from[b], &to[b], (e - b) * sizeof(T)) != 0) {
+            addRun(b, e);
+        }
+    }
+    if (from.size() > shared) {
+        addRun(shared, from.size());
+    }
+}
+
+
+// Writes the runs into v and resizes it to count. The runs, values and
+// count then hold what v had, so the next call swaps them back
+template <class T>
+static void swapRuns(std::vector<T>& v, size_t& count, std::vector<size_t>& runs,
+                     std::vector<T>& values) {
+    std::vector<size_t> oldRuns;
+    std::vector<T> oldValues;
+    size_t n = v.size();
+    for (size_t i = 0; i < runs.size(); i += 2) {
+        size_t e = std::min(runs[i + 1], n);
+        if (runs[i] < e) {
+            oldRuns.push_back(runs[i]);
+            oldRuns.push_back(e);
+            oldValues.insert(oldValues.end(), v.begin() + runs[i], v.begin() + e);
+        }
+    }
+    if (n > count) {
+        oldRuns.push_back(count);
+        oldRuns.push_back(n);
+        oldValues.insert(oldValues.end(), v.begin() + count, v.end());
+    }
+
+    v.resize(count);
+    size_t next = 0;
+    for (size_t i = 0; i < runs.size(); i += 2) {
+        std::copy(values.begin() + next, values.begin() + next + (runs[i + 1] - runs[i]),
+                  v.begin() + runs[i]);
+        next += runs[i + 1] - runs[i];
+    }
+    runs = std::move(oldRuns);
+    values = std::move(oldValues);
+    count = n;
+}
+
+
+// A ViewMesh on the other side of an edit. Vertices and indices are kept
+// as the runs that differ from the view, the rest is small and kept whole
+struct ViewChanges {
+    size_t id = 0;
+    size_t vertexCount = 0;
+    std::vector<size_t> vertexRuns;
+    std::vector<Vertex> vertices;
+    size_t indexCount = 0;
+    std::vector<size_t> indexRuns;
+    std::vector<uint32_t> indices;
+    size_t lodIndexCount = 0;
+    std::vector<size_t> lodIndexRuns;
+    std::vector<uint32_t> lodIndices;
+    std::vector<float> minPos;
+    std::vector<float> maxPos;
+    std::vector<Primitive> primitives;
+
+    // Costs one pass over both views
+    ViewChanges(const ViewMesh& from, const ViewMesh& to)
+        : id(from.id), vertexCount(from.vertices.size()), indexCount(from.indices.size()),
+          lodIndexCount(from.lodIndices.size()), minPos(from.minPos), maxPos(from.maxPos),
+          primitives(from.primitives) {
+        findRuns(from.vertices, to.vertices, vertexRuns, vertices);
+        findRuns(from.indices, to.indices, indexRuns, indices);
+        findRuns(from.lodIndices, to.lodIndices, lodIndexRuns, lodIndices);
+    }
+
+    ViewChanges() = default;
+
+    void swap(ViewMesh& view) {
+        std::swap(id, view.id);
+        swapRuns(view.vertices, vertexCount, vertexRuns, vertices);
+        swapRuns(view.indices, indexCount, indexRuns, indices);
+        swapRuns(view.lodIndices, lodIndexCount, lodIndexRuns, lodIndices);
+        std::swap(minPos, view.minPos);
+        std::swap(maxPos, view.maxPos);
+        std::swap(primitives, view.primitives);
+    }
+
+    template <class Coder>
+    void code(Coder& c) {
+        c.number(id);
+        c.number(vertexCount);
+        c.ints(vertexRuns);
+        c.words(vertices);
+        c.number(indexCount);
+        c.ints(indexRuns);
+        c.ints(indices);
+        c.number(lodIndexCount);
+        c.ints(lodIndexRuns);
+        c.ints(lodIndices);
+        c.words(minPos);
+        c.words(maxPos);
+        codePrimitives(c, primitives);
+    }
+
+    size_t getBytes() const {
+        return getVectorBytes(vertexRuns) + getVectorBytes(vertices) +
+               getVectorBytes(indexRuns) + getVectorBytes(indices) +
+               getVectorBytes(lodIndexRuns) + getVectorBytes(lodIndices);
+    }
+};
+
+
+// Element pointers are coded as pool ids + 1, 0 is nullptr. Writing looks
+// them up in the snapshot the elements come from, reading in the mesh the
+// elements go to
+struct Links {
+    const geo::REMeshSnapshot* from = nullptr;
+    geo::REMesh* to = nullptr;
+};
+
+static const PoolSnapshot<geo::Vert>& getPool(const geo::REMeshSnapshot& s, const geo::Vert*) { return s.verts; }
+static const PoolSnapshot<geo::Edge>& getPool(const geo::REMeshSnapshot& s, const geo::Edge*) { return s.edges; }
+static const PoolSnapshot<geo::Disk>& getPool(const geo::REMeshSnapshot& s, const geo::Disk*) { return s.disks; }
+static const PoolSnapshot<geo::Loop>& getPool(const geo::REMeshSnapshot& s, const geo::Loop*) { return s.loops; }
+static const PoolSnapshot<geo::Face>& getPool(const geo::REMeshSnapshot& s, const geo::Face*) { return s.faces; }
+static Pool<geo::Vert>& getPool(geo::REMesh& m, const geo::Vert*) { return m.vertsPool; }
+static Pool<geo::Edge>& getPool(geo::REMesh& m, const geo::Edge*) { return m.edgesPool; }
+static Pool<geo::Disk>& getPool(geo::REMesh& m, const geo::Disk*) { return m.disksPool; }
+static Pool<geo::Loop>& getPool(geo::REMesh& m, const geo::Loop*) { return m.loopsPool; }
+static Pool<geo::Face>& getPool(geo::REMesh& m, const geo::Face*) { return m.facesPool; }
+
+
+// One member of all elements as a column, similar values pack better
+template <class Coder, class T, class M>
+static void codeColumn(Coder& c, std::vector<T>& elems, M T::* member) {
+    std::vector<M> column;
+    if constexpr (Coder::bWriting) {
+        column.reserve(elems.size());
+        for (auto& e : elems) {
+            column.push_back(e.*member);
+        }
+    }
+    if constexpr (std::is_integral_v<M>) {
+        c.ints(column);
+    } else {
+        c.words(column);
+    }
+    if constexpr (!Coder::bWriting) {
+        for (size_t i = 0; i < elems.size(); i++) {
+            elems[i].*member = column[i];
+        }
+    }
+}
+
+
+template <class Coder, class T, class L>
+static void codeLinks(Coder& c, std::vector<T>& elems, L* T::* member, const Links& links) {
+    std::vector<size_t> ids;
+    if constexpr (Coder::bWriting) {
+        auto& pool = getPool(*links.from, static_cast<const L*>(nullptr));
+        ids.reserve(elems.size());
+        for (auto& e : elems) {
+            ids.push_back(e.*member ? pool.getId(e.*member) + 1 : 0);
+        }
+    }
+    c.ints(ids);
+    if constexpr (!Coder::bWriting) {
+        auto& pool = getPool(*links.to, static_cast<const L*>(nullptr));
+        for (size_t i = 0; i < elems.size(); i++) {
+            elems[i].*member = ids[i] ? pool.get(ids[i] - 1) : nullptr;
+        }
+    }
+}
+
+
+// Every member but the id, which follows from the position in the pool
+template <class Coder>
+static void codeElements(Coder& c, std::vector<geo::Vert>& verts, const Links& links) {
+    codeColumn(c, verts, &geo::Vert::pos);
+    codeColumn(c, verts, &geo::Vert::color);
+    codeColumn(c, verts, &geo::Vert::texCoord);
+    codeColumn(c, verts, &geo::Vert::viewId);
+    codeLinks(c, verts, &geo::Vert::edge, links);
+}
+
+template <class Coder>
+static void codeElements(Coder& c, std::vector<geo::Edge>& edges, const Links& links) {
+    codeLinks(c, edges, &geo::Edge::v1, links);
+    codeLinks(c, edges, &geo::Edge::v2, links);
+    codeLinks(c, edges, &geo::Edge::loop, links);
+    codeLinks(c, edges, &geo::Edge::d1, links);
+    codeLinks(c, edges, &geo::Edge::d2, links);
+}
+
+template <class Coder>
+static void codeElements(Coder& c, std::vector<geo::Disk>& disks, const Links& links) {
+    codeLinks(c, disks, &geo::Disk::prev, links);
+    codeLinks(c, disks, &geo::Disk::next, links);
+}
+
+template <class Coder>
+static void codeElements(Coder& c, std::vector<geo::Loop>& loops, const Links& links) {
+    codeLinks(c, loops, &geo::Loop::v, links);
+    codeLinks(c, loops, &geo::Loop::e, links);
+    codeLinks(c, loops, &geo::Loop::f, links);
+    codeLinks(c, loops, &geo::Loop::radial_prev, links);
+    codeLinks(c, loops, &geo::Loop::radial_next, links);
+    codeLinks(c, loops, &geo::Loop::prev, links);
+    codeLinks(c, loops, &geo::Loop::next, links);
+    codeColumn(c, loops, &geo::Loop::texCoord);
+    codeColumn(c, loops, &geo::Loop::viewId);
+}
+
+// Face::nor is not used and stays null
+template <class Coder>
+static void codeElements(Coder& c, std::vector<geo::Face>& faces, const Links& links) {
+    codeLinks(c, faces, &geo::Face::loop, links);
+    codeColumn(c, faces, &geo::Face::size);
+    codeColumn(c, faces, &geo::Face::primitiveId);
+}
+
+
+// Pages of one pool an edit changed, and the first id the pool never
+// handed out on the side of the edit the step stores
+struct PoolChanges {
+    std::vector<size_t> pages;
+    size_t untouched = 0;
+
+    template <class Coder>
+    void code(Coder& c) {
+        c.number(untouched);
+        c.ints(pages);
+    }
+};
+
+
+// The pages as they are in the snapshot, pages it does not have are empty
+template <class T>
+static void writePages(Writer& w, const PoolSnapshot<T>& from,
+                       const std::vector<size_t>& pages, const Links& links) {
+    const size_t LIVE_WORDS = POOL_PAGE_SIZE / 64;
+    std::vector<uint64_t> live;
+    std::vector<T> elems;
+    live.reserve(pages.size() * LIVE_WORDS);
+    auto scratch = std::make_unique<PoolPageData<T>>();
+    for (auto page : pages) {
+        if (page >= from.getPageCount()) {
+            live.resize(live.size() + LIVE_WORDS, 0);
+            continue;
+        }
+        auto& data = from.readPage(page, *scratch);
+        live.insert(live.end(), data.live.begin(), data.live.end());
+        for (size_t i = 0; i < POOL_PAGE_SIZE; i++) {
+            if (data.isLive(i)) {
+                elems.push_back(data.chunks[i]);
+            }
+        }
+    }
+    w.words(live);
+    codeElements(w, elems, links);
+}
+
+
+// Overwrites the pages of the pool with the ones writePages() wrote and
+// restores its free list. All pools of the mesh must have their pages,
+// links point into them. Pages stay in place, so only elements that died
+// or came back are removed from or added to elems
+template <class T>
+static void readPages(Reader& r, Pool<T>& to, const PoolChanges& changes,
+                      const Links& links, std::vector<T*>& out_elems) {
+    const size_t LIVE_WORDS = POOL_PAGE_SIZE / 64;
+    std::vector<uint64_t> live;
+    r.words(live);
+    size_t count = 0;
+    for (auto word : live) {
+        count += std::popcount(word);
+    }
+    std::vector<T> elems(count);
+    codeElements(r, elems, links);
+    if (changes.pages.empty()) {
+        return;
+    }
+
+    std::vector<T*> removed;
+    std::vector<T*> added;
+    size_t next = 0;
+    for (size_t p = 0; p < changes.pages.size(); p++) {
+        auto& data = to.preparePage(changes.pages[p]);
+        for (size_t i = 0; i < POOL_PAGE_SIZE; i++) {
+            bool bWasLive = data.isLive(i);
+            bool bLive = live[p * LIVE_WORDS + i / 64] & (uint64_t(1) << (i % 64));
+            if (bWasLive && !bLive) {
+                removed.push_back(&data.chunks[i]);
+            } else if (bLive && !bWasLive) {
+                added.push_back(&data.chunks[i]);
+            }
+            data.chunks[i] = bLive ? elems[next++] : T{};
+            data.chunks[i].id = changes.pages[p] * POOL_PAGE_SIZE + i;
+        }
+        std::copy_n(live.begin() + p * LIVE_WORDS, LIVE_WORDS, data.live.begin());
+    }
+    to.restoreFreeList(changes.untouched);
+
+    // Edits append the elements they add, so removed ones are looked for
+    // from the back
+    std::sort(removed.begin(), removed.end(), std::less<>());
+    auto isRemoved = [&](const T* e) {
+        return std::binary_search(removed.begin(), removed.end(), e, std::less<>());
+    };
+    auto first = out_elems.end();
+    for (size_t found = 0; found < removed.size() && first != out_elems.begin();) {
+        --first;
+        found += isRemoved(*first);
+    }
+    out_elems.erase(std::remove_if(first, out_elems.end(), isRemoved), out_elems.end());
+    out_elems.insert(out_elems.end(), added.begin(), added.end());
+}
+
+} // namespace history
+
+
+class HistoryStep {
+public:
+    HistoryStep(int meshIdx, std::string name) : meshIdx(meshIdx), name(std::move(name)) {}
+    virtual ~HistoryStep() = default;
+
+    const int meshIdx;
+    const std::string name;
+
+    // Reverts the edit if bUndo is set and applies it again otherwise
+    virtual void apply(Model& model, bool bUndo) = 0;
+    virtual bool changesTopology() const = 0;
+    // Replaces the raw data with packed bytes. Runs on a worker thread
+    virtual void pack() = 0;
+
+    size_t getBytes() const {
+        return _bytes.load();
+    }
+
+    // Waits for pack() started by the history
+    void wait() {
+        if (_packing.valid()) {
+            _packing.get();
+        }
+    }
+
+    bool isPacking() const {
+        return _packing.valid() &&
+               _packing.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    }
+
+protected:
+    std::atomic<size_t> _bytes = 0;
+
+private:
+    friend class History;
+    std::future<void> _packing;
+};
+
+
+class VertexStep : public HistoryStep {
+public:
+    using HistoryStep::HistoryStep;
+
+    // Sorted by id, after holds the positions at the end of the edit
+    std::vector<size_t> ids;
+    std::vector<glm::vec3> before;
+    std::vector<glm::vec3> after;
+
+    void apply(Model& model, bool bUndo) override {
+        if (_bPacked) {
+            history::Reader r{_packed.data()};
+            r.ints(ids);
+            r.words(before);
+            r.words(after, &before);
+        }
+
+        auto& mesh = model.reMeshes[meshIdx];
+        auto& positions = bUndo ? before : after;
+        mesh.dirtyVerts.reserve(mesh.dirtyVerts.size() + ids.size());
+        for (size_t i = 0; i < ids.size(); i++) {
+            geo::Vert* v = mesh.vertsPool.get(ids[i]);
+            mesh.prepareWrite(v);
+            v->pos = positions[i];
+            mesh.dirtyVerts.push_back(v);
+        }
+
+        if (_bPacked) {
+            _dropRaw();
+        }
+    }
+
+    bool changesTopology() const override {
+        return false;
+    }
+
+    void pack() override {
+        if (_bPacked) {
+            return;
+        }
+        history::Writer w;
+        w.ints(ids);
+        w.words(before);
+        w.words(after, &before);
+        _packed = std::move(w.bytes);
+        _packed.shrink_to_fit();
+        _dropRaw();
+        _bPacked = true;
+        _bytes = _packed.size();
+    }
+
+    void updateBytes() {
+        _bytes = history::getVectorBytes(ids) + history::getVectorBytes(before) +
+                 history::getVectorBytes(after);
+    }
+
+private:
+    std::vector<uint8_t> _packed;
+    bool _bPacked = false;
+
+    void _dropRaw() {
+        ids = {};
+        before = {};
+        after = {};
+    }
+};
+
+
+// Pages of the REMesh pools a topology edit changed and the view, as
+// they are on the other side of the edit. Pages keep the pool ids of all
+// elements, links are stored as ids, so steps stay valid when a mesh gets
+// new pools, e.g. by subdivision
+class TopologyStep : public HistoryStep {
+public:
+    // before is the snapshot taken right before the edit, mesh the edited
+    // mesh without killed elements, beforeView and view the view before
+    // and after the edit
+    TopologyStep(int meshIdx, std::string name, geo::REMeshSnapshot&& before,
+                 const geo::REMesh& mesh, const ViewMesh& beforeView, const ViewMesh& view)
+        : HistoryStep(meshIdx, std::move(name)), _snapshot(std::move(before)),
+          _view(beforeView, view) {
+        _findChanges(mesh);
+    }
+
+    // Undo and redo both swap the changed pages and view runs with the
+    // stored ones
+    void apply(Model& model, bool) override {
+        // Packed pages refer to elements by pool id only
+        pack();
+        auto& mesh = model.reMeshes[meshIdx];
+        auto& view = model.viewMeshes[meshIdx];
+        geo::compactMesh(mesh);
+        // pack() reads the pages the mesh has now from here
+        _snapshot = mesh.snapshot();
+
+        history::Reader r{_packed.data()};
+        _codeChanges(r);
+        auto reserve = [](auto& pool, const history::PoolChanges& changes) {
+            if (!changes.pages.empty()) {
+                pool.reservePages(changes.pages.back() + 1);
+            }
+        };
+        reserve(mesh.vertsPool, _verts);
+        reserve(mesh.edgesPool, _edges);
+        reserve(mesh.disksPool, _disks);
+        reserve(mesh.loopsPool, _loops);
+        reserve(mesh.facesPool, _faces);
+
+        history::Links links{nullptr, &mesh};
+        history::readPages(r, mesh.vertsPool, _verts, links, mesh.verts);
+        history::readPages(r, mesh.edgesPool, _edges, links, mesh.edges);
+        history::readPages(r, mesh.disksPool, _disks, links, mesh.disks);
+        history::readPages(r, mesh.loopsPool, _loops, links, mesh.loops);
+        history::readPages(r, mesh.facesPool, _faces, links, mesh.faces);
+        mesh.dirtyVerts.clear();
+        mesh.dirtyViewIds.clear();
+
+        _view = {};
+        _view.code(r);
+        _view.swap(view);
+
+        _packed = {};
+        _bPacked = false;
+        _updateBytes();
+    }
+
+    bool changesTopology() const override {
+        return true;
+    }
+
+    void pack() override {
+        if (_bPacked) {
+            return;
+        }
+        _verts.untouched = _snapshot.verts.getUntouched();
+        _edges.untouched = _snapshot.edges.getUntouched();
+        _disks.untouched = _snapshot.disks.getUntouched();
+        _loops.untouched = _snapshot.loops.getUntouched();
+        _faces.untouched = _snapshot.faces.getUntouched();
+
+        history::Writer w;
+        _codeChanges(w);
+        history::Links links{&_snapshot, nullptr};
+        history::writePages(w, _snapshot.verts, _verts.pages, links);
+        history::writePages(w, _snapshot.edges, _edges.pages, links);
+        history::writePages(w, _snapshot.disks, _disks.pages, links);
+        history::writePages(w, _snapshot.loops, _loops.pages, links);
+        history::writePages(w, _snapshot.faces, _faces.pages, links);
+        _view.code(w);
+
+        _packed = std::move(w.bytes);
+        _packed.shrink_to_fit();
+        // Drops the page copies the snapshot kept
+        _snapshot = geo::REMeshSnapshot{};
+        _view = {};
+        _bPacked = true;
+        _bytes = _packed.size();
+    }
+
+private:
+    // Pages are read from the snapshot until the step is packed
+    geo::REMeshSnapshot _snapshot;
+    history::ViewChanges _view;
+    history::PoolChanges _verts, _edges, _disks, _loops, _faces;
+    std::vector<uint8_t> _packed;
+    bool _bPacked = false;
+
+    template <class Coder>
+    void _codeChanges(Coder& c) {
+        _verts.code(c);
+        _edges.code(c);
+        _disks.code(c);
+        _loops.code(c);
+        _faces.code(c);
+    }
+
+    void _findChanges(const geo::REMesh& mesh) {
+        mesh.vertsPool.getChangedPages(_snapshot.verts, _verts.pages);
+        mesh.edgesPool.getChangedPages(_snapshot.edges, _edges.pages);
+        mesh.disksPool.getChangedPages(_snapshot.disks, _disks.pages);
+        mesh.loopsPool.getChangedPages(_snapshot.loops, _loops.pages);
+        mesh.facesPool.getChangedPages(_snapshot.faces, _faces.pages);
+        _updateBytes();
+    }
+
+    // Page copies the snapshot holds for the step
+    void _updateBytes() {
+        _bytes = _verts.pages.size() * sizeof(PoolPageData<geo::Vert>) +
+                 _edges.pages.size() * sizeof(PoolPageData<geo::Edge>) +
+                 _disks.pages.size() * sizeof(PoolPageData<geo::Disk>) +
+                 _loops.pages.size() * sizeof(PoolPageData<geo::Loop>) +
+                 _faces.pages.size() * sizeof(PoolPageData<geo::Face>) +
+                 _view.getBytes();
+    }
+};
+
+
+class History {
+public:
+    explicit History(size_t budget = DEFAULT_HISTORY_BUDGET) : _budget(budget) {}
+
+    ~History() {
+        clear();
+    }
+
+    History(const History&) = delete;
+    History& operator=(const History&) = delete;
+
+
+    // Remembers positions of verts before they are moved. Vertices added
+    // by later calls of the same edit are remembered too
+    void beginVertexEdit(int meshIdx, const std::vector<geo::Vert*>& verts) {
+        if (!_pending || _pending->meshIdx != meshIdx) {
+            _pending = std::make_shared<VertexStep>(meshIdx, "Move vertices");
+        }
+        _pending->ids.reserve(_pending->ids.size() + verts.size());
+        _pending->before.reserve(_pending->before.size() + verts.size());
+        for (auto v : verts) {
+            _pending->ids.push_back(v->id);
+            _pending->before.push_back(v->pos);
+        }
+    }
+
+    bool isEditingVertices() const {
+        return _pending != nullptr;
+    }
+
+    // Records the current positions of the vertices passed to
+    // beginVertexEdit(). Vertices that did not move are dropped
+    void endVertexEdit(Model& model) {
+        if (!_pending) {
+            return;
+        }
+        auto step = std::move(_pending);
+        auto& mesh = model.reMeshes[step->meshIdx];
+
+        std::vector<size_t> order(step->ids.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return step->ids[a] < step->ids[b];
+        });
+
+        std::vector<size_t> ids;
+        std::vector<glm::vec3> before, after;
+        ids.reserve(order.size());
+        before.reserve(order.size());
+        after.reserve(order.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            size_t id = step->ids[order[i]];
+            // The first call that saw a vertex has its original position
+            if (!ids.empty() && ids.back() == id) {
+                continue;
+            }
+            auto& pos = mesh.vertsPool.get(id)->pos;
+            if (pos == step->before[order[i]]) {
+                continue;
+            }
+            ids.push_back(id);
+            before.push_back(step->before[order[i]]);
+            after.push_back(pos);
+        }
+
+        if (ids.empty()) {
+            return;
+        }
+        step->ids = std::move(ids);
+        step->before = std::move(before);
+        step->after = std::move(after);
+        step->updateBytes();
+        _push(step);
+    }
+
+    // Records a topology edit of mesh. before is the snapshot of the mesh
+    // taken right before the edit, after compactMesh(), beforeView the
+    // view at that time and view the view after the edit. Costs O(pool
+    // pages) and one pass over the views on the calling thread
+    void pushTopologyStep(int meshIdx, std::string name, geo::REMeshSnapshot&& before,
+                          geo::REMesh& mesh, const ViewMesh& beforeView, const ViewMesh& view) {
+        geo::compactMesh(mesh);
+        _push(std::make_shared<TopologyStep>(meshIdx, std::move(name), std::move(before),
+                                             mesh, beforeView, view));
+    }
+
+    bool canUndo() const {
+        return _current > 0;
+    }
+
+    bool canRedo() const {
+        return _current < _steps.size();
+    }
+
+    // Sets out_meshIdx to the changed mesh and out_bTopology if the mesh
+    // and its view were replaced and have to be uploaded again
+    bool undo(Model& model, int& out_meshIdx, bool& out_bTopology) {
+        endVertexEdit(model);
+        if (!canUndo()) {
+            return false;
+        }
+        auto& step = _steps[--_current];
+        _apply(step, model, true);
+        out_meshIdx = step->meshIdx;
+        out_bTopology = step->changesTopology();
+        trc::log("Undo: " + step->name, trc::DEBUG);
+        return true;
+    }
+
+    bool redo(Model& model, int& out_meshIdx, bool& out_bTopology) {
+        endVertexEdit(model);
+        if (!canRedo()) {
+            return false;
+        }
+        auto& step = _steps[_current++];
+        _apply(step, model, false);
+        out_meshIdx = step->meshIdx;
+        out_bTopology = step->changesTopology();
+        trc::log("Redo: " + step->name, trc::DEBUG);
+        return true;
+    }
+
+    void clear() {
+        // Running pack jobs hold their steps until they finish
+        _steps.clear();
+        _current = 0;
+        _pending = nullptr;
+    }
+
+    size_t getBytes() const {
+        size_t bytes = 0;
+        for (auto& step : _steps) {
+            bytes += step->getBytes();
+        }
+        return bytes;
+    }
+
+    size_t getStepCount() const {
+        return _steps.size();
+    }
+
+    void setBudget(size_t budget) {
+        _budget = budget;
+        _trim();
+    }
+
+private:
+    size_t _budget;
+    // Steps before _current are undone by undo(), the rest are redone
+    std::deque<std::shared_ptr<HistoryStep>> _steps;
+    size_t _current = 0;
+    std::shared_ptr<VertexStep> _pending;
+    // Packs one step at a time in the order the steps were pushed
+    ThreadPool _packer{1};
+
+
+    void _push(std::shared_ptr<HistoryStep> step) {
+        // A new edit drops the steps that could be redone
+        _steps.erase(_steps.begin() + _current, _steps.end());
+        _steps.push_back(step);
+        _current = _steps.size();
+        _pack(step);
+        _trim();
+    }
+
+    void _apply(std::shared_ptr<HistoryStep>& step, Model& model, bool bUndo) {
+        step->wait();
+        step->apply(model, bUndo);
+        _pack(step);
+        _trim();
+    }
+
+    void _pack(const std::shared_ptr<HistoryStep>& step) {
+        // The task is owned by the future of the step, a strong pointer
+        // would keep the step alive forever
+        std::weak_ptr<HistoryStep> weak = step;
+        auto task = std::make_shared<std::packaged_task<void()>>([weak]() {
+            if (auto locked = weak.lock()) {
+                locked->pack();
+            }
+        });
+        step->_packing = task->get_future();
+        _packer.submit([task]() { (*task)(); });
+    }
+
+    // Drops the oldest steps over the budget. The newest step always stays.
+    // Steps still being packed are counted by a later call, their raw size
+    // would evict steps the packed size leaves room for. A step may finish
+    // packing during the call, so every size is read once
+    void _trim() {
+        std::vector<size_t> sizes;
+        sizes.reserve(_steps.size());
+        size_t bytes = 0;
+        for (auto& step : _steps) {
+            sizes.push_back(step->isPacking() ? 0 : step->getBytes());
+            bytes += sizes.back();
+        }
+        size_t dropped = 0;
+        while (bytes > _budget && _current > 1) {
+            bytes -= sizes[dropped++];
+            _steps.pop_front();
+            _current--;
+        }
+    }
+};
+
+} // namespace ale
+
+#endif // ALE_HISTORY
@@ -0,0 +1,521 @@
+/*
+    Level of detail generation for ViewMesh primitives.
+
+    Levels are made by quadric error edge collapse on the index buffer.
+    Vertices are never moved or created, so every level shares the vertex
+    range of the mesh and only adds indices:
+    - a vertex collapses onto a neighbour, the error is the distance of
+      the neighbour to the planes of the triangles merged into the vertex
+    - differences in UVs and normals are added to the error, vertices on
+      UV or normal seams and on open borders are locked
+    - collapses that flip a triangle are rejected
+
+    Errors are in mesh space units, see ale::PrimitiveLod.
+
+    Reference:
+    https://www.cs.cmu.edu/~garland/Papers/quadrics.pdf
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <primitives.h>
+#include <ale_mesh_optimizer.h>
+#include <tracer.h>
+
+#ifndef ALE_MESH_LOD
+#define ALE_MESH_LOD
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace geo {
+
+// Index count ratios of the generated levels
+const float MESH_LOD_RATIOS[] = {0.5f, 0.25f, 0.125f};
+const size_t MAX_MESH_LODS = sizeof(MESH_LOD_RATIOS) / sizeof(MESH_LOD_RATIOS[0]);
+
+// A level is dropped if it does not remove this share of the previous one
+const float MESH_LOD_MIN_REDUCTION = 0.1f;
+
+// Scale of UV and normal differences relative to the mesh size
+const float MESH_LOD_ATTRIBUTE_WEIGHT = 0.05f;
+
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes.
+// w is the total weight, so evaluate() / w is the mean squared distance
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double w = 0;
+
+    // Plane n.p + d = 0, n must be normalized
+    static Quadric fromPlane(glm::dvec3 n, double d, double weight) {
+        Quadric q;
+        q.a00 = n.x * n.x * weight; q.a01 = n.x * n.y * weight; q.a02 = n.x * n.z * weight; q.a03 = n.x * d * weight;
+        q.a11 = n.y * n.y * weight; q.a12 = n.y * n.z * weight; q.a13 = n.y * d * weight;
+        q.a22 = n.z * n.z * weight; q.a23 = n.z * d * weight;
+        q.a33 = d * d * weight;
+        q.w = weight;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& o) {
+        a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+        a11 += o.a11; a12 += o.a12; a13 += o.a13;
+        a22 += o.a22; a23 += o.a23;
+        a33 += o.a33;
+        w += o.w;
+        return *this;
+    }
+
+    // Weighted sum of squared distances from p to the planes
+    double evaluate(glm::dvec3 p) const {
+        double e = a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x +
+                   a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y +
+                   a22 * p.z * p.z + 2 * a23 * p.z +
+                   a33;
+        return std::max(e, 0.0);
+    }
+};
+
+
+/*
+    Simplifies a triangle list until it has at most targetIndexCount
+    indices or no collapse is left. Returns the largest error of the
+    applied collapses in mesh units
+*/
+[[maybe_unused]]
+static float simplifyIndices(const std::vector<Vertex>& vertices,
+                             const uint32_t* indices, size_t indexCount,
+                             size_t targetIndexCount,
+                             std::vector<uint32_t>& out_indices) {
+    out_indices.assign(indices, indices + indexCount - indexCount % 3);
+    if (out_indices.size() <= targetIndexCount) {
+        return 0;
+    }
+
+    const uint32_t NONE = UINT32_MAX;
+    size_t vertexCount = vertices.size();
+
+    auto sameAttributes = [](const Vertex& a, const Vertex& b) {
+        return a.texCoord == b.texCoord && a.normal == b.normal && a.color == b.color;
+    };
+
+    // Merge exact duplicates. Positions shared by vertices with different
+    // attributes are seams. position[] is the first vertex at a position
+    std::vector<uint32_t> canonical(vertexCount, NONE);
+    std::vector<uint32_t> position(vertexCount, NONE);
+    std::vector<uint32_t> nextWedge(vertexCount, NONE);
+    std::vector<bool> lockedPosition(vertexCount, false);
+    std::unordered_map<glm::vec3, uint32_t> positions;
+
+    for (uint32_t idx : out_indices) {
+        if (canonical[idx] != NONE) {
+            continue;
+        }
+
+        auto [it, bInserted] = positions.try_emplace(vertices[idx].pos, idx);
+        uint32_t first = it->second;
+        position[idx] = first;
+        canonical[idx] = idx;
+
+        if (bInserted) {
+            continue;
+        }
+
+        for (uint32_t v = first; v != NONE; v = nextWedge[v]) {
+            if (sameAttributes(vertices[v], vertices[idx])) {
+                canonical[idx] = v;
+                break;
+            }
+        }
+        if (canonical[idx] == idx) {
+            nextWedge[idx] = nextWedge[first];
+            nextWedge[first] = idx;
+            lockedPosition[first] = true;
+        }
+    }
+
+    for (auto& idx : out_indices) {
+        idx = canonical[idx];
+    }
+
+    // Open borders: edges between positions used by one triangle
+    {
+        std::unordered_map<uint64_t, int> edgeUses;
+        auto edgeKey = [&](uint32_t a, uint32_t b) {
+            uint64_t pa = position[a], pb = position[b];
+            return pa < pb ? (pa << 32) | pb : (pb << 32) | pa;
+        };
+        for (size_t i = 0; i < out_indices.size(); i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                edgeUses[edgeKey(out_indices[i + k], out_indices[i + (k + 1) % 3])]++;
+            }
+        }
+        for (size_t i = 0; i < out_indices.size(); i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t a = out_indices[i + k];
+                uint32_t b = out_indices[i + (k + 1) % 3];
+                if (edgeUses[edgeKey(a, b)] == 1) {
+                    lockedPosition[position[a]] = true;
+                    lockedPosition[position[b]] = true;
+                }
+            }
+        }
+    }
+
+    std::vector<bool> locked(vertexCount, false);
+    for (uint32_t idx : out_indices) {
+        locked[idx] = lockedPosition[position[idx]];
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (uint32_t idx : out_indices) {
+        min = glm::min(min, vertices[idx].pos);
+        max = glm::max(max, vertices[idx].pos);
+    }
+    float extent = glm::length(max - min);
+    double attributeScale = MESH_LOD_ATTRIBUTE_WEIGHT * extent;
+    attributeScale *= attributeScale;
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < out_indices.size(); i += 3) {
+        glm::dvec3 p0 = vertices[out_indices[i + 0]].pos;
+        glm::dvec3 p1 = vertices[out_indices[i + 1]].pos;
+        glm::dvec3 p2 = vertices[out_indices[i + 2]].pos;
+
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(n);
+        if (area <= 0) {
+            continue;
+        }
+        n /= area;
+
+        Quadric q = Quadric::fromPlane(n, -glm::dot(n, p0), area);
+        for (size_t k = 0; k < 3; k++) {
+            quadrics[out_indices[i + k]] += q;
+        }
+    }
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    auto getCost = [&](uint32_t from, uint32_t to) {
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        double cost = q.w > 0 ? q.evaluate(vertices[to].pos) / q.w : 0;
+
+        glm::vec2 dUv = vertices[from].texCoord - vertices[to].texCoord;
+        glm::vec3 dN = vertices[from].normal - vertices[to].normal;
+        cost += (glm::dot(dUv, dUv) + 0.25f * glm::dot(dN, dN)) * attributeScale;
+        return cost;
+    };
+
+    // Triangles stay consistent if their normal keeps its direction
+    auto isFlipped = [&](uint32_t a, uint32_t b, uint32_t c, glm::vec3 newA) {
+        glm::vec3 pb = vertices[b].pos;
+        glm::vec3 pc = vertices[c].pos;
+        glm::vec3 before = glm::cross(pb - vertices[a].pos, pc - vertices[a].pos);
+        glm::vec3 after = glm::cross(pb - newA, pc - newA);
+        return glm::dot(before, after) <= 0;
+    };
+
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> triOffsets(vertexCount + 1);
+    std::vector<uint32_t> vertTris;
+    double maxCost = 0;
+
+    while (out_indices.size() > targetIndexCount) {
+        size_t triCount = out_indices.size() / 3;
+
+        // Vertex to triangle adjacency of this pass
+        std::fill(triOffsets.begin(), triOffsets.end(), 0);
+        for (uint32_t idx : out_indices) {
+            triOffsets[idx + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            triOffsets[v + 1] += triOffsets[v];
+        }
+        vertTris.resize(out_indices.size());
+        std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+        for (size_t t = 0; t < triCount; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                vertTris[fill[out_indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+
+        collapses.clear();
+        for (size_t i = 0; i < out_indices.size(); i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t a = out_indices[i + k];
+                uint32_t b = out_indices[i + (k + 1) % 3];
+                if (a == b) {
+                    continue;
+                }
+                if (!locked[a]) {
+                    collapses.push_back({a, b, getCost(a, b)});
+                }
+                if (!locked[b]) {
+                    collapses.push_back({b, a, getCost(b, a)});
+                }
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+            return x.cost < y.cost;
+        });
+
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        // Every collapse removes about two triangles
+        size_t trianglesToRemove = triCount - targetIndexCount / 3;
+        size_t removed = 0;
+
+        for (const Collapse& c : collapses) {
+            if (removed >= trianglesToRemove) {
+                break;
+            }
+            if (touched[c.from] || touched[c.to]) {
+                continue;
+            }
+
+            bool bFlips = false;
+            size_t merged = 0;
+            for (uint32_t i = triOffsets[c.from]; i < triOffsets[c.from + 1] && !bFlips; i++) {
+                const uint32_t* tri = &out_indices[vertTris[i] * 3];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+                    merged++;
+                    continue;
+                }
+                for (size_t k = 0; k < 3; k++) {
+                    if (tri[k] == c.from) {
+                        bFlips = isFlipped(tri[k], tri[(k + 1) % 3], tri[(k + 2) % 3], vertices[c.to].pos);
+                    }
+                }
+            }
+            if (bFlips) {
+                continue;
+            }
+
+            remap[c.from] = c.to;
+            quadrics[c.to] += quadrics[c.from];
+            maxCost = std::max(maxCost, c.cost);
+            removed += merged;
+
+            // Triangles around the collapse changed, their vertices wait
+            // for the next pass
+            for (uint32_t i = triOffsets[c.from]; i < triOffsets[c.from + 1]; i++) {
+                const uint32_t* tri = &out_indices[vertTris[i] * 3];
+                touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+        }
+
+        if (removed == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < out_indices.size(); i += 3) {
+            uint32_t a = remap[out_indices[i + 0]];
+            uint32_t b = remap[out_indices[i + 1]];
+            uint32_t c = remap[out_indices[i + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            out_indices[write++] = a;
+            out_indices[write++] = b;
+            out_indices[write++] = c;
+        }
+        out_indices.resize(write);
+    }
+
+    return static_cast<float>(std::sqrt(maxCost));
+}
+
+
+// Up to MAX_MESH_LODS levels of count indices, appended to out_lods and
+// out_lodIndices. Returns the triangle counts and errors for the log
+[[maybe_unused]]
+static std::string buildLods(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t count,
+                             std::vector<PrimitiveLod>& out_lods, std::vector<uint32_t>& out_lodIndices) {
+    std::vector<uint32_t> lodIndices;
+    size_t previousSize = count;
+    std::string report;
+
+    for (float ratio : MESH_LOD_RATIOS) {
+        size_t target = static_cast<size_t>(count * ratio) / 3 * 3;
+        float error = simplifyIndices(vertices, indices, count, target, lodIndices);
+
+        if (lodIndices.size() > previousSize * (1.0f - MESH_LOD_MIN_REDUCTION)) {
+            break;
+        }
+
+        if (!lodIndices.empty()) {
+            auto [minIt, maxIt] = std::minmax_element(lodIndices.begin(), lodIndices.end());
+            optimizeVertexCache(lodIndices.data(), lodIndices.size(), *minIt, *maxIt - *minIt + 1);
+        }
+
+        out_lods.push_back({
+            .offsetIdx = out_lodIndices.size(),
+            .size = lodIndices.size(),
+            .error = error,
+        });
+        out_lodIndices.insert(out_lodIndices.end(), lodIndices.begin(), lodIndices.end());
+        previousSize = lodIndices.size();
+
+        char level[96];
+        snprintf(level, sizeof(level), " | %zu tris, error %.4g", lodIndices.size() / 3, error);
+        report += level;
+    }
+    return report;
+}
+
+
+/*
+    Builds up to MAX_MESH_LODS levels for every primitive of the mesh and
+    stores them in ViewMesh::lodIndices. Logs triangle counts and errors
+*/
+[[maybe_unused]]
+static void generateMeshLods(ViewMesh& mesh) {
+    mesh.lodIndices.clear();
+    for (size_t p = 0; p < mesh.primitives.size(); p++) {
+        Primitive& prim = mesh.primitives[p];
+        prim.lods.clear();
+        std::string report = buildLods(mesh.vertices, mesh.indices.data() + prim.offsetIdx, prim.size,
+                                       prim.lods, mesh.lodIndices);
+        trc::log("Mesh " + std::to_string(mesh.id) + " primitive " + std::to_string(p) +
+                 " LODs: " + std::to_string(prim.size / 3) + " tris" + report);
+    }
+}
+
+
+// Drops the levels of the marked primitives, the levels of the others
+// are kept and move to the front of ViewMesh::lodIndices
+[[maybe_unused]]
+static void dropMeshLods(ViewMesh& mesh, const std::vector<uint8_t>& primitives) {
+    std::vector<uint32_t> kept;
+    for (size_t p = 0; p < mesh.primitives.size(); p++) {
+        auto& prim = mesh.primitives[p];
+        if (p < primitives.size() && primitives[p]) {
+            prim.lods.clear();
+            continue;
+        }
+        for (auto& lod : prim.lods) {
+            size_t offset = kept.size();
+            kept.insert(kept.end(), mesh.lodIndices.begin() + lod.offsetIdx,
+                        mesh.lodIndices.begin() + lod.offsetIdx + lod.size);
+            lod.offsetIdx = offset;
+        }
+    }
+    mesh.lodIndices = std::move(kept);
+}
+
+
+/*
+    Levels of some primitives of a view, built apart from the view so the
+    build can run on a worker thread:
+    - beginMeshLodUpdate() copies what the build reads
+    - buildMeshLodUpdate() makes the levels
+    - applyMeshLodUpdate() appends them to the view, if the indices of the
+      primitives are still the ones the levels were made of
+*/
+struct MeshLodUpdate {
+    size_t meshId = 0;
+    std::vector<Vertex> vertices;
+    std::vector<size_t> primitives;
+    std::vector<std::vector<uint32_t>> indices;
+    std::vector<std::vector<PrimitiveLod>> lods;
+    std::vector<uint32_t> lodIndices;
+};
+
+[[maybe_unused]]
+static MeshLodUpdate beginMeshLodUpdate(const ViewMesh& mesh, const std::vector<size_t>& primitives) {
+    MeshLodUpdate update;
+    update.meshId = mesh.id;
+    update.vertices = mesh.vertices;
+    update.primitives = primitives;
+    for (auto p : primitives) {
+        auto& prim = mesh.primitives[p];
+        update.indices.emplace_back(mesh.indices.begin() + prim.offsetIdx,
+                                    mesh.indices.begin() + prim.offsetIdx + prim.size);
+    }
+    return update;
+}
+
+[[maybe_unused]]
+static void buildMeshLodUpdate(MeshLodUpdate& update) {
+    update.lods.resize(update.primitives.size());
+    for (size_t i = 0; i < update.primitives.size(); i++) {
+        std::string report = buildLods(update.vertices, update.indices[i].data(), update.indices[i].size(),
+                                       update.lods[i], update.lodIndices);
+        trc::log("Mesh " + std::to_string(update.meshId) + " primitive " + std::to_string(update.primitives[i]) +
+                 " LODs: " + std::to_string(update.indices[i].size() / 3) + " tris" + report);
+    }
+    update.vertices = {};
+}
+
+// Returns false and changes nothing if the view changed since the update
+// began. Levels are appended, so history steps of the view stay valid
+[[maybe_unused]]
+static bool applyMeshLodUpdate(ViewMesh& mesh, const MeshLodUpdate& update) {
+    if (mesh.id != update.meshId) {
+        return false;
+    }
+    for (size_t i = 0; i < update.primitives.size(); i++) {
+        size_t p = update.primitives[i];
+        if (p >= mesh.primitives.size() || !mesh.primitives[p].lods.empty()) {
+            return false;
+        }
+        auto& prim = mesh.primitives[p];
+        auto& indices = update.indices[i];
+        if (prim.size != indices.size() ||
+            !std::equal(indices.begin(), indices.end(), mesh.indices.begin() + prim.offsetIdx)) {
+            return false;
+        }
+    }
+
+    size_t offset = mesh.lodIndices.size();
+    mesh.lodIndices.insert(mesh.lodIndices.end(), update.lodIndices.begin(), update.lodIndices.end());
+    for (size_t i = 0; i < update.primitives.size(); i++) {
+        auto& prim = mesh.primitives[update.primitives[i]];
+        prim.lods = update.lods[i];
+        for (auto& lod : prim.lods) {
+            lod.offsetIdx += offset;
+        }
+    }
+    return true;
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_MESH_LOD
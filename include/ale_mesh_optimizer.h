@@ -0,0 +1,311 @@
+/*
+    Import time optimization of ViewMesh index and vertex order.
+
+    - optimizeVertexCache() reorders the triangles of a primitive for the
+      post-transform vertex cache (Forsyth's linear speed algorithm)
+    - optimizeVertexFetch() reorders vertices by first use, so vertex
+      fetches walk memory mostly forward
+    - getACMR() measures the average cache miss ratio: transformed
+      vertices per triangle with a FIFO cache. 0.5 is the practical
+      minimum for regular meshes, 3 means no reuse at all
+
+    Reference:
+    https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+
+//int
+#include <primitives.h>
+#include <re_mesh.h>
+#include <tracer.h>
+
+#ifndef ALE_MESH_OPTIMIZER
+#define ALE_MESH_OPTIMIZER
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace geo {
+
+// FIFO size used to report ACMR. Close to what desktop GPUs behave like
+const uint32_t ACMR_CACHE_SIZE = 16;
+
+// Vertices per triangle that miss a FIFO cache of cacheSize entries
+[[maybe_unused]]
+static float getACMR(const uint32_t* indices, size_t indexCount,
+                     uint32_t cacheSize = ACMR_CACHE_SIZE) {
+    if (indexCount < 3) {
+        return 0;
+    }
+
+    std::deque<uint32_t> cache;
+    size_t misses = 0;
+
+    for (size_t i = 0; i < indexCount; i++) {
+        if (std::find(cache.begin(), cache.end(), indices[i]) != cache.end()) {
+            continue;
+        }
+
+        misses++;
+        cache.push_back(indices[i]);
+        if (cache.size() > cacheSize) {
+            cache.pop_front();
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+}
+
+
+// Scoring of the Forsyth algorithm, constants are the ones of the paper
+namespace forsyth {
+
+const int CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRI_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+static float getVertexScore(int cachePos, uint32_t remainingTris) {
+    if (remainingTris == 0) {
+        // Not used by any triangle left
+        return -1.0f;
+    }
+
+    float score = 0;
+    if (cachePos >= 0) {
+        if (cachePos < 3) {
+            // Vertices of the last triangle get a fixed score, so the next
+            // triangle does not simply reuse its edge and form strips
+            score = LAST_TRI_SCORE;
+        } else {
+            float scaler = 1.0f / (CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePos - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+
+    // Prefer vertices with few triangles left, they are finished sooner
+    score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingTris), -VALENCE_BOOST_POWER);
+    return score;
+}
+
+} // namespace forsyth
+
+
+/*
+    Reorders triangles in place. Indices must be in
+    [vertexBegin, vertexBegin + vertexCount)
+*/
+[[maybe_unused]]
+static void optimizeVertexCache(uint32_t* indices, size_t indexCount,
+                                uint32_t vertexBegin, uint32_t vertexCount) {
+    size_t triCount = indexCount / 3;
+    if (triCount < 2 || vertexCount == 0) {
+        return;
+    }
+
+    // Vertex to triangle adjacency in CSR form
+    std::vector<uint32_t> triOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triCount * 3; i++) {
+        triOffsets[indices[i] - vertexBegin + 1]++;
+    }
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        triOffsets[v + 1] += triOffsets[v];
+    }
+
+    std::vector<uint32_t> vertTris(triCount * 3);
+    std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+    for (size_t t = 0; t < triCount; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k] - vertexBegin;
+            vertTris[fill[v]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    // Triangles not emitted yet, per vertex
+    std::vector<uint32_t> remaining(vertexCount);
+    std::vector<int> cachePos(vertexCount, -1);
+    std::vector<float> vertScore(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++) {
+        remaining[v] = triOffsets[v + 1] - triOffsets[v];
+        vertScore[v] = forsyth::getVertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triScore(triCount);
+    std::vector<bool> emitted(triCount, false);
+    for (size_t t = 0; t < triCount; t++) {
+        triScore[t] = 0;
+        for (size_t k = 0; k < 3; k++) {
+            triScore[t] += vertScore[indices[t * 3 + k] - vertexBegin];
+        }
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(triCount * 3);
+
+    // Holds CACHE_SIZE vertices plus the 3 that may be pushed out by
+    // a new triangle
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve(forsyth::CACHE_SIZE + 3);
+    newCache.reserve(forsyth::CACHE_SIZE + 3);
+
+    auto bestInitial = std::max_element(triScore.begin(), triScore.end());
+    int64_t bestTri = bestInitial - triScore.begin();
+    // Scan start for triangles outside the cache
+    size_t nextUnemitted = 0;
+
+    while (bestTri >= 0) {
+        emitted[bestTri] = true;
+        uint32_t tri[3];
+        for (size_t k = 0; k < 3; k++) {
+            tri[k] = indices[bestTri * 3 + k] - vertexBegin;
+            result.push_back(indices[bestTri * 3 + k]);
+
+            // Drop the triangle from the vertex adjacency
+            uint32_t* begin = vertTris.data() + triOffsets[tri[k]];
+            uint32_t* end = begin + remaining[tri[k]];
+            *std::find(begin, end, static_cast<uint32_t>(bestTri)) = *(end - 1);
+            remaining[tri[k]]--;
+        }
+
+        // Triangle vertices go to the front of the cache
+        newCache.assign(tri, tri + 3);
+        for (uint32_t v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                newCache.push_back(v);
+            }
+        }
+        std::swap(cache, newCache);
+
+        for (size_t i = 0; i < cache.size(); i++) {
+            uint32_t v = cache[i];
+            cachePos[v] = i < forsyth::CACHE_SIZE ? static_cast<int>(i) : -1;
+            vertScore[v] = forsyth::getVertexScore(cachePos[v], remaining[v]);
+        }
+
+        // Rescore triangles around the cache and pick the best one
+        bestTri = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            for (uint32_t i = 0; i < remaining[v]; i++) {
+                uint32_t t = vertTris[triOffsets[v] + i];
+                triScore[t] = vertScore[indices[t * 3 + 0] - vertexBegin] +
+                              vertScore[indices[t * 3 + 1] - vertexBegin] +
+                              vertScore[indices[t * 3 + 2] - vertexBegin];
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    bestTri = t;
+                }
+            }
+        }
+
+        if (cache.size() > forsyth::CACHE_SIZE) {
+            cache.resize(forsyth::CACHE_SIZE);
+        }
+
+        // Nothing adjacent to the cache, continue with any triangle
+        if (bestTri < 0) {
+            while (nextUnemitted < triCount && emitted[nextUnemitted]) {
+                nextUnemitted++;
+            }
+            if (nextUnemitted < triCount) {
+                bestTri = nextUnemitted;
+            }
+        }
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+
+/*
+    Reorders vertices by first use in the index buffer and rewrites the
+    indices. Unused vertices keep their relative order at the end.
+    out_remap maps old vertex ids to new ones
+*/
+[[maybe_unused]]
+static void optimizeVertexFetch(ViewMesh& mesh, std::vector<uint32_t>& out_remap) {
+    const uint32_t UNUSED = UINT32_MAX;
+    out_remap.assign(mesh.vertices.size(), UNUSED);
+
+    uint32_t next = 0;
+    for (auto& idx : mesh.indices) {
+        if (out_remap[idx] == UNUSED) {
+            out_remap[idx] = next++;
+        }
+        idx = out_remap[idx];
+    }
+
+    for (auto& r : out_remap) {
+        if (r == UNUSED) {
+            r = next++;
+        }
+    }
+
+    std::vector<Vertex> vertices(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        vertices[out_remap[i]] = mesh.vertices[i];
+    }
+    mesh.vertices = std::move(vertices);
+}
+
+
+// Points REMesh vertices and face corners to the view vertices after
+// optimizeVertexFetch()
+[[maybe_unused]]
+static void remapViewIds(REMesh& mesh, const std::vector<uint32_t>& remap) {
+    mesh.prepareTopologyWrite();
+    for (auto v : mesh.verts) {
+        v->viewId = remap[v->viewId];
+    }
+    for (auto l : mesh.loops) {
+        l->viewId = remap[l->viewId];
+    }
+}
+
+
+/*
+    Runs the cache and fetch passes over every primitive of a mesh and
+    logs ACMR before and after. Primitives keep their index ranges
+*/
+[[maybe_unused]]
+static void optimizeMesh(ViewMesh& mesh, std::vector<uint32_t>& out_remap) {
+    if (mesh.indices.empty()) {
+        out_remap.clear();
+        return;
+    }
+
+    float acmrBefore = getACMR(mesh.indices.data(), mesh.indices.size());
+
+    for (const auto& prim : mesh.primitives) {
+        uint32_t* indices = mesh.indices.data() + prim.offsetIdx;
+        auto [minIt, maxIt] = std::minmax_element(indices, indices + prim.size);
+        if (minIt == indices + prim.size) {
+            continue;
+        }
+        optimizeVertexCache(indices, prim.size, *minIt, *maxIt - *minIt + 1);
+    }
+
+    optimizeVertexFetch(mesh, out_remap);
+
+    float acmrAfter = getACMR(mesh.indices.data(), mesh.indices.size());
+
+    char acmr[64];
+    snprintf(acmr, sizeof(acmr), "%.3f -> %.3f", acmrBefore, acmrAfter);
+    trc::log("Mesh " + std::to_string(mesh.id) + " ACMR: " + acmr);
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_MESH_OPTIMIZER
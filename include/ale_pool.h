@@ -1,12 +1,28 @@
 #include <memory.h>
 #include <tracer.h>
 #include <vector>
-#include <forward_list>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <bit>
 
 
 /*
     This is the master of all vectors, The Pool Handler!
-    Creates a non-growing (for now) pool.
+    Creates a pool of init() size. A full pool grows by adding pages,
+    pages never move, so pointers to chunks stay valid.
+
+    Pages are reference counted. snapshot() shares all pages with a
+    PoolSnapshot, the first write to a shared page copies it for the
+    snapshots, the pool keeps writing to its own page. Writers call
+    prepareWrite() before they change a chunk, readers of a snapshot may
+    run on other threads. getChangedPages() lists the pages written since
+    a snapshot, undo writes them back with preparePage().
 */
 
 #ifndef ALE_POOL
@@ -16,7 +32,151 @@ namespace trc = ale::Tracer;
 
 namespace ale {
 
-// TODO: Store _freeList as a bitmap. Store it inside empty cells of _vector
+// TODO: Store _freeList as a bitmap. Store it inside empty cells of the pages
+
+const size_t POOL_PAGE_SIZE = 1024;
+
+
+template <class T>
+struct PoolPageData {
+    std::array<T, POOL_PAGE_SIZE> chunks;
+    // Bit per chunk, set while the chunk is handed out
+    std::array<uint64_t, POOL_PAGE_SIZE / 64> live;
+
+    bool isLive(size_t i) const {
+        return live[i / 64] & (uint64_t(1) << (i % 64));
+    }
+};
+
+
+template <class T>
+struct PoolPage {
+    PoolPageData<T> data;
+    // Epoch of the pool when the page was last copied for its snapshots
+    uint64_t epoch = 0;
+    // Snapshot readers of the page and the copy of the page on the first
+    // write are mutually exclusive
+    std::mutex mutex;
+};
+
+
+template <class T>
+class Pool;
+
+
+// Pages of a pool at the time of a snapshot, shared with the pool
+template <class T>
+struct PoolSnapshotState {
+    std::vector<std::shared_ptr<PoolPage<T>>> pages;
+    // Chunks from this id on were never requested
+    size_t untouched = 0;
+    // Copies made by the pool before it wrote to a page, null while the
+    // page is still shared
+    std::unique_ptr<std::atomic<const PoolPageData<T>*>[]> frozen;
+    std::vector<std::shared_ptr<const PoolPageData<T>>> frozenOwners;
+    // Page indices sorted by the address of their first chunk
+    std::vector<std::pair<const T*, size_t>> bases;
+};
+
+
+// Immutable view of a pool. Elements are read by the pointers the live
+// elements store, they are returned by value
+template <class T>
+class PoolSnapshot {
+public:
+    PoolSnapshot() = default;
+    explicit PoolSnapshot(std::shared_ptr<PoolSnapshotState<T>> state) : _state(std::move(state)) {}
+
+    bool isEmpty() const {
+        return !_state || _state->pages.empty();
+    }
+
+    size_t getPageCount() const {
+        return _state ? _state->pages.size() : 0;
+    }
+
+    size_t getUntouched() const {
+        return _state ? _state->untouched : 0;
+    }
+
+    // Element a pointer of a live or a snapshot element points to
+    T get(const T* ptr) const {
+        size_t page, offset;
+        _locate(ptr, page, offset);
+        if (auto data = _state->frozen[page].load(std::memory_order_acquire)) {
+            return data->chunks[offset];
+        }
+        auto& live = *_state->pages[page];
+        std::lock_guard<std::mutex> lock(live.mutex);
+        if (auto data = _state->frozen[page].load(std::memory_order_acquire)) {
+            return data->chunks[offset];
+        }
+        return live.data.chunks[offset];
+    }
+
+    // Pool id of the element, without reading it
+    size_t getId(const T* ptr) const {
+        size_t page, offset;
+        _locate(ptr, page, offset);
+        return page * POOL_PAGE_SIZE + offset;
+    }
+
+    // Page as it was at the time of the snapshot. A page still shared
+    // with the pool is copied to scratch
+    const PoolPageData<T>& readPage(size_t page, PoolPageData<T>& scratch) const {
+        if (auto data = _state->frozen[page].load(std::memory_order_acquire)) {
+            return *data;
+        }
+        auto& live = *_state->pages[page];
+        std::lock_guard<std::mutex> lock(live.mutex);
+        if (auto data = _state->frozen[page].load(std::memory_order_acquire)) {
+            return *data;
+        }
+        scratch = live.data;
+        return scratch;
+    }
+
+    // Calls fn(const T&) for every element handed out at the time of the
+    // snapshot, in id order. Shared pages are copied out one at a time
+    template <class Fn>
+    void forEach(Fn&& fn) const {
+        if (isEmpty()) {
+            return;
+        }
+        auto scratch = std::make_unique<PoolPageData<T>>();
+        for (size_t page = 0; page < _state->pages.size(); page++) {
+            auto& data = readPage(page, *scratch);
+            for (size_t i = 0; i < POOL_PAGE_SIZE; i++) {
+                if (data.isLive(i)) {
+                    fn(data.chunks[i]);
+                }
+            }
+        }
+    }
+
+private:
+    template <class U>
+    friend class Pool;
+    std::shared_ptr<PoolSnapshotState<T>> _state;
+
+    void _locate(const T* ptr, size_t& out_page, size_t& out_offset) const {
+        auto& bases = _state->bases;
+        auto it = std::upper_bound(bases.begin(), bases.end(), ptr,
+                                   [](const T* p, const std::pair<const T*, size_t>& b) {
+                                       return std::less<const T*>()(p, b.first);
+                                   });
+        if (it == bases.begin()) {
+            throw std::runtime_error("failed to find a pool page of a snapshot element!");
+        }
+        --it;
+        out_offset = (reinterpret_cast<uintptr_t>(ptr) -
+                      reinterpret_cast<uintptr_t>(it->first)) / sizeof(T);
+        if (out_offset >= POOL_PAGE_SIZE) {
+            throw std::runtime_error("failed to find a pool page of a snapshot element!");
+        }
+        out_page = it->second;
+    }
+};
 
 
 // T is a size of a chunk
@@ -32,52 +192,258 @@ public:
 
     ~Pool() {};
 
+    // Elements are referenced by pointers, so a pool may be moved
+    // (the storage stays in place) but never copied
+    Pool(Pool&&) = default;
+    Pool& operator=(Pool&&) = default;
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
 
     void init(size_t size) {
         if (inited) {
             std::string currentType = (typeid(T).name());
-            std::string currentSize = std::to_string(_vector.size());
+            std::string currentSize = std::to_string(getCapacity());
             trc::log("POOL OF TYPE: " + currentType
                    + " ALREADY INITED TO SIZE: " + currentSize, trc::ERROR);
             return;
         }
 
-        _vector.resize(size);
-        // Create nodes for free chunks (all are free!)
-        for(size_t i = 0; i < _vector.size(); i++) {
-            _freeList.push_front(i);
-        }
-
+        _addPages(size);
         inited = true;
     }
 
 
     T* request(size_t& id) {
-        // No free chunks left
-        if (_freeList.empty()) {
-            trc::raw << "Over capacity!\n";
-            trc::raw << "Pool size: " << _vector.size() << " type: " << typeid(T).name()<< "\n";
-            return nullptr;
-        }
+        // Reuse the last released chunk
+        if (!_freeList.empty()) {
+            id = _freeList.back();
+            _freeList.pop_back();
+        } else {
+            // No free chunks left, add a page
+            if (_untouched == getCapacity()) {
+                _addPages(POOL_PAGE_SIZE);
+                inited = true;
+            }
 
-        // Delete free chunk node, get free chunk id
-        size_t _id = _freeList.front();
+            // Chunks never handed out are taken in order, so elements
+            // requested in a row are adjacent in memory
+            id = _untouched++;
+        }
 
-        id = _id;
-        _freeList.pop_front();
-        return &_vector[_id];
+        prepareWrite(id);
+        auto& data = _pages[id / POOL_PAGE_SIZE]->data;
+        size_t i = id % POOL_PAGE_SIZE;
+        data.live[i / 64] |= uint64_t(1) << (i % 64);
+        return &data.chunks[i];
     };
 
+    // Makes sure count more requests do not add pages one at a time.
+    // Bulk operations call it before allocating
+    void reserve(size_t count) {
+        size_t available = _freeList.size() + (getCapacity() - _untouched);
+        if (available < count) {
+            _addPages(count - available);
+            inited = true;
+        }
+    }
+
+    // Hands out count chunks that were never requested as the ids
+    // [first, first + count) and returns first. Pages are added and
+    // prepared here, so the chunks can be written from several threads
+    size_t requestRange(size_t count) {
+        size_t first = _untouched;
+        size_t end = first + count;
+        reservePages((end + POOL_PAGE_SIZE - 1) / POOL_PAGE_SIZE);
+        for (size_t page = first / POOL_PAGE_SIZE; page * POOL_PAGE_SIZE < end; page++) {
+            prepareWrite(page * POOL_PAGE_SIZE);
+        }
+
+        // Live bits are set a word at a time
+        for (size_t id = first; id < end;) {
+            size_t bit = id % 64;
+            size_t bits = std::min<size_t>(64 - bit, end - id);
+            uint64_t mask = bits == 64 ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1) << bit;
+            _pages[id / POOL_PAGE_SIZE]->data.live[id % POOL_PAGE_SIZE / 64] |= mask;
+            id += bits;
+        }
+        _untouched = end;
+        return first;
+    }
+
     void release(size_t id) {
-        _freeList.push_front(id);
+        prepareWrite(id);
+        auto& data = _pages[id / POOL_PAGE_SIZE]->data;
+        size_t i = id % POOL_PAGE_SIZE;
+        data.live[i / 64] &= ~(uint64_t(1) << (i % 64));
+        _freeList.push_back(id);
     };
 
+    // Chunk of an id handed out by request()
+    T* get(size_t id) {
+        return &_pages[id / POOL_PAGE_SIZE]->data.chunks[id % POOL_PAGE_SIZE];
+    }
+
+    const T* get(size_t id) const {
+        return &_pages[id / POOL_PAGE_SIZE]->data.chunks[id % POOL_PAGE_SIZE];
+    }
+
+    // True between request() and release() of the id
+    bool isLive(size_t id) const {
+        return id < getCapacity() &&
+               _pages[id / POOL_PAGE_SIZE]->data.isLive(id % POOL_PAGE_SIZE);
+    }
+
+    size_t getCapacity() const {
+        return _pages.size() * POOL_PAGE_SIZE;
+    }
+
+
+    // Copies the page of the chunk for the snapshots that share it. Call
+    // before changing the chunk, from the thread that owns the pool
+    void prepareWrite(size_t id) {
+        auto& page = *_pages[id / POOL_PAGE_SIZE];
+        if (page.epoch != _epoch) {
+            _freezePage(id / POOL_PAGE_SIZE);
+        }
+    }
+
+    // prepareWrite() for every chunk, for edits that touch most of a pool
+    void prepareWriteAll() {
+        if (_frozenEpoch == _epoch) {
+            return;
+        }
+        for (size_t page = 0; page < _pages.size(); page++) {
+            if (_pages[page]->epoch != _epoch) {
+                _freezePage(page);
+            }
+        }
+        _frozenEpoch = _epoch;
+    }
+
+    // Shares all pages, O(pages)
+    PoolSnapshot<T> snapshot() {
+        auto state = std::make_shared<PoolSnapshotState<T>>();
+        state->pages = _pages;
+        state->untouched = _untouched;
+        state->frozen = std::make_unique<std::atomic<const PoolPageData<T>*>[]>(_pages.size());
+        state->bases.reserve(_pages.size());
+        for (size_t page = 0; page < _pages.size(); page++) {
+            state->frozen[page].store(nullptr, std::memory_order_relaxed);
+            state->bases.emplace_back(_pages[page]->data.chunks.data(), page);
+        }
+        std::sort(state->bases.begin(), state->bases.end(), [](const auto& a, const auto& b) {
+            return std::less<const T*>()(a.first, b.first);
+        });
+
+        // Pages shared from now on are copied on their next write
+        _epoch++;
+        _snapshots.push_back(state);
+        return PoolSnapshot<T>(state);
+    }
+
+    // Pages that differ from the snapshot: pages written or added since,
+    // and all pages of both if the snapshot is of the pool this one
+    // replaced. O(pages)
+    void getChangedPages(const PoolSnapshot<T>& since, std::vector<size_t>& out_pages) const {
+        out_pages.clear();
+        size_t count = since.getPageCount();
+        for (size_t page = 0; page < std::max(count, _pages.size()); page++) {
+            if (page >= count || page >= _pages.size() ||
+                since._state->pages[page] != _pages[page] ||
+                since._state->frozen[page].load(std::memory_order_relaxed)) {
+                out_pages.push_back(page);
+            }
+        }
+    }
+
+    // Adds empty pages until the pool has pageCount pages
+    void reservePages(size_t pageCount) {
+        if (pageCount > _pages.size()) {
+            _addPages((pageCount - _pages.size()) * POOL_PAGE_SIZE);
+            inited = true;
+        }
+    }
+
+    // Page data to overwrite as a whole, the page is prepared for writing.
+    // Call restoreFreeList() once all pages are written
+    PoolPageData<T>& preparePage(size_t page) {
+        reservePages(page + 1);
+        prepareWrite(page * POOL_PAGE_SIZE);
+        return _pages[page]->data;
+    }
+
+    // Rebuilds the free list from the live bits. Chunks from untouched on
+    // count as never requested
+    void restoreFreeList(size_t untouched) {
+        _untouched = std::min(untouched, getCapacity());
+        _freeList.clear();
+        // Lower ids are handed out first. Walks the live bits a word at a
+        // time, full words are skipped
+        constexpr size_t WORDS = POOL_PAGE_SIZE / 64;
+        for (size_t end = _untouched; end > 0;) {
+            size_t word = (end - 1) / 64;
+            size_t begin = word * 64;
+            uint64_t free = ~_pages[word / WORDS]->data.live[word % WORDS];
+            if (end - begin < 64) {
+                free &= (uint64_t(1) << (end - begin)) - 1;
+            }
+            while (free) {
+                size_t bit = 63 - std::countl_zero(free);
+                _freeList.push_back(begin + bit);
+                free &= ~(uint64_t(1) << bit);
+            }
+            end = begin;
+        }
+    }
+
 private:
     bool inited = false;
-    // internal vector with data
-    std::vector<T> _vector;
-    // Free list is a separate linked list that tracks which chunks are free
-    std::forward_list<size_t> _freeList;
+    // Chunk id / POOL_PAGE_SIZE is the page of the chunk
+    std::vector<std::shared_ptr<PoolPage<T>>> _pages;
+    // Chunks [_untouched, capacity) were never requested
+    size_t _untouched = 0;
+    // Free list is a separate stack that tracks released chunks
+    std::vector<size_t> _freeList;
+
+    // Bumped by every snapshot. Pages of an older epoch may be shared
+    uint64_t _epoch = 0;
+    uint64_t _frozenEpoch = 0;
+    std::vector<std::weak_ptr<PoolSnapshotState<T>>> _snapshots;
+
+
+    void _addPages(size_t size) {
+        size_t count = (size + POOL_PAGE_SIZE - 1) / POOL_PAGE_SIZE;
+        _pages.reserve(_pages.size() + count);
+        for (size_t i = 0; i < count; i++) {
+            auto page = std::make_shared<PoolPage<T>>();
+            page->epoch = _epoch;
+            _pages.push_back(std::move(page));
+        }
+    }
+
+    void _freezePage(size_t pageIdx) {
+        auto& page = *_pages[pageIdx];
+        page.epoch = _epoch;
+
+        std::erase_if(_snapshots, [](const auto& s) { return s.expired(); });
+
+        std::shared_ptr<const PoolPageData<T>> copy;
+        for (auto& weak : _snapshots) {
+            auto state = weak.lock();
+            if (!state || pageIdx >= state->pages.size() ||
+                state->frozen[pageIdx].load(std::memory_order_relaxed)) {
+                continue;
+            }
+            if (!copy) {
+                copy = std::make_shared<const PoolPageData<T>>(page.data);
+            }
+            state->frozenOwners.push_back(copy);
+            // Readers that saw no copy finish reading the page first
+            std::lock_guard<std::mutex> lock(page.mutex);
+            state->frozen[pageIdx].store(copy.get(), std::memory_order_release);
+        }
+    }
 };
 
 } //namespace ale
@@ -0,0 +1,279 @@
+/*
+    Selection of REMesh elements.
+
+    Selections are bitsets indexed by pool ids, one per element type, so
+    tests and toggles are O(1) and counts are popcounts. The sets of a
+    MeshSelection are kept consistent by the select*From*() functions,
+    which derive two sets from the third:
+    - from faces: vertices and edges of the faces
+    - from edges: vertices of the edges, faces with all edges selected
+    - from vertices: edges and faces with all vertices selected
+    Switching the selection mode is a call with the set of the old mode.
+
+    Bits of killed elements are not cleared. Edits that change the
+    connectivity clear the selection or derive it again.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <bit>
+#include <span>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <re_mesh.h>
+#include <ale_thread_pool.h>
+
+#ifndef ALE_SELECTION
+#define ALE_SELECTION
+
+namespace ale {
+namespace geo {
+
+// Bit per pool id. Grows on set(), ids past the end are not selected
+class SelectionBits {
+public:
+    bool test(size_t id) const {
+        size_t word = id / 64;
+        return word < _words.size() && (_words[word] >> (id % 64)) & 1;
+    }
+
+    void set(size_t id) {
+        _fit(id);
+        _words[id / 64] |= uint64_t(1) << (id % 64);
+    }
+
+    void reset(size_t id) {
+        if (id / 64 < _words.size()) {
+            _words[id / 64] &= ~(uint64_t(1) << (id % 64));
+        }
+    }
+
+    // Returns the new state of the bit
+    bool toggle(size_t id) {
+        _fit(id);
+        _words[id / 64] ^= uint64_t(1) << (id % 64);
+        return test(id);
+    }
+
+    // Keeps the memory, selections are cleared often
+    void clear() {
+        std::fill(_words.begin(), _words.end(), 0);
+    }
+
+    size_t count() const {
+        size_t result = 0;
+        for (auto word : _words) {
+            result += std::popcount(word);
+        }
+        return result;
+    }
+
+    bool any() const {
+        return std::any_of(_words.begin(), _words.end(), [](uint64_t w) { return w != 0; });
+    }
+
+    // Calls fn(size_t id) for every set bit in id order
+    template <class Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t word = 0; word < _words.size(); word++) {
+            uint64_t bits = _words[word];
+            while (bits) {
+                fn(word * 64 + std::countr_zero(bits));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> _words;
+
+    void _fit(size_t id) {
+        if (id / 64 >= _words.size()) {
+            _words.resize(id / 64 + 1, 0);
+        }
+    }
+};
+
+
+struct MeshSelection {
+    SelectionBits verts;
+    SelectionBits edges;
+    SelectionBits faces;
+
+    void clear() {
+        verts.clear();
+        edges.clear();
+        faces.clear();
+    }
+
+    bool isEmpty() const {
+        return !verts.any() && !edges.any() && !faces.any();
+    }
+};
+
+
+[[maybe_unused]]
+static void selectFromFaces(REMesh& mesh, MeshSelection& sel) {
+    sel.verts.clear();
+    sel.edges.clear();
+    sel.faces.forEach([&](size_t id) {
+        Face* f = mesh.facesPool.get(id);
+        auto l = f->loop;
+        do {
+            sel.verts.set(l->v->id);
+            sel.edges.set(l->e->id);
+            l = l->next;
+        } while (l != f->loop);
+    });
+}
+
+
+[[maybe_unused]]
+static void selectFromEdges(REMesh& mesh, MeshSelection& sel) {
+    sel.verts.clear();
+    sel.faces.clear();
+    sel.edges.forEach([&](size_t id) {
+        Edge* e = mesh.edgesPool.get(id);
+        sel.verts.set(e->v1->id);
+        sel.verts.set(e->v2->id);
+    });
+    for (auto f : mesh.faces) {
+        bool bAll = true;
+        auto l = f->loop;
+        do {
+            bAll = sel.edges.test(l->e->id);
+            l = l->next;
+        } while (bAll && l != f->loop);
+        if (bAll) {
+            sel.faces.set(f->id);
+        }
+    }
+}
+
+
+[[maybe_unused]]
+static void selectFromVerts(REMesh& mesh, MeshSelection& sel) {
+    sel.edges.clear();
+    sel.faces.clear();
+    for (auto e : mesh.edges) {
+        if (sel.verts.test(e->v1->id) && sel.verts.test(e->v2->id)) {
+            sel.edges.set(e->id);
+        }
+    }
+    for (auto f : mesh.faces) {
+        bool bAll = true;
+        auto l = f->loop;
+        do {
+            bAll = sel.verts.test(l->v->id);
+            l = l->next;
+        } while (bAll && l != f->loop);
+        if (bAll) {
+            sel.faces.set(f->id);
+        }
+    }
+}
+
+
+[[maybe_unused]]
+static void getSelectedVerts(REMesh& mesh, const MeshSelection& sel,
+                             std::vector<Vert*>& out_verts) {
+    out_verts.clear();
+    out_verts.reserve(sel.verts.count());
+    sel.verts.forEach([&](size_t id) { out_verts.push_back(mesh.vertsPool.get(id)); });
+}
+
+
+[[maybe_unused]]
+static void getSelectedFaces(REMesh& mesh, const MeshSelection& sel,
+                             std::vector<Face*>& out_faces) {
+    out_faces.clear();
+    out_faces.reserve(sel.faces.count());
+    sel.faces.forEach([&](size_t id) { out_faces.push_back(mesh.facesPool.get(id)); });
+}
+
+
+// Mean position, summed per worker in double precision
+[[maybe_unused]]
+static glm::vec3 getPivot(const std::vector<glm::vec3>& positions, ThreadPool& threads) {
+    if (positions.empty()) {
+        return glm::vec3(0);
+    }
+    std::vector<glm::dvec3> sums(threads.getSlotCount(), glm::dvec3(0));
+    threads.parallelFor(positions.size(), 4096, [&](size_t begin, size_t end, size_t slot) {
+        glm::dvec3 sum(0);
+        for (size_t i = begin; i < end; i++) {
+            sum += glm::dvec3(positions[i]);
+        }
+        sums[slot] = sum;
+    });
+
+    glm::dvec3 total(0);
+    for (auto& s : sums) {
+        total += s;
+    }
+    return glm::vec3(total / double(positions.size()));
+}
+
+
+// Moves verts[i] to transform * base[i] and marks them dirty. With
+// weights, verts[i] moves weights[i] of the way from base[i]. Blocks of
+// positions are transformed as separate x, y, z arrays, so the compiler
+// vectorizes the math, then written back to the vertices
+[[maybe_unused]]
+static void transformVerts(REMesh& mesh, std::span<Vert* const> verts,
+                           std::span<const glm::vec3> base, const glm::mat4& transform,
+                           ThreadPool& threads, std::span<const float> weights = {}) {
+    // Pool pages are copied for snapshots on the calling thread only
+    for (auto v : verts) {
+        mesh.prepareWrite(v);
+    }
+
+    const size_t BLOCK = 256;
+    const glm::mat4 m = transform;
+    threads.parallelFor(verts.size(), 4096, [&](size_t begin, size_t end, size_t) {
+        float x[BLOCK], y[BLOCK], z[BLOCK];
+        float ox[BLOCK], oy[BLOCK], oz[BLOCK];
+        for (size_t first = begin; first < end; first += BLOCK) {
+            size_t n = std::min(BLOCK, end - first);
+            for (size_t i = 0; i < n; i++) {
+                x[i] = base[first + i].x;
+                y[i] = base[first + i].y;
+                z[i] = base[first + i].z;
+            }
+            for (size_t i = 0; i < n; i++) {
+                ox[i] = m[0][0] * x[i] + m[1][0] * y[i] + m[2][0] * z[i] + m[3][0];
+                oy[i] = m[0][1] * x[i] + m[1][1] * y[i] + m[2][1] * z[i] + m[3][1];
+                oz[i] = m[0][2] * x[i] + m[1][2] * y[i] + m[2][2] * z[i] + m[3][2];
+            }
+            if (!weights.empty()) {
+                for (size_t i = 0; i < n; i++) {
+                    float w = weights[first + i];
+                    ox[i] = x[i] + w * (ox[i] - x[i]);
+                    oy[i] = y[i] + w * (oy[i] - y[i]);
+                    oz[i] = z[i] + w * (oz[i] - z[i]);
+                }
+            }
+            for (size_t i = 0; i < n; i++) {
+                verts[first + i]->pos = glm::vec3(ox[i], oy[i], oz[i]);
+            }
+        }
+    });
+
+    mesh.dirtyVerts.insert(mesh.dirtyVerts.end(), verts.begin(), verts.end());
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_SELECTION
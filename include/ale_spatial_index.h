@@ -0,0 +1,259 @@
+/*
+    Spatial indices over sets of points.
+
+    PointGrid is a uniform grid for radius queries. Cells are hashed into
+    a table of about one bucket per point and the points are sorted by
+    bucket with a counting sort, so a build is O(n) and needs no
+    allocation per cell. A bucket may hold points of several cells,
+    queries skip the points of other cells. A cell size close to the
+    query radius keeps queries at 27 cells.
+
+    PointKdTree is a balanced k-d tree for nearest point queries, which
+    cost about O(log n) however dense the points are.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <compare>
+#include <algorithm>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <tracer.h>
+
+#ifndef ALE_SPATIAL_INDEX
+#define ALE_SPATIAL_INDEX
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace geo {
+
+struct GridCell {
+    int64_t x, y, z;
+    auto operator<=>(const GridCell&) const = default;
+};
+
+
+class PointGrid {
+public:
+    // Points are copied, indices passed to the callbacks index points
+    void build(const std::vector<glm::vec3>& points, float cellSize) {
+        if (!(cellSize > 0)) {
+            trc::log("Point grid cell size must be positive, using 1", trc::WARNING);
+            cellSize = 1;
+        }
+        _cellSize = cellSize;
+
+        size_t bucketCount = 1;
+        while (bucketCount < points.size()) {
+            bucketCount *= 2;
+        }
+        _mask = bucketCount - 1;
+
+        std::vector<uint32_t> buckets(points.size());
+        _bucketStart.assign(bucketCount + 1, 0);
+        for (size_t i = 0; i < points.size(); i++) {
+            buckets[i] = _getBucket(getCell(points[i]));
+            _bucketStart[buckets[i] + 1]++;
+        }
+        for (size_t b = 0; b < bucketCount; b++) {
+            _bucketStart[b + 1] += _bucketStart[b];
+        }
+
+        // Points of a bucket are stored together with their positions
+        std::vector<uint32_t> next(_bucketStart.begin(), _bucketStart.end() - 1);
+        _items.resize(points.size());
+        _itemPos.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++) {
+            uint32_t slot = next[buckets[i]]++;
+            _items[slot] = static_cast<uint32_t>(i);
+            _itemPos[slot] = points[i];
+        }
+    }
+
+    void clear() {
+        _bucketStart.clear();
+        _items.clear();
+        _itemPos.clear();
+    }
+
+    size_t size() const {
+        return _items.size();
+    }
+
+    float getCellSize() const {
+        return _cellSize;
+    }
+
+    GridCell getCell(const glm::vec3& p) const {
+        return {static_cast<int64_t>(std::floor(p.x / _cellSize)),
+                static_cast<int64_t>(std::floor(p.y / _cellSize)),
+                static_cast<int64_t>(std::floor(p.z / _cellSize))};
+    }
+
+    // Calls fn(uint32_t idx, const glm::vec3& pos) for the points of the cell
+    template <class Fn>
+    void forEachInCell(const GridCell& cell, Fn&& fn) const {
+        if (_items.empty()) {
+            return;
+        }
+        uint32_t b = _getBucket(cell);
+        for (uint32_t i = _bucketStart[b]; i < _bucketStart[b + 1]; i++) {
+            if (getCell(_itemPos[i]) == cell) {
+                fn(_items[i], _itemPos[i]);
+            }
+        }
+    }
+
+    // Calls fn(uint32_t idx, float dist2) for the points within the radius
+    template <class Fn>
+    void forEachInRadius(const glm::vec3& center, float radius, Fn&& fn) const {
+        GridCell lo = getCell(center - glm::vec3(radius));
+        GridCell hi = getCell(center + glm::vec3(radius));
+        float radius2 = radius * radius;
+        for (int64_t x = lo.x; x <= hi.x; x++) {
+            for (int64_t y = lo.y; y <= hi.y; y++) {
+                for (int64_t z = lo.z; z <= hi.z; z++) {
+                    forEachInCell({x, y, z}, [&](uint32_t idx, const glm::vec3& pos) {
+                        glm::vec3 d = pos - center;
+                        float dist2 = glm::dot(d, d);
+                        if (dist2 <= radius2) {
+                            fn(idx, dist2);
+                        }
+                    });
+                }
+            }
+        }
+    }
+
+private:
+    float _cellSize = 1;
+    size_t _mask = 0;
+    // Bucket b holds _items[_bucketStart[b], _bucketStart[b + 1])
+    std::vector<uint32_t> _bucketStart;
+    std::vector<uint32_t> _items;
+    std::vector<glm::vec3> _itemPos;
+
+    uint32_t _getBucket(const GridCell& c) const {
+        uint64_t h = static_cast<uint64_t>(c.x) * 73856093u ^
+                     static_cast<uint64_t>(c.y) * 19349663u ^
+                     static_cast<uint64_t>(c.z) * 83492791u;
+        return static_cast<uint32_t>(h & _mask);
+    }
+};
+
+
+class PointKdTree {
+public:
+    void build(const std::vector<glm::vec3>& points) {
+        _nodes.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++) {
+            _nodes[i] = {points[i], static_cast<uint32_t>(i), 0};
+        }
+        _build(0, _nodes.size());
+    }
+
+    void clear() {
+        _nodes.clear();
+    }
+
+    size_t size() const {
+        return _nodes.size();
+    }
+
+    // Squared distance to the nearest point within maxDist, false if
+    // there is none
+    bool findNearest(const glm::vec3& p, float maxDist, float& out_dist2) const {
+        float best2 = maxDist * maxDist;
+        bool bFound = false;
+        _findNearest(0, _nodes.size(), p, best2, bFound);
+        out_dist2 = best2;
+        return bFound;
+    }
+
+private:
+    // The tree is implicit: the middle node of a range splits it, the
+    // halves before and after it are its subtrees
+    struct Node {
+        glm::vec3 pos;
+        uint32_t idx;
+        uint8_t axis;
+    };
+    std::vector<Node> _nodes;
+
+
+    void _build(size_t begin, size_t end) {
+        if (end - begin < 2) {
+            return;
+        }
+        // Split along the widest extent of the range
+        glm::vec3 lo = _nodes[begin].pos;
+        glm::vec3 hi = lo;
+        for (size_t i = begin + 1; i < end; i++) {
+            lo = glm::min(lo, _nodes[i].pos);
+            hi = glm::max(hi, _nodes[i].pos);
+        }
+        glm::vec3 extent = hi - lo;
+        uint8_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(_nodes.begin() + begin, _nodes.begin() + mid, _nodes.begin() + end,
+                         [axis](const Node& a, const Node& b) {
+                             return a.pos[axis] < b.pos[axis];
+                         });
+        _nodes[mid].axis = axis;
+        _build(begin, mid);
+        _build(mid + 1, end);
+    }
+
+    void _findNearest(size_t begin, size_t end, const glm::vec3& p,
+                      float& best2, bool& bFound) const {
+        while (begin < end) {
+            size_t mid = begin + (end - begin) / 2;
+            const Node& node = _nodes[mid];
+            glm::vec3 d = node.pos - p;
+            float dist2 = glm::dot(d, d);
+            if (dist2 <= best2) {
+                best2 = dist2;
+                bFound = true;
+            }
+            if (end - begin == 1) {
+                return;
+            }
+
+            // The near half first, the far one only if the splitting plane
+            // is closer than the best point
+            float diff = p[node.axis] - node.pos[node.axis];
+            bool bLeft = diff < 0;
+            if (bLeft) {
+                _findNearest(begin, mid, p, best2, bFound);
+            } else {
+                _findNearest(mid + 1, end, p, best2, bFound);
+            }
+            if (diff * diff > best2) {
+                return;
+            }
+            if (bLeft) {
+                begin = mid + 1;
+            } else {
+                end = mid;
+            }
+        }
+    }
+};
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_SPATIAL_INDEX
@@ -0,0 +1,151 @@
+#pragma once
+
+/*
+    A fixed size pool of worker threads. The calling thread takes part
+    in parallelFor(), so a pool of N threads has N + 1 worker slots.
+*/
+
+// ext
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+
+#ifndef ALE_THREAD_POOL
+#define ALE_THREAD_POOL
+
+namespace ale {
+
+class ThreadPool {
+public:
+    // 0 threads means one thread per hardware core besides the caller
+    explicit ThreadPool(size_t threadCount = 0) {
+        if (threadCount == 0) {
+            size_t cores = std::thread::hardware_concurrency();
+            threadCount = cores > 1 ? cores - 1 : 0;
+        }
+
+        _threads.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; i++) {
+            _threads.emplace_back([this]() { _workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _bStop = true;
+        }
+        _jobAvailable.notify_all();
+
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of chunks parallelFor() can run at once, including the caller
+    size_t getSlotCount() const {
+        return _threads.size() + 1;
+    }
+
+    // Splits [0, count) into at most getSlotCount() chunks of at least
+    // minChunk elements and calls fn(begin, end, slot) for each chunk.
+    // Slots are unique within one call, so they can index per-worker
+    // resources. Blocks until all chunks are done and rethrows the first
+    // exception thrown by fn
+    void parallelFor(size_t count, size_t minChunk,
+                     const std::function<void(size_t, size_t, size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+
+        minChunk = std::max<size_t>(minChunk, 1);
+        size_t chunkCount = std::min(getSlotCount(), (count + minChunk - 1) / minChunk);
+        size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+        std::mutex doneMutex;
+        std::condition_variable doneCv;
+        size_t pending = chunkCount - 1;
+        std::exception_ptr error = nullptr;
+
+        auto runChunk = [&](size_t chunk) {
+            size_t begin = chunk * chunkSize;
+            size_t end = std::min(begin + chunkSize, count);
+            try {
+                if (begin < end) {
+                    fn(begin, end, chunk);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        for (size_t chunk = 1; chunk < chunkCount; chunk++) {
+            submit([&, chunk]() {
+                runChunk(chunk);
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (--pending == 0) {
+                    doneCv.notify_one();
+                }
+            });
+        }
+
+        // The caller always takes the first chunk
+        runChunk(0);
+
+        {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneCv.wait(lock, [&]() { return pending == 0; });
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Queues a job without waiting for it
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push(std::move(job));
+        }
+        _jobAvailable.notify_one();
+    }
+
+private:
+    std::vector<std::thread> _threads;
+    std::queue<std::function<void()>> _jobs;
+    std::mutex _mutex;
+    std::condition_variable _jobAvailable;
+    bool _bStop = false;
+
+    void _workerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _jobAvailable.wait(lock, [this]() { return _bStop || !_jobs.empty(); });
+                if (_bStop && _jobs.empty()) {
+                    return;
+                }
+                job = std::move(_jobs.front());
+                _jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+} // namespace ale
+
+#endif // ALE_THREAD_POOL
@@ -4,6 +4,7 @@
 
 // ext
 #include <algorithm>
+#include <cstdlib>
 #include <memory>
 #ifndef GLFW
 #define GLFW
@@ -11,6 +11,10 @@
 // int
 #include <primitives.h>
 #include <re_mesh.h>
+#include <ale_selection.h>
+#include <re_mesh_proportional.h>
+#include <re_mesh_normals.h>
+#include <re_mesh_sculpt.h>
 
 namespace ale {
 
@@ -71,6 +75,35 @@ struct SelectionState {
 };
 
 
+// Settings of the mesh editing operations of MESH_MODE
+struct MeshToolsState {
+    // Share of faces left by decimation
+    float decimateRatio = 0.5f;
+    int subdivisionLevels = 1;
+    // Loop subdivision instead of Catmull-Clark, needs triangles
+    bool bLoopSubdivision = false;
+    // Gizmo drags also move vertices near the selection
+    bool bProportional = false;
+    float proportionalRadius = 1.0f;
+    ale::geo::ProportionalFalloff proportionalFalloff = ale::geo::SMOOTH_FALLOFF;
+    // Right mouse drags sculpt the current mesh, the gizmo is hidden
+    bool bSculpt = false;
+    ale::geo::SculptBrushSettings sculptBrush;
+    // Normals computed for edited meshes
+    ale::geo::NormalSettings normals;
+};
+
+
+// Operation requested by the mesh tools UI
+enum GMeshTool {
+    NO_MESH_TOOL,
+    DECIMATE_TOOL,
+    SUBDIVIDE_TOOL,
+    EXTRUDE_TOOL,
+    NORMALS_TOOL,
+};
+
+
 struct GEditorState {
     GEditorMode editorMode;
     GTransformMode transformMode;
@@ -86,12 +119,13 @@ struct GEditorState {
     //
     SelectionState selection;
 
-    std::vector<ale::geo::Vert*> selectedVerts;
-    std::vector<ale::geo::Edge*> selectedEdges;
-    std::vector<ale::geo::Face*> selectedFaces;
+    // Element selections of the meshes of the current model, by mesh index
+    std::vector<ale::geo::MeshSelection> meshSelections;
 
     std::vector<std::pair<std::vector<glm::vec3>, UI_DRAW_TYPE>> uiDrawQueue;
 
+    MeshToolsState meshTools;
+
 
     GEditorState(){
         editorMode = OBJECT_MODE;
@@ -111,6 +145,21 @@ struct GEditorState {
         _enumCycle(spaceMode, SPACE_MODE_MAX);
     }
 
+    ale::geo::MeshSelection& getMeshSelection(size_t meshIdx) {
+        if (meshIdx >= meshSelections.size()) {
+            meshSelections.resize(meshIdx + 1);
+        }
+        return meshSelections[meshIdx];
+    }
+
+    // Selection of the mesh of the current node, null without one
+    ale::geo::MeshSelection* getCurrentSelection() {
+        if (!currentModelNode || currentModelNode->meshIdx < 0) {
+            return nullptr;
+        }
+        return &getMeshSelection(currentModelNode->meshIdx);
+    }
+
 private:
     // Recieves a reference to enum and its max value.
     // Loops over the enum
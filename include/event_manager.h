@@ -12,6 +12,9 @@ responsibilities. Think about better design patterns
 
 //ext
 #include <functional>
+#include <future>
+#include <chrono>
+#include <list>
 
 //int
 #include <tracer.h>
@@ -23,11 +26,26 @@ responsibilities. Think about better design patterns
 #include <editor_state.h>
 #include <ale_geo_utils.h>
 #include <re_mesh.h>
+#include <re_mesh_decimate.h>
+#include <re_mesh_subdivide.h>
+#include <re_mesh_extrude.h>
+#include <re_mesh_proportional.h>
+#include <re_mesh_normals.h>
+#include <re_mesh_sculpt.h>
+#include <re_mesh_validate.h>
+#include <ale_history.h>
 #include <renderer.h>
 
 
 namespace ale {
 
+// Debug builds check meshes after every edit of their connectivity
+#ifdef NDEBUG
+const bool eventManager_validateMeshEdits = false;
+#else
+const bool eventManager_validateMeshEdits = true;
+#endif
+
 class EventManager {
 public:
     EventManager(sp<ale::Renderer> renderer,
@@ -51,6 +69,11 @@ public:
         _inputManager->setActionBinding(inp::RMV_SELECT_ALL,flushBuffer, false);
         _inputManager->setActionBinding(inp::CYCLE_MODE_EDITOR,changeModeEditor, false);
         _inputManager->setActionBinding(inp::CYCLE_MODE_OPERATION,changeModeOperation, false);
+        _inputManager->setActionBinding(inp::UNDO, undo, false);
+        _inputManager->setActionBinding(inp::REDO, redo, false);
+        _inputManager->setActionBinding(inp::TOGGLE_PROPORTIONAL, toggleProportional, false);
+        _inputManager->setActionBinding(inp::GROW_PROPORTIONAL, growProportional, false);
+        _inputManager->setActionBinding(inp::SHRINK_PROPORTIONAL, shrinkProportional, false);
     }
 
 void frameEventCallback() {
@@ -59,19 +82,59 @@ void frameEventCallback() {
     auto& _state = this->_editorState;
 
     MVP pvm = {.m = ubo.model, .v = ubo.view, .p = ui::getFlippedProjection(ubo.proj)};
+    bool bSculptInput = _state->editorMode == ale::MESH_MODE && _state->currentREMesh &&
+                        _state->meshTools.bSculpt && _inputManager->isRightMousePressed();
     if (_state->currentModelNode && _state->editorMode == ale::OBJECT_MODE) {
-        ui::drawImGuiGizmo(ubo.view, ubo.proj, &_state->currentModelNode->transform , *_state.get());
-    } else if (!_state->selectedFaces.empty() && _state->editorMode == ale::MESH_MODE) {
-        // Get first vertice
-        auto& v = _state->selectedFaces[0]->loop->v;
+        if (ui::drawImGuiGizmo(ubo.view, ubo.proj, &_state->currentModelNode->transform , *_state.get())) {
+            _renderer->markSceneDirty();
+        }
+    } else if (_state->editorMode == ale::MESH_MODE && _state->currentREMesh) {
+        if (!_state->meshTools.bSculpt) {
+            transformSelection(ubo);
+        } else if (bSculptInput) {
+            sculptCurrentMesh(ubo);
+        }
+    }
 
-        auto tr = geo::constructTransformFromPos(v->pos);
+    if (_sculpt.isStroking() && !bSculptInput) {
+        endSculptStroke();
+    }
 
-        ui::drawImGuiGizmo(ubo.view, ubo.proj, &tr, *_state.get());
+    finishLodUpdates();
 
-        auto newPos = geo::extractPosFromTransform(tr);
-        v->pos = newPos;
+    if (_history.isEditingVertices() && !ImGuizmo::IsUsing() && !_sculpt.isStroking()) {
+        if (_state->currentREMesh && _state->currentModelNode) {
+            std::span<geo::Vert* const> moved = _gizmoVerts;
+            if (_bProportionalDrag) {
+                moved = _proportional.getVerts();
+            }
+            updateNormals(_state->currentModelNode->meshIdx, moved);
+        }
+        _history.endVertexEdit(*_state->currentModel);
+        _proportional.clear();
+        _bProportionalDrag = false;
+        _bGizmoStale = true;
+        drawSelection();
+    }
 
+    if (_state->editorMode == ale::MESH_MODE && _state->currentModelNode &&
+        _state->currentModelNode->meshIdx >= 0) {
+        switch (ui::drawMeshToolsUI(*_state.get())) {
+            case ale::DECIMATE_TOOL:
+                decimateCurrentMesh();
+                break;
+            case ale::SUBDIVIDE_TOOL:
+                subdivideCurrentMesh();
+                break;
+            case ale::EXTRUDE_TOOL:
+                extrudeSelectedFaces();
+                break;
+            case ale::NORMALS_TOOL:
+                recomputeNormals();
+                break;
+            default:
+                break;
+        }
     }
 
 
@@ -128,6 +191,34 @@ private:
     sp<ale::Renderer> _renderer;
     sp<ale::GEditorState> _editorState;
     sp<ale::InputManager> _inputManager;
+    ale::History _history;
+
+    // Selected vertices and their positions at the start of a gizmo drag.
+    // Gathered again when the selection or the positions change
+    std::vector<geo::Vert*> _gizmoVerts;
+    std::vector<glm::vec3> _gizmoBase;
+    glm::mat4 _gizmoStart = glm::mat4(1);
+    glm::mat4 _gizmoTransform = glm::mat4(1);
+    bool _bGizmoStale = true;
+
+    // Vertices near the selection moved by the current drag
+    geo::ProportionalEdit _proportional;
+    bool _bProportionalDrag = false;
+    size_t _proportionalRecorded = 0;
+
+    // Normals of the edited mesh, kept up to date by edits of its vertices
+    geo::MeshNormals _normals;
+    // Sculpting of the current mesh, begun again after the connectivity
+    // changes or another mesh is sculpted
+    geo::SculptSession _sculpt;
+    // LODs of primitives an extrude changed, built on worker threads by
+    // mesh index. A running build can not be stopped, so it is only dropped
+    // once it is done
+    std::list<std::pair<int, std::future<geo::MeshLodUpdate>>> _lodUpdates;
+
+    // Grab strokes move on the plane through their start facing the ray
+    glm::vec3 _grabStart = glm::vec3(0);
+    glm::vec3 _grabNormal = glm::vec3(0, 0, 1);
 
 
     // WASD free camera movement
@@ -181,9 +272,13 @@ private:
     };
 
 
-    // Removes all primitives from the buffer
+    // Removes all primitives from the buffer and deselects everything
     std::function<void()> flushBuffer = [this](){
         _editorState->uiDrawQueue.clear();
+        if (auto sel = _editorState->getCurrentSelection()) {
+            sel->clear();
+        }
+        _bGizmoStale = true;
     };
 
 
@@ -205,6 +300,411 @@ private:
     };
 
 
+    std::function<void()> toggleProportional = [this]() {
+        auto& tools = _editorState->meshTools;
+        tools.bProportional = !tools.bProportional;
+        trc::log(std::string("Proportional editing ") + (tools.bProportional ? "on" : "off"));
+    };
+    std::function<void()> growProportional = [this]() { scaleProportionalRadius(1.25f); };
+    std::function<void()> shrinkProportional = [this]() { scaleProportionalRadius(0.8f); };
+
+
+    // Logs the errors of a mesh after an edit, see eventManager_validateMeshEdits
+    void validateMesh(int meshIdx, const std::string& edit) {
+        if (!eventManager_validateMeshEdits) {
+            return;
+        }
+        auto& reMesh = _editorState->currentModel->reMeshes[meshIdx];
+        auto report = geo::validate(reMesh, _renderer->getThreadPool());
+        if (!report.isValid()) {
+            trc::log(edit + " broke REMesh " + std::to_string(meshIdx) + ": " + report.toString(),
+                     trc::ERROR);
+        }
+    }
+
+    std::function<void()> undo = [this]() { applyHistory(true); };
+    std::function<void()> redo = [this]() { applyHistory(false); };
+
+
+    // Vertex steps are synced through dirtyVerts, meshes replaced by
+    // topology steps are uploaded again
+    void applyHistory(bool bUndo) {
+        if (!_editorState->currentModel) {
+            return;
+        }
+        if (_sculpt.isStroking()) {
+            endSculptStroke();
+        }
+
+        int meshIdx;
+        bool bTopology;
+        auto& model = *_editorState->currentModel;
+        if (!(bUndo ? _history.undo(model, meshIdx, bTopology)
+                    : _history.redo(model, meshIdx, bTopology))) {
+            trc::log(bUndo ? "Nothing to undo" : "Nothing to redo");
+            return;
+        }
+
+        if (bTopology) {
+            _editorState->getMeshSelection(meshIdx).clear();
+            _editorState->uiDrawQueue.clear();
+            _sculpt.clear();
+            _normals.clear();
+            _renderer->uploadMesh(meshIdx);
+            validateMesh(meshIdx, bUndo ? "Undo" : "Redo");
+        } else {
+            updateNormals(meshIdx, model.reMeshes[meshIdx].dirtyVerts);
+        }
+        _bGizmoStale = true;
+    }
+
+
+    // The gizmo sits at the mean of the selected vertices. A drag moves
+    // them from their positions at the start of the drag by the change of
+    // the gizmo transform since then
+    void transformSelection(const UniformBufferObject& ubo) {
+        auto sel = _editorState->getCurrentSelection();
+        if (!sel || !sel->verts.any()) {
+            return;
+        }
+        auto& mesh = *_editorState->currentREMesh;
+        auto& threads = _renderer->getThreadPool();
+
+        if (_bGizmoStale && !_history.isEditingVertices()) {
+            geo::getSelectedVerts(mesh, *sel, _gizmoVerts);
+            _gizmoBase.resize(_gizmoVerts.size());
+            for (size_t i = 0; i < _gizmoVerts.size(); i++) {
+                _gizmoBase[i] = _gizmoVerts[i]->pos;
+            }
+            _gizmoStart = geo::constructTransformFromPos(geo::getPivot(_gizmoBase, threads));
+            _gizmoTransform = _gizmoStart;
+            _bGizmoStale = false;
+        }
+
+        auto view = ubo.view;
+        auto proj = ubo.proj;
+        if (!ale::UIManager::drawImGuiGizmo(view, proj, &_gizmoTransform, *_editorState.get())) {
+            return;
+        }
+
+        // One history step per gizmo drag
+        auto& tools = _editorState->meshTools;
+        if (!_history.isEditingVertices()) {
+            _bProportionalDrag = tools.bProportional;
+            if (_bProportionalDrag) {
+                _proportional.begin(mesh, *sel, tools.proportionalRadius,
+                                    tools.proportionalFalloff, threads);
+                _proportionalRecorded = 0;
+            } else {
+                _history.beginVertexEdit(_editorState->currentModelNode->meshIdx, _gizmoVerts);
+            }
+        }
+
+        if (_bProportionalDrag) {
+            applyProportional();
+        } else {
+            geo::transformVerts(mesh, _gizmoVerts, _gizmoBase,
+                                _gizmoTransform * glm::inverse(_gizmoStart), threads);
+        }
+    }
+
+
+    // Vertices that a larger radius adds to the drag are recorded before
+    // they move
+    void applyProportional() {
+        auto verts = _proportional.getVerts();
+        if (verts.size() > _proportionalRecorded) {
+            _history.beginVertexEdit(_editorState->currentModelNode->meshIdx,
+                                     {verts.begin() + _proportionalRecorded, verts.end()});
+            _proportionalRecorded = verts.size();
+        }
+        _proportional.apply(*_editorState->currentREMesh,
+                            _gizmoTransform * glm::inverse(_gizmoStart),
+                            _renderer->getThreadPool());
+    }
+
+
+    // The radius may change during a drag, the drag is applied again
+    void scaleProportionalRadius(float factor) {
+        auto& tools = _editorState->meshTools;
+        tools.proportionalRadius *= factor;
+        if (_bProportionalDrag) {
+            _proportional.setRadius(tools.proportionalRadius, _renderer->getThreadPool());
+            applyProportional();
+        }
+        trc::log("Proportional radius " + std::to_string(tools.proportionalRadius), trc::DEBUG);
+    }
+
+
+    // Dabs along the cursor path while the right button is held, one
+    // history step per stroke
+    void sculptCurrentMesh(const UniformBufferObject& ubo) {
+        int meshIdx = _editorState->currentModelNode ? _editorState->currentModelNode->meshIdx : -1;
+        if (meshIdx < 0) {
+            return;
+        }
+        auto& mesh = *_editorState->currentREMesh;
+        auto& view = _editorState->currentModel->viewMeshes[meshIdx];
+        auto& threads = _renderer->getThreadPool();
+        auto& brush = _editorState->meshTools.sculptBrush;
+        if (!_sculpt.isActive(mesh)) {
+            if (!_normals.isActive(mesh)) {
+                _normals.compute(mesh, _editorState->meshTools.normals, threads);
+            }
+            _sculpt.begin(mesh, _normals, threads);
+        }
+
+        // Cursor ray in mesh space
+        auto mouse = _inputManager->getMousePos();
+        auto fwd = geo::screenToWorld(ale::UIManager::getFlippedProjection(ubo.proj) * ubo.view,
+                                      {mouse.x, mouse.y}, _renderer->getDisplaySize());
+        glm::mat4 toMesh = glm::inverse(_editorState->currentModelNode->transform);
+        glm::vec3 origin = glm::vec3(toMesh * glm::vec4(_renderer->getCurrentCamera()->getPos(), 1.0f));
+        glm::vec3 dir = glm::normalize(glm::vec3(toMesh * glm::vec4(fwd, 0.0f)));
+
+        glm::vec3 center;
+        if (brush.type == geo::GRAB_BRUSH && _sculpt.isStroking()) {
+            float facing = glm::dot(dir, _grabNormal);
+            if (std::abs(facing) < 1e-6f) {
+                return;
+            }
+            center = origin + dir * (glm::dot(_grabStart - origin, _grabNormal) / facing);
+        } else if (!_sculpt.raycast(origin, dir, center)) {
+            return;
+        }
+
+        if (!_sculpt.isStroking()) {
+            _sculpt.beginStroke(center, brush);
+            _grabStart = center;
+            _grabNormal = dir;
+        }
+        _sculpt.stroke(mesh, view, center, brush, threads, [&](const std::vector<geo::Vert*>& verts) {
+            _history.beginVertexEdit(meshIdx, verts);
+        });
+    }
+
+
+    void endSculptStroke() {
+        _sculpt.endStroke();
+        _history.endVertexEdit(*_editorState->currentModel);
+        _bGizmoStale = true;
+    }
+
+
+    // Normals of the faces around moved vertices, the sculpt BVH follows
+    // the faces. Normals of a mesh are computed at its first edit
+    void updateNormals(int meshIdx, std::span<geo::Vert* const> verts) {
+        auto& mesh = _editorState->currentModel->reMeshes[meshIdx];
+        auto& threads = _renderer->getThreadPool();
+        if (!_normals.isActive(mesh)) {
+            _normals.compute(mesh, _editorState->meshTools.normals, threads);
+        }
+        _normals.update(mesh, _editorState->currentModel->viewMeshes[meshIdx], verts, threads);
+        _sculpt.refit(mesh, _normals.getUpdatedFaces(), threads);
+    }
+
+
+    // Replaces all normals of the current mesh. Split corners need view
+    // vertices of their own, so the view mesh is rebuilt
+    void recomputeNormals() {
+        int meshIdx = _editorState->currentModelNode->meshIdx;
+        auto& reMesh = _editorState->currentModel->reMeshes[meshIdx];
+        auto& viewMesh = _editorState->currentModel->viewMeshes[meshIdx];
+
+        geo::compactMesh(reMesh);
+        auto before = reMesh.snapshot();
+        ViewMesh beforeView = viewMesh;
+        _normals.compute(reMesh, _editorState->meshTools.normals, _renderer->getThreadPool());
+        geo::rebuildViewMesh(reMesh, viewMesh, [&](const geo::Loop* l) { return _normals.getCornerNormal(l); });
+        std::vector<uint32_t> remap;
+        geo::optimizeMesh(viewMesh, remap);
+        geo::remapViewIds(reMesh, remap);
+        geo::generateMeshLods(viewMesh);
+
+        _history.pushTopologyStep(meshIdx, "Normals", std::move(before), reMesh, beforeView, viewMesh);
+        _renderer->uploadMesh(meshIdx);
+    }
+
+
+    // Highlights the selected faces of the current mesh
+    void drawSelection() {
+        auto& queue = _editorState->uiDrawQueue;
+        std::erase_if(queue, [](const auto& item) { return item.second == ale::VERT; });
+
+        auto sel = _editorState->getCurrentSelection();
+        if (!sel || !_editorState->currentREMesh) {
+            return;
+        }
+        std::vector<geo::Face*> faces;
+        geo::getSelectedFaces(*_editorState->currentREMesh, *sel, faces);
+        for (auto f : faces) {
+            std::vector<glm::vec3> loopVec;
+            auto l = f->loop;
+            do {
+                loopVec.push_back(l->v->pos);
+                l = l->next;
+            } while (l != f->loop);
+            queue.push_back({loopVec, ale::VERT});
+        }
+    }
+
+
+    // Decimates the mesh of the selected node and uploads the result
+    void decimateCurrentMesh() {
+        int meshIdx = _editorState->currentModelNode->meshIdx;
+        auto& reMesh = _editorState->currentModel->reMeshes[meshIdx];
+        auto& viewMesh = _editorState->currentModel->viewMeshes[meshIdx];
+
+        geo::compactMesh(reMesh);
+        auto before = reMesh.snapshot();
+        ViewMesh beforeView = viewMesh;
+        size_t target = reMesh.faces.size() * _editorState->meshTools.decimateRatio;
+        int lastPercent = 0;
+        geo::decimate(reMesh, target, _renderer->getThreadPool(), [&](float progress) {
+            int percent = static_cast<int>(progress * 10) * 10;
+            if (percent > lastPercent) {
+                lastPercent = percent;
+                trc::log("Decimating mesh " + std::to_string(meshIdx) + ": " +
+                         std::to_string(percent) + "%", trc::DEBUG);
+            }
+        });
+
+        // Selections may point to removed elements
+        _editorState->getMeshSelection(meshIdx).clear();
+        _editorState->uiDrawQueue.clear();
+        _sculpt.clear();
+        _normals.clear();
+        _bGizmoStale = true;
+
+        geo::rebuildViewMesh(reMesh, viewMesh);
+        std::vector<uint32_t> remap;
+        geo::optimizeMesh(viewMesh, remap);
+        geo::remapViewIds(reMesh, remap);
+        geo::generateMeshLods(viewMesh);
+
+        _history.pushTopologyStep(meshIdx, "Decimate", std::move(before), reMesh, beforeView, viewMesh);
+        _renderer->uploadMesh(meshIdx);
+        validateMesh(meshIdx, "Decimate");
+    }
+
+
+    void subdivideCurrentMesh() {
+        int meshIdx = _editorState->currentModelNode->meshIdx;
+        auto& reMesh = _editorState->currentModel->reMeshes[meshIdx];
+        auto& viewMesh = _editorState->currentModel->viewMeshes[meshIdx];
+        auto& tools = _editorState->meshTools;
+
+        // Subdivision builds a new mesh, the old one keeps its pages in the
+        // snapshot and history packs them off the main thread
+        geo::compactMesh(reMesh);
+        auto before = reMesh.snapshot();
+        ViewMesh beforeView = viewMesh;
+        auto scheme = tools.bLoopSubdivision ? geo::LOOP_SUBDIVISION : geo::CATMULL_CLARK;
+        if (!geo::subdivide(reMesh, scheme, tools.subdivisionLevels, _renderer->getThreadPool())) {
+            return;
+        }
+
+        // The old elements are gone
+        _editorState->getMeshSelection(meshIdx).clear();
+        _editorState->uiDrawQueue.clear();
+        _sculpt.clear();
+        _bGizmoStale = true;
+
+        // Imported normals do not fit the smoothed surface
+        _normals.compute(reMesh, tools.normals, _renderer->getThreadPool());
+        geo::rebuildViewMesh(reMesh, viewMesh, [&](const geo::Loop* l) { return _normals.getCornerNormal(l); });
+        std::vector<uint32_t> remap;
+        geo::optimizeMesh(viewMesh, remap);
+        geo::remapViewIds(reMesh, remap);
+        geo::generateMeshLods(viewMesh);
+
+        _history.pushTopologyStep(meshIdx, "Subdivide", std::move(before), reMesh, beforeView, viewMesh);
+        _renderer->uploadMesh(meshIdx);
+        validateMesh(meshIdx, "Subdivide");
+    }
+
+
+    // The selection stays on the cap faces, so it can be moved right away
+    void extrudeSelectedFaces() {
+        auto sel = _editorState->getCurrentSelection();
+        if (!sel || !sel->faces.any()) {
+            return;
+        }
+        int meshIdx = _editorState->currentModelNode->meshIdx;
+        auto& reMesh = _editorState->currentModel->reMeshes[meshIdx];
+        auto& viewMesh = _editorState->currentModel->viewMeshes[meshIdx];
+
+        geo::compactMesh(reMesh);
+        auto before = reMesh.snapshot();
+        std::vector<geo::Face*> faces;
+        geo::getSelectedFaces(reMesh, *sel, faces);
+        ViewMesh beforeView = viewMesh;
+        auto result = geo::extrudeFaceRegion(reMesh, faces);
+        trc::log("Extruded " + std::to_string(faces.size()) + " faces, " +
+                 std::to_string(result.sideFaces.size()) + " side faces");
+        // Cap faces keep their ids, their vertices are the cap vertices now
+        geo::selectFromFaces(reMesh, *sel);
+        _sculpt.clear();
+        _normals.clear();
+        _bGizmoStale = true;
+        drawSelection();
+
+        // Vertex and index counts changed. Only the new corners and the cap
+        // triangles are uploaded, a view that is out of date with the
+        // REMesh is rebuilt. New corners get the normals of their faces
+        std::vector<std::pair<size_t, size_t>> vertexRanges;
+        std::vector<std::pair<size_t, size_t>> indexRanges;
+        bool bUpdated = geo::updateExtrudeView(reMesh, viewMesh, result, vertexRanges, indexRanges);
+        if (!bUpdated) {
+            geo::rebuildViewMesh(reMesh, viewMesh);
+        }
+        updateNormals(meshIdx, result.capVerts);
+        _history.pushTopologyStep(meshIdx, "Extrude", std::move(before), reMesh, beforeView, viewMesh);
+        if (bUpdated) {
+            _renderer->uploadMeshRanges(meshIdx, vertexRanges, indexRanges);
+        } else {
+            _renderer->uploadMesh(meshIdx);
+        }
+        validateMesh(meshIdx, "Extrude");
+
+        // Primitives that lost their LODs get them back off the main thread
+        std::vector<size_t> stale;
+        for (size_t p = 0; p < viewMesh.primitives.size() && p < beforeView.primitives.size(); p++) {
+            if (viewMesh.primitives[p].lods.empty() && !beforeView.primitives[p].lods.empty()) {
+                stale.push_back(p);
+            }
+        }
+        if (!stale.empty()) {
+            _lodUpdates.emplace_back(meshIdx, std::async(std::launch::async,
+                [update = geo::beginMeshLodUpdate(viewMesh, stale)]() mutable {
+                    geo::buildMeshLodUpdate(update);
+                    return std::move(update);
+                }));
+        }
+    }
+
+
+    // Adds LODs built on worker threads to their views once ready. Views
+    // whose primitives changed since drop them
+    void finishLodUpdates() {
+        for (auto it = _lodUpdates.begin(); it != _lodUpdates.end();) {
+            if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                it++;
+                continue;
+            }
+            int meshIdx = it->first;
+            geo::MeshLodUpdate update = it->second.get();
+            it = _lodUpdates.erase(it);
+
+            auto& viewMeshes = _editorState->currentModel->viewMeshes;
+            if (meshIdx < static_cast<int>(viewMeshes.size()) &&
+                geo::applyMeshLodUpdate(viewMeshes[meshIdx], update)) {
+                _renderer->uploadMesh(meshIdx);
+            }
+        }
+    }
+
+
     void raycastObjMode(const glm::vec3& pos, glm::vec3& fwd){
         bool _hits = false;
 
@@ -247,26 +747,16 @@ private:
             auto pos4 = glm::vec4(pos, 1.0f);
             pos4 = glm::inverse(_editorState->currentModelNode->transform) * pos4;
 
-            result = geo::rayIntersectsTriangle(pos4, fwd, f, intersection, distance);
+            result = geo::rayIntersectsFace(pos4, fwd, f, intersection, distance);
             if (result) {
-
-                std::vector<geo::Loop*> out_loops {};
-                geo::getBoundingLoops(f, out_loops);
-                std::vector<glm::vec3> loopVec {};
-                loopVec.reserve(3);
-
-
                 trc::raw << "\n face "<< trc::RED << f->id << trc::RESET << " face\n";
 
-                for (auto& l : out_loops) {
-                    auto _v = l->v;
-                    trc::raw << "\n "<< _v->id << " vector \n";
-                    loopVec.push_back(l->v->pos);
-                }
-                _editorState->uiDrawQueue.push_back({loopVec,ale::VERT});
-                // TODO: Load range to selected buffer
-                _editorState->selectedFaces.clear();
-                _editorState->selectedFaces.push_back(f);
+                // A click adds the face to the selection or removes it
+                auto sel = _editorState->getCurrentSelection();
+                sel->faces.toggle(f->id);
+                geo::selectFromFaces(*_editorState->currentREMesh, *sel);
+                _bGizmoStale = true;
+                drawSelection();
                 break;
             }
         }
@@ -61,6 +61,15 @@ enum InputAction {
     SET_MODE_EDITOR_MESH,
     SET_MODE_EDITOR_UV,
     SET_MODE_EDITOR_ANIM,
+
+    // Event history
+    UNDO,
+    REDO,
+
+    // Proportional editing
+    TOGGLE_PROPORTIONAL,
+    GROW_PROPORTIONAL,
+    SHRINK_PROPORTIONAL,
 };
 
 class InputManager {
@@ -100,6 +109,7 @@ public:
     bool isActionActive(InputAction _action);
     glm::highp_vec2 getLastDeltaMouseOffset();
     glm::highp_vec2 getMousePos();
+    bool isRightMousePressed();
 };
 
 } // namespace ale
@@ -21,6 +21,11 @@
 #include <tinygltf/tiny_gltf.h>
 #include <tol/tiny_obj_loader.h>
 #include <ale_geo_utils.h>
+#include <re_mesh_normals.h>
+#include <re_mesh_validate.h>
+#include <ale_thread_pool.h>
+#include <ale_mesh_optimizer.h>
+#include <ale_mesh_lod.h>
 #include <memory.h>
 
 namespace ale {
@@ -45,7 +50,7 @@ private:
     // System IO methods
     static bool _canReadFile(std::filesystem::path p);
     // Geometry methods
-    static void _generateVertexNormals(ale::ViewMesh &_mesh);
+    static void _generateVertexNormals(ale::ViewMesh &_mesh, size_t firstIndex);
     const int _getNumEdgesInMesh(const ViewMesh &_mesh);
 
     // TinyGlTF methods
@@ -56,6 +61,7 @@ private:
     int _loadNodesGLTF(const tinygltf::Model &in_model, ale::Model &out_model);
     int _loadTextureGLTF(const tinygltf::Image &in_texture, ale::Image &out_texture);
     void _bindNodeGLTF(const tinygltf::Model &in_model, const tinygltf::Node &n, int parent, int current, ale::Model &out_model);
+    static int _loadNodeInstancesGLTF(const tinygltf::Model &in_model, const tinygltf::Node &n, ale::Node &out_node);
     static int _tryLoadMeshIndices(const tinygltf::Model& in_model, const tinygltf::Primitive& primitive, ale::ViewMesh& out_mesh);
     static int _loadMaterialsGLTF(const tinygltf::Model& in_model, ale::Model& out_model);
 
@@ -87,15 +87,27 @@ struct Material {
     int normalTexIdx{-1};
     int emissiveTexIdx{-1};
     int occlusionTexIdx{-1};
+    // Disables backface culling for the material
+    bool bDoubleSided{false};
     //TODO: Extend material with more pbr properties
 };
 
 
+// A simplified version of a primitive, indices are in ViewMesh::lodIndices
+struct PrimitiveLod {
+    size_t offsetIdx;
+    size_t size;
+    // Mesh space distance the level may deviate from the full primitive
+    float error;
+};
+
 // Primitives bind materials to parts of the mesh
 struct Primitive {
     int materialID;
     size_t offsetIdx;
     size_t size;
+    // Coarser levels, ordered by increasing error
+    std::vector<PrimitiveLod> lods{};
     // TODO: Extend with actual primitive properties
 };
 
@@ -108,6 +120,9 @@ struct ViewMesh {
     std::vector<float> minPos{};
     std::vector<float> maxPos{};
     std::vector<Primitive> primitives;
+    // Index ranges of Primitive::lods. They refer to the vertices above
+    // and go stale if the topology of the mesh changes
+    std::vector<uint32_t> lodIndices{};
 };
 
 
@@ -119,6 +134,9 @@ struct Node {
     int meshIdx = -1;
     std::vector<int> children{};
     bool bVisible = true;
+    // Local transforms of mesh instances (EXT_mesh_gpu_instancing).
+    // If not empty, the mesh is drawn once per transform
+    std::vector<glm::mat4> instanceTransforms{};
 };
 
 // TODO: Might be good to move Model to a separate TU and link both re_mesh
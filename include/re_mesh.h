@@ -16,6 +16,7 @@
 #pragma once
 #include <vector>
 #include <unordered_set>
+#include <cstdint>
 
 #ifndef GLM
 #define GLM
@@ -43,6 +44,10 @@ struct Loop;
 struct Face;
 
 
+// viewId of vertices that are not drawn, e.g. not part of any face yet
+const size_t NO_VIEW_ID = SIZE_MAX;
+
+
 struct Vert {
     glm::vec3 pos;
     glm::vec3 color;
@@ -99,6 +104,10 @@ struct Loop {
     Loop *radial_prev, *radial_next;
     // Loops forming a face
     Loop *prev, *next;
+    // Per face corner UVs. Corners of a vertex differ on UV seams
+    glm::vec2 texCoord;
+    // ViewMesh vertex the corner is drawn with
+    size_t viewId;
     size_t id;
 
     bool operator==(const Loop& other) const {
@@ -125,6 +134,8 @@ struct Face {
     glm::vec3 *nor;
     size_t id;
     unsigned int size;
+    // ViewMesh primitive the face belongs to
+    size_t primitiveId;
 
 	bool operator==(const Face& other) const {
         return (*loop->v == *other.loop->v);
@@ -132,10 +143,36 @@ struct Face {
 };
 
 
+// Immutable view of a REMesh that shares its pool pages, see ale::Pool.
+// Element pointers of the snapshot still point into the live mesh, get()
+// returns the element they pointed to when the snapshot was taken
+struct REMeshSnapshot {
+    size_t id = 0;
+    ale::PoolSnapshot<Face> faces;
+    ale::PoolSnapshot<Edge> edges;
+    ale::PoolSnapshot<Loop> loops;
+    ale::PoolSnapshot<Vert> verts;
+    ale::PoolSnapshot<Disk> disks;
+
+    Face get(const Face* f) const { return faces.get(f); }
+    Edge get(const Edge* e) const { return edges.get(e); }
+    Loop get(const Loop* l) const { return loops.get(l); }
+    Vert get(const Vert* v) const { return verts.get(v); }
+    Disk get(const Disk* d) const { return disks.get(d); }
+};
+
+
 // TODO: this is a boilerplate mesh class, it must be extended
 class REMesh {
 public:
+    REMesh() = default;
     ~REMesh() {}
+    // Elements point into the pools, moving keeps them valid
+    REMesh(REMesh&&) = default;
+    REMesh& operator=(REMesh&&) = default;
+    REMesh(const REMesh&) = delete;
+    REMesh& operator=(const REMesh&) = delete;
+
     size_t id;
     ale::Pool<Face> facesPool;
     ale::Pool<Edge> edgesPool;
@@ -147,6 +184,69 @@ public:
     std::vector<Loop*> loops;
     std::vector<Vert*> verts;
     std::vector<Disk*> disks;
+
+    // Pool ids of elements killed by Euler operators. They stay in the
+    // vectors above until compactMesh() removes and releases them
+    std::vector<size_t> killedFaces;
+    std::vector<size_t> killedEdges;
+    std::vector<size_t> killedLoops;
+    std::vector<size_t> killedVerts;
+    std::vector<size_t> killedDisks;
+
+    // Vertices moved since the last GPU sync. Edits push the vertices they
+    // move, the renderer uploads only their view vertices
+    std::vector<Vert*> dirtyVerts;
+    // View vertices an edit wrote itself, uploaded without a lookup
+    std::vector<size_t> dirtyViewIds;
+
+
+    // Edits call these before they write to elements, so snapshots keep
+    // the old data. Edits prepare the elements they change, only edits
+    // that rewrite most of the mesh prepare all of it
+    void prepareWrite(const Vert* v) {
+        vertsPool.prepareWrite(v->id);
+    }
+
+    void prepareWrite(const Edge* e) {
+        edgesPool.prepareWrite(e->id);
+    }
+
+    void prepareWrite(const Face* f) {
+        facesPool.prepareWrite(f->id);
+    }
+
+    void prepareWrite(const Loop* l) {
+        loopsPool.prepareWrite(l->id);
+    }
+
+    void prepareWrite(const Disk* d) {
+        disksPool.prepareWrite(d->id);
+    }
+
+    void prepareTopologyWrite() {
+        facesPool.prepareWriteAll();
+        edgesPool.prepareWriteAll();
+        loopsPool.prepareWriteAll();
+        vertsPool.prepareWriteAll();
+        disksPool.prepareWriteAll();
+    }
+
+    // O(pages). Take it between edits, killed elements that are not
+    // compacted yet are part of the snapshot
+    REMeshSnapshot snapshot() {
+        if (!killedFaces.empty() || !killedEdges.empty() || !killedLoops.empty() ||
+            !killedVerts.empty() || !killedDisks.empty()) {
+            trc::log("Snapshot of a mesh with killed elements", trc::WARNING);
+        }
+        return REMeshSnapshot {
+            .id = id,
+            .faces = facesPool.snapshot(),
+            .edges = edgesPool.snapshot(),
+            .loops = loopsPool.snapshot(),
+            .verts = vertsPool.snapshot(),
+            .disks = disksPool.snapshot(),
+        };
+    }
 };
 
 } // namespace geo
@@ -0,0 +1,351 @@
+/*
+    Bounding volume hierarchy over the faces of a REMesh.
+
+    Faces are split at the median of their centers along the widest axis
+    until a leaf holds at most BVH_LEAF_FACES faces. Leaves keep:
+    - their faces
+    - the vertices they own. A vertex is owned by the first leaf with one
+      of its faces, so the owned vertices of all leaves are every vertex
+      once and leaves can be updated in parallel
+    - all vertices of their faces, for bounds and normals
+    A leaf contains its owned vertices, so a sphere query that returns
+    the leaves it touches finds every vertex within the sphere.
+
+    Moving vertices keeps the tree valid after refit(), the split of the
+    faces does not change. Changes of the connectivity need a new build.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+#include <glm/gtx/intersect.hpp>
+
+//int
+#include <re_mesh.h>
+#include <ale_thread_pool.h>
+
+#ifndef ALE_REMESH_BVH
+#define ALE_REMESH_BVH
+
+namespace ale {
+namespace geo {
+
+const size_t BVH_LEAF_FACES = 256;
+
+
+struct BVHNode {
+    glm::vec3 lo;
+    glm::vec3 hi;
+    // Children of inner nodes, always after their parent
+    uint32_t left = 0;
+    uint32_t right = 0;
+    uint32_t firstFace = 0;
+    uint32_t faceCount = 0;
+    uint32_t firstVert = 0;
+    uint32_t vertCount = 0;
+    uint32_t firstCorner = 0;
+    uint32_t cornerCount = 0;
+
+    bool isLeaf() const {
+        return left == 0;
+    }
+};
+
+
+class MeshBVH {
+public:
+    void build(REMesh& mesh) {
+        clear();
+        if (mesh.faces.empty()) {
+            return;
+        }
+        _faces = mesh.faces;
+        std::vector<glm::vec3> centers(mesh.facesPool.getCapacity());
+        for (auto f : _faces) {
+            glm::vec3 sum(0);
+            auto l = f->loop;
+            do {
+                sum += l->v->pos;
+                l = l->next;
+            } while (l != f->loop);
+            centers[f->id] = sum / float(f->size);
+        }
+
+        // Ranges of _faces are split in place, depth first
+        struct Range {
+            uint32_t node, begin, end;
+        };
+        std::vector<Range> stack = {{0, 0, static_cast<uint32_t>(_faces.size())}};
+        _nodes.emplace_back();
+        while (!stack.empty()) {
+            auto [node, begin, end] = stack.back();
+            stack.pop_back();
+            if (end - begin <= BVH_LEAF_FACES) {
+                _nodes[node].firstFace = begin;
+                _nodes[node].faceCount = end - begin;
+                _leaves.push_back(node);
+                continue;
+            }
+
+            glm::vec3 lo(std::numeric_limits<float>::max());
+            glm::vec3 hi(std::numeric_limits<float>::lowest());
+            for (uint32_t i = begin; i < end; i++) {
+                lo = glm::min(lo, centers[_faces[i]->id]);
+                hi = glm::max(hi, centers[_faces[i]->id]);
+            }
+            glm::vec3 extent = hi - lo;
+            int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+            uint32_t mid = begin + (end - begin) / 2;
+            std::nth_element(_faces.begin() + begin, _faces.begin() + mid, _faces.begin() + end,
+                             [&](const Face* a, const Face* b) {
+                                 return centers[a->id][axis] < centers[b->id][axis];
+                             });
+
+            uint32_t left = static_cast<uint32_t>(_nodes.size());
+            _nodes.emplace_back();
+            _nodes.emplace_back();
+            _nodes[node].left = left;
+            _nodes[node].right = left + 1;
+            stack.push_back({left + 1, mid, end});
+            stack.push_back({left, begin, mid});
+        }
+
+        _faceLoopOffsets.resize(_faces.size() + 1);
+        _faceLoopOffsets[0] = 0;
+        for (size_t i = 0; i < _faces.size(); i++) {
+            _faceLoopOffsets[i + 1] = _faceLoopOffsets[i] + static_cast<uint32_t>(_faces[i]->size);
+        }
+        _faceLoops.resize(_faceLoopOffsets.back());
+        for (size_t i = 0; i < _faces.size(); i++) {
+            uint32_t k = _faceLoopOffsets[i];
+            auto l = _faces[i]->loop;
+            do {
+                _faceLoops[k++] = l;
+                l = l->next;
+            } while (l != _faces[i]->loop);
+        }
+
+        const uint32_t NONE = UINT32_MAX;
+        std::vector<uint32_t> owner(mesh.vertsPool.getCapacity(), NONE);
+        std::vector<uint32_t> seen(mesh.vertsPool.getCapacity(), NONE);
+        _leafOf.assign(mesh.facesPool.getCapacity(), NONE);
+        for (auto leaf : _leaves) {
+            auto& node = _nodes[leaf];
+            node.firstVert = static_cast<uint32_t>(_verts.size());
+            node.firstCorner = static_cast<uint32_t>(_corners.size());
+            for (auto f : getFaces(leaf)) {
+                _leafOf[f->id] = leaf;
+                auto l = f->loop;
+                do {
+                    size_t id = l->v->id;
+                    if (owner[id] == NONE) {
+                        owner[id] = leaf;
+                        _verts.push_back(l->v);
+                    }
+                    if (seen[id] != leaf) {
+                        seen[id] = leaf;
+                        _corners.push_back(l->v);
+                    }
+                    l = l->next;
+                } while (l != f->loop);
+            }
+            node.vertCount = static_cast<uint32_t>(_verts.size()) - node.firstVert;
+            node.cornerCount = static_cast<uint32_t>(_corners.size()) - node.firstCorner;
+        }
+
+        // Vertices without faces are in no leaf, sculpting skips them
+        for (auto leaf : _leaves) {
+            _refitLeaf(leaf);
+        }
+        _refitInner();
+    }
+
+    void clear() {
+        _nodes.clear();
+        _leaves.clear();
+        _faces.clear();
+        _verts.clear();
+        _corners.clear();
+        _faceLoops.clear();
+        _faceLoopOffsets.clear();
+        _leafOf.clear();
+    }
+
+    bool isEmpty() const {
+        return _nodes.empty();
+    }
+
+    const BVHNode& getNode(uint32_t node) const {
+        return _nodes[node];
+    }
+
+    std::span<const uint32_t> getLeaves() const {
+        return _leaves;
+    }
+
+    // Leaf of a face of the mesh at the time of the build
+    uint32_t getLeaf(const Face* f) const {
+        return _leafOf[f->id];
+    }
+
+    std::span<Face* const> getFaces(uint32_t leaf) const {
+        auto& node = _nodes[leaf];
+        return std::span<Face* const>(_faces).subspan(node.firstFace, node.faceCount);
+    }
+
+    // Loops of the face k of a leaf, from Face::loop on
+    std::span<Loop* const> getFaceLoops(uint32_t leaf, size_t k) const {
+        size_t i = _nodes[leaf].firstFace + k;
+        return std::span<Loop* const>(_faceLoops).subspan(
+            _faceLoopOffsets[i], _faceLoopOffsets[i + 1] - _faceLoopOffsets[i]);
+    }
+
+    std::span<Vert* const> getOwnedVerts(uint32_t leaf) const {
+        auto& node = _nodes[leaf];
+        return std::span<Vert* const>(_verts).subspan(node.firstVert, node.vertCount);
+    }
+
+    std::span<Vert* const> getCornerVerts(uint32_t leaf) const {
+        auto& node = _nodes[leaf];
+        return std::span<Vert* const>(_corners).subspan(node.firstCorner, node.cornerCount);
+    }
+
+    // Leaves with bounds within radius of the center
+    void queryLeaves(const glm::vec3& center, float radius, std::vector<uint32_t>& out_leaves) const {
+        out_leaves.clear();
+        if (_nodes.empty()) {
+            return;
+        }
+        float r2 = radius * radius;
+        uint32_t stack[64];
+        size_t top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t idx = stack[--top];
+            auto& node = _nodes[idx];
+            glm::vec3 d = center - glm::clamp(center, node.lo, node.hi);
+            if (glm::dot(d, d) > r2) {
+                continue;
+            }
+            if (node.isLeaf()) {
+                out_leaves.push_back(idx);
+            } else {
+                stack[top++] = node.right;
+                stack[top++] = node.left;
+            }
+        }
+    }
+
+    // Nearest face hit by the ray, faces are fan triangulated
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir,
+                 float& out_dist, Face*& out_face) const {
+        out_dist = std::numeric_limits<float>::max();
+        out_face = nullptr;
+        if (_nodes.empty()) {
+            return false;
+        }
+        glm::vec3 invDir = 1.0f / dir;
+        uint32_t stack[64];
+        size_t top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t idx = stack[--top];
+            auto& node = _nodes[idx];
+            if (!_hitsBounds(node, origin, invDir, out_dist)) {
+                continue;
+            }
+            if (!node.isLeaf()) {
+                stack[top++] = node.right;
+                stack[top++] = node.left;
+                continue;
+            }
+            for (auto f : getFaces(idx)) {
+                const glm::vec3& a = f->loop->v->pos;
+                for (auto l = f->loop->next; l->next != f->loop; l = l->next) {
+                    glm::vec2 bary;
+                    float dist;
+                    if (glm::intersectRayTriangle(origin, dir, a, l->v->pos, l->next->v->pos, bary, dist) &&
+                        dist < out_dist) {
+                        out_dist = dist;
+                        out_face = f;
+                    }
+                }
+            }
+        }
+        return out_face != nullptr;
+    }
+
+    // Bounds of the leaves from their vertices, then of all inner nodes
+    void refit(std::span<const uint32_t> leaves, ThreadPool& threads) {
+        threads.parallelFor(leaves.size(), 4, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                _refitLeaf(leaves[i]);
+            }
+        });
+        _refitInner();
+    }
+
+private:
+    std::vector<BVHNode> _nodes;
+    std::vector<uint32_t> _leaves;
+    std::vector<Face*> _faces;
+    std::vector<Vert*> _verts;
+    std::vector<Vert*> _corners;
+    // Loops of _faces[i] start at _faceLoopOffsets[i]
+    std::vector<Loop*> _faceLoops;
+    std::vector<uint32_t> _faceLoopOffsets;
+    // Leaf by face pool id
+    std::vector<uint32_t> _leafOf;
+
+
+    void _refitLeaf(uint32_t leaf) {
+        auto& node = _nodes[leaf];
+        node.lo = glm::vec3(std::numeric_limits<float>::max());
+        node.hi = glm::vec3(std::numeric_limits<float>::lowest());
+        for (auto v : getCornerVerts(leaf)) {
+            node.lo = glm::min(node.lo, v->pos);
+            node.hi = glm::max(node.hi, v->pos);
+        }
+    }
+
+    // Children follow their parents, so a reverse pass sees them first
+    void _refitInner() {
+        for (size_t i = _nodes.size(); i-- > 0;) {
+            auto& node = _nodes[i];
+            if (!node.isLeaf()) {
+                node.lo = glm::min(_nodes[node.left].lo, _nodes[node.right].lo);
+                node.hi = glm::max(_nodes[node.left].hi, _nodes[node.right].hi);
+            }
+        }
+    }
+
+    // Slab test, misses bounds behind the nearest hit so far
+    static bool _hitsBounds(const BVHNode& node, const glm::vec3& origin,
+                            const glm::vec3& invDir, float maxDist) {
+        glm::vec3 t1 = (node.lo - origin) * invDir;
+        glm::vec3 t2 = (node.hi - origin) * invDir;
+        glm::vec3 tMin = glm::min(t1, t2);
+        glm::vec3 tMax = glm::max(t1, t2);
+        float enter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+        float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDist));
+        return enter <= exit;
+    }
+};
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_BVH
@@ -0,0 +1,701 @@
+/*
+    Quadric error edge collapse on REMesh.
+
+    A collapse merges one vertex of an edge into the other one and does
+    not move it, same as ale_mesh_lod.h:
+    - the error is the distance of the kept vertex to the planes of the
+      faces merged into it, plus the UV difference of both vertices
+    - vertices on open borders, UV seams, primitive borders, non-manifold
+      edges and non-triangle faces are never removed
+    - collapses that break the link condition or flip a face are rejected
+
+    Collapses are chosen in passes over flat triangle arrays like
+    simplifyIndices(): edge costs are computed in parallel, edges within
+    the cost of the cheapest DECIMATE_PASS_SHARE collapse while no other
+    collapse of the pass touched their triangles. The REMesh takes the
+    result at the end: faces and loops that are left are kept, edges are
+    moved or removed and radial and disk cycles linked again. Removed
+    elements are released to the mesh pools.
+
+    Reference:
+    https://www.cs.cmu.edu/~garland/Papers/quadrics.pdf
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <re_mesh.h>
+#include <ale_geo_utils.h>
+#include <ale_mesh_lod.h>
+#include <ale_thread_pool.h>
+#include <tracer.h>
+
+#ifndef ALE_REMESH_DECIMATE
+#define ALE_REMESH_DECIMATE
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace geo {
+
+// Share of the cheapest edges a pass considers. Less keeps the error
+// closer to one collapse at a time, more needs fewer passes
+const float DECIMATE_PASS_SHARE = 0.1f;
+// Edge costs sampled for the cost limit of a pass
+const size_t DECIMATE_PASS_SAMPLES = 65536;
+
+
+struct DecimateResult {
+    size_t facesBefore = 0;
+    size_t facesAfter = 0;
+    size_t collapses = 0;
+    size_t passes = 0;
+    // Largest error of the applied collapses in mesh units
+    float error = 0;
+};
+
+
+/*
+    Collapses edges of a triangle REMesh until it has at most targetFaces
+    faces or no valid collapse is left. progress receives values in [0, 1].
+    Pointers to removed elements are invalid afterwards, the ViewMesh must
+    be rebuilt with rebuildViewMesh()
+*/
+[[maybe_unused]]
+static DecimateResult decimate(REMesh& mesh, size_t targetFaces, ThreadPool& threads,
+                               std::function<void(float)> progress = nullptr) {
+    DecimateResult result;
+    result.facesBefore = mesh.faces.size();
+    result.facesAfter = mesh.faces.size();
+    if (mesh.faces.size() <= targetFaces || mesh.verts.empty()) {
+        return result;
+    }
+    // Collapses reach most of the mesh, all pages are copied at once
+    mesh.prepareTopologyWrite();
+
+    // Elements are indexed by their pool ids
+    auto getIdCount = [](const auto& elements) {
+        size_t count = 0;
+        for (auto el : elements) {
+            count = std::max(count, el->id + 1);
+        }
+        return count;
+    };
+    size_t vertCount = getIdCount(mesh.verts);
+    size_t edgeCount = getIdCount(mesh.edges);
+
+    std::vector<Vert*> vertById(vertCount, nullptr);
+    for (auto v : mesh.verts) {
+        vertById[v->id] = v;
+    }
+
+    std::vector<bool> deadVerts(vertCount, false);
+    std::vector<bool> deadEdges(edgeCount, false);
+    std::vector<bool> deadLoops(getIdCount(mesh.loops), false);
+    std::vector<bool> deadFaces(getIdCount(mesh.faces), false);
+    std::vector<bool> deadDisks(getIdCount(mesh.disks), false);
+
+    // Corner of a face at vertex v. l is the loop of the face on an edge of v
+    auto getCorner = [](Loop* l, const Vert* v) {
+        return l->v == v ? l : l->next;
+    };
+
+    auto getRadialCount = [](const Edge* e) {
+        if (!e->loop) {
+            return 0;
+        }
+        int count = 1;
+        for (auto l = e->loop->radial_next; l != e->loop; l = l->radial_next) {
+            count++;
+        }
+        return count;
+    };
+
+    // Calls fn for each edge in the disk cycle of v
+    auto forEachDiskEdge = [](Vert* v, auto&& fn) {
+        Edge* first = v->edge;
+        if (!first) {
+            return;
+        }
+        Edge* e = first;
+        do {
+            Edge* next = getDisk(e, v)->next;
+            fn(e);
+            e = next;
+        } while (e != first);
+    };
+
+    // Vertices that can not be removed. Vertices with an edge outside of
+    // the triangles can not take collapses either, the passes only see
+    // the triangles
+    std::vector<uint8_t> locked(vertCount, 0);
+    std::vector<uint8_t> blocked(vertCount, 0);
+    for (auto e : mesh.edges) {
+        int radial = getRadialCount(e);
+        bool bLock = radial != 2;
+        bool bBlock = radial == 0;
+        for (auto l = e->loop; l && !bBlock; l = l->radial_next == e->loop ? nullptr : l->radial_next) {
+            bBlock = l->f->size != 3;
+        }
+        if (!bLock) {
+            Loop* l1 = e->loop;
+            Loop* l2 = e->loop->radial_next;
+            bLock = bBlock ||
+                    l1->f->primitiveId != l2->f->primitiveId ||
+                    getCorner(l1, e->v1)->texCoord != getCorner(l2, e->v1)->texCoord ||
+                    getCorner(l1, e->v2)->texCoord != getCorner(l2, e->v2)->texCoord;
+        }
+        if (bLock) {
+            locked[e->v1->id] = 1;
+            locked[e->v2->id] = 1;
+        }
+        if (bBlock) {
+            blocked[e->v1->id] = 1;
+            blocked[e->v2->id] = 1;
+        }
+    }
+
+    // Vertices joining several fans (bowties) are locked too. A manifold
+    // fan is walked around in as many steps as the vertex has edges
+    std::vector<uint32_t> valences(vertCount, 0);
+    for (auto v : mesh.verts) {
+        size_t valence = 0;
+        forEachDiskEdge(v, [&](Edge*) { valence++; });
+        valences[v->id] = static_cast<uint32_t>(valence);
+        if (locked[v->id] || !v->edge || !v->edge->loop) {
+            locked[v->id] = 1;
+            continue;
+        }
+
+        Loop* start = getCorner(v->edge->loop, v);
+        Loop* l = start;
+        size_t steps = 0;
+        do {
+            Loop* across = l->prev->radial_next;
+            l = getCorner(across, v);
+            steps++;
+        } while (l != start && steps <= valence);
+
+        locked[v->id] = steps != valence;
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    std::vector<glm::vec3> positions(vertCount);
+    for (auto v : mesh.verts) {
+        positions[v->id] = v->pos;
+        min = glm::min(min, v->pos);
+        max = glm::max(max, v->pos);
+    }
+    double attributeScale = MESH_LOD_ATTRIBUTE_WEIGHT * glm::length(max - min);
+    attributeScale *= attributeScale;
+
+    // Triangles as flat corner arrays, three per triangle in face order
+    std::vector<Face*> triFaces;
+    std::vector<uint32_t> corners;
+    std::vector<glm::vec2> cornerUvs;
+    std::vector<size_t> cornerViewIds;
+    triFaces.reserve(mesh.faces.size());
+    corners.reserve(3 * mesh.faces.size());
+    cornerUvs.reserve(3 * mesh.faces.size());
+    cornerViewIds.reserve(3 * mesh.faces.size());
+
+    // Plane of a face through its first three corners, weighted by area
+    auto getPlane = [](glm::dvec3 p0, glm::dvec3 p1, glm::dvec3 p2, Quadric& out_quadric) {
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(n);
+        if (area <= 0) {
+            return false;
+        }
+        n /= area;
+        out_quadric = Quadric::fromPlane(n, -glm::dot(n, p0), area);
+        return true;
+    };
+
+    // Other faces add their planes here, triangles after the adjacency
+    std::vector<Quadric> quadrics(vertCount);
+    for (auto f : mesh.faces) {
+        Loop* l = f->loop;
+        if (f->size == 3) {
+            triFaces.push_back(f);
+            for (Loop* c : {l, l->next, l->prev}) {
+                corners.push_back(static_cast<uint32_t>(c->v->id));
+                cornerUvs.push_back(c->texCoord);
+                cornerViewIds.push_back(c->viewId);
+            }
+            continue;
+        }
+
+        Quadric q;
+        if (!getPlane(l->v->pos, l->next->v->pos, l->prev->v->pos, q)) {
+            continue;
+        }
+        Loop* it = l;
+        do {
+            quadrics[it->v->id] += q;
+            it = it->next;
+        } while (it != l);
+    }
+
+    auto getCost = [&](uint32_t from, uint32_t to, size_t fromCorner, size_t toCorner) {
+        // Evaluated apart, the sum of both quadrics is not copied
+        const Quadric& qFrom = quadrics[from];
+        const Quadric& qTo = quadrics[to];
+        double w = qFrom.w + qTo.w;
+        glm::dvec3 p = positions[to];
+        double cost = w > 0 ? (qFrom.evaluate(p) + qTo.evaluate(p)) / w : 0;
+
+        glm::vec2 dUv = cornerUvs[fromCorner] - cornerUvs[toCorner];
+        return cost + glm::dot(dUv, dUv) * attributeScale;
+    };
+
+    auto getNext = [](size_t corner) {
+        return corner % 3 == 2 ? corner - 2 : corner + 1;
+    };
+
+    // Collapse along the edge from a corner to the next one of its
+    // triangle. DIRECTION_BIT marks a collapse of the next corner
+    const uint32_t DIRECTION_BIT = 1u << 31;
+    struct Collapse {
+        float cost;
+        uint32_t corner;
+    };
+    const float NO_COLLAPSE = std::numeric_limits<float>::infinity();
+
+    std::vector<Collapse> edgeCosts;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> triOffsets(vertCount + 1);
+    std::vector<uint32_t> fill(vertCount);
+    std::vector<uint32_t> vertTris;
+    std::vector<uint32_t> remap(vertCount);
+    std::vector<uint8_t> touched(vertCount, 0);
+    std::vector<uint8_t> changed(vertCount, 0);
+    for (uint32_t v = 0; v < vertCount; v++) {
+        remap[v] = v;
+    }
+    const uint32_t NONE = UINT32_MAX;
+    // Vertex each removed vertex was merged into
+    std::vector<uint32_t> mergedInto(vertCount, NONE);
+
+    // Generation marks for the link condition
+    std::vector<uint32_t> marks(vertCount, 0);
+    uint32_t mark = 0;
+
+    uint32_t opposite[2];
+
+    // Link condition, valence of the opposite vertices and flips, from the
+    // triangles of this pass. Vertices of both are not touched yet, so
+    // their triangles are current
+    auto canCollapse = [&](uint32_t from, uint32_t to) {
+        if (mark > UINT32_MAX - 2) {
+            std::fill(marks.begin(), marks.end(), 0);
+            mark = 0;
+        }
+        mark += 2;
+        size_t merged = 0;
+        for (uint32_t i = triOffsets[from]; i < triOffsets[from + 1]; i++) {
+            const uint32_t* tri = &corners[vertTris[i] * 3];
+            for (size_t k = 0; k < 3; k++) {
+                marks[tri[k]] = mark;
+            }
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                if (merged == 2) {
+                    return false;
+                }
+                opposite[merged++] = tri[0] ^ tri[1] ^ tri[2] ^ from ^ to;
+            }
+        }
+        if (merged != 2 || opposite[0] == opposite[1]) {
+            return false;
+        }
+
+        // Shared neighbours other than the opposite vertices would double
+        // an edge
+        size_t shared = 0;
+        for (uint32_t i = triOffsets[to]; i < triOffsets[to + 1]; i++) {
+            const uint32_t* tri = &corners[vertTris[i] * 3];
+            for (size_t k = 0; k < 3; k++) {
+                if (marks[tri[k]] == mark && tri[k] != from && tri[k] != to) {
+                    marks[tri[k]] = mark + 1;
+                    shared++;
+                }
+            }
+        }
+        if (shared != 2) {
+            return false;
+        }
+
+        // Opposite vertices lose an edge. Less than three leaves a
+        // degenerate fan
+        if (valences[opposite[0]] <= 3 || valences[opposite[1]] <= 3) {
+            return false;
+        }
+
+        // Triangles around from keep their orientation when it moves to to
+        const glm::vec3& target = positions[to];
+        for (uint32_t i = triOffsets[from]; i < triOffsets[from + 1]; i++) {
+            const uint32_t* tri = &corners[vertTris[i] * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                continue;
+            }
+            size_t k = tri[0] == from ? 0 : tri[1] == from ? 1 : 2;
+            const glm::vec3& pa = positions[from];
+            const glm::vec3& pb = positions[tri[(k + 1) % 3]];
+            const glm::vec3& pc = positions[tri[(k + 2) % 3]];
+            glm::vec3 before = glm::cross(pb - pa, pc - pa);
+            glm::vec3 after = glm::cross(pb - target, pc - target);
+            if (glm::dot(before, after) <= 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Vertex to triangle adjacency, built again after every pass
+    auto buildAdjacency = [&]() {
+        std::fill(triOffsets.begin(), triOffsets.end(), 0);
+        for (uint32_t v : corners) {
+            triOffsets[v + 1]++;
+        }
+        for (size_t v = 0; v < vertCount; v++) {
+            triOffsets[v + 1] += triOffsets[v];
+        }
+        vertTris.resize(corners.size());
+        std::copy(triOffsets.begin(), triOffsets.end() - 1, fill.begin());
+        for (size_t t = 0; t < corners.size() / 3; t++) {
+            for (size_t k = 0; k < 3; k++) {
+                vertTris[fill[corners[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+    };
+    buildAdjacency();
+
+    // Each vertex sums the planes of its triangles, so vertices are
+    // independent
+    threads.parallelFor(vertCount, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t v = begin; v < end; v++) {
+            for (uint32_t i = triOffsets[v]; i < triOffsets[v + 1]; i++) {
+                const uint32_t* tri = &corners[vertTris[i] * 3];
+                Quadric q;
+                if (getPlane(positions[tri[0]], positions[tri[1]], positions[tri[2]], q)) {
+                    quadrics[v] += q;
+                }
+            }
+        }
+    });
+
+    size_t faceCount = mesh.faces.size();
+    size_t toRemove = faceCount - targetFaces;
+    double maxCost = 0;
+    std::vector<float> samples;
+    bool bAllCandidates = false;
+
+    while (faceCount > targetFaces) {
+        result.passes++;
+
+        // Cheapest direction of every edge. An inner edge is seen from
+        // both of its triangles, the one where it goes to a higher id
+        // keeps it. Costs only change around vertices that took a merge,
+        // the others move with their corners
+        bool bAll = edgeCosts.empty();
+        edgeCosts.resize(corners.size());
+        threads.parallelFor(corners.size(), 16384, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                size_t next = getNext(i);
+                uint32_t a = corners[i];
+                uint32_t b = corners[next];
+                if (!bAll && !changed[a] && !changed[b]) {
+                    continue;
+                }
+                float cost = NO_COLLAPSE;
+                uint32_t corner = static_cast<uint32_t>(i);
+                if (a < b) {
+                    if (!locked[a] && !blocked[b]) {
+                        cost = static_cast<float>(getCost(a, b, i, next));
+                    }
+                    if (!locked[b] && !blocked[a]) {
+                        float other = static_cast<float>(getCost(b, a, next, i));
+                        if (other < cost) {
+                            cost = other;
+                            corner |= DIRECTION_BIT;
+                        }
+                    }
+                }
+                edgeCosts[i] = {cost, corner};
+            }
+        });
+
+        std::fill(changed.begin(), changed.end(), 0);
+
+        // The pass takes the edges up to the cost of the cheapest share,
+        // estimated from a sample. They are tried in memory order, which
+        // keeps the error close to cost order at a fraction of the time
+        size_t stride = std::max<size_t>(1, edgeCosts.size() / DECIMATE_PASS_SAMPLES);
+        samples.clear();
+        for (size_t i = 0; i < edgeCosts.size(); i += stride) {
+            if (edgeCosts[i].cost != NO_COLLAPSE) {
+                samples.push_back(edgeCosts[i].cost);
+            }
+        }
+        float threshold = NO_COLLAPSE;
+        if (!bAllCandidates && samples.size() * DECIMATE_PASS_SHARE >= 1) {
+            auto nth = samples.begin() + static_cast<size_t>(samples.size() * DECIMATE_PASS_SHARE);
+            std::nth_element(samples.begin(), nth, samples.end());
+            threshold = *nth;
+        }
+        collapses.clear();
+        for (auto& c : edgeCosts) {
+            if (c.cost <= threshold && c.cost != NO_COLLAPSE) {
+                collapses.push_back(c);
+            }
+        }
+
+        // Every collapse removes two triangles
+        size_t removed = 0;
+        for (const Collapse& c : collapses) {
+            if (faceCount - removed <= targetFaces) {
+                break;
+            }
+            size_t i = c.corner & ~DIRECTION_BIT;
+            size_t next = getNext(i);
+            bool bNext = c.corner & DIRECTION_BIT;
+            uint32_t from = corners[bNext ? next : i];
+            uint32_t to = corners[bNext ? i : next];
+            if (touched[from] || touched[to] || !canCollapse(from, to)) {
+                continue;
+            }
+
+            // Corners of from take the UV and view vertex of to on the
+            // collapsed edge
+            glm::vec2 wedgeUv = cornerUvs[bNext ? i : next];
+            size_t wedgeViewId = cornerViewIds[bNext ? i : next];
+            for (uint32_t k = triOffsets[from]; k < triOffsets[from + 1]; k++) {
+                size_t t = vertTris[k] * 3;
+                for (size_t j = t; j < t + 3; j++) {
+                    touched[corners[j]] = 1;
+                    if (corners[j] == from) {
+                        cornerUvs[j] = wedgeUv;
+                        cornerViewIds[j] = wedgeViewId;
+                    }
+                }
+            }
+
+            remap[from] = to;
+            mergedInto[from] = to;
+            changed[to] = 1;
+            quadrics[to] += quadrics[from];
+            valences[to] = valences[to] + valences[from] - 4;
+            valences[opposite[0]]--;
+            valences[opposite[1]]--;
+            maxCost = std::max(maxCost, double(c.cost));
+            result.collapses++;
+            removed += 2;
+        }
+
+        // If none of the cheap edges could collapse, the next pass tries
+        // all of them before giving up
+        if (removed == 0) {
+            if (bAllCandidates || threshold == NO_COLLAPSE) {
+                break;
+            }
+            bAllCandidates = true;
+            continue;
+        }
+        bAllCandidates = false;
+        faceCount -= removed;
+
+        size_t write = 0;
+        for (size_t i = 0; i < corners.size(); i += 3) {
+            uint32_t a = remap[corners[i + 0]];
+            uint32_t b = remap[corners[i + 1]];
+            uint32_t c = remap[corners[i + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            triFaces[write / 3] = triFaces[i / 3];
+            corners[write] = a;
+            corners[write + 1] = b;
+            corners[write + 2] = c;
+            for (size_t k = 0; k < 3; k++) {
+                cornerUvs[write + k] = cornerUvs[i + k];
+                cornerViewIds[write + k] = cornerViewIds[i + k];
+                Collapse cost = edgeCosts[i + k];
+                cost.corner = static_cast<uint32_t>(write + k) | (cost.corner & DIRECTION_BIT);
+                edgeCosts[write + k] = cost;
+            }
+            write += 3;
+        }
+        triFaces.resize(write / 3);
+        corners.resize(write);
+        edgeCosts.resize(write);
+        cornerUvs.resize(write);
+        cornerViewIds.resize(write);
+        for (uint32_t v = 0; v < vertCount; v++) {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+        buildAdjacency();
+
+        if (progress) {
+            progress(0.9f * static_cast<float>(result.facesBefore - faceCount) / toRemove);
+        }
+    }
+
+    // The REMesh takes the result of all passes at once. Triangles that
+    // are left keep their faces and loops, edges of removed vertices move
+    // to the vertex they were merged into or are removed with the
+    // triangles between them. Radial and disk cycles are linked again
+    auto getFinal = [&](uint32_t v) {
+        uint32_t last = v;
+        while (mergedInto[last] != NONE) {
+            last = mergedInto[last];
+        }
+        while (mergedInto[v] != NONE) {
+            uint32_t next = mergedInto[v];
+            mergedInto[v] = last;
+            v = next;
+        }
+        return last;
+    };
+    std::vector<uint8_t> bMerged(vertCount, 0);
+    for (auto v : mesh.verts) {
+        if (mergedInto[v->id] != NONE) {
+            deadVerts[v->id] = true;
+            bMerged[getFinal(static_cast<uint32_t>(v->id))] = 1;
+        }
+    }
+
+    std::vector<uint8_t> bFaceLeft(deadFaces.size(), 0);
+    for (size_t t = 0; t < triFaces.size(); t++) {
+        Face* f = triFaces[t];
+        bFaceLeft[f->id] = 1;
+        Loop* l = f->loop;
+        for (size_t k = 3 * t; k < 3 * t + 3; k++) {
+            l->v = vertById[corners[k]];
+            l->texCoord = cornerUvs[k];
+            l->viewId = cornerViewIds[k];
+            l = l->next;
+        }
+    }
+    for (auto f : mesh.faces) {
+        if (f->size == 3 && !bFaceLeft[f->id]) {
+            deadFaces[f->id] = true;
+            Loop* l = f->loop;
+            do {
+                deadLoops[l->id] = true;
+                l = l->next;
+            } while (l != f->loop);
+        }
+    }
+
+    // Edges by their vertex ids, only around vertices that took merges
+    auto getKey = [](uint32_t a, uint32_t b) {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    };
+    std::unordered_map<uint64_t, Edge*> edgesByKey;
+    for (auto e : mesh.edges) {
+        uint32_t a = static_cast<uint32_t>(e->v1->id);
+        uint32_t b = static_cast<uint32_t>(e->v2->id);
+        if (!deadVerts[a] && !deadVerts[b] && (bMerged[a] || bMerged[b])) {
+            edgesByKey.emplace(getKey(a, b), e);
+        }
+    }
+    for (auto e : mesh.edges) {
+        uint32_t a = static_cast<uint32_t>(e->v1->id);
+        uint32_t b = static_cast<uint32_t>(e->v2->id);
+        if (!deadVerts[a] && !deadVerts[b]) {
+            continue;
+        }
+        a = getFinal(a);
+        b = getFinal(b);
+        if (a == b || !edgesByKey.emplace(getKey(a, b), e).second) {
+            deadEdges[e->id] = true;
+            deadDisks[e->d1->id] = true;
+            deadDisks[e->d2->id] = true;
+            continue;
+        }
+        e->v1 = vertById[a];
+        e->v2 = vertById[b];
+    }
+
+    for (auto v : mesh.verts) {
+        v->edge = nullptr;
+    }
+    for (auto e : mesh.edges) {
+        if (!deadEdges[e->id]) {
+            e->loop = nullptr;
+            addEdgeToDisk(mesh, e, e->v1);
+            addEdgeToDisk(mesh, e, e->v2);
+        }
+    }
+    for (auto f : mesh.faces) {
+        if (deadFaces[f->id]) {
+            continue;
+        }
+        Loop* l = f->loop;
+        do {
+            Vert* a = l->v;
+            Vert* b = l->next->v;
+            Edge* e = l->e;
+            if (deadEdges[e->id] || !((e->v1 == a && e->v2 == b) || (e->v1 == b && e->v2 == a))) {
+                e = edgesByKey.at(getKey(static_cast<uint32_t>(a->id), static_cast<uint32_t>(b->id)));
+                l->e = e;
+            }
+            addLoopToEdge(mesh, e, l);
+            l = l->next;
+        } while (l != f->loop);
+    }
+
+    // Release removed elements to the pools
+    auto compact = [](auto& elements, auto& pool, const std::vector<bool>& dead) {
+        std::erase_if(elements, [&](auto el) {
+            if (!dead[el->id]) {
+                return false;
+            }
+            pool.release(el->id);
+            return true;
+        });
+    };
+    compact(mesh.faces, mesh.facesPool, deadFaces);
+    compact(mesh.loops, mesh.loopsPool, deadLoops);
+    compact(mesh.edges, mesh.edgesPool, deadEdges);
+    compact(mesh.disks, mesh.disksPool, deadDisks);
+    compact(mesh.verts, mesh.vertsPool, deadVerts);
+
+    result.facesAfter = mesh.faces.size();
+    result.error = static_cast<float>(std::sqrt(maxCost));
+
+    if (progress) {
+        progress(1.0f);
+    }
+
+    char error[32];
+    snprintf(error, sizeof(error), "%.4g", result.error);
+    trc::log("REMesh " + std::to_string(mesh.id) + " decimated: " +
+             std::to_string(result.facesBefore) + " -> " + std::to_string(result.facesAfter) +
+             " faces in " + std::to_string(result.passes) + " passes, error " + error);
+    return result;
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_DECIMATE
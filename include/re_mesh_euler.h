@@ -0,0 +1,630 @@
+/*
+    Euler operators on REMesh.
+
+    Every operator changes a bounded neighbourhood of the mesh: new
+    elements come from the mesh pools and are appended to the element
+    vectors, killed elements are unlinked from all cycles and queued in
+    the killed lists of the mesh. compactMesh() drops killed elements from
+    the element vectors and releases them to the pools, call it once a
+    batch of edits is done. Until then killed elements must not be used.
+
+    - makeEdgeVert / killEdgeVert: a new vertex with an edge to an existing
+      one, and its inverse. killEdgeVert also joins the two edges of a
+      vertex with two edges (inverse of splitEdge)
+    - makeEdgeFace / killEdgeFace: split a face with a new edge between two
+      of its corners, and its inverse. joinFaces finds the shared edge
+    - splitEdge: a new vertex inside an edge, faces of the edge grow
+    - spliceVerts / spliceEdges: merge disk and radial cycles of two
+      vertices or two edges with the same vertices
+    - makeFace / killFace: a face on existing vertices, and its removal
+
+    Operators prepare every element they write, so snapshots of the mesh
+    keep their data and copy only the pages an edit touched. Operators
+    that would break the mesh return nullptr or false and change nothing.
+    New vertices have NO_VIEW_ID until the ViewMesh is rebuilt, new face
+    corners copy the view vertex of a neighbouring corner.
+
+    Reference:
+    https://wiki.blender.org/wiki/Source/Modeling/BMesh/Design
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <algorithm>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <re_mesh.h>
+#include <ale_geo_utils.h>
+#include <re_mesh_iterators.h>
+#include <tracer.h>
+
+#ifndef ALE_REMESH_EULER
+#define ALE_REMESH_EULER
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace geo {
+
+namespace euler {
+
+// Requests a zeroed element and appends it to the element vector
+template <class T>
+static T* newElement(Pool<T>& pool, std::vector<T*>& elems) {
+    size_t id;
+    T* e = pool.request(id);
+    *e = T{};
+    e->id = id;
+    elems.push_back(e);
+    return e;
+}
+
+// Drops killed elements from the element vector and releases them
+template <class T>
+static void compactElements(Pool<T>& pool, std::vector<T*>& elems, std::vector<size_t>& killed) {
+    if (killed.empty()) {
+        return;
+    }
+
+    size_t maxId = *std::max_element(killed.begin(), killed.end());
+    std::vector<bool> dead(maxId + 1, false);
+    for (auto id : killed) {
+        dead[id] = true;
+    }
+
+    std::erase_if(elems, [&](const T* e) { return e->id <= maxId && dead[e->id]; });
+    for (auto id : killed) {
+        pool.release(id);
+    }
+    killed.clear();
+}
+
+static void killLoop(REMesh& mesh, Loop* l) {
+    mesh.prepareWrite(l);
+    mesh.killedLoops.push_back(l->id);
+    l->f = nullptr;
+}
+
+static void killFaceOnly(REMesh& mesh, Face* f) {
+    mesh.prepareWrite(f);
+    mesh.killedFaces.push_back(f->id);
+    f->loop = nullptr;
+}
+
+// Unlinks an edge without loops from its disks and kills it
+static void killEdgeOnly(REMesh& mesh, Edge* e) {
+    assert(!e->loop);
+    removeEdgeFromDisk(mesh, e, e->v1);
+    removeEdgeFromDisk(mesh, e, e->v2);
+    mesh.killedDisks.push_back(e->d1->id);
+    mesh.killedDisks.push_back(e->d2->id);
+    mesh.killedEdges.push_back(e->id);
+    mesh.prepareWrite(e);
+    e->v1 = nullptr;
+    e->v2 = nullptr;
+}
+
+static void killVertOnly(REMesh& mesh, Vert* v) {
+    assert(!v->edge);
+    mesh.prepareWrite(v);
+    mesh.killedVerts.push_back(v->id);
+    v->viewId = NO_VIEW_ID;
+}
+
+static unsigned int countFaceLoops(Face* f) {
+    unsigned int size = 0;
+    auto l = f->loop;
+    do {
+        size++;
+        l = l->next;
+    } while (l != f->loop);
+    return size;
+}
+
+// Copies the corner attributes of src to a new corner of the same vertex
+static void copyCorner(Loop* dst, const Loop* src) {
+    dst->texCoord = src->texCoord;
+    dst->viewId = src->viewId;
+}
+
+} // namespace euler
+
+
+// Releases all killed elements. Pointers to them become invalid
+[[maybe_unused]]
+static void compactMesh(REMesh& mesh) {
+    euler::compactElements(mesh.facesPool, mesh.faces, mesh.killedFaces);
+    euler::compactElements(mesh.loopsPool, mesh.loops, mesh.killedLoops);
+    euler::compactElements(mesh.edgesPool, mesh.edges, mesh.killedEdges);
+    euler::compactElements(mesh.disksPool, mesh.disks, mesh.killedDisks);
+    euler::compactElements(mesh.vertsPool, mesh.verts, mesh.killedVerts);
+}
+
+
+// Edge between v1 and v2 or nullptr. Walks the disk of v1
+[[maybe_unused]]
+static Edge* findEdge(const Vert* v1, const Vert* v2) {
+    for (auto e : vertEdges(v1)) {
+        if (getOtherVert(e, v1) == v2) {
+            return e;
+        }
+    }
+    return nullptr;
+}
+
+
+[[maybe_unused]]
+static size_t getValence(const Vert* v) {
+    return std::ranges::distance(vertEdges(v));
+}
+
+
+// Isolated vertex
+[[maybe_unused]]
+static Vert* makeVert(REMesh& mesh, const glm::vec3& pos) {
+    auto v = euler::newElement(mesh.vertsPool, mesh.verts);
+    v->pos = pos;
+    v->viewId = NO_VIEW_ID;
+    return v;
+}
+
+
+// Wire edge between two different vertices. Does not check for an
+// existing edge, see findEdge()
+[[maybe_unused]]
+static Edge* makeEdge(REMesh& mesh, Vert* v1, Vert* v2) {
+    assert(v1 != v2);
+    auto e = euler::newElement(mesh.edgesPool, mesh.edges);
+    e->v1 = v1;
+    e->v2 = v2;
+    e->d1 = euler::newElement(mesh.disksPool, mesh.disks);
+    e->d2 = euler::newElement(mesh.disksPool, mesh.disks);
+    addEdgeToDisk(mesh, e, v1);
+    addEdgeToDisk(mesh, e, v2);
+    return e;
+}
+
+
+// MEV: a new vertex at pos connected to v by a wire edge
+[[maybe_unused]]
+static Vert* makeEdgeVert(REMesh& mesh, Vert* v, const glm::vec3& pos, Edge*& out_edge) {
+    auto nv = makeVert(mesh, pos);
+    nv->color = v->color;
+    nv->texCoord = v->texCoord;
+    out_edge = makeEdge(mesh, v, nv);
+    return nv;
+}
+
+
+/*
+    Inverse of makeEdgeVert() and splitEdge(). Kills v and e:
+    - v has only e, which is a wire edge: both are removed
+    - v has two edges: the other edge takes the place of e, faces around
+      v lose their corner at v. Faces must keep at least 3 corners and
+      the other ends of the edges must not share an edge yet
+*/
+[[maybe_unused]]
+static bool killEdgeVert(REMesh& mesh, Edge* e, Vert* v) {
+    assert(e->v1 == v || e->v2 == v);
+    size_t valence = getValence(v);
+
+    if (valence == 1) {
+        if (e->loop) {
+            return false;
+        }
+        euler::killEdgeOnly(mesh, e);
+        euler::killVertOnly(mesh, v);
+        return true;
+    }
+
+    if (valence != 2) {
+        return false;
+    }
+
+    Edge* keep = getDisk(e, v)->next;
+    Vert* u = getOtherVert(e, v);
+    Vert* w = getOtherVert(keep, v);
+    if (u == w || findEdge(u, w)) {
+        return false;
+    }
+
+    // Every face passes v through e and keep, check sizes first
+    if (auto l = e->loop) {
+        do {
+            if (l->f->size <= 3) {
+                return false;
+            }
+            l = l->radial_next;
+        } while (l != e->loop);
+    }
+
+    // Remove the corners at v. A corner before v that lies on e moves
+    // to keep, which then spans the same vertices
+    while (Loop* l = e->loop) {
+        Loop* lv = l->v == v ? l : l->next;
+        Loop* lp = lv->prev;
+        Face* f = lv->f;
+        assert(lv->v == v);
+
+        removeLoopFromEdge(mesh, lv->e, lv);
+        mesh.prepareWrite(lp);
+        mesh.prepareWrite(lv->next);
+        mesh.prepareWrite(f);
+        if (lp->e == e) {
+            removeLoopFromEdge(mesh, e, lp);
+            lp->e = keep;
+            addLoopToEdge(mesh, keep, lp);
+        }
+
+        lp->next = lv->next;
+        lv->next->prev = lp;
+        if (f->loop == lv) {
+            f->loop = lp;
+        }
+        f->size--;
+        euler::killLoop(mesh, lv);
+    }
+    assert(!keep->loop || keep->loop->v == u || keep->loop->v == w);
+
+    euler::killEdgeOnly(mesh, e);
+
+    // keep changes its end at v to u, the disk link moves with it
+    removeEdgeFromDisk(mesh, keep, v);
+    mesh.prepareWrite(keep);
+    if (keep->v1 == v) {
+        keep->v1 = u;
+    } else {
+        keep->v2 = u;
+    }
+    addEdgeToDisk(mesh, keep, u);
+
+    euler::killVertOnly(mesh, v);
+    return true;
+}
+
+
+/*
+    SEMV: splits e at t (0 is e->v1) with a new vertex. e keeps e->v1,
+    the returned vertex is connected to e->v2 by out_edge. Every face of e
+    gets a corner at the new vertex
+*/
+[[maybe_unused]]
+static Vert* splitEdge(REMesh& mesh, Edge* e, float t, Edge*& out_edge) {
+    Vert* v1 = e->v1;
+    Vert* v2 = e->v2;
+    auto nv = makeVert(mesh, glm::mix(v1->pos, v2->pos, t));
+    nv->color = glm::mix(v1->color, v2->color, t);
+    nv->texCoord = glm::mix(v1->texCoord, v2->texCoord, t);
+
+    std::vector<Loop*> loops;
+    if (auto l = e->loop) {
+        do {
+            loops.push_back(l);
+            l = l->radial_next;
+        } while (l != e->loop);
+    }
+
+    removeEdgeFromDisk(mesh, e, v2);
+    mesh.prepareWrite(e);
+    e->v2 = nv;
+    addEdgeToDisk(mesh, e, nv);
+    auto ne = makeEdge(mesh, nv, v2);
+
+    for (auto l : loops) {
+        auto nl = euler::newElement(mesh.loopsPool, mesh.loops);
+        bool bForward = l->v == v1;
+        nl->v = nv;
+        nl->f = l->f;
+        nl->texCoord = glm::mix(l->texCoord, l->next->texCoord, bForward ? t : 1.0f - t);
+        nl->viewId = l->viewId;
+
+        // v1 -> nv stays on e, nv -> v2 goes to ne and the other way round
+        mesh.prepareWrite(l);
+        mesh.prepareWrite(l->next);
+        mesh.prepareWrite(l->f);
+        if (bForward) {
+            nl->e = ne;
+            addLoopToEdge(mesh, ne, nl);
+        } else {
+            removeLoopFromEdge(mesh, e, l);
+            l->e = ne;
+            addLoopToEdge(mesh, ne, l);
+            nl->e = e;
+            addLoopToEdge(mesh, e, nl);
+        }
+
+        nl->prev = l;
+        nl->next = l->next;
+        l->next->prev = nl;
+        l->next = nl;
+        l->f->size++;
+    }
+
+    out_edge = ne;
+    return nv;
+}
+
+
+/*
+    MEF: splits the face of l1 and l2 with a new edge between their
+    vertices. The face keeps l1, the returned face gets l2. Corners must
+    be of the same face, not adjacent and at two vertices without an edge
+*/
+[[maybe_unused]]
+static Face* makeEdgeFace(REMesh& mesh, Loop* l1, Loop* l2, Edge*& out_edge) {
+    Face* f = l1->f;
+    if (l2->f != f || l1 == l2 || l1->next == l2 || l2->next == l1 ||
+        l1->v == l2->v || findEdge(l1->v, l2->v)) {
+        return nullptr;
+    }
+
+    auto e = makeEdge(mesh, l1->v, l2->v);
+    auto nf = euler::newElement(mesh.facesPool, mesh.faces);
+    nf->primitiveId = f->primitiveId;
+
+    // a closes l1 .. l2->prev, b closes l2 .. l1->prev
+    auto a = euler::newElement(mesh.loopsPool, mesh.loops);
+    auto b = euler::newElement(mesh.loopsPool, mesh.loops);
+    a->v = l2->v;
+    a->e = e;
+    euler::copyCorner(a, l2);
+    b->v = l1->v;
+    b->e = e;
+    euler::copyCorner(b, l1);
+    addLoopToEdge(mesh, e, a);
+    addLoopToEdge(mesh, e, b);
+
+    Loop* l1Prev = l1->prev;
+    Loop* l2Prev = l2->prev;
+    for (Loop* l : {l1, l2, l1Prev, l2Prev}) {
+        mesh.prepareWrite(l);
+    }
+    mesh.prepareWrite(f);
+    l2Prev->next = a;
+    a->prev = l2Prev;
+    a->next = l1;
+    l1->prev = a;
+    l1Prev->next = b;
+    b->prev = l1Prev;
+    b->next = l2;
+    l2->prev = b;
+
+    f->loop = l1;
+    nf->loop = l2;
+    a->f = f;
+    auto l = l2;
+    do {
+        mesh.prepareWrite(l);
+        l->f = nf;
+        l = l->next;
+    } while (l != l2);
+
+    f->size = euler::countFaceLoops(f);
+    nf->size = euler::countFaceLoops(nf);
+    out_edge = e;
+    return nf;
+}
+
+
+/*
+    KEF: joins the two faces of e and kills e and the second face. Both
+    faces must use e in opposite directions and share no other vertex.
+    Returns the joined face
+*/
+[[maybe_unused]]
+static Face* killEdgeFace(REMesh& mesh, Edge* e) {
+    Loop* la = e->loop;
+    if (!la || la->radial_next == la || la->radial_next->radial_next != la) {
+        return nullptr;
+    }
+    Loop* lb = la->radial_next;
+    Face* fa = la->f;
+    Face* fb = lb->f;
+    if (fa == fb || la->v == lb->v) {
+        return nullptr;
+    }
+
+    // A second shared vertex or edge would leave a face that passes a
+    // vertex twice
+    for (auto l = lb->next->next; l != lb; l = l->next) {
+        for (auto c : faceLoops(fa)) {
+            if (c->v == l->v) {
+                return nullptr;
+            }
+        }
+    }
+
+    auto l = lb->next;
+    do {
+        mesh.prepareWrite(l);
+        l->f = fa;
+        l = l->next;
+    } while (l != lb);
+
+    for (Loop* c : {la->prev, la->next, lb->prev, lb->next}) {
+        mesh.prepareWrite(c);
+    }
+    mesh.prepareWrite(fa);
+    la->prev->next = lb->next;
+    lb->next->prev = la->prev;
+    lb->prev->next = la->next;
+    la->next->prev = lb->prev;
+    fa->loop = la->next;
+    fa->size = fa->size + fb->size - 2;
+
+    removeLoopFromEdge(mesh, e, la);
+    removeLoopFromEdge(mesh, e, lb);
+    euler::killLoop(mesh, la);
+    euler::killLoop(mesh, lb);
+    euler::killFaceOnly(mesh, fb);
+    euler::killEdgeOnly(mesh, e);
+    return fa;
+}
+
+
+// Joins two faces that share exactly one edge
+[[maybe_unused]]
+static Face* joinFaces(REMesh& mesh, Face* f1, Face* f2) {
+    Edge* shared = nullptr;
+    auto l = f1->loop;
+    do {
+        auto r = l->radial_next;
+        while (r != l) {
+            if (r->f == f2) {
+                if (shared) {
+                    return nullptr;
+                }
+                shared = l->e;
+            }
+            r = r->radial_next;
+        }
+        l = l->next;
+    } while (l != f1->loop);
+
+    return shared ? killEdgeFace(mesh, shared) : nullptr;
+}
+
+
+/*
+    Face on existing vertices in winding order. Missing edges are made,
+    corner attributes are copied from the vertices. example gives the
+    primitive of the face
+*/
+[[maybe_unused]]
+static Face* makeFace(REMesh& mesh, const std::vector<Vert*>& verts, const Face* example = nullptr) {
+    if (verts.size() < 3) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < verts.size(); i++) {
+        if (std::find(verts.begin() + i + 1, verts.end(), verts[i]) != verts.end()) {
+            return nullptr;
+        }
+    }
+
+    auto f = euler::newElement(mesh.facesPool, mesh.faces);
+    f->size = static_cast<unsigned int>(verts.size());
+    f->primitiveId = example ? example->primitiveId : 0;
+
+    Loop* first = nullptr;
+    Loop* prev = nullptr;
+    for (size_t i = 0; i < verts.size(); i++) {
+        Vert* v = verts[i];
+        Vert* next = verts[(i + 1) % verts.size()];
+        Edge* e = findEdge(v, next);
+        if (!e) {
+            e = makeEdge(mesh, v, next);
+        }
+
+        auto l = euler::newElement(mesh.loopsPool, mesh.loops);
+        l->v = v;
+        l->e = e;
+        l->f = f;
+        l->texCoord = v->texCoord;
+        l->viewId = v->viewId;
+        addLoopToEdge(mesh, e, l);
+
+        if (prev) {
+            prev->next = l;
+            l->prev = prev;
+        } else {
+            first = l;
+        }
+        prev = l;
+    }
+    prev->next = first;
+    first->prev = prev;
+    f->loop = first;
+    return f;
+}
+
+
+// Kills a face and its corners. Edges and vertices stay
+[[maybe_unused]]
+static void killFace(REMesh& mesh, Face* f) {
+    auto l = f->loop;
+    do {
+        auto next = l->next;
+        removeLoopFromEdge(mesh, l->e, l);
+        euler::killLoop(mesh, l);
+        l = next;
+    } while (l != f->loop);
+    euler::killFaceOnly(mesh, f);
+}
+
+
+/*
+    Moves all edges and corners of v to keep and kills v. The vertices
+    must not share an edge or a face, a face would pass keep twice. Edges
+    that end up doubled are not merged, see spliceEdges()
+*/
+[[maybe_unused]]
+static bool spliceVerts(REMesh& mesh, Vert* keep, Vert* v) {
+    if (keep == v || findEdge(keep, v)) {
+        return false;
+    }
+    for (auto l : vertLoops(v)) {
+        for (auto c : faceLoops(l->f)) {
+            if (c->v == keep) {
+                return false;
+            }
+        }
+    }
+
+    while (Edge* e = v->edge) {
+        removeEdgeFromDisk(mesh, e, v);
+        if (auto l = e->loop) {
+            do {
+                if (l->v == v) {
+                    mesh.prepareWrite(l);
+                    l->v = keep;
+                }
+                l = l->radial_next;
+            } while (l != e->loop);
+        }
+        mesh.prepareWrite(e);
+        if (e->v1 == v) {
+            e->v1 = keep;
+        } else {
+            e->v2 = keep;
+        }
+        addEdgeToDisk(mesh, e, keep);
+    }
+
+    euler::killVertOnly(mesh, v);
+    return true;
+}
+
+
+// Moves the corners of e to keep and kills e. Both edges must join the
+// same vertices
+[[maybe_unused]]
+static bool spliceEdges(REMesh& mesh, Edge* keep, Edge* e) {
+    bool bSame = (keep->v1 == e->v1 && keep->v2 == e->v2) ||
+                 (keep->v1 == e->v2 && keep->v2 == e->v1);
+    if (keep == e || !bSame) {
+        return false;
+    }
+
+    while (Loop* l = e->loop) {
+        removeLoopFromEdge(mesh, e, l);
+        l->e = keep;
+        addLoopToEdge(mesh, keep, l);
+    }
+
+    euler::killEdgeOnly(mesh, e);
+    return true;
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_EULER
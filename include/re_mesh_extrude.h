@@ -0,0 +1,450 @@
+/*
+    Face region extrude on REMesh.
+
+    The selected faces stay in place as the cap of the extrusion and the
+    rest of the mesh is cut away from them:
+    - an edge with a selected face and an unselected face, or with only
+      one face, is a boundary edge. The cap gets a copy of it and a side
+      quad joins both copies
+    - a vertex of the region that has any edge outside the region is
+      duplicated, the cap uses the copy. Boundary vertices are joined to
+      their copy by a side edge
+    - everything else of the region is only used by the cap and moves
+      with it without copies
+
+    Edges and vertices are classified in one pass over the corners of the
+    selection. New elements are counted first and reserved in the pools,
+    so allocation does not grow the pools one block at a time. Only the
+    elements of the region are prepared for writing, snapshots copy the
+    pages around the selection and share the rest.
+
+    updateExtrudeView() then adds the new corners to the ViewMesh in place
+    and returns the vertex and index ranges to upload, the rest of the
+    view stays as it is.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <re_mesh.h>
+#include <re_mesh_euler.h>
+#include <ale_geo_utils.h>
+#include <ale_mesh_lod.h>
+#include <tracer.h>
+
+#ifndef ALE_REMESH_EXTRUDE
+#define ALE_REMESH_EXTRUDE
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace geo {
+
+struct ExtrudeResult {
+    // Vertices of the cap. Moving them moves the extrusion
+    std::vector<Vert*> capVerts;
+    // The selected faces without repeats
+    std::vector<Face*> capFaces;
+    std::vector<Face*> sideFaces;
+};
+
+
+[[maybe_unused]]
+static ExtrudeResult extrudeFaceRegion(REMesh& mesh, const std::vector<Face*>& faces) {
+    ExtrudeResult result;
+    if (faces.empty()) {
+        return result;
+    }
+
+    enum : uint8_t { UNSEEN, REGION, BOUNDARY };
+
+    // Pool ids are below pool capacity, so they index flat arrays
+    std::vector<uint8_t> selected(mesh.facesPool.getCapacity(), 0);
+    std::vector<Face*> region;
+    region.reserve(faces.size());
+    for (auto f : faces) {
+        if (!selected[f->id]) {
+            selected[f->id] = 1;
+            region.push_back(f);
+        }
+    }
+
+    std::vector<uint8_t> edgeState(mesh.edgesPool.getCapacity(), UNSEEN);
+    std::vector<uint8_t> vertSeen(mesh.vertsPool.getCapacity(), 0);
+    std::vector<Loop*> boundaryLoops;
+    std::vector<Edge*> regionEdges;
+    std::vector<Vert*> regionVerts;
+
+    for (auto f : region) {
+        auto l = f->loop;
+        do {
+            Edge* e = l->e;
+            if (edgeState[e->id] == UNSEEN) {
+                bool bBoundary = l->radial_next == l;
+                for (auto r = l->radial_next; r != l; r = r->radial_next) {
+                    if (!selected[r->f->id]) {
+                        bBoundary = true;
+                        break;
+                    }
+                }
+                edgeState[e->id] = bBoundary ? BOUNDARY : REGION;
+                if (bBoundary) {
+                    // One side quad per edge, along the first selected corner
+                    boundaryLoops.push_back(l);
+                } else {
+                    regionEdges.push_back(e);
+                }
+            }
+
+            if (!vertSeen[l->v->id]) {
+                vertSeen[l->v->id] = 1;
+                regionVerts.push_back(l->v);
+            }
+            l = l->next;
+        } while (l != f->loop);
+    }
+
+    // Region vertices with an edge outside the region are split
+    const size_t NONE = SIZE_MAX;
+    std::vector<size_t> dupIdx(mesh.vertsPool.getCapacity(), NONE);
+    std::vector<Vert*> splitVerts;
+    for (auto v : regionVerts) {
+        auto e = v->edge;
+        do {
+            if (edgeState[e->id] != REGION) {
+                dupIdx[v->id] = splitVerts.size();
+                splitVerts.push_back(v);
+                break;
+            }
+            e = getDisk(e, v)->next;
+        } while (e != v->edge);
+    }
+
+    // Side edges are made for boundary vertices only, at most one per copy
+    size_t newVerts = splitVerts.size();
+    size_t newEdges = boundaryLoops.size() + splitVerts.size();
+    size_t newFaces = boundaryLoops.size();
+    mesh.vertsPool.reserve(newVerts);
+    mesh.edgesPool.reserve(newEdges);
+    mesh.disksPool.reserve(2 * newEdges);
+    mesh.facesPool.reserve(newFaces);
+    mesh.loopsPool.reserve(4 * newFaces);
+    mesh.verts.reserve(mesh.verts.size() + newVerts);
+    mesh.edges.reserve(mesh.edges.size() + newEdges);
+    mesh.disks.reserve(mesh.disks.size() + 2 * newEdges);
+    mesh.faces.reserve(mesh.faces.size() + newFaces);
+    mesh.loops.reserve(mesh.loops.size() + 4 * newFaces);
+
+    std::vector<Vert*> copies(splitVerts.size());
+    std::vector<Edge*> sideEdges(splitVerts.size(), nullptr);
+    for (size_t i = 0; i < splitVerts.size(); i++) {
+        Vert* v = splitVerts[i];
+        copies[i] = makeVert(mesh, v->pos);
+        copies[i]->color = v->color;
+        copies[i]->texCoord = v->texCoord;
+    }
+    auto getCopy = [&](Vert* v) {
+        size_t idx = dupIdx[v->id];
+        return idx == NONE ? v : copies[idx];
+    };
+    auto getSideEdge = [&](Vert* v) {
+        size_t idx = dupIdx[v->id];
+        if (!sideEdges[idx]) {
+            sideEdges[idx] = makeEdge(mesh, v, copies[idx]);
+        }
+        return sideEdges[idx];
+    };
+
+    // Region edges follow their vertices to the cap
+    for (auto e : regionEdges) {
+        for (Vert* v : {e->v1, e->v2}) {
+            Vert* copy = getCopy(v);
+            if (copy == v) {
+                continue;
+            }
+            removeEdgeFromDisk(mesh, e, v);
+            mesh.prepareWrite(e);
+            if (e->v1 == v) {
+                e->v1 = copy;
+            } else {
+                e->v2 = copy;
+            }
+            addEdgeToDisk(mesh, e, copy);
+        }
+    }
+
+    // Cap copies of boundary edges and side quads p -> q -> q' -> p'
+    result.sideFaces.reserve(boundaryLoops.size());
+    std::vector<Loop*> capLoops;
+    for (auto l : boundaryLoops) {
+        Edge* e = l->e;
+        Vert* p = l->v;
+        Vert* q = l->next->v;
+        Edge* capEdge = makeEdge(mesh, getCopy(p), getCopy(q));
+
+        capLoops.clear();
+        Loop* r = e->loop;
+        do {
+            if (selected[r->f->id]) {
+                capLoops.push_back(r);
+            }
+            r = r->radial_next;
+        } while (r != e->loop);
+        for (auto c : capLoops) {
+            removeLoopFromEdge(mesh, e, c);
+            c->e = capEdge;
+            addLoopToEdge(mesh, capEdge, c);
+        }
+
+        Face* side = euler::newElement(mesh.facesPool, mesh.faces);
+        side->size = 4;
+        side->primitiveId = l->f->primitiveId;
+
+        Vert* corners[4] = {p, q, getCopy(q), getCopy(p)};
+        Edge* edges[4] = {e, getSideEdge(q), capEdge, getSideEdge(p)};
+        const Loop* sources[4] = {l, l->next, l->next, l};
+        Loop* loops[4];
+        for (size_t k = 0; k < 4; k++) {
+            loops[k] = euler::newElement(mesh.loopsPool, mesh.loops);
+            loops[k]->v = corners[k];
+            loops[k]->e = edges[k];
+            loops[k]->f = side;
+            euler::copyCorner(loops[k], sources[k]);
+            addLoopToEdge(mesh, edges[k], loops[k]);
+        }
+        for (size_t k = 0; k < 4; k++) {
+            loops[k]->next = loops[(k + 1) % 4];
+            loops[k]->prev = loops[(k + 3) % 4];
+        }
+        side->loop = loops[0];
+        result.sideFaces.push_back(side);
+    }
+
+    // Corners of the cap move to the copies last, side quads copied their
+    // attributes above. Only corners at copies are written, so the inner
+    // pages of the region stay shared with snapshots
+    for (auto f : region) {
+        auto l = f->loop;
+        do {
+            Vert* copy = getCopy(l->v);
+            if (copy != l->v) {
+                mesh.prepareWrite(l);
+                l->v = copy;
+            }
+            l = l->next;
+        } while (l != f->loop);
+    }
+
+    result.capVerts.reserve(regionVerts.size());
+    for (auto v : regionVerts) {
+        result.capVerts.push_back(getCopy(v));
+    }
+    result.capFaces = std::move(region);
+    return result;
+}
+
+
+/*
+    Updates the ViewMesh after extrudeFaceRegion() the way rebuildViewMesh()
+    would, without rebuilding it:
+    - corners of vertex copies get new view vertices at the end of the
+      view, corners that had the same view vertex share one
+    - cap triangles are found in the indices and refer to them, side faces
+      are fan triangulated at the end of their primitives
+    LODs of primitives with cap or side faces are dropped, the others
+    keep theirs, see MeshLodUpdate to build them again. out_vertexRanges and out_indexRanges are sorted
+    (first, count) ranges to upload. Returns false and changes nothing if
+    a corner has no view vertex of its UV, rebuild the view then
+*/
+[[maybe_unused]]
+static bool updateExtrudeView(REMesh& mesh, ale::ViewMesh& view, const ExtrudeResult& result,
+                              std::vector<std::pair<size_t, size_t>>& out_vertexRanges,
+                              std::vector<std::pair<size_t, size_t>>& out_indexRanges) {
+    out_vertexRanges.clear();
+    out_indexRanges.clear();
+    const uint32_t NONE = UINT32_MAX;
+    const size_t vertexCount = view.vertices.size();
+
+    // Copies are the only cap vertices without a view vertex
+    std::vector<uint8_t> bCopy(mesh.vertsPool.getCapacity(), 0);
+    for (auto v : result.capVerts) {
+        if (v->viewId == NO_VIEW_ID) {
+            bCopy[v->id] = 1;
+        }
+    }
+    auto isCopy = [&](const Vert* v) {
+        return bCopy[v->id] != 0;
+    };
+
+    // New view vertices by the view vertex the corners had
+    std::vector<uint32_t> remap(vertexCount, NONE);
+    std::vector<ale::Vertex> added;
+    auto plan = [&](const Loop* l) {
+        if (l->viewId >= vertexCount || view.vertices[l->viewId].texCoord != l->texCoord) {
+            return false;
+        }
+        if (isCopy(l->v) && remap[l->viewId] == NONE) {
+            remap[l->viewId] = static_cast<uint32_t>(vertexCount + added.size());
+            added.push_back(view.vertices[l->viewId]);
+            added.back().pos = l->v->pos;
+        }
+        return true;
+    };
+    // Other cap corners keep their view vertices
+    for (auto faces : {&result.capFaces, &result.sideFaces}) {
+        bool bSide = faces == &result.sideFaces;
+        for (auto f : *faces) {
+            if (f->primitiveId >= view.primitives.size()) {
+                return false;
+            }
+            for (auto l : faceLoops(f)) {
+                if ((bSide || isCopy(l->v)) && !plan(l)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    // Triangles of cap faces at copies, rotated to start at the lowest
+    // index so any rotation of a stored triangle matches
+    using Triangle = std::array<uint32_t, 3>;
+    auto rotate = [](Triangle t) {
+        auto first = std::min_element(t.begin(), t.end());
+        std::rotate(t.begin(), first, t.end());
+        return t;
+    };
+    std::vector<Triangle> capTris;
+    std::vector<uint32_t> corners;
+    for (auto f : result.capFaces) {
+        corners.clear();
+        bool bMoved = false;
+        for (auto l : faceLoops(f)) {
+            corners.push_back(static_cast<uint32_t>(l->viewId));
+            bMoved |= remap[l->viewId] != NONE;
+        }
+        for (size_t i = 1; bMoved && i + 1 < corners.size(); i++) {
+            capTris.push_back(rotate({corners[0], corners[i], corners[i + 1]}));
+        }
+    }
+    std::sort(capTris.begin(), capTris.end());
+
+    // One pass over the indices, only triangles at remapped vertices are
+    // looked up. Every cap triangle is matched once
+    std::vector<uint8_t> bMatched(capTris.size(), 0);
+    std::vector<size_t> found;
+    auto& indices = view.indices;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        if ((indices[i] >= vertexCount || remap[indices[i]] == NONE) &&
+            (indices[i + 1] >= vertexCount || remap[indices[i + 1]] == NONE) &&
+            (indices[i + 2] >= vertexCount || remap[indices[i + 2]] == NONE)) {
+            continue;
+        }
+        Triangle t = rotate({indices[i], indices[i + 1], indices[i + 2]});
+        auto it = std::lower_bound(capTris.begin(), capTris.end(), t);
+        for (; it != capTris.end() && *it == t; it++) {
+            size_t k = it - capTris.begin();
+            if (!bMatched[k]) {
+                bMatched[k] = 1;
+                found.push_back(i);
+                break;
+            }
+        }
+    }
+    if (found.size() != capTris.size()) {
+        return false;
+    }
+
+    // Nothing failed, write the plan
+    for (auto faces : {&result.capFaces, &result.sideFaces}) {
+        for (auto f : *faces) {
+            for (auto l : faceLoops(f)) {
+                if (isCopy(l->v)) {
+                    mesh.prepareWrite(l);
+                    mesh.prepareWrite(l->v);
+                    l->viewId = remap[l->viewId];
+                    l->v->viewId = l->viewId;
+                }
+            }
+        }
+    }
+    view.vertices.insert(view.vertices.end(), added.begin(), added.end());
+    for (auto i : found) {
+        for (size_t k = i; k < i + 3; k++) {
+            if (remap[indices[k]] != NONE) {
+                indices[k] = remap[indices[k]];
+            }
+        }
+    }
+
+    // Side faces go to the end of their primitives, later primitives move
+    std::vector<std::vector<uint32_t>> sideIndices(view.primitives.size());
+    for (auto f : result.sideFaces) {
+        corners.clear();
+        for (auto l : faceLoops(f)) {
+            corners.push_back(static_cast<uint32_t>(l->viewId));
+        }
+        auto& out = sideIndices[f->primitiveId];
+        for (size_t i = 1; i + 1 < corners.size(); i++) {
+            out.insert(out.end(), {corners[0], corners[i], corners[i + 1]});
+        }
+    }
+    size_t firstInsert = indices.size();
+    for (size_t p = 0; p < view.primitives.size(); p++) {
+        auto& prim = view.primitives[p];
+        if (sideIndices[p].empty()) {
+            continue;
+        }
+        size_t at = prim.offsetIdx + prim.size;
+        indices.insert(indices.begin() + at, sideIndices[p].begin(), sideIndices[p].end());
+        for (auto& other : view.primitives) {
+            if (&other != &prim && other.offsetIdx >= at) {
+                other.offsetIdx += sideIndices[p].size();
+            }
+        }
+        prim.size += sideIndices[p].size();
+        firstInsert = std::min(firstInsert, at);
+    }
+    std::vector<uint8_t> bStale(view.primitives.size(), 0);
+    for (auto faces : {&result.capFaces, &result.sideFaces}) {
+        for (auto f : *faces) {
+            bStale[f->primitiveId] = 1;
+        }
+    }
+    dropMeshLods(view, bStale);
+
+    if (!added.empty()) {
+        out_vertexRanges.push_back({vertexCount, added.size()});
+    }
+    std::sort(found.begin(), found.end());
+    for (size_t i = 0; i < found.size() && found[i] < firstInsert;) {
+        size_t first = found[i];
+        size_t last = first;
+        for (; i < found.size() && found[i] < firstInsert && found[i] <= last + DIRTY_RANGE_GAP; i++) {
+            last = found[i];
+        }
+        out_indexRanges.push_back({first, std::min(last + 3, firstInsert) - first});
+    }
+    if (firstInsert < indices.size()) {
+        out_indexRanges.push_back({firstInsert, indices.size() - firstInsert});
+    }
+    return true;
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_EXTRUDE
@@ -0,0 +1,397 @@
+/*
+    Topology iterators and a cached adjacency of REMesh.
+
+    The ranges walk the pointer cycles of the mesh without allocating:
+    - faceLoops(f): loops of a face in order
+    - edgeLoops(e): radial cycle of an edge, loops of its faces
+    - vertEdges(v): disk cycle of a vertex
+    - vertLoops(v): face corners of a vertex
+    - vertFaces(v): faces of a vertex, one per corner
+    - vertVerts(v): vertices sharing an edge with v
+    They are std::ranges::forward_range and end with
+    std::default_sentinel, so they work with range-for and <ranges>.
+    Changes of the connectivity during a walk invalidate it.
+
+    MeshAdjacency stores vertex to faces and vertex to vertices in CSR
+    arrays by vertex pool id. Algorithms that read the one-rings many
+    times and do not change the connectivity read them from two flat
+    arrays instead of chasing the cycles.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+
+//int
+#include <re_mesh.h>
+#include <ale_geo_utils.h>
+#include <ale_thread_pool.h>
+
+#ifndef ALE_REMESH_ITERATORS
+#define ALE_REMESH_ITERATORS
+
+namespace ale {
+namespace geo {
+
+// Forward iterator over a cursor that walks one cycle. A cursor has
+// get(), next() and isDone() and compares equal at the same element
+template <class Cursor>
+class TopologyIterator {
+public:
+    using iterator_concept = std::forward_iterator_tag;
+    using value_type = typename Cursor::value_type;
+    using difference_type = std::ptrdiff_t;
+
+    TopologyIterator() = default;
+    explicit TopologyIterator(const Cursor& cursor) : _cursor(cursor) {}
+
+    value_type operator*() const {
+        return _cursor.get();
+    }
+
+    TopologyIterator& operator++() {
+        _cursor.next();
+        return *this;
+    }
+
+    TopologyIterator operator++(int) {
+        auto result = *this;
+        _cursor.next();
+        return result;
+    }
+
+    bool operator==(const TopologyIterator& other) const {
+        return _cursor == other._cursor;
+    }
+
+    bool operator==(std::default_sentinel_t) const {
+        return _cursor.isDone();
+    }
+
+private:
+    Cursor _cursor;
+};
+
+
+template <class Cursor>
+class TopologyRange {
+public:
+    explicit TopologyRange(const Cursor& first) : _first(first) {}
+
+    TopologyIterator<Cursor> begin() const {
+        return TopologyIterator<Cursor>(_first);
+    }
+
+    std::default_sentinel_t end() const {
+        return std::default_sentinel;
+    }
+
+    bool empty() const {
+        return _first.isDone();
+    }
+
+private:
+    Cursor _first;
+};
+
+
+struct FaceLoopCursor {
+    using value_type = Loop*;
+    Loop* first = nullptr;
+    Loop* cur = nullptr;
+
+    Loop* get() const {
+        return cur;
+    }
+
+    void next() {
+        cur = cur->next;
+        if (cur == first) {
+            cur = nullptr;
+        }
+    }
+
+    bool isDone() const {
+        return cur == nullptr;
+    }
+
+    bool operator==(const FaceLoopCursor&) const = default;
+};
+
+
+struct RadialLoopCursor {
+    using value_type = Loop*;
+    Loop* first = nullptr;
+    Loop* cur = nullptr;
+
+    Loop* get() const {
+        return cur;
+    }
+
+    void next() {
+        cur = cur->radial_next;
+        if (cur == first) {
+            cur = nullptr;
+        }
+    }
+
+    bool isDone() const {
+        return cur == nullptr;
+    }
+
+    bool operator==(const RadialLoopCursor&) const = default;
+};
+
+
+struct DiskEdgeCursor {
+    using value_type = Edge*;
+    const Vert* v = nullptr;
+    Edge* cur = nullptr;
+
+    Edge* get() const {
+        return cur;
+    }
+
+    void next() {
+        cur = getDisk(cur, v)->next;
+        if (cur == v->edge) {
+            cur = nullptr;
+        }
+    }
+
+    bool isDone() const {
+        return cur == nullptr;
+    }
+
+    bool operator==(const DiskEdgeCursor&) const = default;
+};
+
+
+// Corners of v are the loops at v in the radial cycles of its edges,
+// every corner is found once, on the edge leaving v in its face
+struct VertLoopCursor {
+    using value_type = Loop*;
+    const Vert* v = nullptr;
+    Edge* edge = nullptr;
+    Loop* cur = nullptr;
+
+    VertLoopCursor() = default;
+
+    explicit VertLoopCursor(const Vert* vert) : v(vert), edge(vert->edge) {
+        cur = edge ? edge->loop : nullptr;
+        _find();
+    }
+
+    Loop* get() const {
+        return cur;
+    }
+
+    void next() {
+        _nextRadial();
+        _find();
+    }
+
+    bool isDone() const {
+        return edge == nullptr;
+    }
+
+    bool operator==(const VertLoopCursor&) const = default;
+
+private:
+    void _nextRadial() {
+        cur = cur->radial_next;
+        if (cur == edge->loop) {
+            cur = nullptr;
+        }
+    }
+
+    // Moves on from cur to the next loop at v, nullptr cur starts at the
+    // next edge
+    void _find() {
+        while (edge) {
+            while (cur) {
+                if (cur->v == v) {
+                    return;
+                }
+                _nextRadial();
+            }
+            edge = getDisk(edge, v)->next;
+            if (edge == v->edge) {
+                edge = nullptr;
+                return;
+            }
+            cur = edge->loop;
+        }
+    }
+};
+
+
+struct VertFaceCursor : VertLoopCursor {
+    using value_type = Face*;
+    using VertLoopCursor::VertLoopCursor;
+
+    Face* get() const {
+        return cur->f;
+    }
+
+    bool operator==(const VertFaceCursor&) const = default;
+};
+
+
+struct VertVertCursor : DiskEdgeCursor {
+    using value_type = Vert*;
+
+    Vert* get() const {
+        return getOtherVert(cur, v);
+    }
+
+    bool operator==(const VertVertCursor&) const = default;
+};
+
+
+using FaceLoopRange = TopologyRange<FaceLoopCursor>;
+using EdgeLoopRange = TopologyRange<RadialLoopCursor>;
+using VertEdgeRange = TopologyRange<DiskEdgeCursor>;
+using VertLoopRange = TopologyRange<VertLoopCursor>;
+using VertFaceRange = TopologyRange<VertFaceCursor>;
+using VertVertRange = TopologyRange<VertVertCursor>;
+
+static_assert(std::ranges::forward_range<FaceLoopRange>);
+static_assert(std::ranges::forward_range<VertLoopRange>);
+static_assert(std::ranges::forward_range<VertVertRange>);
+
+
+[[maybe_unused]]
+static FaceLoopRange faceLoops(const Face* f) {
+    return FaceLoopRange({f->loop, f->loop});
+}
+
+[[maybe_unused]]
+static EdgeLoopRange edgeLoops(const Edge* e) {
+    return EdgeLoopRange({e->loop, e->loop});
+}
+
+[[maybe_unused]]
+static VertEdgeRange vertEdges(const Vert* v) {
+    return VertEdgeRange({v, v->edge});
+}
+
+[[maybe_unused]]
+static VertLoopRange vertLoops(const Vert* v) {
+    return VertLoopRange(VertLoopCursor(v));
+}
+
+// A face that uses v twice is returned twice
+[[maybe_unused]]
+static VertFaceRange vertFaces(const Vert* v) {
+    return VertFaceRange(VertFaceCursor(v));
+}
+
+[[maybe_unused]]
+static VertVertRange vertVerts(const Vert* v) {
+    VertVertCursor cursor;
+    cursor.v = v;
+    cursor.cur = v->edge;
+    return VertVertRange(cursor);
+}
+
+
+class MeshAdjacency {
+public:
+    // Counts and fills the one-rings of all vertices in parallel
+    void build(const REMesh& mesh, ThreadPool& threads) {
+        clear();
+        size_t capacity = mesh.vertsPool.getCapacity();
+        _faceOffsets.assign(capacity + 1, 0);
+        _vertOffsets.assign(capacity + 1, 0);
+
+        threads.parallelFor(mesh.verts.size(), 4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                const Vert* v = mesh.verts[i];
+                uint32_t faces = 0;
+                for ([[maybe_unused]] auto l : vertLoops(v)) {
+                    faces++;
+                }
+                uint32_t verts = 0;
+                for ([[maybe_unused]] auto e : vertEdges(v)) {
+                    verts++;
+                }
+                _faceOffsets[v->id + 1] = faces;
+                _vertOffsets[v->id + 1] = verts;
+            }
+        });
+        for (size_t i = 0; i < capacity; i++) {
+            _faceOffsets[i + 1] += _faceOffsets[i];
+            _vertOffsets[i + 1] += _vertOffsets[i];
+        }
+
+        _faces.resize(_faceOffsets.back());
+        _loops.resize(_faceOffsets.back());
+        _verts.resize(_vertOffsets.back());
+        threads.parallelFor(mesh.verts.size(), 4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                const Vert* v = mesh.verts[i];
+                uint32_t f = _faceOffsets[v->id];
+                for (auto l : vertLoops(v)) {
+                    _loops[f] = l;
+                    _faces[f++] = l->f;
+                }
+                uint32_t n = _vertOffsets[v->id];
+                for (auto u : vertVerts(v)) {
+                    _verts[n++] = u;
+                }
+            }
+        });
+        _mesh = &mesh;
+    }
+
+    void clear() {
+        _mesh = nullptr;
+        _faceOffsets.clear();
+        _vertOffsets.clear();
+        _faces.clear();
+        _loops.clear();
+        _verts.clear();
+    }
+
+    bool isActive(const REMesh& mesh) const {
+        return _mesh == &mesh && _faceOffsets.size() == mesh.vertsPool.getCapacity() + 1;
+    }
+
+    // Same order as vertFaces(v) at the time of the build
+    std::span<Face* const> getFaces(const Vert* v) const {
+        return std::span<Face* const>(_faces).subspan(
+            _faceOffsets[v->id], _faceOffsets[v->id + 1] - _faceOffsets[v->id]);
+    }
+
+    // Same order as vertLoops(v) at the time of the build
+    std::span<Loop* const> getLoops(const Vert* v) const {
+        return std::span<Loop* const>(_loops).subspan(
+            _faceOffsets[v->id], _faceOffsets[v->id + 1] - _faceOffsets[v->id]);
+    }
+
+    // Same order as vertVerts(v) at the time of the build
+    std::span<Vert* const> getVerts(const Vert* v) const {
+        return std::span<Vert* const>(_verts).subspan(
+            _vertOffsets[v->id], _vertOffsets[v->id + 1] - _vertOffsets[v->id]);
+    }
+
+private:
+    const REMesh* _mesh = nullptr;
+    // One-ring of the vertex with pool id i starts at offsets[i]
+    std::vector<uint32_t> _faceOffsets;
+    std::vector<uint32_t> _vertOffsets;
+    std::vector<Face*> _faces;
+    std::vector<Loop*> _loops;
+    std::vector<Vert*> _verts;
+};
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_ITERATORS
@@ -0,0 +1,509 @@
+/*
+    Vertex normals of REMesh and ViewMesh.
+
+    The normal of a vertex is the sum of the normals of its faces,
+    weighted by the angle of the face corner at the vertex or by the face
+    area. Angles keep the normal independent of how the faces around the
+    vertex are triangulated. Split normals give each corner the sum of
+    the faces of its vertex within the crease angle of its own face, so
+    hard edges stay hard.
+
+    MeshNormals keeps the normals of a REMesh by pool id:
+    - compute() computes all of them in parallel, faces first
+    - update() recomputes the faces around moved vertices and the
+      vertices of those faces, the only normals a move changes, and
+      writes them to the view mesh
+    Corners are drawn with their view vertex. rebuildViewMesh() with the
+    corner normals gives split corners their own view vertices, a move
+    that splits other corners shows after the next rebuild. Connectivity
+    changes need compute() again.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <string>
+#include <span>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <primitives.h>
+#include <re_mesh.h>
+#include <ale_geo_utils.h>
+#include <re_mesh_iterators.h>
+#include <ale_thread_pool.h>
+#include <tracer.h>
+
+#ifndef ALE_REMESH_NORMALS
+#define ALE_REMESH_NORMALS
+
+namespace ale {
+namespace geo {
+
+const std::vector<std::string> NormalWeight_Names { "ANGLE", "AREA", };
+
+enum NormalWeight {
+    ANGLE_WEIGHTED,
+    AREA_WEIGHTED,
+    NORMAL_WEIGHT_MAX,
+};
+
+
+struct NormalSettings {
+    NormalWeight weight = ANGLE_WEIGHTED;
+    // Corners split where faces meet at more than creaseAngle degrees
+    bool bSplit = false;
+    float creaseAngle = 30.0f;
+};
+
+
+// Weight of the corner at b of the face a, b, c with a normal of length
+// twice the face area
+[[maybe_unused]]
+static float getCornerWeight(NormalWeight weight, const glm::vec3& a, const glm::vec3& b,
+                             const glm::vec3& c, float doubleArea) {
+    if (weight == AREA_WEIGHTED) {
+        return 0.5f * doubleArea;
+    }
+    glm::vec3 e1 = a - b;
+    glm::vec3 e2 = c - b;
+    return std::atan2(glm::length(glm::cross(e1, e2)), glm::dot(e1, e2));
+}
+
+
+/*
+    Normals of the triangles of indices [firstIndex, firstIndex + count)
+    of a ViewMesh. Vertices at one position share the normal, meshes are
+    often split on UV seams. Split corners that share a vertex get copies
+    of it, appended to the vertices
+*/
+[[maybe_unused]]
+static void generateViewNormals(ale::ViewMesh& mesh, size_t firstIndex, size_t count,
+                                const NormalSettings& settings = {}) {
+    if (count % 3 != 0 || firstIndex + count > mesh.indices.size()) {
+        trc::log("Cannot calculate normals, input mesh is not triangulated!", trc::ERROR);
+        return;
+    }
+    const uint32_t NONE = UINT32_MAX;
+    uint32_t* indices = mesh.indices.data() + firstIndex;
+
+    std::vector<uint32_t> pointOfVert(mesh.vertices.size(), NONE);
+    std::unordered_map<glm::vec3, uint32_t> points;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v = indices[i];
+        if (pointOfVert[v] == NONE) {
+            auto [it, bNew] = points.try_emplace(mesh.vertices[v].pos,
+                                                 static_cast<uint32_t>(points.size()));
+            pointOfVert[v] = it->second;
+        }
+    }
+
+    std::vector<glm::vec3> faceNormals(count / 3);
+    std::vector<float> weights(count);
+    for (size_t t = 0; t < count / 3; t++) {
+        const glm::vec3& a = mesh.vertices[indices[3 * t + 0]].pos;
+        const glm::vec3& b = mesh.vertices[indices[3 * t + 1]].pos;
+        const glm::vec3& c = mesh.vertices[indices[3 * t + 2]].pos;
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float len = glm::length(n);
+        faceNormals[t] = len > 0 ? n / len : glm::vec3(0);
+        weights[3 * t + 0] = getCornerWeight(settings.weight, c, a, b, len);
+        weights[3 * t + 1] = getCornerWeight(settings.weight, a, b, c, len);
+        weights[3 * t + 2] = getCornerWeight(settings.weight, b, c, a, len);
+    }
+
+    // Corners of point p are corners[first[p]] to corners[first[p + 1]]
+    std::vector<uint32_t> first(points.size() + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        first[pointOfVert[indices[i]] + 1]++;
+    }
+    for (size_t p = 0; p < points.size(); p++) {
+        first[p + 1] += first[p];
+    }
+    std::vector<uint32_t> corners(count);
+    std::vector<uint32_t> cursor(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        corners[cursor[pointOfVert[indices[i]]]++] = static_cast<uint32_t>(i);
+    }
+
+    float cosCrease = std::cos(glm::radians(settings.creaseAngle));
+    std::vector<glm::vec3> cornerNormals(count);
+    for (size_t p = 0; p < points.size(); p++) {
+        glm::vec3 smooth(0);
+        for (uint32_t k = first[p]; k < first[p + 1]; k++) {
+            smooth += faceNormals[corners[k] / 3] * weights[corners[k]];
+        }
+        for (uint32_t k = first[p]; k < first[p + 1]; k++) {
+            const glm::vec3& own = faceNormals[corners[k] / 3];
+            glm::vec3 n = smooth;
+            if (settings.bSplit) {
+                n = glm::vec3(0);
+                for (uint32_t j = first[p]; j < first[p + 1]; j++) {
+                    const glm::vec3& other = faceNormals[corners[j] / 3];
+                    if (j == k || glm::dot(own, other) >= cosCrease) {
+                        n += other * weights[corners[j]];
+                    }
+                }
+            }
+            float len = glm::length(n);
+            cornerNormals[corners[k]] = len > 0 ? n / len : glm::vec3(0, 0, 1);
+        }
+    }
+
+    // Copies of a vertex with other normals form a list
+    std::vector<uint32_t> nextCopy(mesh.vertices.size(), NONE);
+    std::vector<uint8_t> bWritten(mesh.vertices.size(), 0);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v = indices[i];
+        const glm::vec3& n = cornerNormals[i];
+        if (!bWritten[v]) {
+            bWritten[v] = 1;
+            mesh.vertices[v].normal = n;
+            continue;
+        }
+        uint32_t idx = v;
+        while (idx != NONE && mesh.vertices[idx].normal != n) {
+            idx = nextCopy[idx];
+        }
+        if (idx == NONE) {
+            idx = static_cast<uint32_t>(mesh.vertices.size());
+            ale::Vertex copy = mesh.vertices[v];
+            copy.normal = n;
+            mesh.vertices.push_back(copy);
+            nextCopy.push_back(nextCopy[v]);
+            nextCopy[v] = idx;
+        }
+        indices[i] = idx;
+    }
+}
+
+
+class MeshNormals {
+public:
+    bool isActive(const REMesh& mesh) const {
+        return _mesh == &mesh && _faceNormals.size() == mesh.facesPool.getCapacity() &&
+               _vertNormals.size() == mesh.vertsPool.getCapacity() &&
+               _cornerWeights.size() == mesh.loopsPool.getCapacity();
+    }
+
+    const NormalSettings& getSettings() const {
+        return _settings;
+    }
+
+    // All normals of the mesh, the view mesh is not written
+    void compute(REMesh& mesh, const NormalSettings& settings, ThreadPool& threads) {
+        clear();
+        _mesh = &mesh;
+        _settings = settings;
+        _cosCrease = std::cos(glm::radians(settings.creaseAngle));
+        _faceNormals.assign(mesh.facesPool.getCapacity(), glm::vec3(0));
+        _vertNormals.assign(mesh.vertsPool.getCapacity(), glm::vec3(0, 0, 1));
+        _cornerWeights.assign(mesh.loopsPool.getCapacity(), 0.0f);
+        if (settings.bSplit) {
+            _cornerNormals.assign(mesh.loopsPool.getCapacity(), glm::vec3(0, 0, 1));
+        }
+        _vertStamp.assign(mesh.vertsPool.getCapacity(), 0);
+        _faceStamp.assign(mesh.facesPool.getCapacity(), 0);
+
+        threads.parallelFor(mesh.faces.size(), 4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                updateFace(mesh.faces[i]);
+            }
+        });
+        threads.parallelFor(mesh.verts.size(), 4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                updateVert(mesh.verts[i], [](size_t, const glm::vec3&) {});
+            }
+        });
+    }
+
+    // Keeps the settings
+    void clear() {
+        _mesh = nullptr;
+        _faceNormals.clear();
+        _vertNormals.clear();
+        _cornerWeights.clear();
+        _cornerNormals.clear();
+        _vertStamp.clear();
+        _faceStamp.clear();
+        _faces.clear();
+        _verts.clear();
+        _stamp = 0;
+    }
+
+    const glm::vec3& getFaceNormal(const Face* f) const {
+        return _faceNormals[f->id];
+    }
+
+    // Smooth normal of the vertex, also with split normals
+    const glm::vec3& getVertNormal(const Vert* v) const {
+        return _vertNormals[v->id];
+    }
+
+    const glm::vec3& getCornerNormal(const Loop* l) const {
+        return _settings.bSplit ? _cornerNormals[l->id] : _vertNormals[l->v->id];
+    }
+
+    // Normals of the faces around verts and of the vertices of those
+    // faces, written to the view with the positions
+    void update(REMesh& mesh, ale::ViewMesh& view, std::span<Vert* const> verts, ThreadPool& threads) {
+        _faces.clear();
+        if (!isActive(mesh) || verts.empty()) {
+            return;
+        }
+        uint32_t stamp = _nextStamp();
+        for (auto v : verts) {
+            for (auto f : vertFaces(v)) {
+                if (_faceStamp[f->id] != stamp) {
+                    _faceStamp[f->id] = stamp;
+                    _faces.push_back(f);
+                }
+            }
+        }
+        threads.parallelFor(_faces.size(), 1024, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                updateFace(_faces[i]);
+            }
+        });
+
+        _verts.clear();
+        for (auto f : _faces) {
+            auto l = f->loop;
+            do {
+                if (_vertStamp[l->v->id] != stamp) {
+                    _vertStamp[l->v->id] = stamp;
+                    _verts.push_back(l->v);
+                }
+                l = l->next;
+            } while (l != f->loop);
+        }
+        writeVerts(mesh, view, _verts, threads);
+    }
+
+    // Faces the last update() recomputed
+    std::span<Face* const> getUpdatedFaces() const {
+        return _faces;
+    }
+
+    // Normal of the face and weights of its corners, faces may be updated
+    // in parallel
+    void updateFace(const Face* f) {
+        const size_t MAX_CORNERS = 16;
+        Loop* corners[MAX_CORNERS];
+        size_t count = 0;
+        auto l = f->loop;
+        do {
+            if (count < MAX_CORNERS) {
+                corners[count] = l;
+            }
+            count++;
+            l = l->next;
+        } while (l != f->loop);
+        if (count <= MAX_CORNERS) {
+            updateFace(f, std::span<Loop* const>(corners, count));
+            return;
+        }
+        std::vector<Loop*> all;
+        for (auto c : faceLoops(f)) {
+            all.push_back(c);
+        }
+        updateFace(f, all);
+    }
+
+    // Same with the loops of the face in order, e.g. cached by MeshBVH
+    void updateFace(const Face* f, std::span<Loop* const> loops) {
+        // Cross products of a face fan sum to twice the face area
+        size_t count = loops.size();
+        glm::vec3 n(0);
+        const glm::vec3& a = loops[0]->v->pos;
+        for (size_t i = 1; i + 1 < count; i++) {
+            n += glm::cross(loops[i]->v->pos - a, loops[i + 1]->v->pos - a);
+        }
+        float len = glm::length(n);
+        _faceNormals[f->id] = len > 0 ? n / len : glm::vec3(0);
+
+        if (_settings.weight == AREA_WEIGHTED) {
+            for (auto l : loops) {
+                _cornerWeights[l->id] = 0.5f * len;
+            }
+            return;
+        }
+
+        // Edge lengths are computed once for both of their corners
+        glm::vec3 prevEdge = a - loops[count - 1]->v->pos;
+        float prevInv = _getInverseLength(prevEdge);
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 edge = loops[i + 1 < count ? i + 1 : 0]->v->pos - loops[i]->v->pos;
+            float inv = _getInverseLength(edge);
+            _cornerWeights[loops[i]->id] = _getAngle(-glm::dot(prevEdge, edge) * prevInv * inv);
+            prevEdge = edge;
+            prevInv = inv;
+        }
+    }
+
+    // Normal of the vertex and of its corners from the face normals.
+    // Calls fn(size_t viewId, const glm::vec3& normal) for the view
+    // vertices of the vertex, ids may repeat
+    template <class Fn>
+    void updateVert(const Vert* v, Fn&& fn) {
+        _updateVert(v, vertLoops(v), fn);
+    }
+
+    // Same with the loops of the vertex, e.g. cached by MeshAdjacency
+    template <class Fn>
+    void updateVert(const Vert* v, std::span<Loop* const> loops, Fn&& fn) {
+        _updateVert(v, loops, fn);
+    }
+
+    // Normals of verts after updateFace() of their faces. Positions and
+    // normals go to their view vertices, which are uploaded through
+    // REMesh::dirtyViewIds
+    void writeVerts(REMesh& mesh, ale::ViewMesh& view, std::span<Vert* const> verts, ThreadPool& threads,
+                    const MeshAdjacency* adjacency = nullptr) {
+        _slotViewIds.resize(threads.getSlotCount());
+        for (auto& ids : _slotViewIds) {
+            ids.clear();
+        }
+        threads.parallelFor(verts.size(), 1024, [&](size_t begin, size_t end, size_t slot) {
+            auto& ids = _slotViewIds[slot];
+            for (size_t i = begin; i < end; i++) {
+                Vert* v = verts[i];
+                auto write = [&](size_t viewId, const glm::vec3& n) {
+                    if (viewId < view.vertices.size()) {
+                        view.vertices[viewId].pos = v->pos;
+                        view.vertices[viewId].normal = n;
+                        ids.push_back(viewId);
+                    }
+                };
+                if (adjacency) {
+                    _updateVert(v, adjacency->getLoops(v), write);
+                } else {
+                    _updateVert(v, vertLoops(v), write);
+                }
+            }
+        });
+        for (auto& ids : _slotViewIds) {
+            mesh.dirtyViewIds.insert(mesh.dirtyViewIds.end(), ids.begin(), ids.end());
+        }
+    }
+
+private:
+    const REMesh* _mesh = nullptr;
+    NormalSettings _settings;
+    float _cosCrease = 1.0f;
+
+    // Unit normals by face and vertex pool id, weights and split normals
+    // by loop pool id
+    std::vector<glm::vec3> _faceNormals;
+    std::vector<glm::vec3> _vertNormals;
+    std::vector<float> _cornerWeights;
+    std::vector<glm::vec3> _cornerNormals;
+
+    // Dedup of elements per update
+    std::vector<uint32_t> _vertStamp;
+    std::vector<uint32_t> _faceStamp;
+    uint32_t _stamp = 0;
+    std::vector<Face*> _faces;
+    std::vector<Vert*> _verts;
+    // View vertices written per worker slot
+    std::vector<std::vector<size_t>> _slotViewIds;
+
+
+    uint32_t _nextStamp() {
+        if (++_stamp == 0) {
+            std::fill(_vertStamp.begin(), _vertStamp.end(), 0);
+            std::fill(_faceStamp.begin(), _faceStamp.end(), 0);
+            _stamp = 1;
+        }
+        return _stamp;
+    }
+
+    // acos() within 7e-5 radians, Abramowitz and Stegun 4.4.45. Weights
+    // need no more and std::acos() is most of the cost of a face
+    static float _getAngle(float cos) {
+        float x = std::min(std::abs(cos), 1.0f);
+        float a = std::sqrt(1.0f - x) * (1.5707288f + x * (-0.2121144f + x * (0.0742610f - 0.0187293f * x)));
+        return cos < 0 ? 3.14159265f - a : a;
+    }
+
+    static float _getInverseLength(const glm::vec3& v) {
+        float len2 = glm::dot(v, v);
+        return len2 > 0 ? 1.0f / std::sqrt(len2) : 0.0f;
+    }
+
+    // Loops is vertLoops(v) or a cached copy of it
+    template <class Range, class Fn>
+    void _updateVert(const Vert* v, Range&& loops, Fn& fn) {
+        // Corners of a vertex use a few view vertices, more are found by
+        // another walk
+        const size_t MAX_SEAMS = 8;
+        size_t seams[MAX_SEAMS];
+        size_t seamCount = 0;
+        bool bMoreSeams = false;
+
+        glm::vec3 n(0);
+        for (auto l : loops) {
+            n += _faceNormals[l->f->id] * _cornerWeights[l->id];
+            if (l->viewId != v->viewId && (seamCount == 0 || seams[seamCount - 1] != l->viewId)) {
+                if (seamCount < MAX_SEAMS) {
+                    seams[seamCount++] = l->viewId;
+                } else {
+                    bMoreSeams = true;
+                }
+            }
+        }
+        float len = glm::length(n);
+        n = len > 0 ? n / len : glm::vec3(0, 0, 1);
+        _vertNormals[v->id] = n;
+
+        if (_settings.bSplit) {
+            _updateCorners(v, loops, fn);
+            return;
+        }
+        fn(v->viewId, n);
+        for (size_t i = 0; i < seamCount; i++) {
+            fn(seams[i], n);
+        }
+        if (bMoreSeams) {
+            for (auto l : loops) {
+                if (l->viewId != v->viewId) {
+                    fn(l->viewId, n);
+                }
+            }
+        }
+    }
+
+    // Each corner sums the faces within the crease angle of its own face
+    template <class Range, class Fn>
+    void _updateCorners(const Vert* v, Range& loops, Fn& fn) {
+        for (auto l : loops) {
+            const glm::vec3& own = _faceNormals[l->f->id];
+            glm::vec3 n(0);
+            for (auto other : loops) {
+                const glm::vec3& normal = _faceNormals[other->f->id];
+                if (other == l || glm::dot(own, normal) >= _cosCrease) {
+                    n += normal * _cornerWeights[other->id];
+                }
+            }
+            float len = glm::length(n);
+            _cornerNormals[l->id] = len > 0 ? n / len : _vertNormals[v->id];
+            fn(l->viewId, _cornerNormals[l->id]);
+        }
+    }
+};
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_NORMALS
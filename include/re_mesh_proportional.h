@@ -0,0 +1,267 @@
+/*
+    Proportional editing on REMesh.
+
+    A transform of the selection also moves the vertices within a radius
+    of it, weighted by a falloff of their distance to the nearest selected
+    vertex. The affected vertices are searched once per drag:
+    - all vertex positions go into a PointGrid with cells of the search
+      radius, the candidates are the points of the cells next to the
+      cells of the selected vertices
+    - a k-d tree over the selected vertices gives the distance of each
+      candidate to the selection, in parallel. Unlike a grid it stays fast
+      when many selected vertices are within the radius
+    - candidates are sorted by that distance
+    A radius below the searched one is a prefix of the sorted vertices, so
+    changing it only recomputes weights. A larger radius searches again
+    with at least twice the radius.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <string>
+#include <span>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <re_mesh.h>
+#include <ale_selection.h>
+#include <ale_spatial_index.h>
+#include <ale_thread_pool.h>
+
+#ifndef ALE_REMESH_PROPORTIONAL
+#define ALE_REMESH_PROPORTIONAL
+
+namespace ale {
+namespace geo {
+
+const std::vector<std::string> ProportionalFalloff_Names { "SMOOTH", "SPHERE", "ROOT", "SHARP", "LINEAR", "CONSTANT", };
+
+enum ProportionalFalloff {
+    SMOOTH_FALLOFF,
+    SPHERE_FALLOFF,
+    ROOT_FALLOFF,
+    SHARP_FALLOFF,
+    LINEAR_FALLOFF,
+    CONSTANT_FALLOFF,
+    FALLOFF_MAX,
+};
+
+
+// Weight of a vertex at t = distance / radius, 1 at the selection
+[[maybe_unused]]
+static float getFalloffWeight(ProportionalFalloff falloff, float t) {
+    t = std::clamp(t, 0.0f, 1.0f);
+    float s = 1.0f - t;
+    switch (falloff) {
+        case SMOOTH_FALLOFF:
+            return s * s * (3.0f - 2.0f * s);
+        case SPHERE_FALLOFF:
+            return std::sqrt(1.0f - t * t);
+        case ROOT_FALLOFF:
+            return std::sqrt(s);
+        case SHARP_FALLOFF:
+            return s * s;
+        case CONSTANT_FALLOFF:
+            return 1.0f;
+        case LINEAR_FALLOFF:
+        case FALLOFF_MAX:
+            break;
+    }
+    return s;
+}
+
+
+class ProportionalEdit {
+public:
+    // Once per drag, before the first apply(). Positions at this point are
+    // the base of all transforms of the drag
+    void begin(REMesh& mesh, const MeshSelection& sel, float radius,
+               ProportionalFalloff falloff, ThreadPool& threads) {
+        clear();
+        _falloff = falloff;
+        _meshVerts = mesh.verts;
+        _positions.resize(_meshVerts.size());
+        for (size_t i = 0; i < _meshVerts.size(); i++) {
+            _positions[i] = _meshVerts[i]->pos;
+        }
+        sel.verts.forEach([&](size_t id) { _selectedPos.push_back(mesh.vertsPool.get(id)->pos); });
+        setRadius(radius, threads);
+    }
+
+    void clear() {
+        _meshVerts.clear();
+        _positions.clear();
+        _selectedPos.clear();
+        _grid.clear();
+        _selectedTree.clear();
+        _verts.clear();
+        _base.clear();
+        _dist.clear();
+        _weights.clear();
+        _searchRadius = 0;
+        _count = 0;
+        _applied = 0;
+    }
+
+    void setRadius(float radius, ThreadPool& threads) {
+        _radius = std::max(radius, MIN_RADIUS);
+        if (_radius > _searchRadius) {
+            _search(std::max(_radius, 2 * _searchRadius), threads);
+        }
+        _count = std::lower_bound(_dist.begin(), _dist.end(), _radius) - _dist.begin();
+        _updateWeights(threads);
+    }
+
+    void setFalloff(ProportionalFalloff falloff, ThreadPool& threads) {
+        _falloff = falloff;
+        _updateWeights(threads);
+    }
+
+    float getRadius() const {
+        return _radius;
+    }
+
+    // Vertices moved by apply(), nearest to the selection first. A larger
+    // radius only appends to them
+    std::span<Vert* const> getVerts() const {
+        return std::span<Vert* const>(_verts).first(_count);
+    }
+
+    // Moves the affected vertices from their base positions. Vertices
+    // left out by a smaller radius go back to their base
+    void apply(REMesh& mesh, const glm::mat4& transform, ThreadPool& threads) {
+        transformVerts(mesh, getVerts(), std::span<const glm::vec3>(_base).first(_count),
+                       transform, threads, _weights);
+        for (size_t i = _count; i < _applied; i++) {
+            mesh.prepareWrite(_verts[i]);
+            _verts[i]->pos = _base[i];
+            mesh.dirtyVerts.push_back(_verts[i]);
+        }
+        _applied = _count;
+    }
+
+private:
+    static constexpr float MIN_RADIUS = 1e-4f;
+
+    ProportionalFalloff _falloff = SMOOTH_FALLOFF;
+    float _radius = 0;
+    float _searchRadius = 0;
+
+    // All vertices of the mesh at the start of the drag
+    std::vector<Vert*> _meshVerts;
+    std::vector<glm::vec3> _positions;
+    std::vector<glm::vec3> _selectedPos;
+    PointGrid _grid;
+    PointKdTree _selectedTree;
+
+    // Vertices within the search radius sorted by distance
+    std::vector<Vert*> _verts;
+    std::vector<glm::vec3> _base;
+    std::vector<float> _dist;
+    // Weights of the first _count vertices, the ones within the radius
+    std::vector<float> _weights;
+    size_t _count = 0;
+    size_t _applied = 0;
+
+
+    void _search(float radius, ThreadPool& threads) {
+        _searchRadius = radius;
+        _verts.clear();
+        _base.clear();
+        _dist.clear();
+        if (_selectedPos.empty()) {
+            return;
+        }
+        _grid.build(_positions, radius);
+        if (_selectedTree.size() != _selectedPos.size()) {
+            _selectedTree.build(_selectedPos);
+        }
+
+        // Cells within the radius of a selected vertex are the neighbours
+        // of the cells with selected vertices
+        std::vector<GridCell> cells;
+        cells.reserve(_selectedPos.size());
+        for (auto& p : _selectedPos) {
+            cells.push_back(_grid.getCell(p));
+        }
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+        std::vector<GridCell> near;
+        near.reserve(cells.size() * 27);
+        for (auto& c : cells) {
+            for (int64_t x = -1; x <= 1; x++) {
+                for (int64_t y = -1; y <= 1; y++) {
+                    for (int64_t z = -1; z <= 1; z++) {
+                        near.push_back({c.x + x, c.y + y, c.z + z});
+                    }
+                }
+            }
+        }
+        std::sort(near.begin(), near.end());
+        near.erase(std::unique(near.begin(), near.end()), near.end());
+
+        std::vector<uint32_t> candidates;
+        for (auto& c : near) {
+            _grid.forEachInCell(c, [&](uint32_t idx, const glm::vec3&) { candidates.push_back(idx); });
+        }
+
+        const float NONE = std::numeric_limits<float>::max();
+        std::vector<float> dist(candidates.size());
+        threads.parallelFor(candidates.size(), 1024, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                float dist2;
+                bool bFound = _selectedTree.findNearest(_positions[candidates[i]], radius, dist2);
+                dist[i] = bFound ? std::sqrt(dist2) : NONE;
+            }
+        });
+
+        // Ties are ordered by index, so the order of the nearer vertices
+        // does not depend on the search radius
+        std::vector<uint32_t> order;
+        order.reserve(candidates.size());
+        for (uint32_t i = 0; i < candidates.size(); i++) {
+            if (dist[i] <= radius) {
+                order.push_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return dist[a] != dist[b] ? dist[a] < dist[b] : candidates[a] < candidates[b];
+        });
+
+        _verts.reserve(order.size());
+        _base.reserve(order.size());
+        _dist.reserve(order.size());
+        for (auto i : order) {
+            _verts.push_back(_meshVerts[candidates[i]]);
+            _base.push_back(_positions[candidates[i]]);
+            _dist.push_back(dist[i]);
+        }
+    }
+
+    void _updateWeights(ThreadPool& threads) {
+        _weights.resize(_count);
+        threads.parallelFor(_count, 4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                _weights[i] = getFalloffWeight(_falloff, _dist[i] / _radius);
+            }
+        });
+    }
+};
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_PROPORTIONAL
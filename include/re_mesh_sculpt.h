@@ -0,0 +1,450 @@
+/*
+    Sculpt brushes on REMesh.
+
+    A SculptSession keeps a MeshBVH of the mesh and updates its
+    MeshNormals while the mesh is sculpted. A stroke is a row of dabs
+    spaced along the cursor path. A dab:
+    - queries the leaves of the BVH within the brush radius
+    - computes new positions of the vertices the leaves own, one task per
+      leaf. Positions are written after all are computed, so the smooth
+      brush reads the positions before the dab
+    - updates the normals of the faces of the leaves and of their
+      vertices, writes them to the view mesh and refits the leaves. Face
+      loops come from the BVH and one-rings from a MeshAdjacency built
+      with it, so normals and smooth read flat arrays
+    Faces with a moved vertex are in a leaf of the dab, the leaf bounds
+    contain the vertex, so normals elsewhere do not change.
+
+    Brushes:
+    - draw moves vertices along the mean normal under the brush
+    - smooth moves vertices to the mean of their neighbours
+    - grab moves the vertices under the brush at the start of the stroke
+      with the cursor
+    - inflate moves vertices along their own normals
+    Connectivity changes need clear(), edits outside of the session
+    refit() the faces their normals were updated for.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <string>
+#include <span>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <primitives.h>
+#include <re_mesh.h>
+#include <re_mesh_bvh.h>
+#include <re_mesh_iterators.h>
+#include <re_mesh_normals.h>
+#include <re_mesh_proportional.h>
+#include <ale_geo_utils.h>
+#include <ale_thread_pool.h>
+
+#ifndef ALE_REMESH_SCULPT
+#define ALE_REMESH_SCULPT
+
+namespace ale {
+namespace geo {
+
+const std::vector<std::string> SculptBrush_Names { "DRAW", "SMOOTH", "GRAB", "INFLATE", };
+
+enum SculptBrush {
+    DRAW_BRUSH,
+    SMOOTH_BRUSH,
+    GRAB_BRUSH,
+    INFLATE_BRUSH,
+    SCULPT_BRUSH_MAX,
+};
+
+
+struct SculptBrushSettings {
+    SculptBrush type = DRAW_BRUSH;
+    float radius = 0.5f;
+    // Share of the radius a draw or inflate dab moves a vertex, share of
+    // the way to the neighbours for smooth. Grab follows the cursor
+    float strength = 0.5f;
+    ProportionalFalloff falloff = SMOOTH_FALLOFF;
+    // Draw and inflate push inwards
+    bool bInvert = false;
+};
+
+
+// Distance between dabs in brush radii
+const float SCULPT_DAB_SPACING = 0.25f;
+// Offset of a full strength dab in brush radii
+const float SCULPT_DAB_OFFSET = 0.05f;
+
+
+class SculptSession {
+public:
+    bool isActive(const REMesh& mesh) const {
+        return _mesh == &mesh && _normals->isActive(mesh);
+    }
+
+    // Builds the BVH and computes the normals if they are not computed
+    // yet, the view keeps its normals until a brush moves its vertices
+    void begin(REMesh& mesh, MeshNormals& normals, ThreadPool& threads) {
+        clear();
+        _mesh = &mesh;
+        _normals = &normals;
+        if (!normals.isActive(mesh)) {
+            normals.compute(mesh, normals.getSettings(), threads);
+        }
+        _bvh.build(mesh);
+        _adjacency.build(mesh, threads);
+        _touched.assign(mesh.vertsPool.getCapacity(), 0);
+        _vertStamp.assign(mesh.vertsPool.getCapacity(), 0);
+    }
+
+    void clear() {
+        _mesh = nullptr;
+        _normals = nullptr;
+        _bvh.clear();
+        _adjacency.clear();
+        _touched.clear();
+        _vertStamp.clear();
+        _stroke = 0;
+        _stamp = 0;
+        _bStroke = false;
+    }
+
+    // Nearest hit of a ray in mesh space
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir, glm::vec3& out_hit) const {
+        float dist;
+        Face* face;
+        if (!_bvh.raycast(origin, dir, dist, face)) {
+            return false;
+        }
+        out_hit = origin + dir * dist;
+        return true;
+    }
+
+    bool isStroking() const {
+        return _bStroke;
+    }
+
+    void beginStroke(const glm::vec3& center, const SculptBrushSettings& brush) {
+        _bStroke = true;
+        _bFirstDab = true;
+        _strokeStart = center;
+        _lastDab = center;
+        if (++_stroke == 0) {
+            std::fill(_touched.begin(), _touched.end(), 0);
+            _stroke = 1;
+        }
+
+        _grabVerts.clear();
+        _grabBase.clear();
+        _grabWeights.clear();
+        if (brush.type == GRAB_BRUSH) {
+            _bvh.queryLeaves(center, brush.radius, _grabLeaves);
+            for (auto leaf : _grabLeaves) {
+                for (auto v : _bvh.getOwnedVerts(leaf)) {
+                    float dist = glm::length(v->pos - center);
+                    if (dist < brush.radius) {
+                        _grabVerts.push_back(v);
+                        _grabBase.push_back(v->pos);
+                        _grabWeights.push_back(getFalloffWeight(brush.falloff, dist / brush.radius));
+                    }
+                }
+            }
+        }
+    }
+
+    void endStroke() {
+        _bStroke = false;
+    }
+
+    /*
+        Moves the stroke to center, dabs are spaced along the way. Calls
+        onTouch(const std::vector<Vert*>&) with the vertices the stroke is
+        about to move for the first time. Returns the number of dabs
+    */
+    template <class Fn>
+    size_t stroke(REMesh& mesh, ale::ViewMesh& view, const glm::vec3& center,
+                  const SculptBrushSettings& brush, ThreadPool& threads, Fn&& onTouch) {
+        if (!_bStroke || !isActive(mesh)) {
+            return 0;
+        }
+        if (brush.type == GRAB_BRUSH) {
+            if (center == _lastDab && !_bFirstDab) {
+                return 0;
+            }
+            _bFirstDab = false;
+            _lastDab = center;
+            _dab(mesh, view, center, brush, threads, onTouch);
+            return 1;
+        }
+
+        size_t count = 0;
+        if (_bFirstDab) {
+            _bFirstDab = false;
+            _dab(mesh, view, center, brush, threads, onTouch);
+            count++;
+        }
+        float spacing = std::max(brush.radius * SCULPT_DAB_SPACING, 1e-6f);
+        float dist = glm::length(center - _lastDab);
+        if (dist < spacing) {
+            return count;
+        }
+        glm::vec3 step = (center - _lastDab) * (spacing / dist);
+        for (; dist >= spacing; dist -= spacing) {
+            _lastDab += step;
+            _dab(mesh, view, _lastDab, brush, threads, onTouch);
+            count++;
+        }
+        return count;
+    }
+
+    // Bounds of the leaves of faces whose vertices moved outside of the
+    // session, e.g. by undo or the gizmo
+    void refit(const REMesh& mesh, std::span<Face* const> faces, ThreadPool& threads) {
+        if (!isActive(mesh) || faces.empty()) {
+            return;
+        }
+        _leaves.clear();
+        for (auto f : faces) {
+            _leaves.push_back(_bvh.getLeaf(f));
+        }
+        std::sort(_leaves.begin(), _leaves.end());
+        _leaves.erase(std::unique(_leaves.begin(), _leaves.end()), _leaves.end());
+        _bvh.refit(_leaves, threads);
+    }
+
+private:
+    REMesh* _mesh = nullptr;
+    MeshNormals* _normals = nullptr;
+    MeshBVH _bvh;
+    MeshAdjacency _adjacency;
+
+    // Stroke that moved a vertex last, moves are recorded once per stroke
+    std::vector<uint32_t> _touched;
+    uint32_t _stroke = 0;
+    bool _bStroke = false;
+    bool _bFirstDab = false;
+    glm::vec3 _strokeStart = glm::vec3(0);
+    glm::vec3 _lastDab = glm::vec3(0);
+
+    // Grab moves the vertices found at the start of the stroke
+    std::vector<uint32_t> _grabLeaves;
+    std::vector<Vert*> _grabVerts;
+    std::vector<glm::vec3> _grabBase;
+    std::vector<float> _grabWeights;
+
+    // Dedup of vertices per dab
+    std::vector<uint32_t> _vertStamp;
+    uint32_t _stamp = 0;
+
+    // Scratch of a dab. Owned vertices, later faces, of _leaves[i] start
+    // at _offsets[i]
+    std::vector<uint32_t> _leaves;
+    std::vector<size_t> _offsets;
+    std::vector<float> _weights;
+    std::vector<glm::vec3> _newPos;
+    std::vector<glm::vec3> _leafNormals;
+    std::vector<Vert*> _moved;
+    std::vector<glm::vec3> _movedPos;
+    std::vector<Vert*> _firstMoved;
+    std::vector<uint8_t> _faceChanged;
+    std::vector<Vert*> _normalVerts;
+
+
+    uint32_t _nextStamp() {
+        if (++_stamp == 0) {
+            std::fill(_vertStamp.begin(), _vertStamp.end(), 0);
+            _stamp = 1;
+        }
+        return _stamp;
+    }
+
+    template <class Fn>
+    void _dab(REMesh& mesh, ale::ViewMesh& view, const glm::vec3& center,
+              const SculptBrushSettings& brush, ThreadPool& threads, Fn& onTouch) {
+        if (brush.type == GRAB_BRUSH) {
+            _leaves = _grabLeaves;
+            _moved = _grabVerts;
+            _movedPos.resize(_grabVerts.size());
+            glm::vec3 delta = center - _strokeStart;
+            threads.parallelFor(_grabVerts.size(), 4096, [&](size_t begin, size_t end, size_t) {
+                for (size_t i = begin; i < end; i++) {
+                    _movedPos[i] = _grabBase[i] + delta * _grabWeights[i];
+                }
+            });
+        } else {
+            _bvh.queryLeaves(center, brush.radius, _leaves);
+            _computeDab(center, brush, threads);
+        }
+
+        // Pool pages are copied for snapshots on the calling thread only
+        uint32_t moved = _nextStamp();
+        _firstMoved.clear();
+        for (auto v : _moved) {
+            if (_touched[v->id] != _stroke) {
+                _touched[v->id] = _stroke;
+                _firstMoved.push_back(v);
+            }
+            _vertStamp[v->id] = moved;
+            mesh.prepareWrite(v);
+        }
+        if (!_firstMoved.empty()) {
+            onTouch(_firstMoved);
+        }
+        threads.parallelFor(_moved.size(), 4096, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                _moved[i]->pos = _movedPos[i];
+            }
+        });
+
+        // Faces of the leaves with a moved vertex, flagged by their
+        // position in the leaves
+        _offsets.resize(_leaves.size() + 1);
+        _offsets[0] = 0;
+        for (size_t i = 0; i < _leaves.size(); i++) {
+            _offsets[i + 1] = _offsets[i] + _bvh.getNode(_leaves[i]).faceCount;
+        }
+        _faceChanged.resize(_offsets.back());
+        threads.parallelFor(_leaves.size(), 4, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                auto faces = _bvh.getFaces(_leaves[i]);
+                for (size_t k = 0; k < faces.size(); k++) {
+                    bool bChanged = false;
+                    auto loops = _bvh.getFaceLoops(_leaves[i], k);
+                    for (auto l : loops) {
+                        bChanged |= _vertStamp[l->v->id] == moved;
+                    }
+                    if (bChanged) {
+                        _normals->updateFace(faces[k], loops);
+                    }
+                    _faceChanged[_offsets[i] + k] = bChanged;
+                }
+            }
+        });
+
+        uint32_t stamp = _nextStamp();
+        _normalVerts.clear();
+        for (size_t i = 0; i < _leaves.size(); i++) {
+            auto faces = _bvh.getFaces(_leaves[i]);
+            for (size_t k = 0; k < faces.size(); k++) {
+                if (_faceChanged[_offsets[i] + k]) {
+                    _addCornerVerts(_bvh.getFaceLoops(_leaves[i], k), stamp);
+                }
+            }
+        }
+        _normals->writeVerts(mesh, view, _normalVerts, threads, &_adjacency);
+        _bvh.refit(_leaves, threads);
+    }
+
+    void _addCornerVerts(std::span<Loop* const> loops, uint32_t stamp) {
+        for (auto l : loops) {
+            if (_vertStamp[l->v->id] != stamp) {
+                _vertStamp[l->v->id] = stamp;
+                _normalVerts.push_back(l->v);
+            }
+        }
+    }
+
+    // New positions of the owned vertices of _leaves within the radius
+    void _computeDab(const glm::vec3& center, const SculptBrushSettings& brush, ThreadPool& threads) {
+        _offsets.resize(_leaves.size() + 1);
+        _offsets[0] = 0;
+        for (size_t i = 0; i < _leaves.size(); i++) {
+            _offsets[i + 1] = _offsets[i] + _bvh.getNode(_leaves[i]).vertCount;
+        }
+        size_t count = _offsets.back();
+        _weights.resize(count);
+        _newPos.resize(count);
+        _leafNormals.assign(_leaves.size(), glm::vec3(0));
+
+        float r = brush.radius;
+        threads.parallelFor(_leaves.size(), 4, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                auto verts = _bvh.getOwnedVerts(_leaves[i]);
+                glm::vec3 normal(0);
+                for (size_t k = 0; k < verts.size(); k++) {
+                    float dist = glm::length(verts[k]->pos - center);
+                    float w = dist < r ? getFalloffWeight(brush.falloff, dist / r) : 0.0f;
+                    _weights[_offsets[i] + k] = w;
+                    normal += _normals->getVertNormal(verts[k]) * w;
+                }
+                _leafNormals[i] = normal;
+            }
+        });
+
+        glm::vec3 areaNormal(0);
+        for (auto& n : _leafNormals) {
+            areaNormal += n;
+        }
+        float len = glm::length(areaNormal);
+        areaNormal = len > 0 ? areaNormal / len : glm::vec3(0);
+
+        float offset = brush.strength * r * SCULPT_DAB_OFFSET * (brush.bInvert ? -1.0f : 1.0f);
+        float smooth = std::clamp(brush.strength, 0.0f, 1.0f);
+        threads.parallelFor(_leaves.size(), 4, [&](size_t begin, size_t end, size_t) {
+            for (size_t i = begin; i < end; i++) {
+                auto verts = _bvh.getOwnedVerts(_leaves[i]);
+                for (size_t k = 0; k < verts.size(); k++) {
+                    float w = _weights[_offsets[i] + k];
+                    if (w <= 0) {
+                        continue;
+                    }
+                    Vert* v = verts[k];
+                    glm::vec3& pos = _newPos[_offsets[i] + k];
+                    switch (brush.type) {
+                        case DRAW_BRUSH:
+                            pos = v->pos + areaNormal * (offset * w);
+                            break;
+                        case INFLATE_BRUSH:
+                            pos = v->pos + _normals->getVertNormal(v) * (offset * w);
+                            break;
+                        case SMOOTH_BRUSH:
+                            pos = v->pos + (_getNeighbourMean(v) - v->pos) * (smooth * w);
+                            break;
+                        case GRAB_BRUSH:
+                        case SCULPT_BRUSH_MAX:
+                            pos = v->pos;
+                            break;
+                    }
+                }
+            }
+        });
+
+        _moved.clear();
+        _movedPos.clear();
+        for (size_t i = 0; i < _leaves.size(); i++) {
+            auto verts = _bvh.getOwnedVerts(_leaves[i]);
+            for (size_t k = 0; k < verts.size(); k++) {
+                if (_weights[_offsets[i] + k] > 0) {
+                    _moved.push_back(verts[k]);
+                    _movedPos.push_back(_newPos[_offsets[i] + k]);
+                }
+            }
+        }
+    }
+
+    glm::vec3 _getNeighbourMean(const Vert* v) const {
+        glm::vec3 sum(0);
+        size_t count = 0;
+        for (auto u : _adjacency.getVerts(v)) {
+            sum += u->pos;
+            count++;
+        }
+        return count > 0 ? sum / float(count) : v->pos;
+    }
+};
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_SCULPT
@@ -0,0 +1,517 @@
+/*
+    Catmull-Clark and Loop subdivision of REMesh.
+
+    A level builds a new mesh instead of splitting faces in place. Element
+    counts of the result are known up front, so the new pools are allocated
+    once and every new element has a fixed index derived from the old
+    element it comes from (V, E, C, F are old vertex, edge, corner and face
+    counts, a corner is a face loop):
+    - vertices: vertex points [0, V), edge points [V, V + E) and, for
+      Catmull-Clark, face points [V + E, V + E + F)
+    - edges: two halves per old edge, 2 * e + side, and one inner edge per
+      corner, 2 * E + c
+    - loops: four per corner, 4 * c + k
+    - faces: Catmull-Clark makes a quad per corner, Loop a triangle per
+      corner plus a center triangle per old face, C + f
+    Positions, faces, radial cycles and disk cycles are then filled in
+    parallel. Every new element is written by exactly one task.
+
+    Vertices with two border edges follow the cubic B-spline of the border,
+    vertices on non-manifold edges or with more border edges stay in place.
+    UVs and colors are interpolated linearly per face corner, so UV seams
+    are kept. Corners keep the view vertex of the corner they come from,
+    see rebuildViewMesh().
+
+    References:
+    https://en.wikipedia.org/wiki/Catmull%E2%80%93Clark_subdivision_surface
+    https://en.wikipedia.org/wiki/Loop_subdivision_surface
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif // GLM
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+
+//int
+#include <re_mesh.h>
+#include <ale_geo_utils.h>
+#include <ale_thread_pool.h>
+#include <tracer.h>
+
+#ifndef ALE_REMESH_SUBDIVIDE
+#define ALE_REMESH_SUBDIVIDE
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace geo {
+
+enum SubdivisionScheme {
+    CATMULL_CLARK,
+    LOOP_SUBDIVISION,
+};
+
+const int MAX_SUBDIVISION_LEVELS = 4;
+// Larger results are rejected before anything is allocated
+const size_t MAX_SUBDIVISION_FACES = 1 << 24;
+// Elements processed by one parallelFor() chunk at least
+const size_t SUBDIVIDE_MIN_CHUNK = 2048;
+
+
+namespace subdiv {
+
+const size_t NONE = SIZE_MAX;
+
+// Maps pool ids of elements to their position in the element vector
+template <class T>
+static void indexElements(const std::vector<T*>& elems, std::vector<size_t>& out_index,
+                          ThreadPool& threads) {
+    size_t maxId = 0;
+    for (auto e : elems) {
+        maxId = std::max(maxId, e->id);
+    }
+    out_index.assign(elems.empty() ? 0 : maxId + 1, NONE);
+
+    threads.parallelFor(elems.size(), SUBDIVIDE_MIN_CHUNK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            out_index[elems[i]->id] = i;
+        }
+    });
+}
+
+// Inits a pool to exactly count elements and requests all of them as
+// one id range. Pointers and ids are filled in parallel
+template <class T>
+static void allocElements(Pool<T>& pool, std::vector<T*>& out_elems, size_t count,
+                          ThreadPool& threads) {
+    pool.init(count);
+    size_t first = pool.requestRange(count);
+    out_elems.resize(count);
+    threads.parallelFor(count, SUBDIVIDE_MIN_CHUNK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            out_elems[i] = pool.get(first + i);
+            out_elems[i]->id = first + i;
+        }
+    });
+}
+
+static size_t countLoops(const Edge* e) {
+    size_t count = 0;
+    if (auto l = e->loop) {
+        do {
+            count++;
+            l = l->radial_next;
+        } while (l != e->loop);
+    }
+    return count;
+}
+
+// Appends l to the radial cycle of e. last is the previously appended loop
+static void appendRadial(Edge* e, Loop*& last, Loop* l) {
+    if (!last) {
+        e->loop = l;
+    } else {
+        last->radial_next = l;
+        l->radial_prev = last;
+    }
+    last = l;
+}
+
+static void closeRadial(Edge* e, Loop* last) {
+    if (!last) {
+        e->loop = nullptr;
+        return;
+    }
+    last->radial_next = e->loop;
+    e->loop->radial_prev = last;
+}
+
+// Appends e to the disk cycle of v. last is the previously appended edge
+static void appendDisk(Vert* v, Edge*& last, Edge* e) {
+    auto* d = getDisk(e, v);
+    if (!last) {
+        v->edge = e;
+    } else {
+        getDisk(last, v)->next = e;
+        d->prev = last;
+    }
+    last = e;
+}
+
+static void closeDisk(Vert* v, Edge* last) {
+    if (!last) {
+        v->edge = nullptr;
+        return;
+    }
+    getDisk(last, v)->next = v->edge;
+    getDisk(v->edge, v)->prev = last;
+}
+
+} // namespace subdiv
+
+
+/*
+    Builds one subdivision level of in into out. out must be a default
+    constructed mesh. Loop subdivision needs a triangle mesh
+*/
+[[maybe_unused]]
+static bool subdivideOnce(const REMesh& in, REMesh& out, SubdivisionScheme scheme,
+                          ThreadPool& threads) {
+    using namespace subdiv;
+    const bool bLoop = scheme == LOOP_SUBDIVISION;
+
+    if (bLoop && std::any_of(in.faces.begin(), in.faces.end(),
+                             [](const Face* f) { return f->size != 3; })) {
+        trc::log("Loop subdivision needs a triangle mesh", trc::ERROR);
+        return false;
+    }
+
+    std::vector<size_t> vertIdx, edgeIdx, loopIdx, faceIdx;
+    indexElements(in.verts, vertIdx, threads);
+    indexElements(in.edges, edgeIdx, threads);
+    indexElements(in.loops, loopIdx, threads);
+    indexElements(in.faces, faceIdx, threads);
+
+    const size_t V = in.verts.size();
+    const size_t E = in.edges.size();
+    const size_t C = in.loops.size();
+    const size_t F = in.faces.size();
+    // Loop of a corner that lies on the half edge of the previous edge
+    const size_t lastK = bLoop ? 2 : 3;
+
+    const size_t edgeCount = 2 * E + C;
+    out.id = in.id;
+    allocElements(out.vertsPool, out.verts, V + E + (bLoop ? 0 : F), threads);
+    allocElements(out.edgesPool, out.edges, edgeCount, threads);
+    allocElements(out.loopsPool, out.loops, 4 * C, threads);
+    allocElements(out.facesPool, out.faces, bLoop ? C + F : C, threads);
+    allocElements(out.disksPool, out.disks, 2 * edgeCount, threads);
+
+    auto vertPoint = [&](const Vert* v) { return out.verts[vertIdx[v->id]]; };
+    auto edgePoint = [&](const Edge* e) { return out.verts[V + edgeIdx[e->id]]; };
+    auto facePoint = [&](const Face* f) { return out.verts[V + E + faceIdx[f->id]]; };
+    auto halfEdge = [&](const Edge* e, const Vert* v) {
+        return out.edges[2 * edgeIdx[e->id] + (e->v1 == v ? 0 : 1)];
+    };
+    auto innerEdge = [&](const Loop* l) { return out.edges[2 * E + loopIdx[l->id]]; };
+    auto newLoop = [&](const Loop* l, size_t k) { return out.loops[4 * loopIdx[l->id] + k]; };
+    auto setDisks = [&](Edge* e, size_t i) {
+        e->d1 = out.disks[2 * i];
+        e->d2 = out.disks[2 * i + 1];
+    };
+
+    // Face points, and center faces of Loop subdivision
+    std::vector<glm::vec3> faceCenters(F);
+    std::vector<glm::vec2> faceUVs(F);
+    threads.parallelFor(F, SUBDIVIDE_MIN_CHUNK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const Face* f = in.faces[i];
+            glm::vec3 pos(0);
+            glm::vec3 color(0);
+            glm::vec2 uv(0);
+            float n = 0;
+            auto l = f->loop;
+            do {
+                pos += l->v->pos;
+                color += l->v->color;
+                uv += l->texCoord;
+                n++;
+                l = l->next;
+            } while (l != f->loop);
+
+            faceCenters[i] = pos / n;
+            faceUVs[i] = uv / n;
+
+            if (bLoop) {
+                Face* center = out.faces[C + i];
+                center->loop = newLoop(f->loop, 3);
+                center->nor = nullptr;
+                center->size = 3;
+                center->primitiveId = f->primitiveId;
+            } else {
+                Vert* fp = out.verts[V + E + i];
+                fp->pos = faceCenters[i];
+                fp->color = color / n;
+                fp->texCoord = faceUVs[i];
+                fp->viewId = f->loop->viewId;
+            }
+        }
+    });
+
+    // Edge points and half edges
+    threads.parallelFor(E, SUBDIVIDE_MIN_CHUNK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const Edge* e = in.edges[i];
+            glm::vec3 mid = (e->v1->pos + e->v2->pos) * 0.5f;
+            glm::vec3 pos = mid;
+
+            if (countLoops(e) == 2) {
+                const Loop* l1 = e->loop;
+                const Loop* l2 = l1->radial_next;
+                if (bLoop) {
+                    pos = 0.75f * mid + 0.125f * (l1->prev->v->pos + l2->prev->v->pos);
+                } else {
+                    pos = 0.5f * mid + 0.25f * (faceCenters[faceIdx[l1->f->id]] +
+                                                faceCenters[faceIdx[l2->f->id]]);
+                }
+            }
+
+            Vert* ep = out.verts[V + i];
+            ep->pos = pos;
+            ep->color = (e->v1->color + e->v2->color) * 0.5f;
+            ep->texCoord = (e->v1->texCoord + e->v2->texCoord) * 0.5f;
+            ep->viewId = e->v1->viewId;
+
+            for (size_t side = 0; side < 2; side++) {
+                Vert* v = side == 0 ? e->v1 : e->v2;
+                Edge* half = out.edges[2 * i + side];
+                half->v1 = vertPoint(v);
+                half->v2 = ep;
+                setDisks(half, 2 * i + side);
+
+                // Radial order follows the old edge
+                Loop* last = nullptr;
+                if (auto l = e->loop) {
+                    do {
+                        appendRadial(half, last, l->v == v ? newLoop(l, 0) : newLoop(l->next, lastK));
+                        l = l->radial_next;
+                    } while (l != e->loop);
+                }
+                closeRadial(half, last);
+            }
+        }
+    });
+
+    // Vertex points
+    threads.parallelFor(V, SUBDIVIDE_MIN_CHUNK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const Vert* v = in.verts[i];
+            Vert* vp = out.verts[i];
+            vp->pos = v->pos;
+            vp->color = v->color;
+            vp->texCoord = v->texCoord;
+            vp->viewId = v->viewId;
+
+            if (!v->edge) {
+                continue;
+            }
+
+            size_t n = 0;
+            size_t borders = 0;
+            bool bFixed = false;
+            glm::vec3 ring(0);
+            glm::vec3 borderRing(0);
+            glm::vec3 faceSum(0);
+            float faceCount = 0;
+
+            auto e = v->edge;
+            do {
+                glm::vec3 other = getOtherVert(e, v)->pos;
+                size_t loops = countLoops(e);
+                ring += other;
+                n++;
+                if (loops == 1) {
+                    borders++;
+                    borderRing += other;
+                } else if (loops != 2) {
+                    bFixed = true;
+                }
+
+                if (!bLoop && e->loop) {
+                    auto l = e->loop;
+                    do {
+                        if (l->v == v) {
+                            faceSum += faceCenters[faceIdx[l->f->id]];
+                            faceCount++;
+                        }
+                        l = l->radial_next;
+                    } while (l != e->loop);
+                }
+                e = getDisk(e, v)->next;
+            } while (e != v->edge);
+
+            if (bFixed || (borders != 0 && borders != 2) || n < 3) {
+                continue;
+            }
+
+            float valence = static_cast<float>(n);
+            if (borders == 2) {
+                vp->pos = (borderRing + 6.0f * v->pos) * 0.125f;
+            } else if (bLoop) {
+                float beta = n == 3 ? 3.0f / 16.0f : 3.0f / (8.0f * valence);
+                vp->pos = (1.0f - valence * beta) * v->pos + beta * ring;
+            } else if (faceCount > 0) {
+                // (F + 2R + (n - 3)P) / n, R is the average of edge midpoints
+                glm::vec3 avgFace = faceSum / faceCount;
+                glm::vec3 avgMid = (ring / valence + v->pos) * 0.5f;
+                vp->pos = (avgFace + 2.0f * avgMid + (valence - 3.0f) * v->pos) / valence;
+            }
+        }
+    });
+
+    // Faces, loops and inner edges of every corner
+    threads.parallelFor(C, SUBDIVIDE_MIN_CHUNK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            const Loop* l = in.loops[i];
+            const Loop* next = l->next;
+            const Loop* prev = l->prev;
+            size_t fIdx = faceIdx[l->f->id];
+
+            Vert* epNext = edgePoint(l->e);
+            Vert* epPrev = edgePoint(prev->e);
+            glm::vec2 uvNext = (l->texCoord + next->texCoord) * 0.5f;
+            glm::vec2 uvPrev = (prev->texCoord + l->texCoord) * 0.5f;
+
+            Face* f = out.faces[i];
+            f->nor = nullptr;
+            f->size = bLoop ? 3 : 4;
+            f->primitiveId = l->f->primitiveId;
+
+            Loop* q[4];
+            for (size_t k = 0; k < 4; k++) {
+                q[k] = newLoop(l, k);
+                q[k]->viewId = l->viewId;
+                q[k]->f = f;
+            }
+
+            q[0]->v = vertPoint(l->v);
+            q[0]->e = halfEdge(l->e, l->v);
+            q[0]->texCoord = l->texCoord;
+            q[1]->v = epNext;
+            q[1]->e = innerEdge(l);
+            q[1]->texCoord = uvNext;
+            q[lastK]->v = epPrev;
+            q[lastK]->e = halfEdge(prev->e, l->v);
+            q[lastK]->texCoord = uvPrev;
+
+            Edge* inner = innerEdge(l);
+            inner->v1 = epNext;
+            setDisks(inner, 2 * E + i);
+            Loop* last = nullptr;
+            appendRadial(inner, last, q[1]);
+
+            if (bLoop) {
+                // q[3] is the corner of the center triangle
+                q[3]->v = epNext;
+                q[3]->e = innerEdge(next);
+                q[3]->texCoord = uvNext;
+                q[3]->f = out.faces[C + fIdx];
+                q[3]->next = newLoop(next, 3);
+                q[3]->prev = newLoop(prev, 3);
+
+                inner->v2 = epPrev;
+                appendRadial(inner, last, newLoop(prev, 3));
+            } else {
+                q[2]->v = facePoint(l->f);
+                q[2]->e = innerEdge(prev);
+                q[2]->texCoord = faceUVs[fIdx];
+
+                inner->v2 = facePoint(l->f);
+                appendRadial(inner, last, newLoop(next, 2));
+            }
+            closeRadial(inner, last);
+
+            size_t size = f->size;
+            for (size_t k = 0; k < size; k++) {
+                q[k]->next = q[(k + 1) % size];
+                q[k]->prev = q[(k + size - 1) % size];
+            }
+            f->loop = q[0];
+        }
+    });
+
+    // Disk cycles need the vertices of all new edges
+    threads.parallelFor(out.verts.size(), SUBDIVIDE_MIN_CHUNK, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; i++) {
+            Vert* nv = out.verts[i];
+            Edge* last = nullptr;
+
+            if (i < V) {
+                const Vert* v = in.verts[i];
+                if (auto e = v->edge) {
+                    do {
+                        appendDisk(nv, last, halfEdge(e, v));
+                        e = getDisk(e, v)->next;
+                    } while (e != v->edge);
+                }
+            } else if (i < V + E) {
+                size_t eIdx = i - V;
+                const Edge* e = in.edges[eIdx];
+                appendDisk(nv, last, out.edges[2 * eIdx]);
+                appendDisk(nv, last, out.edges[2 * eIdx + 1]);
+                if (auto l = e->loop) {
+                    do {
+                        appendDisk(nv, last, innerEdge(l));
+                        if (bLoop) {
+                            appendDisk(nv, last, innerEdge(l->next));
+                        }
+                        l = l->radial_next;
+                    } while (l != e->loop);
+                }
+            } else {
+                const Face* f = in.faces[i - V - E];
+                auto l = f->loop;
+                do {
+                    appendDisk(nv, last, innerEdge(l));
+                    l = l->next;
+                } while (l != f->loop);
+            }
+            closeDisk(nv, last);
+        }
+    });
+
+    return true;
+}
+
+
+/*
+    Subdivides a mesh levels times in place. Pointers to elements of the
+    mesh are invalidated. The ViewMesh has to be rebuilt afterwards
+*/
+[[maybe_unused]]
+static bool subdivide(REMesh& mesh, SubdivisionScheme scheme, int levels, ThreadPool& threads) {
+    if (levels < 1 || levels > MAX_SUBDIVISION_LEVELS) {
+        trc::log("Subdivision level must be in [1, " + std::to_string(MAX_SUBDIVISION_LEVELS) + "]",
+                 trc::ERROR);
+        return false;
+    }
+
+    // Catmull-Clark makes a quad per corner, then 4 quads per quad
+    size_t facesAfter = scheme == LOOP_SUBDIVISION ? mesh.faces.size() * 4 : mesh.loops.size();
+    for (int i = 1; i < levels; i++) {
+        facesAfter *= 4;
+    }
+    if (facesAfter > MAX_SUBDIVISION_FACES) {
+        trc::log("Subdivision of REMesh " + std::to_string(mesh.id) + " would make " +
+                 std::to_string(facesAfter) + " faces, skipping", trc::WARNING);
+        return false;
+    }
+
+    size_t facesBefore = mesh.faces.size();
+    for (int i = 0; i < levels; i++) {
+        REMesh result;
+        if (!subdivideOnce(mesh, result, scheme, threads)) {
+            return false;
+        }
+        mesh = std::move(result);
+    }
+
+    trc::log("REMesh " + std::to_string(mesh.id) + " subdivided: " +
+             std::to_string(facesBefore) + " -> " + std::to_string(mesh.faces.size()) + " faces");
+    return true;
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_SUBDIVIDE
@@ -0,0 +1,516 @@
+/*
+    Validation and topology statistics of REMesh.
+
+    validate() checks the mesh in parallel and returns a MeshReport:
+    - element vectors: ids match the pools, nothing is listed twice
+    - pointers: every link points to a live element of the mesh, killed
+      elements that are not compacted yet count as removed
+    - cycles: face loops, radial loops of edges and disk cycles of
+      vertices are closed and linked both ways, loops follow their edges
+    - orphans: every loop is in a face and in a radial cycle, every edge
+      in the disks of its vertices, every disk belongs to an edge
+    Errors are counted and the first maxIssues are kept. The statistics
+    count wire, boundary and non-manifold edges, boundary loops (holes),
+    connected components and the Euler characteristic V - E + F. Counts
+    are exact for meshes without errors.
+
+    Pointers are followed, so they must point into the mesh pools. A
+    validation is O(elements) plus one serial union-find over the edges.
+*/
+
+//ext
+#pragma once
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <functional>
+
+//int
+#include <re_mesh.h>
+#include <ale_geo_utils.h>
+#include <ale_thread_pool.h>
+
+#ifndef ALE_REMESH_VALIDATE
+#define ALE_REMESH_VALIDATE
+
+namespace ale {
+namespace geo {
+
+const std::vector<std::string> MeshElement_Names { "VERT", "EDGE", "DISK", "LOOP", "FACE", };
+
+enum MeshElement {
+    MESH_VERT,
+    MESH_EDGE,
+    MESH_DISK,
+    MESH_LOOP,
+    MESH_FACE,
+    MESH_ELEMENT_MAX,
+};
+
+const std::vector<std::string> MeshIssue_Names {
+    "DANGLING POINTER", "BAD ELEMENT ID", "DEGENERATE ELEMENT", "BROKEN FACE CYCLE",
+    "BROKEN RADIAL CYCLE", "BROKEN DISK CYCLE", "ORPHAN ELEMENT",
+};
+
+enum MeshIssueType {
+    // A link is null or points to an element that is not in the mesh
+    DANGLING_POINTER,
+    // Id out of the pool or not the element, element listed twice
+    BAD_ELEMENT_ID,
+    // Face with less than 3 corners or a vertex twice, edge with one
+    // vertex
+    DEGENERATE_ELEMENT,
+    BROKEN_FACE_CYCLE,
+    BROKEN_RADIAL_CYCLE,
+    BROKEN_DISK_CYCLE,
+    // Live elements not reached from their owners
+    ORPHAN_ELEMENT,
+    MESH_ISSUE_MAX,
+};
+
+// Id of an issue of a whole element type, e.g. orphans found by counts
+const size_t NO_ELEMENT_ID = SIZE_MAX;
+
+struct MeshIssue {
+    MeshIssueType type;
+    MeshElement element;
+    size_t id;
+};
+
+
+struct MeshReport {
+    // Live elements, killed ones are skipped
+    size_t verts = 0;
+    size_t edges = 0;
+    size_t disks = 0;
+    size_t loops = 0;
+    size_t faces = 0;
+
+    // Verts without edges
+    size_t isolatedVerts = 0;
+    // Edges with no faces, one face and more than two faces
+    size_t wireEdges = 0;
+    size_t boundaryEdges = 0;
+    size_t nonManifoldEdges = 0;
+    // Manifold edges whose two faces wind the same way
+    size_t flippedEdges = 0;
+    // Cycles of boundary edges, joined where they share a vertex
+    size_t boundaryLoops = 0;
+    size_t components = 0;
+    int64_t eulerCharacteristic = 0;
+    // Sum of the genus of the components of an oriented 2-manifold, -1
+    // for other meshes
+    int64_t genus = -1;
+
+    size_t errorCount = 0;
+    // First errors, sorted by element and id
+    std::vector<MeshIssue> issues;
+
+    bool isValid() const {
+        return errorCount == 0;
+    }
+
+    bool isManifold() const {
+        return isValid() && wireEdges == 0 && nonManifoldEdges == 0 && isolatedVerts == 0;
+    }
+
+    std::string toString() const {
+        std::string result =
+            std::to_string(verts) + " verts, " + std::to_string(edges) + " edges, " +
+            std::to_string(faces) + " faces, " + std::to_string(loops) + " loops, " +
+            "Euler characteristic " + std::to_string(eulerCharacteristic) + ", " +
+            std::to_string(components) + " components, " +
+            std::to_string(boundaryLoops) + " boundary loops";
+        if (genus >= 0) {
+            result += ", genus " + std::to_string(genus);
+        }
+        if (isolatedVerts || wireEdges || nonManifoldEdges || flippedEdges) {
+            result += ", non-manifold: " + std::to_string(isolatedVerts) + " isolated verts, " +
+                      std::to_string(wireEdges) + " wire edges, " +
+                      std::to_string(nonManifoldEdges) + " edges of 3+ faces, " +
+                      std::to_string(flippedEdges) + " flipped edges";
+        }
+        result += ", " + std::to_string(errorCount) + " errors";
+        for (auto& issue : issues) {
+            result += "\n  " + MeshIssue_Names[issue.type] + " at " +
+                      MeshElement_Names[issue.element] + " " +
+                      (issue.id == NO_ELEMENT_ID ? "*" : std::to_string(issue.id));
+        }
+        return result;
+    }
+};
+
+
+namespace validation {
+
+// Elements of one type that are part of the mesh: listed in the element
+// vector, live in the pool and not killed
+template <class T>
+class ElementSet {
+public:
+    ElementSet(const Pool<T>& pool, const std::vector<size_t>& killed)
+        : _pool(pool), _bits((pool.getCapacity() + 63) / 64), _killed(_bits.size(), 0) {
+        for (auto id : killed) {
+            if (id < pool.getCapacity()) {
+                _killed[id / 64] |= uint64_t(1) << (id % 64);
+            }
+        }
+    }
+
+    bool isKilled(size_t id) const {
+        return _killed[id / 64] & (uint64_t(1) << (id % 64));
+    }
+
+    bool isValidId(const T* p) const {
+        return p->id < _pool.getCapacity() && _pool.get(p->id) == p && _pool.isLive(p->id);
+    }
+
+    // Returns false if the element was inserted before
+    bool insert(size_t id) {
+        uint64_t bit = uint64_t(1) << (id % 64);
+        return !(_bits[id / 64].fetch_or(bit, std::memory_order_relaxed) & bit);
+    }
+
+    bool contains(size_t id) const {
+        return _bits[id / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (id % 64));
+    }
+
+    // Inserted ids passed isValidId(), the pool is not asked again
+    bool contains(const T* p) const {
+        return p && p->id < _pool.getCapacity() && _pool.get(p->id) == p && contains(p->id);
+    }
+
+private:
+    const Pool<T>& _pool;
+    std::vector<std::atomic<uint64_t>> _bits;
+    std::vector<uint64_t> _killed;
+};
+
+
+// Counters and first issues of one worker slot
+struct SlotReport {
+    MeshReport report;
+    // Vert degrees and loops reached from faces and edges, compared to
+    // the totals
+    size_t diskEdges = 0;
+    size_t faceLoops = 0;
+    size_t radialLoops = 0;
+
+    void addIssue(MeshIssueType type, MeshElement element, size_t id, size_t maxIssues) {
+        report.errorCount++;
+        if (report.issues.size() < maxIssues) {
+            report.issues.push_back({type, element, id});
+        }
+    }
+};
+
+
+[[maybe_unused]]
+static uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+[[maybe_unused]]
+static void unite(std::vector<uint32_t>& parents, uint32_t a, uint32_t b) {
+    a = findRoot(parents, a);
+    b = findRoot(parents, b);
+    if (a != b) {
+        parents[std::max(a, b)] = std::min(a, b);
+    }
+}
+
+
+// Inserts the listed elements of a type, checks their ids and returns
+// the number of live ones
+template <class T>
+static size_t validateIds(const std::vector<T*>& elems, MeshElement type, ElementSet<T>& set,
+                          std::vector<SlotReport>& slots, size_t maxIssues, ThreadPool& threads) {
+    std::vector<size_t> counts(slots.size(), 0);
+    threads.parallelFor(elems.size(), 4096, [&](size_t begin, size_t end, size_t slot) {
+        auto& out = slots[slot];
+        for (size_t i = begin; i < end; i++) {
+            const T* p = elems[i];
+            if (!p) {
+                out.addIssue(DANGLING_POINTER, type, NO_ELEMENT_ID, maxIssues);
+            } else if (!set.isValidId(p)) {
+                out.addIssue(BAD_ELEMENT_ID, type, p->id, maxIssues);
+            } else if (set.isKilled(p->id)) {
+                continue;
+            } else if (!set.insert(p->id)) {
+                out.addIssue(BAD_ELEMENT_ID, type, p->id, maxIssues);
+            } else {
+                counts[slot]++;
+            }
+        }
+    });
+    return std::accumulate(counts.begin(), counts.end(), size_t(0));
+}
+
+} // namespace validation
+
+
+// Checks the structure of the mesh, see the top of the file
+[[maybe_unused]]
+static MeshReport validate(const REMesh& mesh, ThreadPool& threads, size_t maxIssues = 32) {
+    using namespace validation;
+    ElementSet<Vert> verts(mesh.vertsPool, mesh.killedVerts);
+    ElementSet<Edge> edges(mesh.edgesPool, mesh.killedEdges);
+    ElementSet<Disk> disks(mesh.disksPool, mesh.killedDisks);
+    ElementSet<Loop> loops(mesh.loopsPool, mesh.killedLoops);
+    ElementSet<Face> faces(mesh.facesPool, mesh.killedFaces);
+    std::vector<SlotReport> slots(threads.getSlotCount());
+
+    size_t vertCount = validateIds(mesh.verts, MESH_VERT, verts, slots, maxIssues, threads);
+    size_t edgeCount = validateIds(mesh.edges, MESH_EDGE, edges, slots, maxIssues, threads);
+    size_t diskCount = validateIds(mesh.disks, MESH_DISK, disks, slots, maxIssues, threads);
+    size_t loopCount = validateIds(mesh.loops, MESH_LOOP, loops, slots, maxIssues, threads);
+    size_t faceCount = validateIds(mesh.faces, MESH_FACE, faces, slots, maxIssues, threads);
+
+    // Walks stop after this many steps, so broken cycles end too
+    const size_t maxSteps = std::max(loopCount, 2 * edgeCount) + 1;
+
+    // Loops link to their face, their corner and edge and both cycles
+    threads.parallelFor(mesh.loops.size(), 4096, [&](size_t begin, size_t end, size_t slot) {
+        auto& out = slots[slot];
+        for (size_t i = begin; i < end; i++) {
+            const Loop* l = mesh.loops[i];
+            if (!loops.contains(l)) {
+                continue;
+            }
+            if (!verts.contains(l->v) || !edges.contains(l->e) || !faces.contains(l->f) ||
+                !loops.contains(l->next) || !loops.contains(l->prev) ||
+                !loops.contains(l->radial_next) || !loops.contains(l->radial_prev)) {
+                out.addIssue(DANGLING_POINTER, MESH_LOOP, l->id, maxIssues);
+                continue;
+            }
+            if (l->next->prev != l || l->prev->next != l || l->next->f != l->f ||
+                !((l->e->v1 == l->v && l->e->v2 == l->next->v) ||
+                  (l->e->v2 == l->v && l->e->v1 == l->next->v))) {
+                out.addIssue(BROKEN_FACE_CYCLE, MESH_LOOP, l->id, maxIssues);
+            }
+            if (l->radial_next->radial_prev != l || l->radial_prev->radial_next != l ||
+                l->radial_next->e != l->e) {
+                out.addIssue(BROKEN_RADIAL_CYCLE, MESH_LOOP, l->id, maxIssues);
+            }
+        }
+    });
+
+    // Face cycles close after size loops of the face
+    threads.parallelFor(mesh.faces.size(), 4096, [&](size_t begin, size_t end, size_t slot) {
+        auto& out = slots[slot];
+        std::vector<const Vert*> corners;
+        for (size_t i = begin; i < end; i++) {
+            const Face* f = mesh.faces[i];
+            if (!faces.contains(f)) {
+                continue;
+            }
+            if (!loops.contains(f->loop)) {
+                out.addIssue(DANGLING_POINTER, MESH_FACE, f->id, maxIssues);
+                continue;
+            }
+            size_t size = 0;
+            const Loop* l = f->loop;
+            corners.clear();
+            do {
+                if (!loops.contains(l) || l->f != f || size > std::min<size_t>(f->size, maxSteps)) {
+                    break;
+                }
+                size++;
+                corners.push_back(l->v);
+                l = l->next;
+            } while (l != f->loop);
+
+            std::sort(corners.begin(), corners.end(), std::less<>());
+            if (l != f->loop || size != f->size) {
+                out.addIssue(BROKEN_FACE_CYCLE, MESH_FACE, f->id, maxIssues);
+            } else if (size < 3 || std::adjacent_find(corners.begin(), corners.end()) != corners.end()) {
+                out.addIssue(DEGENERATE_ELEMENT, MESH_FACE, f->id, maxIssues);
+            }
+            out.faceLoops += size;
+        }
+    });
+
+    // Edges are linked both ways in the disks of their verts, their
+    // radial cycle gives the number of faces. Vertex ids of the edges are
+    // kept for the union-find, the top bit marks boundary edges
+    const uint32_t BOUNDARY_BIT = uint32_t(1) << 31;
+    std::vector<std::pair<uint32_t, uint32_t>> edgeVerts(mesh.edges.size(), {0, 0});
+    threads.parallelFor(mesh.edges.size(), 4096, [&](size_t begin, size_t end, size_t slot) {
+        auto& out = slots[slot];
+        for (size_t i = begin; i < end; i++) {
+            const Edge* e = mesh.edges[i];
+            if (!edges.contains(e)) {
+                continue;
+            }
+            if (!verts.contains(e->v1) || !verts.contains(e->v2) ||
+                !disks.contains(e->d1) || !disks.contains(e->d2) ||
+                (e->loop && !loops.contains(e->loop))) {
+                out.addIssue(DANGLING_POINTER, MESH_EDGE, e->id, maxIssues);
+                continue;
+            }
+            if (e->v1 == e->v2 || e->d1 == e->d2) {
+                out.addIssue(DEGENERATE_ELEMENT, MESH_EDGE, e->id, maxIssues);
+                continue;
+            }
+            edgeVerts[i] = {uint32_t(e->v1->id), uint32_t(e->v2->id)};
+
+            for (const Vert* v : {e->v1, e->v2}) {
+                const Disk* d = getDisk(e, v);
+                auto isLinked = [&](const Edge* other, bool bNext) {
+                    if (!edges.contains(other) || (other->v1 != v && other->v2 != v)) {
+                        return false;
+                    }
+                    const Disk* od = getDisk(other, v);
+                    return bNext ? od->prev == e : od->next == e;
+                };
+                if (!isLinked(d->next, true) || !isLinked(d->prev, false)) {
+                    out.addIssue(BROKEN_DISK_CYCLE, MESH_EDGE, e->id, maxIssues);
+                    break;
+                }
+            }
+
+            if (!e->loop) {
+                out.report.wireEdges++;
+                continue;
+            }
+            size_t count = 0;
+            const Loop* l = e->loop;
+            do {
+                if (!loops.contains(l) || l->e != e || count >= maxSteps) {
+                    break;
+                }
+                count++;
+                l = l->radial_next;
+            } while (l != e->loop);
+            out.radialLoops += count;
+            if (l != e->loop) {
+                out.addIssue(BROKEN_RADIAL_CYCLE, MESH_EDGE, e->id, maxIssues);
+            } else if (count == 1) {
+                out.report.boundaryEdges++;
+                edgeVerts[i].first |= BOUNDARY_BIT;
+            } else if (count > 2) {
+                out.report.nonManifoldEdges++;
+            } else if (e->loop->v == e->loop->radial_next->v) {
+                out.report.flippedEdges++;
+            }
+        }
+    });
+
+    // Disk cycles of verts close and hold only edges of the vertex
+    threads.parallelFor(mesh.verts.size(), 4096, [&](size_t begin, size_t end, size_t slot) {
+        auto& out = slots[slot];
+        for (size_t i = begin; i < end; i++) {
+            const Vert* v = mesh.verts[i];
+            if (!verts.contains(v)) {
+                continue;
+            }
+            if (!v->edge) {
+                out.report.isolatedVerts++;
+                continue;
+            }
+            size_t count = 0;
+            const Edge* e = v->edge;
+            do {
+                if (!edges.contains(e) || (e->v1 != v && e->v2 != v) ||
+                    !disks.contains(getDisk(e, v)) || count >= maxSteps) {
+                    break;
+                }
+                count++;
+                e = getDisk(e, v)->next;
+            } while (e != v->edge);
+            if (e != v->edge) {
+                out.addIssue(BROKEN_DISK_CYCLE, MESH_VERT, v->id, maxIssues);
+            }
+            out.diskEdges += count;
+        }
+    });
+
+    MeshReport report;
+    size_t diskEdges = 0;
+    size_t faceLoops = 0;
+    size_t radialLoops = 0;
+    for (auto& s : slots) {
+        report.isolatedVerts += s.report.isolatedVerts;
+        report.wireEdges += s.report.wireEdges;
+        report.boundaryEdges += s.report.boundaryEdges;
+        report.nonManifoldEdges += s.report.nonManifoldEdges;
+        report.flippedEdges += s.report.flippedEdges;
+        report.errorCount += s.report.errorCount;
+        report.issues.insert(report.issues.end(), s.report.issues.begin(), s.report.issues.end());
+        diskEdges += s.diskEdges;
+        faceLoops += s.faceLoops;
+        radialLoops += s.radialLoops;
+    }
+    report.verts = vertCount;
+    report.edges = edgeCount;
+    report.disks = diskCount;
+    report.loops = loopCount;
+    report.faces = faceCount;
+
+    // Cycles above are closed, elements that are left out of them are
+    // found by counts
+    auto addOrphans = [&](bool bOrphans, MeshElement element) {
+        if (bOrphans) {
+            report.errorCount++;
+            report.issues.push_back({ORPHAN_ELEMENT, element, NO_ELEMENT_ID});
+        }
+    };
+    addOrphans(faceLoops != loopCount || radialLoops != loopCount, MESH_LOOP);
+    addOrphans(diskEdges != 2 * edgeCount, MESH_EDGE);
+    addOrphans(diskCount != 2 * edgeCount, MESH_DISK);
+
+    std::sort(report.issues.begin(), report.issues.end(), [](const auto& a, const auto& b) {
+        return a.element != b.element ? a.element < b.element : a.id < b.id;
+    });
+    if (report.issues.size() > maxIssues) {
+        report.issues.resize(maxIssues);
+    }
+
+    // Components and holes by union-find over vertex pool ids. Links
+    // were checked above, broken meshes get no statistics
+    report.eulerCharacteristic = int64_t(vertCount) - int64_t(edgeCount) + int64_t(faceCount);
+    if (!report.isValid()) {
+        return report;
+    }
+    std::vector<uint32_t> parents(mesh.vertsPool.getCapacity());
+    std::iota(parents.begin(), parents.end(), 0);
+    std::vector<uint32_t> boundaryParents = parents;
+    std::vector<uint8_t> bBoundary(parents.size(), 0);
+    for (auto [v1, v2] : edgeVerts) {
+        uint32_t id = v1 & ~BOUNDARY_BIT;
+        unite(parents, id, v2);
+        if (v1 & BOUNDARY_BIT) {
+            unite(boundaryParents, id, v2);
+            bBoundary[id] = 1;
+            bBoundary[v2] = 1;
+        }
+    }
+    for (uint32_t id = 0; id < parents.size(); id++) {
+        if (!verts.contains(id)) {
+            continue;
+        }
+        report.components += findRoot(parents, id) == id;
+        report.boundaryLoops += bBoundary[id] && findRoot(boundaryParents, id) == id;
+    }
+
+    // chi = 2c - 2g - b for oriented surfaces
+    if (report.isManifold() && report.flippedEdges == 0) {
+        int64_t twiceGenus = 2 * int64_t(report.components) - int64_t(report.boundaryLoops) -
+                             report.eulerCharacteristic;
+        report.genus = twiceGenus >= 0 && twiceGenus % 2 == 0 ? twiceGenus / 2 : -1;
+    }
+    return report;
+}
+
+} // namespace geo
+} // namespace ale
+
+#endif // ALE_REMESH_VALIDATE
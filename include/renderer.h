@@ -28,12 +28,41 @@ Implementation details:
   POI: look for `vkb_` and vkb:: namespaces prefixes for VkBootstrap
   structures
 - This code uses a single buffer for all vertices and a single buffer for
-  all indices for performance reasons. It uses push constants to
-  apply individual object positions
-  POI: createVertexBuffer(), createIndexBuffer(), pushConstantRanges array
+  all indices for performance reasons. Meshes own ranges of these buffers
+  and can be uploaded or removed at runtime. Object transforms are written
+  to a per-frame instance buffer, nodes that share a primitive are drawn
+  with one instanced call
+  POI: createGeometryHeap(), uploadMesh(), buildRenderQueue(),
+  vulkan_geometry_heap.h
+- GPU vertices are quantized to 16 or 20 bytes, ViewMesh keeps full
+  precision data for editing
+  POI: selectVertexFormat(), vulkan_vertex_format.h, shader.vert
+- Primitives carry simplified LOD index ranges built at import. Every
+  draw picks the coarsest level whose error projects below a pixel
+  POI: selectLod(), ale_mesh_lod.h, shaders/cull.comp
+- Device memory is sub-allocated from large blocks by vk::DeviceAllocator.
+  Buffers and images never call vkAllocateMemory directly
+  POI: createBuffer(), createImage(), vulkan_allocator.h
+- Resources replaced at runtime are retired to a deletion queue and
+  destroyed after the fence of the frame that last used them. The
+  destructorStack is only for shutdown
+  POI: retireBuffer(), recreateSwapChain(), vulkan_deletion_queue.h
+- Materials live in a storage buffer and all textures in one descriptor
+  array. A single descriptor set per frame serves every draw
+  POI: loadRenderMaterials(), createSceneDescriptorSets(), shader.frag
+- Pipelines are created through a VkPipelineCache that is saved to disk on
+  shutdown. Pipeline variants are compiled on worker threads
+  POI: createPipelineCache(), createGraphicsPipeline(), vulkan_pipeline_cache.h
+- Scene draws are recorded into secondary command buffers by a thread pool,
+  each worker slot owns a command pool per frame in flight
+  POI: recordSceneCommands(), createWorkerCommandPools(), ale_thread_pool.h
+- An optional GPU driven path culls draws in a compute shader and draws
+  each pipeline batch with vkCmdDrawIndexedIndirectCount. Its draw counts
+  can be read back and compared with CPU culling, `make gpu_cull_check`
+  POI: recordGpuCull(), drawGpuScene(), checkGpuCull(), shaders/cull.comp
 
 Upcoming features:
-- Runtime model streaming and shader switching for 3D editing
+- Runtime material streaming and shader switching for 3D editing
 - Accurate PBR rendering
 */
 
@@ -73,6 +102,8 @@ Upcoming features:
 #include <unordered_map>
 #include <stack>
 #include <memory>
+#include <future>
+#include <chrono>
 
 
 // int
@@ -82,6 +113,14 @@ Upcoming features:
 #include <camera.h>
 #include <tracer.h>
 #include <vulkan_utils.h>
+#include <vulkan_allocator.h>
+#include <vulkan_pipeline_cache.h>
+#include <vulkan_geometry_heap.h>
+#include <vulkan_deletion_queue.h>
+#include <vulkan_vertex_format.h>
+#include <ale_thread_pool.h>
+#include <ale_geo_utils.h>
+#include <ale_mesh_lod.h>
 #include <os_loader.h>
 #include <memory.h>
 #include <ale_imgui_interface.h>
@@ -97,6 +136,11 @@ const uint32_t HEIGHT = 1200;
 
 const int MAX_FRAMES_IN_FLIGHT = 3;
 
+// Serialized VkPipelineCache, relative to the working directory
+const std::string PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+const std::string CULL_SHADER_PATH = "shaders/cull.comp.spv";
+
 const std::vector<const char*> validationLayers = {
     "VK_LAYER_KHRONOS_validation"
 };
@@ -105,7 +149,6 @@ const std::vector<const char*> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
     VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
     VK_EXT_DYNAMIC_RENDERING_UNUSED_ATTACHMENTS_EXTENSION_NAME,
-    VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
 };
 
 #ifdef NDEBUG
@@ -114,6 +157,14 @@ const bool renderer_enableValidationLayers = false;
 const bool renderer_enableValidationLayers = true;
 #endif
 
+// Upload quantized vertices, see vulkan_vertex_format.h. Full precision
+// vertices are easier to read in graphics debuggers
+const bool renderer_packVertices = true;
+
+// Mesh LODs are switched when their error projects to at most this many
+// pixels
+const float renderer_lodPixelError = 1.0f;
+
 
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
@@ -136,13 +187,6 @@ struct Line2D {
     alignas(8) glm::vec2 end;
 };
 
-struct MeshBufferData{
-    unsigned int size;
-    unsigned int offset;
-    glm::mat4 transform;
-};
-
-
 struct PushConstantData {
     unsigned int offset;
     unsigned int size;
@@ -188,9 +232,112 @@ public:
         return mainCamera;
     }
 
+    // Must be called after node transforms or visibility change. Makes the
+    // GPU driven path rebuild its draw records
+    void markSceneDirty() {
+        _gpuSceneVersion++;
+    }
+
+    // Turns on the GPU driven path and compares its draw counts with CPU
+    // culling of the same records every frame, see checkGpuCull()
+    void setGpuCullCheck(bool bCheck) {
+        _bCheckGpuCull = bCheck;
+        _bGpuDriven |= bCheck;
+    }
+
+    // Frames whose GPU draw counts were read back and compared
+    size_t getGpuCullCheckedFrames() const {
+        return _gpuCullCheck.checkedFrames;
+    }
+
+    size_t getGpuCullMismatches() const {
+        return _gpuCullCheck.mismatches;
+    }
+
+    // Uploads a view mesh of the bound model. Call it for new meshes and
+    // after the vertex or index count of a mesh changes
+    void uploadMesh(int meshIdx) {
+        auto& mesh = _model.viewMeshes.at(meshIdx);
+
+        if (meshIdx >= static_cast<int>(_meshQuantization.size())) {
+            _meshQuantization.resize(meshIdx + 1);
+        }
+        if (_vertexFormat != vk::VERTEX_FORMAT_FULL) {
+            _meshQuantization[meshIdx] = vk::getVertexQuantization(mesh.vertices);
+        }
+
+        if (_vertexFormat == vk::VERTEX_FORMAT_PACKED && vk::hasVertexColors(mesh.vertices)) {
+            trc::log("Vertex colors of mesh " + std::to_string(meshIdx) + " are not uploaded", trc::WARNING);
+        }
+
+        std::vector<char> packed;
+        vk::packVertices(_vertexFormat, _meshQuantization[meshIdx],
+                         mesh.vertices.data(), mesh.vertices.size(), packed);
+
+        // LOD levels are uploaded right after the mesh indices
+        std::vector<uint32_t> indices = mesh.indices;
+        bool bLodsValid = std::all_of(mesh.lodIndices.begin(), mesh.lodIndices.end(),
+                                      [&](uint32_t idx) { return idx < mesh.vertices.size(); });
+        if (!bLodsValid) {
+            trc::log("LODs of mesh " + std::to_string(meshIdx) + " are out of date, dropping them", trc::WARNING);
+            mesh.lodIndices.clear();
+            for (auto& p : mesh.primitives) {
+                p.lods.clear();
+            }
+        }
+        indices.insert(indices.end(), mesh.lodIndices.begin(), mesh.lodIndices.end());
+
+        _geometry.uploadMesh(meshIdx, packed.data(), mesh.vertices.size(),
+                             indices.data(), indices.size());
+        markSceneDirty();
+
+        if (meshIdx < static_cast<int>(_meshBounds.size())) {
+            _meshBounds[meshIdx].w = -1;
+        }
+    }
+
+    // Uploads the given (first, count) vertex and index ranges of a mesh
+    // after its counts changed, the rest must be as it was uploaded.
+    // Uploads the whole mesh if it has LODs, is not resident or the new
+    // vertices leave its quantized bounds
+    void uploadMeshRanges(int meshIdx, const std::vector<std::pair<size_t, size_t>>& vertexRanges,
+                          const std::vector<std::pair<size_t, size_t>>& indexRanges) {
+        auto& mesh = _model.viewMeshes.at(meshIdx);
+
+        bool bQuantized = true;
+        if (_vertexFormat != vk::VERTEX_FORMAT_FULL && _geometry.isResident(meshIdx)) {
+            for (auto [first, count] : vertexRanges) {
+                bQuantized &= vk::isQuantizationValid(_meshQuantization[meshIdx], mesh.vertices.data() + first, count);
+            }
+        }
+        if (!_geometry.isResident(meshIdx) || !mesh.lodIndices.empty() || !bQuantized ||
+            !_geometry.resizeMesh(meshIdx, mesh.vertices.size(), mesh.indices.size())) {
+            uploadMesh(meshIdx);
+            return;
+        }
+
+        for (auto [first, count] : vertexRanges) {
+            vk::packVertices(_vertexFormat, _meshQuantization[meshIdx],
+                             mesh.vertices.data() + first, count, _packedVertices);
+            _geometry.writeVertices(meshIdx, _packedVertices.data(), first, count);
+        }
+        for (auto [first, count] : indexRanges) {
+            _geometry.writeIndices(meshIdx, mesh.indices.data() + first, first, count);
+        }
+        // Draws take the new index counts of the primitives
+        markSceneDirty();
+        growMeshBounds(meshIdx, vertexRanges);
+    }
+
+    // Nodes with a removed mesh are not drawn until it is uploaded again
+    void removeMesh(int meshIdx) {
+        _geometry.removeMesh(meshIdx);
+    }
+
     // TODO: Use std::optional or do not pass this as an argument
     void drawFrame(std::function<void()>& uiEvents) {
         vkWaitForFences(vkb_device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        _deletionQueue.flush(currentFrame);
 
         uint32_t imageIndex;
         VkResult currentResult = vkAcquireNextImageKHR(vkb_device, vkb_swapchain,UINT64_MAX,
@@ -204,39 +351,44 @@ public:
             throw std::runtime_error("failed to acquire swap chain image!");
         }
 
-        auto updateREMesh = [this]() {
+        // Only vertices moved by REMesh edits are packed and uploaded
+        auto updateDirtyVertices = [this]() {
             auto& rms = this->_model.reMeshes;
             auto& vms = this->_model.viewMeshes;
 
             for (int i = 0; i < rms.size(); i++) {
-                auto& vmv = vms[i].vertices;
-                auto& rmv = rms[i].verts;
-
-                for (int j = 0; j < rmv.size(); j++ ) {
-                    auto newpos = rmv[j]->pos;
-                    /* newpos.x += 100; */
-                    auto id = rmv[j]->viewId;
-                    vmv[id].pos = newpos;
+                if (rms[i].dirtyVerts.empty() && rms[i].dirtyViewIds.empty()) {
+                    continue;
                 }
-            }
-        };
-        updateREMesh();
-
-
 
-        auto updateDirtyVertices = [this]() {
-            auto& av = this->_allVertices;
-            auto& vms = this->_model.viewMeshes;
+                geo::syncDirtyVerts(rms[i], vms[i], _dirtyRanges);
+                if (_dirtyRanges.empty() || !_geometry.isResident(i)) {
+                    continue;
+                }
 
-            int counter = 0;
-            for (int i = 0; i < vms.size(); i++) {
                 auto& vmv = vms[i].vertices;
-                for (int j = 0; j < vmv.size(); j++ ) {
-                    av[counter].pos = vmv[j].pos;
-                    counter++;
+                auto& q = _meshQuantization[i];
+
+                // Vertices moved out of the quantized bounds, repack the mesh
+                // with some room for the next moves
+                if (_vertexFormat != vk::VERTEX_FORMAT_FULL) {
+                    for (auto [first, count] : _dirtyRanges) {
+                        if (!vk::isQuantizationValid(q, vmv.data() + first, count)) {
+                            q = vk::getVertexQuantization(vmv, vk::QUANTIZATION_EDIT_MARGIN);
+                            _dirtyRanges = {{0, vmv.size()}};
+                            markSceneDirty();
+                            break;
+                        }
+                    }
                 }
-            }
 
+                for (auto [first, count] : _dirtyRanges) {
+                    vk::packVertices(_vertexFormat, q, vmv.data() + first, count, _packedVertices);
+                    _geometry.writeVertices(i, _packedVertices.data(), first, count);
+                }
+
+                growMeshBounds(i, _dirtyRanges);
+            }
         };
         updateDirtyVertices();
 
@@ -251,6 +403,9 @@ public:
         vkResetCommandBuffer(commandBuffers[currentFrame], 0);
         recordRenderCommandBuffer(commandBuffers[currentFrame], imageIndex);
 
+        _lastFrameStats = _frameStats;
+        _frameStats = {};
+
 
         std::vector<VkSemaphore> waitSemaphores = {imageAvailableSemaphores[currentFrame]};
         std::vector<VkPipelineStageFlags> stageMask = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
@@ -262,6 +417,7 @@ public:
         if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
+        _deletionQueue.submit(currentFrame);
 
         std::vector<VkSwapchainKHR> swapChains = {vkb_swapchain};
 
@@ -275,20 +431,170 @@ public:
             throw std::runtime_error("failed to present swap chain image!");
         }
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+
+        if (_bDefragmentRequested) {
+            _bDefragmentRequested = false;
+            defragmentMemory();
+        }
+    }
+
+
+    // Moves geometry buffers out of the least used device memory blocks,
+    // other resources stay where they are. Waits for the device, so it
+    // only runs on request
+    void defragmentMemory() {
+        vkDeviceWaitIdle(vkb_device);
+        _deletionQueue.flushAll();
+        _geometry.flushDeletions();
+
+        VkDeviceSize moved = _allocator.defragment([this](const vk::Allocation& src, const vk::Allocation& dst) {
+            return _geometry.moveBuffer(src, dst, [this](VkBuffer from, VkBuffer to, VkDeviceSize size) {
+                copyBuffer(from, to, size);
+            });
+        });
+        if (moved > 0) {
+            markSceneDirty();
+        }
+        trc::log("Defragmented device memory, moved " + std::to_string(moved) + " bytes", trc::INFO);
     }
 
 
-    // Work in progress! Render individual nodes with position offsets
-    // as push constants.
-    void renderNodes(const VkCommandBuffer commandBuffer, const ale::Model& model) {
+    // Collects draw items from the node tree and sorts them by pipeline,
+    // material and primitive. Items that share a primitive are merged into
+    // runs, each run is recorded as one instanced draw
+    void buildRenderQueue(const ale::Model& model) {
+        _renderQueue.clear();
+        _drawRuns.clear();
+
+        auto frustum = geo::getFrustumPlanes(ubo.proj * ubo.view);
         for (auto nodeId : model.rootNodes) {
-            renderNode(commandBuffer, model.nodes[nodeId], model);
+            collectNode(model.nodes[nodeId], model, &frustum);
+        }
+
+        if (_renderQueue.empty()) {
+            return;
+        }
+
+        if (_bLods) {
+            glm::vec3 cameraPos = mainCamera->getPos();
+            float lodScale = getLodScale();
+            for (auto& item : _renderQueue) {
+                selectLod(item, cameraPos, lodScale);
+            }
+        }
+
+        // Stable sort keeps tree order inside a primitive bucket
+        std::stable_sort(_renderQueue.begin(), _renderQueue.end(),
+                         [](const DrawItem& a, const DrawItem& b) {
+                             return a.sortKey < b.sortKey;
+                         });
+
+        ensureInstanceCapacity(currentFrame, _renderQueue.size());
+
+        // Instance data follows the sorted queue, so every run of equal
+        // items occupies a contiguous range of instances
+        InstanceData* instances = static_cast<InstanceData*>(_instanceBuffers[currentFrame].handle);
+        for (size_t i = 0; i < _renderQueue.size(); i++) {
+            const auto& q = _meshQuantization[_renderQueue[i].meshIdx];
+            instances[i] = {
+                .model = _renderQueue[i].transform,
+                .objData = glm::vec4(static_cast<float>(_renderQueue[i].nodeId),
+                                     static_cast<float>(_renderQueue[i].materialID), 1, 1),
+                .posOffset = glm::vec4(q.offset, 0),
+                .posScale = glm::vec4(q.scale, 0),
+            };
+        }
+
+        size_t runStart = 0;
+        while (runStart < _renderQueue.size()) {
+            const DrawItem& item = _renderQueue[runStart];
+
+            size_t runEnd = runStart + 1;
+            while (runEnd < _renderQueue.size() && _renderQueue[runEnd].sortKey == item.sortKey) {
+                runEnd++;
+            }
+
+            // Pipelines are resolved here, variant futures are not
+            // safe to query from worker threads
+            _drawRuns.push_back({
+                .pipeline = getPipeline(_renderMaterials[item.materialID].pipelineVariant),
+                .firstIndex = item.firstIndex,
+                .indexCount = item.indexCount,
+                .vertexOffset = item.vertexOffset,
+                .indexType = item.indexType,
+                .firstInstance = static_cast<uint32_t>(runStart),
+                .instanceCount = static_cast<uint32_t>(runEnd - runStart),
+            });
+
+            runStart = runEnd;
         }
     }
 
-    void renderNode(const VkCommandBuffer commandBuffer, const ale::Node& node, const ale::Model& model) {
-        // TODO: Add frustum culling
+    // Pixels covered by one world unit at distance 1
+    float getLodScale() {
+        return std::abs(ubo.proj[1][1]) * swapChainExtent.height * 0.5f / renderer_lodPixelError;
+    }
+
+    // World space bounding sphere of a draw item
+    glm::vec4 getItemSphere(const DrawItem& item) {
+        glm::vec4 local = getMeshBounds(item.meshIdx);
+        const glm::mat4& t = item.transform;
+        return glm::vec4(glm::vec3(t * glm::vec4(glm::vec3(local), 1.0f)), local.w * getMaxScale(t));
+    }
+
+    static float getMaxScale(const glm::mat4& t) {
+        return std::max({glm::length(glm::vec3(t[0])),
+                         glm::length(glm::vec3(t[1])),
+                         glm::length(glm::vec3(t[2]))});
+    }
+
+    // Index range of a LOD, level 0 is the full primitive
+    void getLodRange(const DrawItem& item, size_t level, uint32_t& firstIndex, uint32_t& indexCount) {
+        auto& mesh = _model.viewMeshes[item.meshIdx];
+        auto& prim = mesh.primitives[item.primitiveIdx];
+        if (level == 0) {
+            firstIndex = static_cast<uint32_t>(_geometry.getMesh(item.meshIdx).indices.offset + prim.offsetIdx);
+            indexCount = static_cast<uint32_t>(prim.size);
+            return;
+        }
+
+        // LOD indices follow the mesh indices in the geometry heap
+        auto& lod = prim.lods[level - 1];
+        firstIndex = static_cast<uint32_t>(_geometry.getMesh(item.meshIdx).indices.offset +
+                                           mesh.indices.size() + lod.offsetIdx);
+        indexCount = static_cast<uint32_t>(lod.size);
+    }
+
+    // Switches the item to the coarsest LOD whose projected error is below
+    // renderer_lodPixelError
+    void selectLod(DrawItem& item, glm::vec3 cameraPos, float lodScale) {
+        auto& prim = _model.viewMeshes[item.meshIdx].primitives[item.primitiveIdx];
+        if (prim.lods.empty()) {
+            return;
+        }
+
+        glm::vec4 sphere = getItemSphere(item);
+        float distance = std::max(glm::length(glm::vec3(sphere) - cameraPos) - sphere.w,
+                                  mainCamera->getPlaneNear());
+        float scale = getMaxScale(item.transform);
+
+        size_t level = 0;
+        while (level < prim.lods.size() &&
+               prim.lods[level].error * scale * lodScale / distance <= 1.0f) {
+            level++;
+        }
+        if (level == 0) {
+            return;
+        }
+
+        getLodRange(item, level, item.firstIndex, item.indexCount);
+        item.sortKey = (item.sortKey & ~0xFFFFFFFFull) | item.firstIndex;
+    }
 
+    // Items outside the frustum are skipped. The GPU driven path passes
+    // no frustum, it culls on the GPU every frame
+    void collectNode(const ale::Node& node, const ale::Model& model,
+                     const std::vector<glm::vec4>* frustum = nullptr) {
         auto applyParentTransforms = [](const ale::Model& m,
                                         ale::Node n,
                                         glm::mat4& result){
@@ -304,79 +610,186 @@ public:
 
         applyParentTransforms(model, node, t);
 
-        if (node.meshIdx > -1 && node.bVisible == true) {
-            // Get unique node id
-            float objId = static_cast<float>(node.id);
-            // Assign a unique "color" by object's id
-            float perObjColorData[4] = {objId,1,1,1};
+        if (node.meshIdx > -1 && node.bVisible == true && _geometry.isResident(node.meshIdx)) {
+            // Load node mesh
+            const vk::MeshAllocation& meshData = _geometry.getMesh(node.meshIdx);
+            auto& mesh = model.viewMeshes[node.meshIdx];
 
-            float* transform = ale::geo::glmMatToPtr(t);
-            auto transRange = pushConstantRanges[0];
-            auto colorRange = pushConstantRanges[1];
+            auto pushItems = [&](const glm::mat4& transform) {
+                for (size_t primIdx = 0; primIdx < mesh.primitives.size(); primIdx++) {
+                    const ale::Primitive& p = mesh.primitives[primIdx];
+                    auto& mat = _renderMaterials[p.materialID];
+                    uint32_t firstIndex = static_cast<uint32_t>(meshData.indices.offset + p.offsetIdx);
+
+                    // pipeline | index type | primitive. The first index is
+                    // unique for every primitive in an index buffer.
+                    // Materials are indexed in shaders and do not break
+                    // batches
+                    uint64_t index16 = meshData.indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+                    uint64_t sortKey = (static_cast<uint64_t>(mat.pipelineVariant) << 33) |
+                                       (index16 << 32) | firstIndex;
+
+                    DrawItem item {
+                        .sortKey = sortKey,
+                        .transform = transform,
+                        .nodeId = node.id,
+                        .meshIdx = node.meshIdx,
+                        .primitiveIdx = static_cast<int>(primIdx),
+                        .materialID = p.materialID,
+                        .firstIndex = firstIndex,
+                        .indexCount = static_cast<uint32_t>(p.size),
+                        .vertexOffset = static_cast<int32_t>(meshData.vertices.offset),
+                        .indexType = meshData.indexType,
+                    };
+                    if (frustum) {
+                        glm::vec4 sphere = getItemSphere(item);
+                        if (!geo::isSphereInFrustum(glm::vec3(sphere), sphere.w, *frustum)) {
+                            _frameStats.culledItems++;
+                            continue;
+                        }
+                    }
+                    _renderQueue.push_back(item);
+                }
+            };
 
-            vkCmdPushConstants(commandBuffer, pipelineLayout,transRange.stageFlags, transRange.offset,transRange.size,transform);
-            vkCmdPushConstants(commandBuffer, pipelineLayout,colorRange.stageFlags, colorRange.offset, colorRange.size, perObjColorData);
+            if (node.instanceTransforms.empty()) {
+                pushItems(t);
+            } else {
+                for (const auto& instanceTransform : node.instanceTransforms) {
+                    pushItems(t * instanceTransform);
+                }
+            }
+        }
 
-            // Load node mesh
-            MeshBufferData meshData = meshBuffers[node.meshIdx];
-            auto& mesh = model.viewMeshes[node.meshIdx];
+        for(auto childNodeId : node.children) {
+                assert(childNodeId > -1);
+                collectNode(model.nodes[childNodeId], model, frustum);
+        }
+    }
 
-            for (const ale::Primitive& p : mesh.primitives) {
-                // TODO: Bind materials here
+    // Records draw runs into secondary command buffers on the thread pool.
+    // Returns the recorded buffers in draw order
+    std::vector<VkCommandBuffer> recordSceneCommands() {
+        auto& workers = _workerCommands[currentFrame];
+        for (auto& worker : workers) {
+            worker.bUsed = false;
+        }
 
+        _threadPool.parallelFor(_drawRuns.size(), MIN_DRAW_RUNS_PER_WORKER,
+            [this](size_t begin, size_t end, size_t slot) {
+                recordSceneChunk(slot, begin, end);
+            });
 
-                auto& mat = _renderMaterials[p.materialID];
+        std::vector<VkCommandBuffer> secondaries;
+        for (auto& worker : workers) {
+            if (!worker.bUsed) {
+                continue;
+            }
+            secondaries.push_back(worker.buffer);
 
-                VkDescriptorBufferInfo mvpUboInfo {
-                    .buffer = uniformBuffers[currentFrame],
-                    .offset = 0,
-                    .range = sizeof(UniformBufferObject),
-                };
+            _frameStats.drawCalls += worker.stats.drawCalls;
+            _frameStats.pipelineBinds += worker.stats.pipelineBinds;
+            _frameStats.descriptorSetBinds += worker.stats.descriptorSetBinds;
+            _frameStats.instances += worker.stats.instances;
+            _frameStats.triangles += worker.stats.triangles;
+        }
+        return secondaries;
+    }
 
-                VkDescriptorImageInfo textureImageInfo{
-                    .sampler = mat.textureData.sampler,
-                    .imageView = mat.textureData.imageView,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                };
+    // Runs on a worker thread. Only touches the worker's own command pool
+    void recordSceneChunk(size_t slot, size_t begin, size_t end) {
+        auto& worker = _workerCommands[currentFrame][slot];
+        worker.stats = {};
+        worker.bUsed = true;
 
-                std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+        vkResetCommandPool(vkb_device, worker.pool, 0);
 
-                descriptorWrites[0] = {
-                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                    .dstSet = mat.descriptorSet,
-                    .dstBinding = 0,
-                    .dstArrayElement = 0,
-                    .descriptorCount = 1,
-                    .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                    .pBufferInfo = &mvpUboInfo,
-                };
+        VkCommandBufferInheritanceRenderingInfo renderingInheritance {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &swapChainImageFormat,
+            .depthAttachmentFormat = _depthFormat,
+            .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        };
 
-                descriptorWrites[1] = {
-                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                    .dstSet = mat.descriptorSet,
-                    .dstBinding = 1,
-                    .dstArrayElement = 0,
-                    .descriptorCount = 1,
-                    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                    .pImageInfo = &textureImageInfo,
-                };
+        VkCommandBufferInheritanceInfo inheritanceInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+            .pNext = &renderingInheritance,
+        };
+
+        VkCommandBufferBeginInfo beginInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                     VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+            .pInheritanceInfo = &inheritanceInfo,
+        };
+
+        VkCommandBuffer commandBuffer = worker.buffer;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording secondary command buffer!");
+        }
+
+        // Secondary buffers do not inherit dynamic or bound state
+        VkViewport viewport = vk::getViewport(swapChainExtent);
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{.offset = {0, 0}, .extent = swapChainExtent};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        VkBuffer vertexBuffers[] = {_geometry.getVertexBuffer(), _instanceBuffers[currentFrame].vkBuffer,
+                                    _constantColorBuffer.vkBuffer};
+        VkDeviceSize offsets[] = {0, 0, 0};
+
+        vkCmdBindVertexBuffers(commandBuffer, 0, 3, vertexBuffers, offsets);
+
+        // All pipeline variants share the layout, one bind covers the chunk
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+                                0, 1, &_sceneDescriptorSets[currentFrame], 0, nullptr);
+        worker.stats.descriptorSetBinds++;
+
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
 
-                // Push the descriptor set
-                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-                _vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, descriptorWrites.data());
-                vkCmdDrawIndexed(commandBuffer, p.size, 1, meshData.offset + p.offsetIdx, 0, 0);
+        for (size_t i = begin; i < end; i++) {
+            const DrawRun& run = _drawRuns[i];
+
+            if (run.pipeline != boundPipeline) {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, run.pipeline);
+                boundPipeline = run.pipeline;
+                worker.stats.pipelineBinds++;
+            }
+
+            // Runs of one pipeline are sorted by index type, so this
+            // switches at most twice per pipeline
+            if (run.indexType != boundIndexType) {
+                vkCmdBindIndexBuffer(commandBuffer, _geometry.getIndexBuffer(run.indexType), 0, run.indexType);
+                boundIndexType = run.indexType;
             }
+
+            vkCmdDrawIndexed(commandBuffer, run.indexCount, run.instanceCount, run.firstIndex,
+                             run.vertexOffset, run.firstInstance);
+            worker.stats.drawCalls++;
+            worker.stats.instances += run.instanceCount;
+            worker.stats.triangles += run.indexCount / 3 * run.instanceCount;
         }
 
-        for(auto childNodeId : node.children) {
-                assert(childNodeId > -1);
-                renderNode(commandBuffer, model.nodes[childNodeId], model);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record secondary command buffer!");
         }
     }
 
+    // Grows the instance buffer of a frame
+    void ensureInstanceCapacity(uint32_t frame, size_t count) {
+        ensureBufferCapacity(_instanceBuffers[frame], count * sizeof(InstanceData),
+                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+
     void cleanup() {
         // Stop the device for cleanup
         vkDeviceWaitIdle(vkb_device);
+        _deletionQueue.flushAll();
 
         // CLEAN IMGUI
         // START
@@ -387,7 +800,7 @@ public:
 
         cleanupSwapChain();
 
-        vkDestroyPipeline(vkb_device, graphicsPipeline, nullptr);
+        destroyPipelines();
         vkDestroyPipelineLayout(vkb_device, pipelineLayout, nullptr);
 
 
@@ -414,6 +827,12 @@ public:
         return {ds.x, ds.y};
     }
 
+    // Worker threads of the renderer. Editor operations may use them
+    // between frames
+    ThreadPool& getThreadPool() {
+        return _threadPool;
+    }
+
 
 private:
     GLFWwindow* window;
@@ -441,123 +860,311 @@ private:
     std::vector<VkImageView> swapChainImageViews;
 
 
-
-    PFN_vkCmdPushDescriptorSetKHR _vkCmdPushDescriptorSetKHR = nullptr;
-
     VkDescriptorSetLayout _defaultDescriptorSetLayout;
     VkPipelineLayout pipelineLayout;
     VkPipeline graphicsPipeline;
 
+    vk::PipelineCache _pipelineCache;
+    std::vector<char> _vertShaderCode;
+    std::vector<char> _fragShaderCode;
+
+    // Pipelines with fixed function state that differs from graphicsPipeline
+    enum PipelineVariant {
+        PIPELINE_DEFAULT,
+        PIPELINE_DOUBLE_SIDED,
+        PIPELINE_VARIANT_MAX,
+    };
+
+    // Variants are built on worker threads, see createGraphicsPipeline()
+    std::array<std::shared_future<VkPipeline>, PIPELINE_VARIANT_MAX> _pipelineVariants;
+
     VkCommandPool commandPool;
 
+    vk::DeviceAllocator _allocator;
+
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    VkFormat _depthFormat;
+    vk::Allocation depthImageAllocation;
     VkImageView depthImageView;
 
 
     struct TextureData {
         ale::Image* texturePtr = nullptr;
         VkImage image = VK_NULL_HANDLE;
-        VkDeviceMemory deviceMemory = VK_NULL_HANDLE;
+        vk::Allocation allocation;
         VkImageView imageView = VK_NULL_HANDLE;
         VkSampler sampler = VK_NULL_HANDLE;
     };
 
     struct RenderMaterial {
-        TextureData textureData;
-        VkDescriptorSet descriptorSet;
+        PipelineVariant pipelineVariant = PIPELINE_DEFAULT;
+    };
+
+    // Material data read by shader.frag, std430 layout. Texture indices
+    // point into the texture array of the scene descriptor set
+    struct GpuMaterial {
+        int32_t baseColorTexIdx;
+        int32_t normalTexIdx;
+        int32_t emissiveTexIdx;
+        int32_t occlusionTexIdx;
+    };
+
+    // Set 0 of the scene pipelines, bound once per command buffer
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> _sceneDescriptorSets{};
+
+    // A single primitive instance to draw. The queue is sorted by sortKey
+    // (pipeline variant, index type, primitive) before recording
+    struct DrawItem {
+        uint64_t sortKey;
+        glm::mat4 transform;
+        int nodeId;
+        int meshIdx;
+        int primitiveIdx;
+        int materialID;
+        // Full primitive, buildRenderQueue() switches to a LOD range
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        VkIndexType indexType;
+    };
+
+    std::vector<DrawItem> _renderQueue;
+
+    // A run of equal draw items, recorded as one instanced draw
+    struct DrawRun {
+        VkPipeline pipeline;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        int32_t vertexOffset;
+        VkIndexType indexType;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+    };
+
+    std::vector<DrawRun> _drawRuns;
+
+    // State changes in the scene pass, reset every frame
+    struct RenderStats {
+        uint32_t drawCalls = 0;
+        uint32_t pipelineBinds = 0;
+        uint32_t descriptorSetBinds = 0;
+        uint32_t descriptorUpdates = 0;
+        uint32_t instances = 0;
+        // CPU path only, GPU driven draws pick LODs and cull on the GPU
+        uint32_t triangles = 0;
+        uint32_t culledItems = 0;
+    };
+
+    RenderStats _frameStats;
+    RenderStats _lastFrameStats;
+
+    // Smaller scenes are recorded by fewer workers
+    static constexpr size_t MIN_DRAW_RUNS_PER_WORKER = 128;
+
+    ThreadPool _threadPool;
+
+    // Secondary command buffer of one worker slot
+    struct WorkerCommands {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        VkCommandBuffer buffer = VK_NULL_HANDLE;
+        RenderStats stats;
+        bool bUsed = false;
     };
 
+    // One command pool per worker slot per frame in flight
+    std::array<std::vector<WorkerCommands>, MAX_FRAMES_IN_FLIGHT> _workerCommands;
+
 
     std::vector<TextureData> _modelTextures;
 
     std::stack<std::function<bool()>> destructorStack = {};
+    // Runtime replacements, flushed per frame in flight
+    vk::DeletionQueue _deletionQueue;
     ale::Model& _model;
 
     glm::vec4 _posLight = glm::vec4(30.0, 40.0, 100.0, 1.0);
 
-    // binding descriptions for ale::Vertex
-    VkVertexInputBindingDescription ale_VertexBindingDescription = vk::getVertBindingDescription(0, sizeof(ale::Vertex));
+    // Per-instance vertex data, see locations 4-8 in shader.vert
+    struct InstanceData {
+        glm::mat4 model;
+        // x: node id, y: material id, zw: unused
+        glm::vec4 objData;
+        // Dequantization of packed positions, xyz only
+        glm::vec4 posOffset;
+        glm::vec4 posScale;
+    };
+
+    // binding descriptions for vertices (0), InstanceData (1) and the
+    // constant vertex color (2). Set by selectVertexFormat()
+    std::vector<VkVertexInputBindingDescription> ale_VertexBindingDescriptions;
+
+    // attribute descriptions for vertices and InstanceData
+    std::vector<VkVertexInputAttributeDescription> ale_VertexAttributeDescriptions;
 
-    // attribute descriptions for ale::Vertex
-    std::vector<VkVertexInputAttributeDescription> ale_VertexAttributeDescriptions = {
+    // A mat4 takes four consecutive locations
+    const std::vector<VkVertexInputAttributeDescription> ale_InstanceAttributeDescriptions = {
         {
-            .location = 0,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = offsetof(ale::Vertex, pos),
+            .location = 4,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(InstanceData, model),
         },
         {
-            .location = 1,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = offsetof(ale::Vertex, color),
+            .location = 5,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(InstanceData, model) + sizeof(glm::vec4),
         },
         {
-            .location = 2,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32_SFLOAT,
-            .offset = offsetof(ale::Vertex, texCoord),
+            .location = 6,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(InstanceData, model) + 2 * sizeof(glm::vec4),
         },
         {
-            .location = 3,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = offsetof(ale::Vertex, normal),
-        }
-    };
-
-
-    // TODO: This seems like a specific config. Might be useful to
-    // move to a separate header
-    std::vector<VkPushConstantRange> pushConstantRanges = {
+            .location = 7,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(InstanceData, model) + 3 * sizeof(glm::vec4),
+        },
         {
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-            .offset = 0,
-            .size = 64,
+            .location = 8,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(InstanceData, objData),
+        },
+        {
+            .location = 9,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(InstanceData, posOffset),
         },
         {
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .offset = 64,
-            .size = 16,
+            .location = 10,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = offsetof(InstanceData, posScale),
         },
     };
 
+    vk::VertexFormat _vertexFormat = vk::VERTEX_FORMAT_FULL;
+    // Position dequantization of every view mesh
+    std::vector<vk::VertexQuantization> _meshQuantization;
+
+
     struct VulkanBufferLayout {
         // Links to vulkan structures
         VkBuffer vkBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory memory = VK_NULL_HANDLE;
+        vk::Allocation allocation;
         // Buffer size in bytes
         size_t size = -1;
-        // A handle to access mapped memory
+        // A handle to access mapped memory (host visible buffers only)
         void* handle = nullptr;
+    };
 
-        bool mapMemory(VkDevice _device, void**& _handle, VkDeviceMemory _memory, size_t _bufferSize) {
-            handle = _handle;
-            return vkMapMemory(_device, _memory, 0, _bufferSize, 0, _handle);
-        }
+    // A single white vertex read with stride 0 when vertices carry no color
+    VulkanBufferLayout _constantColorBuffer;
+    // Reused by updateDirtyVertices
+    std::vector<char> _packedVertices;
+    std::vector<std::pair<size_t, size_t>> _dirtyRanges;
+
+    // Vertices and indices of all view meshes
+    vk::GeometryHeap _geometry;
+    // Geometry version the draw records were built with
+    uint64_t _geometryVersion = 0;
+    // Set by the stats window, runs defragmentMemory() after the frame
+    bool _bDefragmentRequested = false;
+
+    // Host visible, grown on demand in ensureInstanceCapacity()
+    std::array<VulkanBufferLayout, MAX_FRAMES_IN_FLIGHT> _instanceBuffers;
+
+    // Array of GpuMaterial, indexed by InstanceData::objData.y
+    VulkanBufferLayout _materialBuffer;
+
+    // GPU driven path. Draw records are culled by cull.comp, which writes
+    // indirect commands per batch. There is one batch per pipeline variant
+    // Must match MAX_LODS of cull.comp
+    static constexpr uint32_t GPU_MAX_LODS = 1 + geo::MAX_MESH_LODS;
+
+    struct GpuLod {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        // World space error
+        float error;
+        uint32_t padding;
+    };
 
-        void unmapMemory(VkDevice _device, VkDeviceMemory _memory) {
-            handle = nullptr;
-            memory = VK_NULL_HANDLE;
-            vkUnmapMemory(_device, _memory);
-        }
+    struct GpuDrawRecord {
+        // World space bounding sphere: xyz center, w radius
+        glm::vec4 sphere;
+        int32_t vertexOffset;
+        uint32_t batch;
+        uint32_t commandOffset;
+        uint32_t lodCount;
+        // Level 0 is the full primitive
+        GpuLod lods[GPU_MAX_LODS];
+    };
+
+    struct GpuBatch {
+        PipelineVariant pipelineVariant;
+        VkIndexType indexType;
+        uint32_t commandOffset;
+        uint32_t maxCount;
+    };
+
+    struct CullPushConstants {
+        glm::vec4 planes[6];
+        // xyz position, w LOD scale or 0 if LODs are off
+        glm::vec4 camera;
+        uint32_t recordCount;
+    };
+
+    // Scene data is rebuilt only when the frame's version is out of date
+    struct GpuSceneFrame {
+        VulkanBufferLayout records;
+        VulkanBufferLayout instances;
+        VulkanBufferLayout commands;
+        VulkanBufferLayout counts;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        std::vector<GpuBatch> batches;
+        uint32_t recordCount = 0;
+        uint64_t version = 0;
+
+        // Batch counts copied back for checkGpuCull(). Records on a frustum
+        // plane may go either way, so CPU culling gives a range per batch
+        VulkanBufferLayout countsReadback;
+        std::vector<uint32_t> minCounts;
+        std::vector<uint32_t> maxCounts;
+        uint32_t cpuDraws = 0;
+        bool bCheckPending = false;
     };
 
-    VulkanBufferLayout _vertBuffer;
-    VulkanBufferLayout _vertStagingBuffer;
+    std::array<GpuSceneFrame, MAX_FRAMES_IN_FLIGHT> _gpuScene;
+    uint64_t _gpuSceneVersion = 1;
 
-    VulkanBufferLayout _idxBuffer;
-    VulkanBufferLayout _idxStagingBuffer;
+    struct GpuCullCheck {
+        size_t checkedFrames = 0;
+        size_t mismatches = 0;
+        uint32_t gpuDraws = 0;
+        uint32_t cpuDraws = 0;
+    };
+
+    GpuCullCheck _gpuCullCheck;
+    bool _bCheckGpuCull = false;
 
-    uint32_t indexCount;
+    // Local space bounding spheres of view meshes
+    std::vector<glm::vec4> _meshBounds;
 
+    bool _bDrawIndirectCountSupported = false;
+    bool _bGpuDriven = false;
+    // Distance based mesh LOD selection, see selectLod()
+    bool _bLods = true;
 
-    // TODO: This is exessive, use the staging buffer instead
-    std::vector<ale::Vertex> _allVertices;
+    std::vector<char> _cullShaderCode;
+    VkDescriptorSetLayout _cullDescriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _cullPipeline = VK_NULL_HANDLE;
 
-    // An array of offsets for vertices of each mesh
-    std::vector<MeshBufferData> meshBuffers;
 
     // Number of images in the swap chain
     int chainImageCount;
@@ -572,7 +1179,7 @@ private:
     // end UI
 
     std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<vk::Allocation> uniformBuffersAllocations;
     std::vector<void*> uniformBuffersMapped;
 
     VkDescriptorPool descriptorPool;
@@ -626,22 +1233,24 @@ private:
         createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
-
-        loadExtensionFunctionPointers();
-
         createSwapChain();
         createDescriptorSetLayout();
+        createPipelineCache();
+        selectVertexFormat();
         createGraphicsPipeline();
         createCommandPool();
+        createWorkerCommandPools();
         createDepthResources();
 
         loadRenderMaterials();
 
-        createVertexBuffer();
-        createIndexBuffer();
+        createGeometryHeap();
         createUniformBuffers();
+        createInstanceBuffers();
 
         createDescriptorPool();
+        createSceneDescriptorSets();
+        createCullPipeline();
 
         createCommandBuffers();
         createSyncObjects();
@@ -650,7 +1259,7 @@ private:
     void cleanupSwapChain() {
         vkDestroyImageView(vkb_device, depthImageView, nullptr);
         vkDestroyImage(vkb_device, depthImage, nullptr);
-        vkFreeMemory(vkb_device, depthImageMemory, nullptr);
+        _allocator.free(depthImageAllocation);
 
         for (auto imageView : swapChainImageViews) {
             vkDestroyImageView(vkb_device, imageView, nullptr);
@@ -660,6 +1269,8 @@ private:
     }
 
 
+    // Does not wait for the device. Frames in flight keep using the old
+    // swap chain and depth image, both are retired to the deletion queue
     void recreateSwapChain() {
         int width = 0, height = 0;
         glfwGetFramebufferSize(window, &width, &height);
@@ -668,9 +1279,24 @@ private:
             glfwWaitEvents();
         }
 
-        vkDeviceWaitIdle(vkb_device);
+        _deletionQueue.retire([this,
+                               oldSwapchain = vkb_swapchain,
+                               oldImageViews = swapChainImageViews,
+                               oldDepthView = depthImageView,
+                               oldDepthImage = depthImage,
+                               oldDepthAllocation = depthImageAllocation]() mutable {
+            vkDestroyImageView(vkb_device, oldDepthView, nullptr);
+            vkDestroyImage(vkb_device, oldDepthImage, nullptr);
+            _allocator.free(oldDepthAllocation);
+
+            for (auto imageView : oldImageViews) {
+                vkDestroyImageView(vkb_device, imageView, nullptr);
+            }
 
-        cleanupSwapChain();
+            vkb::destroy_swapchain(oldSwapchain);
+        });
+
+        // The old swap chain is passed to the builder before it is replaced
         createSwapChain();
         createDepthResources();
     }
@@ -792,6 +1418,23 @@ private:
 
         vkb_physicalDevice = physical_device_selector_return.value();
 
+        // Optional features
+        VkPhysicalDeviceVulkan12Features supported12 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        };
+        VkPhysicalDeviceFeatures2 supported {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &supported12,
+        };
+        vkGetPhysicalDeviceFeatures2(vkb_physicalDevice, &supported);
+        _bDrawIndirectCountSupported = supported12.drawIndirectCount;
+
+        // Required for the bindless texture array
+        if (!supported12.runtimeDescriptorArray ||
+            !supported12.shaderSampledImageArrayNonUniformIndexing) {
+            throw std::runtime_error("device does not support descriptor indexing!");
+        }
+
 
     }
 
@@ -803,8 +1446,16 @@ private:
             .dynamicRenderingUnusedAttachments = true,
         };
 
+        VkPhysicalDeviceVulkan12Features features12 {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .drawIndirectCount = _bDrawIndirectCountSupported,
+            .shaderSampledImageArrayNonUniformIndexing = true,
+            .runtimeDescriptorArray = true,
+        };
+
         auto dev_ret = builder
             .add_pNext(&ext)
+            .add_pNext(&features12)
             .build();
 
         if (!dev_ret) {
@@ -830,24 +1481,21 @@ private:
             vkb::destroy_device(vkb_device);
             return false;
         });
-    }
-
-    void loadExtensionFunctionPointers() {
 
-        //NOTE: vkCmdPushDescriptorSetKHR is yet to become a part of the standard
-        // For now it comes as a function pointer
-        _vkCmdPushDescriptorSetKHR =
-            (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(vkb_device, "vkCmdPushDescriptorSetKHR");
-
-        if (_vkCmdPushDescriptorSetKHR == nullptr) {
-            throw std::runtime_error("Failed to load vkCmdPushDescriptorSetKHR");
-        }
+        _allocator.init(vkb_physicalDevice, vkb_device);
 
+        destructorStack.push([this](){
+            _allocator.dumpStats();
+            _allocator.destroy();
+            return false;
+        });
     }
 
     void createSwapChain() {
         vkb::SwapchainBuilder swapchain_builder{ vkb_device };
+        // Lets the driver reuse resources of the swap chain being replaced
         auto swap_ret = swapchain_builder
+                        .set_old_swapchain(vkb_swapchain)
                         .build();
 
         if (!swap_ret){
@@ -872,18 +1520,20 @@ private:
     void createDescriptorSetLayout() {
         std::vector<VkDescriptorSetLayoutBinding> layoutBindings{};
 
+        // 0: MVP + light, 1: materials, 2: all model textures
         vk::pushBackDescriptorSetBinding(layoutBindings, 1,
                                          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
                                          VK_SHADER_STAGE_VERTEX_BIT);
         vk::pushBackDescriptorSetBinding(layoutBindings, 1,
+                                         VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                         VK_SHADER_STAGE_FRAGMENT_BIT);
+        vk::pushBackDescriptorSetBinding(layoutBindings, getTextureDescriptorCount(),
                                          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                          VK_SHADER_STAGE_FRAGMENT_BIT);
 
+        // One set per frame holds everything, see createSceneDescriptorSets()
         auto layoutInfo = vk::getDescriptorSetLayout(layoutBindings);
 
-        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
-
-
         if (vkCreateDescriptorSetLayout(vkb_device, &layoutInfo, nullptr, &_defaultDescriptorSetLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor set layout!");
         }
@@ -895,56 +1545,148 @@ private:
 
     }
 
-    void createGraphicsPipeline() {
-        auto vertShaderCode = Loader::getFileContent("shaders/vert.spv");
-        auto fragShaderCode = Loader::getFileContent("shaders/frag.spv");
+    void createPipelineCache() {
+        _vertShaderCode = Loader::getFileContent("shaders/vert.spv");
+        _fragShaderCode = Loader::getFileContent("shaders/frag.spv");
 
-        auto vertShaderModule = vk::createShaderModule(vkb_device, vertShaderCode);
-        auto fragShaderModule = vk::createShaderModule(vkb_device, fragShaderCode);
+        // The culling shader is optional, the GPU driven path is disabled
+        // without it
+        if (Loader::isFileValid(CULL_SHADER_PATH)) {
+            _cullShaderCode = Loader::getFileContent(CULL_SHADER_PATH);
+        }
 
-        std::string sMainStage = "main";
+        // Any shader rebuild invalidates the cache on disk
+        uint64_t shaderHash = vk::hashBytes(_vertShaderCode.data(), _vertShaderCode.size());
+        shaderHash = vk::hashBytes(_fragShaderCode.data(), _fragShaderCode.size(), shaderHash);
+        shaderHash = vk::hashBytes(_cullShaderCode.data(), _cullShaderCode.size(), shaderHash);
 
-        auto vertShaderStageInfo = vk::getShaderStageInfo(vertShaderModule, VK_SHADER_STAGE_VERTEX_BIT, sMainStage);
-        auto fragShaderStageInfo = vk::getShaderStageInfo(fragShaderModule, VK_SHADER_STAGE_FRAGMENT_BIT, sMainStage);
+        _pipelineCache.init(vkb_physicalDevice, vkb_device, PIPELINE_CACHE_PATH, shaderHash);
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        destructorStack.push([this](){
+            _pipelineCache.save();
+            _pipelineCache.destroy();
+            return false;
+        });
+    }
 
-        auto vertexInputInfo = vk::getVertexInputInfo(ale_VertexBindingDescription,
-                                                    ale_VertexAttributeDescriptions);
-        auto inputAssembly = vk::getDefaultInputAssembly();
-        auto viewportState = vk::getDefaultViewportState();
-        auto rasterizer = vk::getDefaultRasterizer();
-        auto multisampling = vk::getDefaultMultisampling();
-        auto depthStencil = vk::getDefaultDepthStencil();
+    void createGraphicsPipeline() {
+        // Per-draw data comes from the instance buffer, no push constants
+        auto pipelineLayoutInfo = vk::getPipelineLayout(_defaultDescriptorSetLayout, {});
 
-        VkPipelineColorBlendAttachmentState colorBlendAttachment = {
-            .blendEnable = VK_FALSE,
-            .colorWriteMask = 	VK_COLOR_COMPONENT_R_BIT |
-								VK_COLOR_COMPONENT_G_BIT |
-								VK_COLOR_COMPONENT_B_BIT |
-								VK_COLOR_COMPONENT_A_BIT,
-        };
+        if (vkCreatePipelineLayout(vkb_device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
 
-        auto colorBlending = vk::getColorBlending(colorBlendAttachment);
+        VkFormat colorFormat = vkb_swapchain.image_format;
+        VkFormat depthFormat = findDepthFormat();
 
-        std::vector<VkDynamicState> dynamicStates = {
+        // The default pipeline is needed for the first frame
+        graphicsPipeline = buildPipeline(PIPELINE_DEFAULT, colorFormat, depthFormat);
+
+        // Variants are compiled on worker threads and picked up once ready
+        for (int i = PIPELINE_DEFAULT + 1; i < PIPELINE_VARIANT_MAX; ++i) {
+            auto variant = static_cast<PipelineVariant>(i);
+            _pipelineVariants[i] = std::async(std::launch::async,
+                [this, variant, colorFormat, depthFormat]() -> VkPipeline {
+                    try {
+                        return buildPipeline(variant, colorFormat, depthFormat);
+                    } catch (const std::exception& e) {
+                        trc::log(std::string("Pipeline variant failed: ") + e.what(), trc::ERROR);
+                        return VK_NULL_HANDLE;
+                    }
+                }).share();
+        }
+    }
+
+    // Returns the requested variant if it finished compiling, the default
+    // pipeline otherwise
+    VkPipeline getPipeline(PipelineVariant variant) {
+        if (variant == PIPELINE_DEFAULT) {
+            return graphicsPipeline;
+        }
+
+        auto& future = _pipelineVariants[variant];
+        if (future.valid() &&
+            future.wait_for(std::chrono::seconds(0)) == std::future_status::ready &&
+            future.get() != VK_NULL_HANDLE) {
+            return future.get();
+        }
+        return graphicsPipeline;
+    }
+
+    void destroyPipelines() {
+        for (auto& future : _pipelineVariants) {
+            if (future.valid() && future.get() != VK_NULL_HANDLE) {
+                vkDestroyPipeline(vkb_device, future.get(), nullptr);
+            }
+            future = {};
+        }
+        vkDestroyPipeline(vkb_device, graphicsPipeline, nullptr);
+    }
+
+    // Builds one pipeline variant. Does not modify renderer state, so it is
+    // safe to call from worker threads
+    VkPipeline buildPipeline(PipelineVariant variant, VkFormat colorFormat, VkFormat depthFormat) {
+        auto vertShaderModule = vk::createShaderModule(vkb_device, _vertShaderCode);
+        auto fragShaderModule = vk::createShaderModule(vkb_device, _fragShaderCode);
+
+        std::string sMainStage = "main";
+
+        auto vertShaderStageInfo = vk::getShaderStageInfo(vertShaderModule, VK_SHADER_STAGE_VERTEX_BIT, sMainStage);
+        auto fragShaderStageInfo = vk::getShaderStageInfo(fragShaderModule, VK_SHADER_STAGE_FRAGMENT_BIT, sMainStage);
+
+        // OCT_NORMALS of shader.vert
+        VkBool32 octNormals = _vertexFormat != vk::VERTEX_FORMAT_FULL;
+        VkSpecializationMapEntry specEntry{
+            .constantID = 0,
+            .offset = 0,
+            .size = sizeof(VkBool32),
+        };
+        VkSpecializationInfo specInfo{
+            .mapEntryCount = 1,
+            .pMapEntries = &specEntry,
+            .dataSize = sizeof(VkBool32),
+            .pData = &octNormals,
+        };
+        vertShaderStageInfo.pSpecializationInfo = &specInfo;
+
+        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+
+        auto vertexInputInfo = vk::getVertexInputInfo(ale_VertexBindingDescriptions,
+                                                    ale_VertexAttributeDescriptions);
+        auto inputAssembly = vk::getDefaultInputAssembly();
+        auto viewportState = vk::getDefaultViewportState();
+        auto rasterizer = vk::getDefaultRasterizer();
+        auto multisampling = vk::getDefaultMultisampling();
+        auto depthStencil = vk::getDefaultDepthStencil();
+
+        if (variant == PIPELINE_DOUBLE_SIDED) {
+            rasterizer.cullMode = VK_CULL_MODE_NONE;
+        }
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+            .blendEnable = VK_FALSE,
+            .colorWriteMask = 	VK_COLOR_COMPONENT_R_BIT |
+								VK_COLOR_COMPONENT_G_BIT |
+								VK_COLOR_COMPONENT_B_BIT |
+								VK_COLOR_COMPONENT_A_BIT,
+        };
+
+        auto colorBlending = vk::getColorBlending(colorBlendAttachment);
+
+        std::vector<VkDynamicState> dynamicStates = {
             VK_DYNAMIC_STATE_VIEWPORT,
             VK_DYNAMIC_STATE_SCISSOR
         };
 
         auto dynamicState = vk::getPipelineDynamicState(dynamicStates);
-        auto pipelineLayoutInfo = vk::getPipelineLayout(_defaultDescriptorSetLayout, pushConstantRanges);
-
-        if (vkCreatePipelineLayout(vkb_device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create pipeline layout!");
-		}
 
         VkPipelineRenderingCreateInfo renderingCreateInfo {
             .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
             .pNext = VK_NULL_HANDLE,
             .colorAttachmentCount = 1,
-            .pColorAttachmentFormats = &vkb_swapchain.image_format,
-            .depthAttachmentFormat = findDepthFormat(),
+            .pColorAttachmentFormats = &colorFormat,
+            .depthAttachmentFormat = depthFormat,
 
         };
 
@@ -967,13 +1709,16 @@ private:
             .basePipelineHandle = VK_NULL_HANDLE,
         };
 
-
-        if (vkCreateGraphicsPipelines(vkb_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create graphics pipeline!");
-        }
+        VkPipeline pipeline;
+        VkResult result = vkCreateGraphicsPipelines(vkb_device, _pipelineCache.get(), 1, &pipelineInfo, nullptr, &pipeline);
 
         vkDestroyShaderModule(vkb_device, fragShaderModule, nullptr);
         vkDestroyShaderModule(vkb_device, vertShaderModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        return pipeline;
     }
 
     void createCommandPool() {
@@ -997,8 +1742,9 @@ private:
 
     void createDepthResources() {
         VkFormat depthFormat = findDepthFormat();
+        _depthFormat = depthFormat;
 
-        createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+        createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageAllocation);
         depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
     }
 
@@ -1050,22 +1796,61 @@ private:
                 vkDestroyImageView(vkb_device, texData.imageView, nullptr);
 
                 vkDestroyImage(vkb_device, texData.image, nullptr);
-                vkFreeMemory(vkb_device, texData.deviceMemory, nullptr);
+                _allocator.free(texData.allocation);
             }
             return false;
         });
 
-        // Bind textures to materials
+        // Materials reference textures by index, shaders read them from
+        // a storage buffer
         _renderMaterials.resize(_model.materials.size());
+        std::vector<GpuMaterial> gpuMaterials(std::max<size_t>(_model.materials.size(), 1), {0, -1, -1, -1});
+
         for(int i = 0 ; i < _model.materials.size(); ++i) {
             ale::Material& modelMat  = _model.materials[i];
             RenderMaterial& renderMat = _renderMaterials[i];
-            if (modelMat.baseColorTexIdx != -1) {
-                renderMat.textureData = _modelTextures[modelMat.baseColorTexIdx];
-            } else {
-                renderMat.textureData = _modelTextures[0];
+
+            gpuMaterials[i] = {
+                // Materials without a base color fall back to the first texture
+                .baseColorTexIdx = modelMat.baseColorTexIdx != -1 ? modelMat.baseColorTexIdx : 0,
+                .normalTexIdx = modelMat.normalTexIdx,
+                .emissiveTexIdx = modelMat.emissiveTexIdx,
+                .occlusionTexIdx = modelMat.occlusionTexIdx,
+            };
+
+            if (modelMat.bDoubleSided) {
+                renderMat.pipelineVariant = PIPELINE_DOUBLE_SIDED;
             }
         }
+
+        createMaterialBuffer(gpuMaterials);
+    }
+
+    void createMaterialBuffer(const std::vector<GpuMaterial>& gpuMaterials) {
+        VkDeviceSize bufferSize = gpuMaterials.size() * sizeof(GpuMaterial);
+
+        VulkanBufferLayout stagingBuffer;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     stagingBuffer.vkBuffer, stagingBuffer.allocation);
+        memcpy(stagingBuffer.allocation.mapped, gpuMaterials.data(), bufferSize);
+
+        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     _materialBuffer.vkBuffer, _materialBuffer.allocation);
+        _materialBuffer.size = bufferSize;
+
+        copyBuffer(stagingBuffer.vkBuffer, _materialBuffer.vkBuffer, bufferSize);
+        destroyBuffer(stagingBuffer);
+
+        destructorStack.push([this](){
+            destroyBuffer(_materialBuffer);
+            return false;
+        });
+    }
+
+    uint32_t getTextureDescriptorCount() {
+        return static_cast<uint32_t>(std::max<size_t>(_model.textures.size(), 1));
     }
 
 
@@ -1076,30 +1861,27 @@ private:
         VkDeviceSize imageSize = _image->w * _image->h * 4;
 
         VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
+        vk::Allocation stagingAllocation;
         createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     stagingBuffer, stagingBufferMemory);
+                     stagingBuffer, stagingAllocation);
 
-        // TODO: store this pointer for later use
-        void* data;
-        vkMapMemory(vkb_device, stagingBufferMemory, 0, VK_WHOLE_SIZE, 0, &data);
-            memcpy(data, &_image->data.at(0), static_cast<size_t>(imageSize));
-        vkUnmapMemory(vkb_device, stagingBufferMemory);
+        // Staging memory is persistently mapped by the allocator
+        memcpy(stagingAllocation.mapped, &_image->data.at(0), static_cast<size_t>(imageSize));
 
         createImage(_image->w, _image->h,
                     VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
                     VK_IMAGE_USAGE_TRANSFER_DST_BIT |
                     VK_IMAGE_USAGE_SAMPLED_BIT,
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureData.image, _textureData.deviceMemory);
+                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureData.image, _textureData.allocation);
 
         transitionImageLayout(_textureData.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
             copyBufferToImage(stagingBuffer, _textureData.image, static_cast<uint32_t>(_image->w), static_cast<uint32_t>(_image->h));
         transitionImageLayout(_textureData.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
         vkDestroyBuffer(vkb_device, stagingBuffer, nullptr);
-        vkFreeMemory(vkb_device, stagingBufferMemory, nullptr);
+        _allocator.free(stagingAllocation);
     }
 
     void createTextureSampler(TextureData& _textureData) {
@@ -1154,7 +1936,7 @@ private:
         return imageView;
     }
 
-    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, vk::Allocation& imageAllocation) {
         VkImageCreateInfo imageInfo = vk::getImageInfo(width, height, format, tiling, usage);
 
         if (vkCreateImage(vkb_device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
@@ -1164,16 +1946,13 @@ private:
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(vkb_device, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+        auto kind = tiling == VK_IMAGE_TILING_OPTIMAL
+                  ? vk::ResourceKind::OPTIMAL_IMAGE
+                  : vk::ResourceKind::LINEAR;
 
-        if (vkAllocateMemory(vkb_device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
+        imageAllocation = _allocator.allocate(memRequirements, properties, kind);
 
-        vkBindImageMemory(vkb_device, image, imageMemory, 0);
+        vkBindImageMemory(vkb_device, image, imageAllocation.memory, imageAllocation.offset);
     }
 
     void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
@@ -1254,156 +2033,93 @@ private:
         endSingleTimeCommands(commandBuffer);
     }
 
-    void createVertexBuffer() {
-
-        if (_model.viewMeshes.size() <= 0) {
-            throw std::runtime_error("No meshes in the model!");
-        }
-
-        // Counter for all the vertices in the model
-        VkDeviceSize numAllVerts = 0;
-        // Check vertex size against this vert
-        auto vert = _model.viewMeshes[0].vertices[0];
-
-        // Add mesh sizes to the counter
-        for(const auto& m: _model.viewMeshes) {
-            numAllVerts += m.vertices.size();
-        }
-
-        if (numAllVerts <= 0) {
-            throw std::runtime_error("Vertex buffer size is 0!");
-        }
-
-        auto& _vb = _vertBuffer;
-        auto& _vsb = _vertStagingBuffer;
-
-        _vb.size = numAllVerts * sizeof(vert);
-
-        createBuffer(_vb.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                     _vsb.vkBuffer, _vsb.memory);
-
-
-        // Create a huge array with all the vertices
-        std::vector<ale::Vertex> allVertices = {};
-        allVertices.reserve(numAllVerts);
-
-        // TODO: Use this data to map vertices for editing
-
-        // Populate our giant vertex array
-        for (auto m : _model.viewMeshes) {
-            for (auto v: m.vertices) {
-                allVertices.push_back(v);
+    // Picks the GPU vertex layout. The pipelines depend on it, so it is
+    // fixed for the lifetime of the renderer
+    void selectVertexFormat() {
+        _vertexFormat = vk::VERTEX_FORMAT_FULL;
+        if (renderer_packVertices) {
+            _vertexFormat = vk::VERTEX_FORMAT_PACKED;
+            for (const auto& m : _model.viewMeshes) {
+                if (vk::hasVertexColors(m.vertices)) {
+                    _vertexFormat = vk::VERTEX_FORMAT_PACKED_COLOR;
+                    break;
+                }
             }
         }
 
-        vkMapMemory(vkb_device, _vsb.memory, 0, _vb.size, 0, &_vsb.handle);
-        // Map our gigantic vertex array straight to gpu memory
-            memcpy(_vsb.handle, allVertices.data(), _vb.size);
-
-        for (auto& v : allVertices ) {
-            _allVertices.push_back(v);
-        }
-
-        createBuffer(_vb.size, VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                                     VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                     _vb.vkBuffer, _vb.memory);
-
-        copyBuffer(_vsb.vkBuffer, _vb.vkBuffer, _vb.size);
-
-        destructorStack.push([this](){
+        ale_VertexBindingDescriptions = {
+            vk::getVertBindingDescription(0, vk::getVertexStride(_vertexFormat)),
+            vk::getVertBindingDescription(1, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE),
+            vk::getVertBindingDescription(2, 0),
+        };
 
-            vkDestroyBuffer(vkb_device, _vertStagingBuffer.vkBuffer, nullptr);
-            vkFreeMemory(vkb_device, _vertStagingBuffer.memory, nullptr);
+        ale_VertexAttributeDescriptions = vk::getVertexAttributeDescriptions(_vertexFormat);
+        ale_VertexAttributeDescriptions.insert(ale_VertexAttributeDescriptions.end(),
+                                               ale_InstanceAttributeDescriptions.begin(),
+                                               ale_InstanceAttributeDescriptions.end());
 
-            vkDestroyBuffer(vkb_device, _vertBuffer.vkBuffer, nullptr);
-            vkFreeMemory(vkb_device, _vertBuffer.memory, nullptr);
-            return false;
-        });
+        trc::log("Vertex stride: " + std::to_string(vk::getVertexStride(_vertexFormat)) + " bytes");
     }
 
-    void createIndexBuffer() {
-
-        auto& _ib = _idxBuffer;
-        auto _isb = _idxStagingBuffer;
-
-        unsigned long numIdx = 0;
-        indexCount = 0;
-
-        // Samples the first index for default size
-        auto index = _model.viewMeshes[0].indices[0];
-
+    // Reserves room for every view mesh and queues their uploads. The data
+    // reaches the GPU with the first recorded frame
+    void createGeometryHeap() {
         if (_model.viewMeshes.size() <= 0) {
             throw std::runtime_error("No meshes in the model!");
         }
 
-        for(const auto& m: _model.viewMeshes) {
-            numIdx += m.indices.size();
-            indexCount += m.indices.size();
+        uint64_t numVerts = 0;
+        uint64_t numIdx = 0;
+        uint64_t numIdx16 = 0;
+        for (const auto& m : _model.viewMeshes) {
+            numVerts += m.vertices.size();
+            if (vk::GeometryHeap::getIndexType(m.vertices.size()) == VK_INDEX_TYPE_UINT16) {
+                numIdx16 += m.indices.size();
+            } else {
+                numIdx += m.indices.size();
+            }
         }
 
-        if (numIdx<= 0) {
+        if (numVerts <= 0) {
             throw std::runtime_error("Vertex buffer size is 0!");
         }
 
-
-        std::vector<unsigned int> allIdx = {};
-        allIdx.reserve(numIdx * sizeof(index));
-
-
-
-        unsigned int iOffset = 0;
-        unsigned int vOffset = 0;
-
-        for (auto& m : _model.viewMeshes) {
-            unsigned int mSize = m.indices.size();
-            unsigned int vSize = m.vertices.size();
-
-            for (auto i : m.indices) {
-                allIdx.push_back(i + vOffset);
-            }
-
-            MeshBufferData data {
-                .size = mSize,
-                .offset = iOffset,
-            };
-
-            meshBuffers.push_back(data);
-            iOffset += mSize;
-            vOffset += vSize;
+        // Read with stride 0 by meshes without vertex colors
+        createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     _constantColorBuffer.vkBuffer, _constantColorBuffer.allocation);
+        _constantColorBuffer.size = sizeof(uint32_t);
+        _constantColorBuffer.handle = _constantColorBuffer.allocation.mapped;
+        uint32_t white = 0xFFFFFFFF;
+        memcpy(_constantColorBuffer.handle, &white, sizeof(white));
+
+        // Headroom for streamed meshes and for TLSF size class rounding
+        _geometry.init(vkb_device, _allocator, vk::getVertexStride(_vertexFormat), MAX_FRAMES_IN_FLIGHT,
+                       numVerts + numVerts / 4 + 256, numIdx + numIdx / 4 + 256,
+                       numIdx16 + numIdx16 / 4 + 256);
+
+        for (int i = 0; i < _model.viewMeshes.size(); i++) {
+            uploadMesh(i);
         }
 
+        destructorStack.push([this](){
+            _geometry.destroy();
+            destroyBuffer(_constantColorBuffer);
+            return false;
+        });
+    }
 
-        VkDeviceSize bufferSize = numIdx * sizeof(index);
-        _ib.size = bufferSize;
-
-
-
-        createBuffer(_ib.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                 _isb.vkBuffer, _isb.memory);
-
-        vkMapMemory(vkb_device, _isb.memory, 0, bufferSize, 0, &_ib.handle);
-            memcpy(_ib.handle, allIdx.data(), _ib.size);
-        vkUnmapMemory(vkb_device, _isb.memory);
-
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                 _ib.vkBuffer, _ib.memory);
-
-        copyBuffer(_isb.vkBuffer, _ib.vkBuffer, bufferSize);
-
-        vkDestroyBuffer(vkb_device, _isb.vkBuffer, nullptr);
-        vkFreeMemory(vkb_device, _isb.memory, nullptr);
-
+    void createInstanceBuffers() {
+        // Start with room for every node, instancing extensions grow it later
+        size_t initialCount = std::max<size_t>(_model.nodes.size(), 1);
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            ensureInstanceCapacity(i, initialCount);
+        }
 
         destructorStack.push([this](){
-            vkDestroyBuffer(vkb_device, _idxBuffer.vkBuffer, nullptr);
-            vkFreeMemory(vkb_device, _idxBuffer.memory, nullptr);
+            for (auto& buffer : _instanceBuffers) {
+                destroyBuffer(buffer);
+            }
             return false;
         });
     }
@@ -1412,37 +2128,40 @@ private:
         VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
         uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+        uniformBuffersAllocations.resize(MAX_FRAMES_IN_FLIGHT);
         uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersAllocations[i]);
 
-            vkMapMemory(vkb_device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+            uniformBuffersMapped[i] = uniformBuffersAllocations[i].mapped;
         }
 
         destructorStack.push([this](){
             for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
                 vkDestroyBuffer(vkb_device, uniformBuffers[i], nullptr);
-                vkFreeMemory(vkb_device, uniformBuffersMemory[i], nullptr);
+                _allocator.free(uniformBuffersAllocations[i]);
             }
             return false;
         });
     }
 
-    // TODO: Make this flexible
     void createDescriptorPool() {
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        std::array<VkDescriptorPoolSize, 3> poolSizes{};
         // First UBO is for MVP + Light position
         poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        // Texture sampler
+        poolSizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+        // All model textures
         poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        poolSizes[1].descriptorCount = getTextureDescriptorCount() * MAX_FRAMES_IN_FLIGHT;
+        // Materials, culling records, commands and counts
+        poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[2].descriptorCount = 4 * MAX_FRAMES_IN_FLIGHT;
 
         VkDescriptorPoolCreateInfo poolInfo {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-            .maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
+            // Scene and culling sets
+            .maxSets = 2 * MAX_FRAMES_IN_FLIGHT,
             .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
             .pPoolSizes = poolSizes.data(),
         };
@@ -1460,7 +2179,128 @@ private:
 
     }
 
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+    // Descriptors never change between frames, so they are written once
+    // here. Draws select materials and textures by index
+    void createSceneDescriptorSets() {
+        std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+        layouts.fill(_defaultDescriptorSetLayout);
+
+        VkDescriptorSetAllocateInfo allocInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = descriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
+            .pSetLayouts = layouts.data(),
+        };
+
+        if (vkAllocateDescriptorSets(vkb_device, &allocInfo, _sceneDescriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate scene descriptor sets!");
+        }
+
+        if (_modelTextures.empty()) {
+            throw std::runtime_error("model has no textures!");
+        }
+
+        std::vector<VkDescriptorImageInfo> textureInfos(getTextureDescriptorCount());
+        for (size_t i = 0; i < textureInfos.size(); i++) {
+            auto& texData = _modelTextures[i];
+            textureInfos[i] = {
+                .sampler = texData.sampler,
+                .imageView = texData.imageView,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            };
+        }
+
+        VkDescriptorBufferInfo materialInfo {
+            .buffer = _materialBuffer.vkBuffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE,
+        };
+
+        for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            VkDescriptorBufferInfo mvpUboInfo {
+                .buffer = uniformBuffers[frame],
+                .offset = 0,
+                .range = sizeof(UniformBufferObject),
+            };
+
+            std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+
+            descriptorWrites[0] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = _sceneDescriptorSets[frame],
+                .dstBinding = 0,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .pBufferInfo = &mvpUboInfo,
+            };
+
+            descriptorWrites[1] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = _sceneDescriptorSets[frame],
+                .dstBinding = 1,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &materialInfo,
+            };
+
+            descriptorWrites[2] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = _sceneDescriptorSets[frame],
+                .dstBinding = 2,
+                .dstArrayElement = 0,
+                .descriptorCount = static_cast<uint32_t>(textureInfos.size()),
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .pImageInfo = textureInfos.data(),
+            };
+
+            vkUpdateDescriptorSets(vkb_device, static_cast<uint32_t>(descriptorWrites.size()),
+                                   descriptorWrites.data(), 0, nullptr);
+            _frameStats.descriptorUpdates += descriptorWrites.size();
+        }
+    }
+
+    void destroyBuffer(VulkanBufferLayout& buffer) {
+        if (buffer.vkBuffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyBuffer(vkb_device, buffer.vkBuffer, nullptr);
+        _allocator.free(buffer.allocation);
+        buffer = {};
+    }
+
+    // Destroys the buffer once the frames that may use it are complete
+    void retireBuffer(VulkanBufferLayout& buffer) {
+        if (buffer.vkBuffer == VK_NULL_HANDLE) {
+            return;
+        }
+        _deletionQueue.retire([this, buffer]() mutable {
+            destroyBuffer(buffer);
+        });
+        buffer = {};
+    }
+
+    // Recreates the buffer if it is smaller than required. Grows at least
+    // twice to amortize reallocations. Returns true if the buffer changed,
+    // the old buffer is retired
+    bool ensureBufferCapacity(VulkanBufferLayout& buffer, VkDeviceSize required,
+                              VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+        required = std::max<VkDeviceSize>(required, 1);
+        if (buffer.vkBuffer != VK_NULL_HANDLE && buffer.size >= required) {
+            return false;
+        }
+
+        VkDeviceSize newSize = std::max<VkDeviceSize>(required, buffer.vkBuffer != VK_NULL_HANDLE ? buffer.size * 2 : 0);
+
+        retireBuffer(buffer);
+        createBuffer(newSize, usage, properties, buffer.vkBuffer, buffer.allocation);
+        buffer.size = newSize;
+        buffer.handle = buffer.allocation.mapped;
+        return true;
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, vk::Allocation& bufferAllocation) {
         VkBufferCreateInfo bufferInfo{
             .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
             .size = size,
@@ -1475,17 +2315,9 @@ private:
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(vkb_device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{
-            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-            .allocationSize = memRequirements.size,
-            .memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties),
-        };
+        bufferAllocation = _allocator.allocate(memRequirements, properties, vk::ResourceKind::LINEAR);
 
-        if (vkAllocateMemory(vkb_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
-        }
-
-        vkBindBufferMemory(vkb_device, buffer, bufferMemory, 0);
+        vkBindBufferMemory(vkb_device, buffer, bufferAllocation.memory, bufferAllocation.offset);
     }
 
     VkCommandBuffer beginSingleTimeCommands() {
@@ -1540,17 +2372,44 @@ private:
         endSingleTimeCommands(commandBuffer);
     }
 
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(vkb_physicalDevice, &memProperties);
+    void createWorkerCommandPools() {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(vkb_physicalDevice);
 
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
+        VkCommandPoolCreateInfo poolInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value(),
+        };
+
+        for (auto& workers : _workerCommands) {
+            workers.resize(_threadPool.getSlotCount());
+
+            for (auto& worker : workers) {
+                if (vkCreateCommandPool(vkb_device, &poolInfo, nullptr, &worker.pool) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create worker command pool!");
+                }
+
+                VkCommandBufferAllocateInfo allocInfo {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .commandPool = worker.pool,
+                    .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                    .commandBufferCount = 1,
+                };
+
+                if (vkAllocateCommandBuffers(vkb_device, &allocInfo, &worker.buffer) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate secondary command buffer!");
+                }
             }
         }
 
-        throw std::runtime_error("failed to find suitable memory type!");
+        destructorStack.push([this](){
+            for (auto& workers : _workerCommands) {
+                for (auto& worker : workers) {
+                    vkDestroyCommandPool(vkb_device, worker.pool, nullptr);
+                }
+            }
+            return false;
+        });
     }
 
     void createCommandBuffers() {
@@ -1571,17 +2430,16 @@ private:
     void recordRenderCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
         VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
 
-
-        memcpy(_vertStagingBuffer.handle, _allVertices.data(), _vertBuffer.size);
-        copyBuffer(_vertStagingBuffer.vkBuffer, _vertBuffer.vkBuffer, _vertBuffer.size);
-
-
         if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
             throw std::runtime_error("failed to begin recording command buffer!");
         }
 
-        VkBufferCopy copyRegion{ .size = _vertBuffer.size};
-        vkCmdCopyBuffer(commandBuffer, _vertStagingBuffer.vkBuffer, _vertBuffer.vkBuffer, 1, &copyRegion);
+        // Mesh uploads and compaction go before any draw of the frame
+        _geometry.recordFrame(commandBuffer, currentFrame);
+        if (_geometry.getVersion() != _geometryVersion) {
+            _geometryVersion = _geometry.getVersion();
+            markSceneDirty();
+        }
 
         VkRect2D renderAreaWholeViewport = { .offset = {0, 0}, .extent = swapChainExtent, };
 
@@ -1632,9 +2490,11 @@ private:
                                        VK_ATTACHMENT_STORE_OP_DONT_CARE,
                                        clearValues[1]);
 
+        // Scene draws are recorded into secondary buffers on worker threads
         VkRenderingInfo renderingInfo {
             .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
             .pNext = VK_NULL_HANDLE,
+            .flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT,
             .renderArea = renderAreaWholeViewport,
             .layerCount = 1,
             .colorAttachmentCount = 1,
@@ -1642,27 +2502,27 @@ private:
             .pDepthAttachment = &sceneDepthAttachmentInfo,
         };
 
-        // **Render 3D scene**
-        vkCmdBeginRendering(commandBuffer, &renderingInfo);
-
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-            VkViewport viewport = vk::getViewport(swapChainExtent);
-            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-            VkRect2D scissor{.offset = {0, 0}, .extent = swapChainExtent};
-            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-            VkBuffer vertexBuffers[] = {_vertBuffer.vkBuffer};
-            VkDeviceSize offsets[] = {0};
+        if (isGpuDrivenActive()) {
+            recordGpuCull(commandBuffer);
 
-            // Bind all vertices to one buffer
-            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-            vkCmdBindIndexBuffer(commandBuffer, _idxBuffer.vkBuffer, 0, VK_INDEX_TYPE_UINT32);
+            // The GPU driven path records a few indirect draws inline
+            renderingInfo.flags = 0;
 
-            renderNodes(commandBuffer, _model);
+            // **Render 3D scene**
+            vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                drawGpuScene(commandBuffer);
+            vkCmdEndRendering(commandBuffer);
+        } else {
+            buildRenderQueue(_model);
+            std::vector<VkCommandBuffer> sceneCommands = recordSceneCommands();
 
-        vkCmdEndRendering(commandBuffer);
+            // **Render 3D scene**
+            vkCmdBeginRendering(commandBuffer, &renderingInfo);
+                if (!sceneCommands.empty()) {
+                    vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(sceneCommands.size()), sceneCommands.data());
+                }
+            vkCmdEndRendering(commandBuffer);
+        }
 
 
         VkRenderingAttachmentInfo imguiColorAttachmentInfo =
@@ -1697,7 +2557,436 @@ private:
         }
     }
 
+    bool isGpuDrivenActive() {
+        return _bGpuDriven && _cullPipeline != VK_NULL_HANDLE;
+    }
+
+    void createCullPipeline() {
+        if (!_bDrawIndirectCountSupported || _cullShaderCode.empty()) {
+            trc::log("GPU driven rendering is not available", trc::INFO);
+            return;
+        }
+
+        std::vector<VkDescriptorSetLayoutBinding> layoutBindings{};
+        for (int i = 0; i < 3; i++) {
+            vk::pushBackDescriptorSetBinding(layoutBindings, 1,
+                                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                             VK_SHADER_STAGE_COMPUTE_BIT);
+        }
+
+        auto layoutInfo = vk::getDescriptorSetLayout(layoutBindings);
+
+        if (vkCreateDescriptorSetLayout(vkb_device, &layoutInfo, nullptr, &_cullDescriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling descriptor set layout!");
+        }
+
+        std::vector<VkPushConstantRange> cullPushConstantRanges = {
+            {
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .offset = 0,
+                .size = sizeof(CullPushConstants),
+            },
+        };
+
+        auto pipelineLayoutInfo = vk::getPipelineLayout(_cullDescriptorSetLayout, cullPushConstantRanges);
+
+        if (vkCreatePipelineLayout(vkb_device, &pipelineLayoutInfo, nullptr, &_cullPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling pipeline layout!");
+        }
+
+        auto cullShaderModule = vk::createShaderModule(vkb_device, _cullShaderCode);
+        std::string sMainStage = "main";
+
+        VkComputePipelineCreateInfo pipelineInfo {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = vk::getShaderStageInfo(cullShaderModule, VK_SHADER_STAGE_COMPUTE_BIT, sMainStage),
+            .layout = _cullPipelineLayout,
+        };
+
+        VkResult result = vkCreateComputePipelines(vkb_device, _pipelineCache.get(), 1, &pipelineInfo, nullptr, &_cullPipeline);
+        vkDestroyShaderModule(vkb_device, cullShaderModule, nullptr);
+
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling pipeline!");
+        }
+
+        std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+        layouts.fill(_cullDescriptorSetLayout);
+        std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> sets;
+
+        VkDescriptorSetAllocateInfo allocInfo {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = descriptorPool,
+            .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
+            .pSetLayouts = layouts.data(),
+        };
+
+        if (vkAllocateDescriptorSets(vkb_device, &allocInfo, sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate culling descriptor sets!");
+        }
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            _gpuScene[i].descriptorSet = sets[i];
+        }
+
+        destructorStack.push([this](){
+            for (auto& frame : _gpuScene) {
+                destroyBuffer(frame.records);
+                destroyBuffer(frame.instances);
+                destroyBuffer(frame.commands);
+                destroyBuffer(frame.counts);
+                destroyBuffer(frame.countsReadback);
+            }
+            vkDestroyPipeline(vkb_device, _cullPipeline, nullptr);
+            vkDestroyPipelineLayout(vkb_device, _cullPipelineLayout, nullptr);
+            vkDestroyDescriptorSetLayout(vkb_device, _cullDescriptorSetLayout, nullptr);
+            return false;
+        });
+    }
+
+    // Local space bounding sphere of a view mesh
+    glm::vec4 getMeshBounds(int meshIdx) {
+        if (_meshBounds.size() != _model.viewMeshes.size()) {
+            _meshBounds.assign(_model.viewMeshes.size(), glm::vec4(0, 0, 0, -1));
+        }
+
+        glm::vec4& bounds = _meshBounds[meshIdx];
+        if (bounds.w < 0) {
+            auto& vertices = _model.viewMeshes[meshIdx].vertices;
+            glm::vec3 min(std::numeric_limits<float>::max());
+            glm::vec3 max(std::numeric_limits<float>::lowest());
+            for (auto& v : vertices) {
+                min = glm::min(min, v.pos);
+                max = glm::max(max, v.pos);
+            }
+
+            glm::vec3 center = vertices.empty() ? glm::vec3(0) : (min + max) * 0.5f;
+            float radius = 0;
+            for (auto& v : vertices) {
+                radius = std::max(radius, glm::length(v.pos - center));
+            }
+            bounds = glm::vec4(center, radius);
+        }
+        return bounds;
+    }
+
+    // Grows the bounding sphere of a mesh around its center to hold the
+    // given vertex ranges. The GPU path culls with the spheres of its
+    // draw records, so they are rebuilt if it grew
+    void growMeshBounds(int meshIdx, const std::vector<std::pair<size_t, size_t>>& ranges) {
+        if (meshIdx >= static_cast<int>(_meshBounds.size()) || _meshBounds[meshIdx].w < 0) {
+            return;
+        }
+
+        glm::vec4& bounds = _meshBounds[meshIdx];
+        auto& vertices = _model.viewMeshes[meshIdx].vertices;
+        float radius = bounds.w;
+        for (auto [first, count] : ranges) {
+            for (size_t v = first; v < first + count; v++) {
+                radius = std::max(radius, glm::length(vertices[v].pos - glm::vec3(bounds)));
+            }
+        }
+        if (radius > bounds.w) {
+            bounds.w = radius;
+            markSceneDirty();
+        }
+    }
+
+    // Rebuilds draw records, instance data and batches of the current frame.
+    // Runs only after markSceneDirty(), so static scenes cost nothing here
+    void updateGpuScene() {
+        auto& frame = _gpuScene[currentFrame];
+        if (frame.version == _gpuSceneVersion) {
+            return;
+        }
+
+        _renderQueue.clear();
+        for (auto nodeId : _model.rootNodes) {
+            collectNode(_model.nodes[nodeId], _model);
+        }
+
+        // Batches only depend on the pipeline and the index type
+        std::stable_sort(_renderQueue.begin(), _renderQueue.end(),
+                         [](const DrawItem& a, const DrawItem& b) {
+                             return (a.sortKey >> 32) < (b.sortKey >> 32);
+                         });
+
+        size_t count = _renderQueue.size();
+
+        auto hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        bool bResized = false;
+        bResized |= ensureBufferCapacity(frame.records, count * sizeof(GpuDrawRecord),
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+        bResized |= ensureBufferCapacity(frame.instances, count * sizeof(InstanceData),
+                                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, hostVisible);
+        bResized |= ensureBufferCapacity(frame.commands, count * sizeof(VkDrawIndexedIndirectCommand),
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        frame.batches.clear();
+        auto* records = static_cast<GpuDrawRecord*>(frame.records.handle);
+        auto* instances = static_cast<InstanceData*>(frame.instances.handle);
+
+        for (size_t i = 0; i < count; i++) {
+            const DrawItem& item = _renderQueue[i];
+            auto& mat = _renderMaterials[item.materialID];
+
+            if (frame.batches.empty() ||
+                frame.batches.back().pipelineVariant != mat.pipelineVariant ||
+                frame.batches.back().indexType != item.indexType) {
+                frame.batches.push_back({
+                    .pipelineVariant = mat.pipelineVariant,
+                    .indexType = item.indexType,
+                    .commandOffset = static_cast<uint32_t>(i),
+                    .maxCount = 0,
+                });
+            }
+            auto& batch = frame.batches.back();
+            batch.maxCount++;
+
+            auto& prim = _model.viewMeshes[item.meshIdx].primitives[item.primitiveIdx];
+            float scale = getMaxScale(item.transform);
+
+            GpuDrawRecord& record = records[i];
+            record = {
+                .sphere = getItemSphere(item),
+                .vertexOffset = item.vertexOffset,
+                .batch = static_cast<uint32_t>(frame.batches.size() - 1),
+                .commandOffset = batch.commandOffset,
+                .lodCount = static_cast<uint32_t>(std::min<size_t>(prim.lods.size() + 1, GPU_MAX_LODS)),
+            };
+            for (uint32_t level = 0; level < record.lodCount; level++) {
+                GpuLod& lod = record.lods[level];
+                getLodRange(item, level, lod.firstIndex, lod.indexCount);
+                lod.error = level > 0 ? prim.lods[level - 1].error * scale : 0.0f;
+            }
+
+            const auto& q = _meshQuantization[item.meshIdx];
+            instances[i] = {
+                .model = item.transform,
+                .objData = glm::vec4(static_cast<float>(item.nodeId),
+                                     static_cast<float>(item.materialID), 1, 1),
+                .posOffset = glm::vec4(q.offset, 0),
+                .posScale = glm::vec4(q.scale, 0),
+            };
+        }
+
+        bResized |= ensureBufferCapacity(frame.counts, frame.batches.size() * sizeof(uint32_t),
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                         VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        if (bResized) {
+            std::array<VkDescriptorBufferInfo, 3> bufferInfos = {{
+                {.buffer = frame.records.vkBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = frame.commands.vkBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+                {.buffer = frame.counts.vkBuffer, .offset = 0, .range = VK_WHOLE_SIZE},
+            }};
+
+            std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+            for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+                descriptorWrites[i] = {
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .dstSet = frame.descriptorSet,
+                    .dstBinding = i,
+                    .dstArrayElement = 0,
+                    .descriptorCount = 1,
+                    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .pBufferInfo = &bufferInfos[i],
+                };
+            }
+
+            vkUpdateDescriptorSets(vkb_device, static_cast<uint32_t>(descriptorWrites.size()),
+                                   descriptorWrites.data(), 0, nullptr);
+            _frameStats.descriptorUpdates += descriptorWrites.size();
+        }
+
+        frame.recordCount = static_cast<uint32_t>(count);
+        frame.version = _gpuSceneVersion;
+    }
+
+    // Resets batch counts and dispatches frustum culling. Must be recorded
+    // outside of dynamic rendering
+    void recordGpuCull(VkCommandBuffer commandBuffer) {
+        // The fence of this frame was waited for, its counts are complete
+        checkGpuCull(_gpuScene[currentFrame]);
+        updateGpuScene();
+
+        auto& frame = _gpuScene[currentFrame];
+        if (frame.recordCount == 0) {
+            return;
+        }
+
+        vkCmdFillBuffer(commandBuffer, frame.counts.vkBuffer, 0, VK_WHOLE_SIZE, 0);
+
+        VkMemoryBarrier clearBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+        CullPushConstants pc {
+            .camera = glm::vec4(mainCamera->getPos(), _bLods ? getLodScale() : 0.0f),
+            .recordCount = frame.recordCount,
+        };
+        glm::mat4 viewProj = ubo.proj * ubo.view;
+        auto planes = geo::getFrustumPlanes(viewProj);
+        for (int i = 0; i < 6; i++) {
+            pc.planes[i] = planes[i];
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout,
+                                0, 1, &frame.descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+        vkCmdDispatch(commandBuffer, (frame.recordCount + 63) / 64, 1, 1);
+
+        VkMemoryBarrier cullBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+        };
+        VkPipelineStageFlags cullDstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+        if (_bCheckGpuCull) {
+            cullBarrier.dstAccessMask |= VK_ACCESS_TRANSFER_READ_BIT;
+            cullDstStages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, cullDstStages,
+                             0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+
+        if (_bCheckGpuCull) {
+            recordGpuCullReadback(commandBuffer, frame, planes);
+        }
+    }
+
+    // Copies the batch counts to the host and counts the records CPU
+    // culling keeps with the same planes
+    void recordGpuCullReadback(VkCommandBuffer commandBuffer, GpuSceneFrame& frame,
+                               const std::vector<glm::vec4>& planes) {
+        VkDeviceSize size = frame.batches.size() * sizeof(uint32_t);
+        ensureBufferCapacity(frame.countsReadback, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        VkBufferCopy region {.srcOffset = 0, .dstOffset = 0, .size = size};
+        vkCmdCopyBuffer(commandBuffer, frame.counts.vkBuffer, frame.countsReadback.vkBuffer, 1, &region);
+
+        VkMemoryBarrier readbackBarrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        };
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                             0, 1, &readbackBarrier, 0, nullptr, 0, nullptr);
+
+        frame.minCounts.assign(frame.batches.size(), 0);
+        frame.maxCounts.assign(frame.batches.size(), 0);
+        frame.cpuDraws = 0;
+        auto* records = static_cast<const GpuDrawRecord*>(frame.records.handle);
+        for (uint32_t i = 0; i < frame.recordCount; i++) {
+            glm::vec3 center(records[i].sphere);
+            float radius = records[i].sphere.w;
+            // Within a rounding error of a plane the shader may decide
+            // either way
+            bool bClearlyIn = true;
+            bool bClearlyOut = false;
+            for (auto& plane : planes) {
+                float margin = geo::getDistanceToPlane(center, plane) + radius;
+                float tolerance = 1e-5f * (std::abs(margin) + std::abs(plane.w) + radius) + 1e-6f;
+                bClearlyIn &= margin > tolerance;
+                bClearlyOut |= margin < -tolerance;
+            }
+            frame.minCounts[records[i].batch] += bClearlyIn;
+            frame.maxCounts[records[i].batch] += !bClearlyOut;
+            frame.cpuDraws += geo::isSphereInFrustum(center, radius, planes);
+        }
+        frame.bCheckPending = true;
+    }
+
+    // Compares the counts read back from the frame's last culling pass
+    // with CPU culling, logs batches outside of the CPU range
+    void checkGpuCull(GpuSceneFrame& frame) {
+        if (!frame.bCheckPending) {
+            return;
+        }
+        frame.bCheckPending = false;
+
+        auto* counts = static_cast<const uint32_t*>(frame.countsReadback.handle);
+        uint32_t gpuDraws = 0;
+        bool bMatch = true;
+        for (size_t i = 0; i < frame.minCounts.size(); i++) {
+            gpuDraws += counts[i];
+            if (counts[i] < frame.minCounts[i] || counts[i] > frame.maxCounts[i]) {
+                trc::log("GPU culling drew " + std::to_string(counts[i]) + " records of batch " +
+                         std::to_string(i) + ", CPU culling keeps " + std::to_string(frame.minCounts[i]) +
+                         " to " + std::to_string(frame.maxCounts[i]), trc::WARNING);
+                bMatch = false;
+            }
+        }
+
+        _gpuCullCheck.checkedFrames++;
+        _gpuCullCheck.mismatches += !bMatch;
+        _gpuCullCheck.gpuDraws = gpuDraws;
+        _gpuCullCheck.cpuDraws = frame.cpuDraws;
+    }
+
+    // One indirect draw per batch, independent of the object count
+    void drawGpuScene(VkCommandBuffer commandBuffer) {
+        auto& frame = _gpuScene[currentFrame];
+        if (frame.recordCount == 0) {
+            return;
+        }
+
+        VkViewport viewport = vk::getViewport(swapChainExtent);
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{.offset = {0, 0}, .extent = swapChainExtent};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        VkBuffer vertexBuffers[] = {_geometry.getVertexBuffer(), frame.instances.vkBuffer,
+                                    _constantColorBuffer.vkBuffer};
+        VkDeviceSize offsets[] = {0, 0, 0};
+
+        vkCmdBindVertexBuffers(commandBuffer, 0, 3, vertexBuffers, offsets);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+                                0, 1, &_sceneDescriptorSets[currentFrame], 0, nullptr);
+        _frameStats.descriptorSetBinds++;
+
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+
+        for (uint32_t i = 0; i < frame.batches.size(); i++) {
+            const GpuBatch& batch = frame.batches[i];
+
+            VkPipeline pipeline = getPipeline(batch.pipelineVariant);
+            if (pipeline != boundPipeline) {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                boundPipeline = pipeline;
+                _frameStats.pipelineBinds++;
+            }
+
+            if (batch.indexType != boundIndexType) {
+                vkCmdBindIndexBuffer(commandBuffer, _geometry.getIndexBuffer(batch.indexType), 0, batch.indexType);
+                boundIndexType = batch.indexType;
+            }
+
+            vkCmdDrawIndexedIndirectCount(commandBuffer,
+                                          frame.commands.vkBuffer,
+                                          batch.commandOffset * sizeof(VkDrawIndexedIndirectCommand),
+                                          frame.counts.vkBuffer,
+                                          i * sizeof(uint32_t),
+                                          batch.maxCount,
+                                          sizeof(VkDrawIndexedIndirectCommand));
+            _frameStats.drawCalls++;
+        }
+    }
+
     void createSyncObjects() {
+        // Retired resources wait for the in flight fences
+        _deletionQueue.init(MAX_FRAMES_IN_FLIGHT);
+
         imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
         inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1957,6 +3246,34 @@ private:
         ui::drawHierarchyUI(this->_model);
         ImGui::End();
 
+        ImGui::Begin("Render stats");
+        ImGui::Text("Draw calls: %u", _lastFrameStats.drawCalls);
+        ImGui::Text("Pipeline binds: %u", _lastFrameStats.pipelineBinds);
+        ImGui::Text("Descriptor set binds: %u", _lastFrameStats.descriptorSetBinds);
+        ImGui::Text("Descriptor updates: %u", _lastFrameStats.descriptorUpdates);
+        ImGui::Text("Instances: %u", _lastFrameStats.instances);
+        ImGui::Text("Triangles: %u", _lastFrameStats.triangles);
+        ImGui::Text("Culled items: %u", _lastFrameStats.culledItems);
+        ImGui::Checkbox("Mesh LODs", &_bLods);
+        ImGui::Text("Geometry: %.1f / %.1f MiB",
+                    _geometry.getUsedBytes() / (1024.0 * 1024.0),
+                    _geometry.getCapacityBytes() / (1024.0 * 1024.0));
+        ImGui::Text("Device memory allocations: %u", _allocator.getStats().deviceMemoryCount);
+        if (ImGui::Button("Defragment memory")) {
+            _bDefragmentRequested = true;
+        }
+        if (_cullPipeline != VK_NULL_HANDLE) {
+            ImGui::Checkbox("GPU driven", &_bGpuDriven);
+            ImGui::Checkbox("Check against CPU culling", &_bCheckGpuCull);
+            if (_bCheckGpuCull) {
+                ImGui::Text("GPU draws: %u, CPU draws: %u", _gpuCullCheck.gpuDraws, _gpuCullCheck.cpuDraws);
+                ImGui::Text("Mismatches: %zu of %zu frames", _gpuCullCheck.mismatches, _gpuCullCheck.checkedFrames);
+            }
+        } else {
+            ImGui::TextDisabled("GPU driven: not supported");
+        }
+        ImGui::End();
+
         uiEventsCallback();
 
         /// FINAL IMPORTANT STUFF
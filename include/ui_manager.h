@@ -17,6 +17,7 @@
 #include <primitives.h>
 #include <tracer.h>
 #include <ale_geo_utils.h>
+#include <re_mesh_subdivide.h>
 #include <camera.h>
 #include <memory.h>
 #include <editor_state.h>
@@ -38,9 +39,10 @@ public:
     static void drawWorldSpaceVert(const glm::vec3& pos1, const glm::vec3& pos2, const glm::vec3& pos3, const MVP& mvpMat);
     static void drawWorldSpaceCircle(const glm::vec3& pos, const MVP& mvp);
     static void drawVectorOfPrimitives(const std::vector<glm::vec3>& vec, UI_DRAW_TYPE mode, const MVP& pvm);
-    static void drawImGuiGizmo(glm::mat4& view, glm::mat4& proj, glm::mat4* model, GEditorState& state);
+    static bool drawImGuiGizmo(glm::mat4& view, glm::mat4& proj, glm::mat4* model, GEditorState& state);
     static void drawNodeRootsUI(const ale::Model& model, const MVP& pvm);
     static void drawMenuBarUI();
+    static GMeshTool drawMeshToolsUI(GEditorState& state);
     static void drawHierarchyUI(const ale::Model& model);
     static void CameraControlWidgetUI(sp<ale::Camera> cam);
     static void drawDefaultWindowUI(sp<ale::Camera> cam, const ale::Model& model, MVP pvm);
@@ -0,0 +1,829 @@
+#pragma once
+
+/*
+    Device memory sub-allocator for the Vulkan renderer.
+
+    Instead of calling vkAllocateMemory once per resource, the allocator
+    reserves large memory blocks per memory type and hands out ranges of
+    these blocks. Ranges inside a block are managed by a TLSF
+    (two-level segregated fit) allocator, so allocation and freeing are O(1).
+
+    - Blocks are grouped into pools by memory type and by resource kind.
+      Linear resources (buffers) and optimal tiled images never share a block
+      when bufferImageGranularity > 1, so granularity conflicts cannot happen
+    - Host visible blocks are persistently mapped, Allocation::mapped points
+      to the first byte of the allocation
+    - Resources bigger than half of the block size get a dedicated allocation
+    - defragment() moves allocations out of sparse blocks through a user
+      callback, so the owner can recreate and rebind its resources. Each
+      range keeps the alignment it was allocated with for the move
+
+    Reference:
+    http://www.gii.upv.es/tlsf/files/papers/ecrts04_tlsf.pdf
+*/
+
+// ext
+#include <vector>
+#include <array>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef ALE_VK_ALLOCATOR
+#define ALE_VK_ALLOCATOR
+
+// int
+#include <ale_memory.h>
+#include <tracer.h>
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace vk {
+
+
+// Manages offsets inside a range of a fixed size. Does not know anything
+// about Vulkan, so it can be used for any linear memory
+class TlsfRange {
+public:
+    static constexpr uint32_t NULL_NODE = UINT32_MAX;
+
+    void init(uint64_t size) {
+        _nodes.clear();
+        _freeNodeIds.clear();
+        for (auto& sl : _heads) {
+            sl.fill(NULL_NODE);
+        }
+        _slBitmap.fill(0);
+        _flBitmap = 0;
+
+        _size = size;
+        _freeSize = size;
+        _allocCount = 0;
+
+        _first = _newNode();
+        _nodes[_first].offset = 0;
+        _nodes[_first].size = size;
+        _insertFree(_first);
+    }
+
+    // Returns false if there is no free range that fits the request
+    bool alloc(uint64_t size, uint64_t alignment, uint64_t& out_offset,
+               uint32_t& out_node) {
+        if (size == 0) {
+            size = 1;
+        }
+        alignment = alignment == 0 ? 1 : alignment;
+        // Worst case padding for an unaligned free range
+        uint64_t searchSize = size + alignment - 1;
+
+        uint32_t nodeId = _findSuitable(searchSize);
+        // An aligned free range can fit without the worst case padding
+        if (nodeId == NULL_NODE && alignment > 1) {
+            nodeId = _findAligned(size, alignment);
+        }
+        if (nodeId == NULL_NODE) {
+            return false;
+        }
+
+        _removeFree(nodeId);
+
+        uint64_t aligned = _alignUp(_nodes[nodeId].offset, alignment);
+        uint64_t padding = aligned - _nodes[nodeId].offset;
+
+        // Front padding becomes a separate free range
+        if (padding > 0) {
+            uint32_t padId = _newNode();
+            auto& pad = _nodes[padId];
+            auto& n = _nodes[nodeId];
+            pad.offset = n.offset;
+            pad.size = padding;
+            pad.prevPhys = n.prevPhys;
+            pad.nextPhys = nodeId;
+            if (n.prevPhys != NULL_NODE) {
+                _nodes[n.prevPhys].nextPhys = padId;
+            } else {
+                _first = padId;
+            }
+            n.prevPhys = padId;
+            n.offset = aligned;
+            n.size -= padding;
+            _insertFree(padId);
+        }
+
+        // The rest of the range goes back to the free lists
+        if (_nodes[nodeId].size > size) {
+            uint32_t tailId = _newNode();
+            auto& tail = _nodes[tailId];
+            auto& n = _nodes[nodeId];
+            tail.offset = n.offset + size;
+            tail.size = n.size - size;
+            tail.prevPhys = nodeId;
+            tail.nextPhys = n.nextPhys;
+            if (n.nextPhys != NULL_NODE) {
+                _nodes[n.nextPhys].prevPhys = tailId;
+            }
+            n.nextPhys = tailId;
+            n.size = size;
+            _insertFree(tailId);
+        }
+
+        auto& n = _nodes[nodeId];
+        n.bFree = false;
+        n.alignment = alignment;
+        _freeSize -= n.size;
+        _allocCount++;
+
+        out_offset = n.offset;
+        out_node = nodeId;
+        return true;
+    }
+
+    void free(uint32_t nodeId) {
+        assert(nodeId < _nodes.size() && !_nodes[nodeId].bFree);
+
+        _freeSize += _nodes[nodeId].size;
+        _allocCount--;
+        _nodes[nodeId].bFree = true;
+        _nodes[nodeId].alignment = 1;
+
+        // Merge with the physical neighbours
+        uint32_t prev = _nodes[nodeId].prevPhys;
+        if (prev != NULL_NODE && _nodes[prev].bFree) {
+            _removeFree(prev);
+            _absorbNext(prev);
+            nodeId = prev;
+        }
+
+        uint32_t next = _nodes[nodeId].nextPhys;
+        if (next != NULL_NODE && _nodes[next].bFree) {
+            _removeFree(next);
+            _absorbNext(nodeId);
+        }
+
+        _insertFree(nodeId);
+    }
+
+    // Appends free space at the end of the range. Existing offsets stay valid
+    void grow(uint64_t newSize) {
+        if (newSize <= _size) {
+            return;
+        }
+        uint64_t extra = newSize - _size;
+
+        uint32_t last = _first;
+        while (_nodes[last].nextPhys != NULL_NODE) {
+            last = _nodes[last].nextPhys;
+        }
+
+        if (_nodes[last].bFree) {
+            _removeFree(last);
+            _nodes[last].size += extra;
+            _insertFree(last);
+        } else {
+            uint32_t tailId = _newNode();
+            auto& tail = _nodes[tailId];
+            tail.offset = _size;
+            tail.size = extra;
+            tail.prevPhys = last;
+            _nodes[last].nextPhys = tailId;
+            _insertFree(tailId);
+        }
+
+        _size = newSize;
+        _freeSize += extra;
+    }
+
+    // Calls fn(node, offset, size, alignment) for every used range in offset order
+    void forEachAllocation(const std::function<void(uint32_t, uint64_t, uint64_t, uint64_t)>& fn) const {
+        for (uint32_t i = _first; i != NULL_NODE; i = _nodes[i].nextPhys) {
+            if (!_nodes[i].bFree) {
+                fn(i, _nodes[i].offset, _nodes[i].size, _nodes[i].alignment);
+            }
+        }
+    }
+
+    uint64_t getLargestFreeRange() const {
+        if (_flBitmap == 0) {
+            return 0;
+        }
+        uint32_t fl = 63 - std::countl_zero(_flBitmap);
+        uint32_t sl = 31 - std::countl_zero(_slBitmap[fl]);
+
+        uint64_t largest = 0;
+        for (uint32_t i = _heads[fl][sl]; i != NULL_NODE; i = _nodes[i].nextFree) {
+            largest = std::max(largest, _nodes[i].size);
+        }
+        return largest;
+    }
+
+    uint64_t getSize() const { return _size; }
+    uint64_t getFreeSize() const { return _freeSize; }
+    uint64_t getUsedSize() const { return _size - _freeSize; }
+    uint32_t getAllocationCount() const { return _allocCount; }
+    bool isEmpty() const { return _allocCount == 0; }
+
+private:
+    // 16 second level lists per power of two
+    static constexpr uint32_t SL_LOG2 = 4;
+    static constexpr uint32_t SL_COUNT = 1 << SL_LOG2;
+    // Sizes below 256 bytes are split linearly into the first level 0
+    static constexpr uint32_t SMALL_LOG2 = 8;
+    static constexpr uint32_t FL_COUNT = 64 - SMALL_LOG2;
+
+    struct Node {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t prevPhys = NULL_NODE;
+        uint32_t nextPhys = NULL_NODE;
+        uint32_t prevFree = NULL_NODE;
+        uint32_t nextFree = NULL_NODE;
+        bool bFree = true;
+        // Alignment of the request, defragment() moves ranges with it
+        uint64_t alignment = 1;
+    };
+
+    std::vector<Node> _nodes;
+    std::vector<uint32_t> _freeNodeIds;
+    std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> _heads;
+    std::array<uint32_t, FL_COUNT> _slBitmap;
+    uint64_t _flBitmap = 0;
+
+    uint32_t _first = NULL_NODE;
+    uint64_t _size = 0;
+    uint64_t _freeSize = 0;
+    uint32_t _allocCount = 0;
+
+    static uint64_t _alignUp(uint64_t val, uint64_t alignment) {
+        return (val + alignment - 1) / alignment * alignment;
+    }
+
+    static void _mapping(uint64_t size, uint32_t& fl, uint32_t& sl) {
+        if (size < (1ull << SMALL_LOG2)) {
+            fl = 0;
+            sl = static_cast<uint32_t>(size >> (SMALL_LOG2 - SL_LOG2));
+            return;
+        }
+        uint32_t msb = 63 - std::countl_zero(size);
+        fl = msb - SMALL_LOG2 + 1;
+        sl = static_cast<uint32_t>(size >> (msb - SL_LOG2)) & (SL_COUNT - 1);
+    }
+
+    uint32_t _findSuitable(uint64_t size) const {
+        // Round the size up to the next list, so any range in it fits
+        if (size >= (1ull << SMALL_LOG2)) {
+            uint32_t msb = 63 - std::countl_zero(size);
+            size += (1ull << (msb - SL_LOG2)) - 1;
+        } else {
+            size += (1ull << (SMALL_LOG2 - SL_LOG2)) - 1;
+        }
+
+        uint32_t fl, sl;
+        _mapping(size, fl, sl);
+        if (fl >= FL_COUNT) {
+            return NULL_NODE;
+        }
+
+        uint32_t slMap = _slBitmap[fl] & (~0u << sl);
+        if (slMap == 0) {
+            uint64_t flMap = fl + 1 < 64 ? _flBitmap & (~0ull << (fl + 1)) : 0;
+            if (flMap == 0) {
+                return NULL_NODE;
+            }
+            fl = std::countr_zero(flMap);
+            slMap = _slBitmap[fl];
+        }
+        sl = std::countr_zero(slMap);
+
+        return _heads[fl][sl];
+    }
+
+    // Walks every list that can hold size bytes for a range that fits
+    // with its padding. Slow, only used when _findSuitable() fails
+    uint32_t _findAligned(uint64_t size, uint64_t alignment) const {
+        uint32_t fl, sl;
+        _mapping(size, fl, sl);
+
+        for (; fl < FL_COUNT; fl++, sl = 0) {
+            for (uint32_t slMap = _slBitmap[fl] & (~0u << sl); slMap != 0; slMap &= slMap - 1) {
+                for (uint32_t id = _heads[fl][std::countr_zero(slMap)]; id != NULL_NODE;
+                     id = _nodes[id].nextFree) {
+                    const auto& n = _nodes[id];
+                    if (_alignUp(n.offset, alignment) + size <= n.offset + n.size) {
+                        return id;
+                    }
+                }
+            }
+        }
+        return NULL_NODE;
+    }
+
+    uint32_t _newNode() {
+        if (!_freeNodeIds.empty()) {
+            uint32_t id = _freeNodeIds.back();
+            _freeNodeIds.pop_back();
+            _nodes[id] = Node{};
+            return id;
+        }
+        _nodes.push_back(Node{});
+        return static_cast<uint32_t>(_nodes.size() - 1);
+    }
+
+    void _insertFree(uint32_t id) {
+        uint32_t fl, sl;
+        _mapping(_nodes[id].size, fl, sl);
+
+        auto& n = _nodes[id];
+        n.bFree = true;
+        n.prevFree = NULL_NODE;
+        n.nextFree = _heads[fl][sl];
+        if (n.nextFree != NULL_NODE) {
+            _nodes[n.nextFree].prevFree = id;
+        }
+        _heads[fl][sl] = id;
+        _slBitmap[fl] |= 1u << sl;
+        _flBitmap |= 1ull << fl;
+    }
+
+    void _removeFree(uint32_t id) {
+        uint32_t fl, sl;
+        _mapping(_nodes[id].size, fl, sl);
+
+        auto& n = _nodes[id];
+        if (n.prevFree != NULL_NODE) {
+            _nodes[n.prevFree].nextFree = n.nextFree;
+        } else {
+            _heads[fl][sl] = n.nextFree;
+        }
+        if (n.nextFree != NULL_NODE) {
+            _nodes[n.nextFree].prevFree = n.prevFree;
+        }
+        n.prevFree = NULL_NODE;
+        n.nextFree = NULL_NODE;
+
+        if (_heads[fl][sl] == NULL_NODE) {
+            _slBitmap[fl] &= ~(1u << sl);
+            if (_slBitmap[fl] == 0) {
+                _flBitmap &= ~(1ull << fl);
+            }
+        }
+    }
+
+    // Merges the physical next node into the node with id
+    void _absorbNext(uint32_t id) {
+        uint32_t nextId = _nodes[id].nextPhys;
+        auto& next = _nodes[nextId];
+
+        _nodes[id].size += next.size;
+        _nodes[id].nextPhys = next.nextPhys;
+        if (next.nextPhys != NULL_NODE) {
+            _nodes[next.nextPhys].prevPhys = id;
+        }
+        _freeNodeIds.push_back(nextId);
+    }
+};
+
+
+// Tells the allocator whether a resource is linear or an optimal tiled image.
+// Needed to respect bufferImageGranularity
+enum class ResourceKind {
+    LINEAR,
+    OPTIMAL_IMAGE,
+};
+
+
+struct MemoryBlock;
+
+// A range of device memory that can be bound to a buffer or an image
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // Host pointer to the first byte of the allocation (host visible only)
+    void* mapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    // Null for dedicated allocations
+    MemoryBlock* block = nullptr;
+    uint32_t node = TlsfRange::NULL_NODE;
+
+    bool isValid() const { return memory != VK_NULL_HANDLE; }
+};
+
+
+struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void* mapped = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    TlsfRange range;
+};
+
+
+struct MemoryPoolStats {
+    uint32_t memoryTypeIndex;
+    ResourceKind kind;
+    uint32_t blockCount;
+    uint32_t allocationCount;
+    VkDeviceSize reservedBytes;
+    VkDeviceSize usedBytes;
+    VkDeviceSize largestFreeRange;
+};
+
+
+struct AllocatorStats {
+    std::vector<MemoryPoolStats> pools;
+    uint32_t deviceMemoryCount = 0;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+    uint32_t maxMemoryAllocationCount = 0;
+};
+
+
+// Called by defragment() for every allocation it wants to move. The callee
+// finds its resource by src.memory and src.offset, recreates it at dst,
+// copies the data and returns true. It returns false for resources it
+// cannot move. src is freed by the allocator once the callback succeeds
+using DefragMoveFn = std::function<bool(const Allocation& src,
+                                        const Allocation& dst)>;
+
+
+class DeviceAllocator {
+public:
+    // 64 MiB is enough for most of the model assets and small enough
+    // for integrated GPUs
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device,
+              VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE) {
+        _device = device;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &_memProperties);
+
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(physicalDevice, &props);
+        _granularity = props.limits.bufferImageGranularity;
+        _maxAllocationCount = props.limits.maxMemoryAllocationCount;
+
+        _blockSize = preferredBlockSize;
+        _pools.resize(_memProperties.memoryTypeCount * 2);
+    }
+
+    // Frees all blocks. Every resource must be destroyed before this call
+    void destroy() {
+        for (auto& pool : _pools) {
+            for (auto& block : pool) {
+                if (!block->range.isEmpty()) {
+                    trc::log("Destroying a memory block with live allocations!",
+                             trc::WARNING);
+                }
+                vkFreeMemory(_device, block->memory, nullptr);
+            }
+            pool.clear();
+        }
+
+        if (_dedicatedCount > 0) {
+            trc::log(std::to_string(_dedicatedCount)
+                     + " dedicated allocations were not freed!", trc::WARNING);
+        }
+    }
+
+    Allocation allocate(const VkMemoryRequirements& requirements,
+                        VkMemoryPropertyFlags properties,
+                        ResourceKind kind) {
+        uint32_t typeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+
+        // Large resources do not fit well into shared blocks
+        if (requirements.size > _getBlockSize(typeIndex) / 2) {
+            return _allocateDedicated(requirements.size, typeIndex);
+        }
+
+        auto& pool = _pools[_poolIdx(typeIndex, kind)];
+        Allocation result;
+
+        for (auto& block : pool) {
+            if (_tryAllocate(*block, requirements, result)) {
+                return result;
+            }
+        }
+
+        pool.push_back(_createBlock(typeIndex));
+        if (!_tryAllocate(*pool.back(), requirements, result)) {
+            throw std::runtime_error("failed to sub-allocate device memory!");
+        }
+        return result;
+    }
+
+    void free(Allocation& allocation) {
+        if (!allocation.isValid()) {
+            return;
+        }
+
+        if (allocation.block == nullptr) {
+            vkFreeMemory(_device, allocation.memory, nullptr);
+            _dedicatedCount--;
+            _dedicatedBytes -= allocation.size;
+            _deviceMemoryCount--;
+            allocation = {};
+            return;
+        }
+
+        MemoryBlock* block = allocation.block;
+        block->range.free(allocation.node);
+
+        if (block->range.isEmpty()) {
+            _releaseEmptyBlock(block);
+        }
+
+        allocation = {};
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < _memProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) &&
+                (_memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    /*
+        Moves allocations from the least occupied block of each pool to other
+        blocks of the same pool. Emptied blocks are released. Moves at most
+        maxBytes bytes per call, so it can be spread over several frames.
+        Returns the number of moved bytes
+    */
+    VkDeviceSize defragment(const DefragMoveFn& move,
+                            VkDeviceSize maxBytes = UINT64_MAX) {
+        VkDeviceSize moved = 0;
+
+        for (size_t p = 0; p < _pools.size() && moved < maxBytes; p++) {
+            auto& pool = _pools[p];
+            if (pool.size() < 2) {
+                continue;
+            }
+
+            // The least occupied block is the cheapest to empty
+            auto srcIt = std::min_element(pool.begin(), pool.end(),
+                [](const up<MemoryBlock>& a, const up<MemoryBlock>& b) {
+                    return a->range.getUsedSize() < b->range.getUsedSize();
+                });
+            MemoryBlock* src = srcIt->get();
+
+            struct Candidate { uint32_t node; uint64_t offset, size, alignment; };
+            std::vector<Candidate> candidates;
+            src->range.forEachAllocation([&](uint32_t node, uint64_t offset,
+                                             uint64_t size, uint64_t alignment) {
+                candidates.push_back({node, offset, size, alignment});
+            });
+
+            for (auto& c : candidates) {
+                if (moved >= maxBytes) {
+                    break;
+                }
+
+                // Blocks of a pool hold one resource kind, so the alignment
+                // of the resource is all the destination needs
+                Allocation dst;
+                VkMemoryRequirements req {
+                    .size = c.size,
+                    .alignment = c.alignment,
+                    .memoryTypeBits = 1u << src->memoryTypeIndex,
+                };
+
+                bool bAllocated = false;
+                for (auto& block : pool) {
+                    if (block.get() != src &&
+                        _tryAllocate(*block, req, dst)) {
+                        bAllocated = true;
+                        break;
+                    }
+                }
+
+                if (!bAllocated) {
+                    continue;
+                }
+
+                Allocation srcAlloc = _makeAllocation(*src, c.offset, c.size);
+                srcAlloc.node = c.node;
+
+                if (move(srcAlloc, dst)) {
+                    moved += c.size;
+                    free(srcAlloc);
+                } else {
+                    free(dst);
+                }
+            }
+        }
+
+        return moved;
+    }
+
+    AllocatorStats getStats() const {
+        AllocatorStats stats {
+            .deviceMemoryCount = _deviceMemoryCount,
+            .dedicatedCount = _dedicatedCount,
+            .dedicatedBytes = _dedicatedBytes,
+            .maxMemoryAllocationCount = _maxAllocationCount,
+        };
+
+        for (size_t p = 0; p < _pools.size(); p++) {
+            if (_pools[p].empty()) {
+                continue;
+            }
+
+            MemoryPoolStats poolStats {
+                .memoryTypeIndex = static_cast<uint32_t>(p / 2),
+                .kind = p % 2 == 0 ? ResourceKind::LINEAR : ResourceKind::OPTIMAL_IMAGE,
+                .blockCount = static_cast<uint32_t>(_pools[p].size()),
+                .allocationCount = 0,
+                .reservedBytes = 0,
+                .usedBytes = 0,
+                .largestFreeRange = 0,
+            };
+
+            for (auto& block : _pools[p]) {
+                poolStats.allocationCount += block->range.getAllocationCount();
+                poolStats.reservedBytes += block->range.getSize();
+                poolStats.usedBytes += block->range.getUsedSize();
+                poolStats.largestFreeRange = std::max(poolStats.largestFreeRange,
+                                                      block->range.getLargestFreeRange());
+            }
+            stats.pools.push_back(poolStats);
+        }
+
+        return stats;
+    }
+
+    void dumpStats() const {
+        auto stats = getStats();
+        auto mb = [](VkDeviceSize bytes) {
+            return std::to_string(bytes / (1024.0 * 1024.0)) + " MiB";
+        };
+
+        trc::raw << "Device memory allocator stats:\n";
+        trc::raw << "  vkAllocateMemory calls alive: " << stats.deviceMemoryCount
+                 << " / " << stats.maxMemoryAllocationCount << "\n";
+        trc::raw << "  dedicated: " << stats.dedicatedCount << " ("
+                 << mb(stats.dedicatedBytes) << ")\n";
+
+        for (auto& p : stats.pools) {
+            float usage = p.reservedBytes > 0
+                        ? 100.0f * p.usedBytes / p.reservedBytes : 0.0f;
+            trc::raw << "  type " << p.memoryTypeIndex
+                     << (p.kind == ResourceKind::LINEAR ? " linear" : " optimal")
+                     << " | blocks: " << p.blockCount
+                     << " | allocations: " << p.allocationCount
+                     << " | used: " << mb(p.usedBytes) << " / " << mb(p.reservedBytes)
+                     << " (" << usage << "%)"
+                     << " | largest free: " << mb(p.largestFreeRange) << "\n";
+        }
+    }
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties _memProperties{};
+    VkDeviceSize _granularity = 1;
+    VkDeviceSize _blockSize = DEFAULT_BLOCK_SIZE;
+    uint32_t _maxAllocationCount = 0;
+
+    // Two pools per memory type: linear resources and optimal images
+    std::vector<std::vector<up<MemoryBlock>>> _pools;
+
+    uint32_t _deviceMemoryCount = 0;
+    uint32_t _dedicatedCount = 0;
+    VkDeviceSize _dedicatedBytes = 0;
+
+    size_t _poolIdx(uint32_t typeIndex, ResourceKind kind) const {
+        // With granularity of 1 linear and optimal resources can share blocks
+        if (_granularity <= 1) {
+            return typeIndex * 2;
+        }
+        return typeIndex * 2 + (kind == ResourceKind::OPTIMAL_IMAGE ? 1 : 0);
+    }
+
+    // Small heaps get smaller blocks to not reserve the entire heap at once
+    VkDeviceSize _getBlockSize(uint32_t typeIndex) const {
+        uint32_t heapIndex = _memProperties.memoryTypes[typeIndex].heapIndex;
+        VkDeviceSize heapSize = _memProperties.memoryHeaps[heapIndex].size;
+        return std::min(_blockSize, heapSize / 8);
+    }
+
+    bool _isHostVisible(uint32_t typeIndex) const {
+        return _memProperties.memoryTypes[typeIndex].propertyFlags &
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    }
+
+    VkDeviceMemory _allocateMemory(VkDeviceSize size, uint32_t typeIndex) {
+        if (_deviceMemoryCount >= _maxAllocationCount) {
+            trc::log("maxMemoryAllocationCount reached!", trc::ERROR);
+        }
+
+        VkMemoryAllocateInfo allocInfo {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = size,
+            .memoryTypeIndex = typeIndex,
+        };
+
+        VkDeviceMemory memory;
+        if (vkAllocateMemory(_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory!");
+        }
+        _deviceMemoryCount++;
+        return memory;
+    }
+
+    up<MemoryBlock> _createBlock(uint32_t typeIndex) {
+        auto block = to_up<MemoryBlock>();
+        VkDeviceSize size = _getBlockSize(typeIndex);
+
+        block->memory = _allocateMemory(size, typeIndex);
+        block->memoryTypeIndex = typeIndex;
+        block->range.init(size);
+
+        // Host visible blocks stay mapped for their entire lifetime
+        if (_isHostVisible(typeIndex)) {
+            vkMapMemory(_device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+        }
+
+        return block;
+    }
+
+    Allocation _allocateDedicated(VkDeviceSize size, uint32_t typeIndex) {
+        Allocation result {
+            .memory = _allocateMemory(size, typeIndex),
+            .offset = 0,
+            .size = size,
+            .memoryTypeIndex = typeIndex,
+        };
+
+        if (_isHostVisible(typeIndex)) {
+            vkMapMemory(_device, result.memory, 0, VK_WHOLE_SIZE, 0, &result.mapped);
+        }
+
+        _dedicatedCount++;
+        _dedicatedBytes += size;
+        return result;
+    }
+
+    Allocation _makeAllocation(MemoryBlock& block, uint64_t offset, uint64_t size) {
+        return {
+            .memory = block.memory,
+            .offset = offset,
+            .size = size,
+            .mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr,
+            .memoryTypeIndex = block.memoryTypeIndex,
+            .block = &block,
+        };
+    }
+
+    bool _tryAllocate(MemoryBlock& block, const VkMemoryRequirements& requirements,
+                      Allocation& out_allocation) {
+        if (!(requirements.memoryTypeBits & (1u << block.memoryTypeIndex))) {
+            return false;
+        }
+
+        uint64_t offset;
+        uint32_t node;
+        if (!block.range.alloc(requirements.size, requirements.alignment,
+                               offset, node)) {
+            return false;
+        }
+
+        out_allocation = _makeAllocation(block, offset, requirements.size);
+        out_allocation.node = node;
+        return true;
+    }
+
+    // Keeps one empty block per pool to avoid reallocation spikes
+    void _releaseEmptyBlock(MemoryBlock* block) {
+        for (auto& pool : _pools) {
+            auto it = std::find_if(pool.begin(), pool.end(),
+                [block](const up<MemoryBlock>& b) { return b.get() == block; });
+            if (it == pool.end()) {
+                continue;
+            }
+
+            size_t emptyCount = std::count_if(pool.begin(), pool.end(),
+                [](const up<MemoryBlock>& b) { return b->range.isEmpty(); });
+
+            if (emptyCount > 1) {
+                vkFreeMemory(_device, block->memory, nullptr);
+                _deviceMemoryCount--;
+                pool.erase(it);
+            }
+            return;
+        }
+    }
+};
+
+} // namespace vk
+} // namespace ale
+
+#endif // ALE_VK_ALLOCATOR
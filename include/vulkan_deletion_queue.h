@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+    Deferred destruction of GPU resources. A resource retired while frame N
+    is recorded is destroyed once the fence of frame N signals, so replacing
+    a resource at runtime never needs vkDeviceWaitIdle.
+
+    Per frame in flight:
+    - wait for the frame fence, then flush(frame)
+    - record and submit, then submit(frame)
+
+    retire() may be called at any point in between. Resources retired after
+    submit(frame) wait for the next submitted frame
+*/
+
+// ext
+#include <vector>
+#include <functional>
+#include <iterator>
+#include <cstdint>
+
+#ifndef ALE_VK_DELETION_QUEUE
+#define ALE_VK_DELETION_QUEUE
+
+namespace ale {
+namespace vk {
+
+class DeletionQueue {
+public:
+    void init(uint32_t frameCount) {
+        _frames.resize(frameCount);
+    }
+
+    // Queues a destructor. It runs after the next submitted frame completes
+    void retire(std::function<void()> destructor) {
+        _pending.push_back(std::move(destructor));
+    }
+
+    // Ties resources retired so far to the frame that was just submitted
+    void submit(uint32_t frame) {
+        auto& queue = _frames[frame];
+        queue.insert(queue.end(),
+                     std::make_move_iterator(_pending.begin()),
+                     std::make_move_iterator(_pending.end()));
+        _pending.clear();
+    }
+
+    // Destroys resources of a frame. The frame fence must be signaled
+    void flush(uint32_t frame) {
+        _run(_frames[frame]);
+    }
+
+    // Destroys everything. The device must be idle
+    void flushAll() {
+        for (auto& queue : _frames) {
+            _run(queue);
+        }
+        _run(_pending);
+    }
+
+private:
+    std::vector<std::vector<std::function<void()>>> _frames;
+    // Retired since the last submit()
+    std::vector<std::function<void()>> _pending;
+
+    static void _run(std::vector<std::function<void()>>& queue) {
+        // Destructors run in retire order
+        for (auto& destructor : queue) {
+            destructor();
+        }
+        queue.clear();
+    }
+};
+
+} // namespace vk
+} // namespace ale
+
+#endif // ALE_VK_DELETION_QUEUE
@@ -0,0 +1,671 @@
+#pragma once
+
+/*
+    Growable GPU storage for mesh geometry. All meshes share one vertex
+    buffer, every mesh owns a range of it and a range of one of the index
+    buffers. Indices are local to their mesh, draws pass the vertex range
+    offset as vertexOffset.
+
+    - Meshes with up to 65536 vertices keep 16-bit indices in their own
+      buffer, larger meshes use the 32-bit index buffer
+
+    - Ranges are managed by vk::TlsfRange in elements. A full buffer is
+      recreated with more room and its content is copied on the GPU, so
+      offsets of live meshes never change because of growth
+    - Uploads are staged on the CPU and recorded into the frame command
+      buffer by recordFrame(), the queue is never waited for
+    - resizeMesh() keeps the content of a mesh whose counts change, ranges
+      that outgrow their room move to larger ones on the GPU, so edits
+      only upload what they changed
+    - Freed ranges and replaced buffers go through a vk::DeletionQueue and
+      are kept until the fence of the frame that recorded the release
+    - Every frame a few meshes from the end of a buffer are moved into
+      lower free ranges, so the buffers stay packed after removals
+    - moveBuffer() lets DeviceAllocator::defragment() move the buffers of
+      the heap to other device memory
+*/
+
+// ext
+#include <vector>
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef ALE_VK_GEOMETRY_HEAP
+#define ALE_VK_GEOMETRY_HEAP
+
+// int
+#include <vulkan_allocator.h>
+#include <vulkan_deletion_queue.h>
+#include <tracer.h>
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace vk {
+
+// A range of elements (vertices or indices) in a geometry buffer
+struct GeometryRange {
+    uint64_t offset = 0;
+    uint64_t count = 0;
+    // Elements reserved for the range, count can grow up to it in place
+    uint64_t capacity = 0;
+    uint32_t node = TlsfRange::NULL_NODE;
+
+    bool isValid() const { return node != TlsfRange::NULL_NODE; }
+};
+
+
+struct MeshAllocation {
+    GeometryRange vertices;
+    GeometryRange indices;
+    // Selects the index buffer, see GeometryHeap::getIndexBuffer()
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+    bool isResident() const { return vertices.isValid(); }
+};
+
+
+class GeometryHeap {
+public:
+    // Upper limit of bytes moved by compaction in one frame
+    static constexpr VkDeviceSize COMPACTION_BYTES_PER_FRAME = 4ull * 1024 * 1024;
+    // Number of the highest ranges compaction tries to move in one frame
+    static constexpr size_t COMPACTION_CANDIDATES = 16;
+
+    // Meshes with more vertices need 32-bit indices
+    static constexpr uint64_t MAX_INDEX16_VERTICES = 65536;
+
+    static VkIndexType getIndexType(uint64_t vertexCount) {
+        return vertexCount <= MAX_INDEX16_VERTICES ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    }
+
+    // Capacities are in elements. index16Capacity is for the indices of
+    // meshes that pass getIndexType() as VK_INDEX_TYPE_UINT16
+    void init(VkDevice device, DeviceAllocator& allocator, VkDeviceSize vertexSize,
+              uint32_t frameCount, uint64_t vertexCapacity, uint64_t indexCapacity,
+              uint64_t index16Capacity) {
+        _device = device;
+        _allocator = &allocator;
+
+        _pools[VERTEX_POOL].elementSize = vertexSize;
+        _pools[VERTEX_POOL].usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        _pools[INDEX_POOL].elementSize = sizeof(uint32_t);
+        _pools[INDEX_POOL].usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        _pools[INDEX16_POOL].elementSize = sizeof(uint16_t);
+        _pools[INDEX16_POOL].usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+
+        _initPool(_pools[VERTEX_POOL], vertexCapacity);
+        _initPool(_pools[INDEX_POOL], indexCapacity);
+        _initPool(_pools[INDEX16_POOL], index16Capacity);
+
+        _staging.resize(frameCount);
+        _deletions.init(frameCount);
+    }
+
+    // Frees every buffer. The device must be idle
+    void destroy() {
+        _deletions.flushAll();
+        for (auto& pool : _pools) {
+            _destroyBuffer(pool.buffer);
+        }
+        for (auto& staging : _staging) {
+            _destroyBuffer(staging);
+        }
+        _meshes.clear();
+    }
+
+    // Places the mesh in the heap or updates it. A mesh keeps its ranges
+    // if the vertex and index counts did not change
+    void uploadMesh(uint32_t meshId, const void* vertices, uint64_t vertexCount,
+                    const uint32_t* indices, uint64_t indexCount) {
+        if (meshId >= _meshes.size()) {
+            _meshes.resize(meshId + 1);
+        }
+
+        MeshAllocation& mesh = _meshes[meshId];
+        if (!mesh.isResident() ||
+            mesh.vertices.count != vertexCount ||
+            mesh.indices.count != indexCount) {
+            removeMesh(meshId);
+            mesh.indexType = getIndexType(vertexCount);
+            mesh.vertices = _allocate(VERTEX_POOL, vertexCount);
+            mesh.indices = _allocate(_indexPool(mesh), indexCount);
+            _version++;
+        }
+
+        _queueUpload(VERTEX_POOL, vertices, mesh.vertices.offset, vertexCount);
+
+        if (mesh.indexType == VK_INDEX_TYPE_UINT16) {
+            _indices16.assign(indices, indices + indexCount);
+            _queueUpload(INDEX16_POOL, _indices16.data(), mesh.indices.offset, indexCount);
+        } else {
+            _queueUpload(INDEX_POOL, indices, mesh.indices.offset, indexCount);
+        }
+    }
+
+    // Sets the vertex and index counts of a resident mesh and keeps its
+    // content up to the smaller counts, write the rest afterwards. A range
+    // that does not fit moves to a new one with half again as much room.
+    // Returns false if the mesh is not resident or needs the other index
+    // type, upload it whole then
+    bool resizeMesh(uint32_t meshId, uint64_t vertexCount, uint64_t indexCount) {
+        if (!isResident(meshId)) {
+            return false;
+        }
+        MeshAllocation& mesh = _meshes[meshId];
+        if (getIndexType(vertexCount) != mesh.indexType) {
+            return false;
+        }
+        _resizeRange(VERTEX_POOL, mesh.vertices, vertexCount);
+        _resizeRange(_indexPool(mesh), mesh.indices, indexCount);
+        return true;
+    }
+
+    // Overwrites count vertices of a resident mesh starting at first
+    void writeVertices(uint32_t meshId, const void* vertices, uint64_t first, uint64_t count) {
+        const MeshAllocation& mesh = _meshes.at(meshId);
+        if (!mesh.isResident() || first + count > mesh.vertices.count) {
+            throw std::runtime_error("failed to write vertices, range is out of the mesh!");
+        }
+        _queueUpload(VERTEX_POOL, vertices, mesh.vertices.offset + first, count);
+    }
+
+    // Overwrites count indices of a resident mesh starting at first
+    void writeIndices(uint32_t meshId, const uint32_t* indices, uint64_t first, uint64_t count) {
+        const MeshAllocation& mesh = _meshes.at(meshId);
+        if (!mesh.isResident() || first + count > mesh.indices.count) {
+            throw std::runtime_error("failed to write indices, range is out of the mesh!");
+        }
+        if (mesh.indexType == VK_INDEX_TYPE_UINT16) {
+            _indices16.assign(indices, indices + count);
+            _queueUpload(INDEX16_POOL, _indices16.data(), mesh.indices.offset + first, count);
+        } else {
+            _queueUpload(INDEX_POOL, indices, mesh.indices.offset + first, count);
+        }
+    }
+
+    // The ranges stay reserved until the GPU is done with them
+    void removeMesh(uint32_t meshId) {
+        if (meshId >= _meshes.size() || !_meshes[meshId].isResident()) {
+            return;
+        }
+
+        MeshAllocation& mesh = _meshes[meshId];
+        _retireRange(VERTEX_POOL, mesh.vertices.node);
+        _retireRange(_indexPool(mesh), mesh.indices.node);
+        mesh = {};
+        _version++;
+    }
+
+    bool isResident(uint32_t meshId) const {
+        return meshId < _meshes.size() && _meshes[meshId].isResident();
+    }
+
+    const MeshAllocation& getMesh(uint32_t meshId) const {
+        return _meshes.at(meshId);
+    }
+
+    // Records pending growth copies, range moves, uploads and a compaction
+    // step into the command buffer. Must be called once per submitted
+    // frame after the fence of the frame is waited for and outside of
+    // rendering
+    void recordFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+        _deletions.flush(frame);
+
+        bool bRecorded = false;
+
+        for (auto& copy : _growCopies) {
+            _beginTransfer(commandBuffer, bRecorded);
+            VkBufferCopy region { .size = copy.size };
+            vkCmdCopyBuffer(commandBuffer, copy.src, copy.dst, 1, &region);
+            _barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+
+        // A range may move twice in a frame, so every move waits for the last
+        for (auto& move : _moves) {
+            _beginTransfer(commandBuffer, bRecorded);
+            Pool& pool = _pools[move.pool];
+            VkBufferCopy region {
+                .srcOffset = move.src * pool.elementSize,
+                .dstOffset = move.dst * pool.elementSize,
+                .size = move.count * pool.elementSize,
+            };
+            vkCmdCopyBuffer(commandBuffer, pool.buffer.vkBuffer, pool.buffer.vkBuffer, 1, &region);
+            _barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+
+        if (!_uploads.empty()) {
+            _beginTransfer(commandBuffer, bRecorded);
+
+            Buffer& staging = _staging[frame];
+            if (staging.size < _uploadData.size()) {
+                _destroyBuffer(staging);
+                staging = _createBuffer(std::max<VkDeviceSize>(_uploadData.size(), staging.size * 2),
+                                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            }
+            memcpy(staging.allocation.mapped, _uploadData.data(), _uploadData.size());
+
+            for (auto& upload : _uploads) {
+                VkBufferCopy region {
+                    .srcOffset = upload.srcOffset,
+                    .dstOffset = upload.dstOffset,
+                    .size = upload.size,
+                };
+                vkCmdCopyBuffer(commandBuffer, staging.vkBuffer, _pools[upload.pool].buffer.vkBuffer, 1, &region);
+            }
+            _barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+
+        for (uint32_t poolId = 0; poolId < POOL_COUNT; poolId++) {
+            _compactPool(commandBuffer, poolId, bRecorded);
+        }
+
+        if (bRecorded) {
+            VkMemoryBarrier barrier {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+            };
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                                 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        _growCopies.clear();
+        _moves.clear();
+        _uploads.clear();
+        _uploadData.clear();
+
+        _deletions.submit(frame);
+    }
+
+    // Destroys retired ranges and buffers. The device must be idle
+    void flushDeletions() {
+        _deletions.flushAll();
+    }
+
+    /*
+        Move callback for DeviceAllocator::defragment(). Binds a new buffer
+        of the heap to dst in place of the one bound to src, copy copies the
+        content of the old buffer into the new one before it returns.
+        Staging buffers are filled every frame and are not copied. The
+        device must be idle and recordFrame() called after the last change
+        of the heap. Returns false for memory the heap does not own
+    */
+    bool moveBuffer(const Allocation& src, const Allocation& dst,
+                    const std::function<void(VkBuffer, VkBuffer, VkDeviceSize)>& copy) {
+        if (!_growCopies.empty() || !_moves.empty() || !_uploads.empty()) {
+            return false;
+        }
+
+        auto isAt = [&](const Buffer& buffer) {
+            return buffer.vkBuffer != VK_NULL_HANDLE && buffer.allocation.memory == src.memory &&
+                   buffer.allocation.offset == src.offset;
+        };
+        Buffer* buffer = nullptr;
+        bool bCopy = true;
+        for (auto& pool : _pools) {
+            if (isAt(pool.buffer)) {
+                buffer = &pool.buffer;
+            }
+        }
+        for (auto& staging : _staging) {
+            if (isAt(staging)) {
+                buffer = &staging;
+                bCopy = false;
+            }
+        }
+        if (!buffer) {
+            return false;
+        }
+
+        VkBufferCreateInfo bufferInfo {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = buffer->size,
+            .usage = buffer->usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+        VkBuffer moved;
+        if (vkCreateBuffer(_device, &bufferInfo, nullptr, &moved) != VK_SUCCESS) {
+            return false;
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(_device, moved, &memRequirements);
+        if (memRequirements.size > dst.size || dst.offset % memRequirements.alignment != 0) {
+            vkDestroyBuffer(_device, moved, nullptr);
+            return false;
+        }
+        vkBindBufferMemory(_device, moved, dst.memory, dst.offset);
+
+        if (bCopy) {
+            copy(buffer->vkBuffer, moved, buffer->size);
+        }
+        // The allocator frees src after the callback
+        vkDestroyBuffer(_device, buffer->vkBuffer, nullptr);
+        buffer->vkBuffer = moved;
+        buffer->allocation = dst;
+        return true;
+    }
+
+    VkBuffer getVertexBuffer() const { return _pools[VERTEX_POOL].buffer.vkBuffer; }
+    VkBuffer getIndexBuffer(VkIndexType type) const {
+        return _pools[type == VK_INDEX_TYPE_UINT16 ? INDEX16_POOL : INDEX_POOL].buffer.vkBuffer;
+    }
+
+    // Changes every time a mesh gets new ranges, draws that cache offsets
+    // must be rebuilt
+    uint64_t getVersion() const { return _version; }
+
+    VkDeviceSize getUsedBytes() const {
+        VkDeviceSize used = 0;
+        for (auto& pool : _pools) {
+            used += pool.range.getUsedSize() * pool.elementSize;
+        }
+        return used;
+    }
+
+    VkDeviceSize getCapacityBytes() const {
+        VkDeviceSize capacity = 0;
+        for (auto& pool : _pools) {
+            capacity += pool.buffer.size;
+        }
+        return capacity;
+    }
+
+private:
+    enum PoolId : uint32_t {
+        VERTEX_POOL,
+        INDEX_POOL,
+        INDEX16_POOL,
+        POOL_COUNT,
+    };
+
+    struct Buffer {
+        VkBuffer vkBuffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkDeviceSize size = 0;
+        VkBufferUsageFlags usage = 0;
+    };
+
+    struct Pool {
+        Buffer buffer;
+        TlsfRange range;
+        VkDeviceSize elementSize = 1;
+        VkBufferUsageFlags usage = 0;
+    };
+
+    // Copy from staging to a pool, offsets are in bytes
+    struct Upload {
+        uint32_t pool;
+        VkDeviceSize srcOffset;
+        VkDeviceSize dstOffset;
+        VkDeviceSize size;
+    };
+
+    // Old content of a grown pool
+    struct GrowCopy {
+        VkBuffer src;
+        VkBuffer dst;
+        VkDeviceSize size;
+    };
+
+    // Content of a resized range that moved, offsets are in elements
+    struct RangeMove {
+        uint32_t pool;
+        uint64_t src;
+        uint64_t dst;
+        uint64_t count;
+    };
+
+    VkDevice _device = VK_NULL_HANDLE;
+    DeviceAllocator* _allocator = nullptr;
+
+    std::array<Pool, POOL_COUNT> _pools;
+    std::vector<MeshAllocation> _meshes;
+    uint64_t _version = 0;
+
+    std::vector<char> _uploadData;
+    std::vector<Upload> _uploads;
+    std::vector<GrowCopy> _growCopies;
+    std::vector<RangeMove> _moves;
+    // Narrowing scratch for 16-bit index uploads
+    std::vector<uint16_t> _indices16;
+
+    // Old ranges and buffers wait here until the GPU is done with them
+    DeletionQueue _deletions;
+    // One staging buffer per frame in flight
+    std::vector<Buffer> _staging;
+
+    void _initPool(Pool& pool, uint64_t capacity) {
+        capacity = std::max<uint64_t>(capacity, 1);
+        pool.range.init(capacity);
+        pool.buffer = _createBuffer(capacity * pool.elementSize, _poolUsage(pool),
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    static VkBufferUsageFlags _poolUsage(const Pool& pool) {
+        // Growth and compaction copy inside and between pool buffers
+        return pool.usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    }
+
+    static uint32_t _indexPool(const MeshAllocation& mesh) {
+        return mesh.indexType == VK_INDEX_TYPE_UINT16 ? INDEX16_POOL : INDEX_POOL;
+    }
+
+    // reserve elements after count stay free for the range to grow into
+    GeometryRange _allocate(uint32_t poolId, uint64_t count, uint64_t reserve = 0) {
+        Pool& pool = _pools[poolId];
+        uint64_t size = std::max<uint64_t>(count + reserve, 1);
+        GeometryRange range { .count = count, .capacity = size };
+
+        if (!pool.range.alloc(size, 1, range.offset, range.node)) {
+            _grow(poolId, size);
+            if (!pool.range.alloc(size, 1, range.offset, range.node)) {
+                throw std::runtime_error("failed to allocate geometry range!");
+            }
+        }
+        return range;
+    }
+
+    void _resizeRange(uint32_t poolId, GeometryRange& range, uint64_t count) {
+        if (count <= range.capacity) {
+            range.count = count;
+            return;
+        }
+
+        GeometryRange moved = _allocate(poolId, count, count / 2);
+        _moves.push_back({
+            .pool = poolId,
+            .src = range.offset,
+            .dst = moved.offset,
+            .count = std::min(range.count, count),
+        });
+
+        // Uploads of this frame to the old range land in the new one
+        VkDeviceSize elementSize = _pools[poolId].elementSize;
+        VkDeviceSize begin = range.offset * elementSize;
+        VkDeviceSize end = (range.offset + range.capacity) * elementSize;
+        for (auto& upload : _uploads) {
+            if (upload.pool == poolId && upload.dstOffset >= begin && upload.dstOffset < end) {
+                upload.dstOffset += (moved.offset - range.offset) * elementSize;
+            }
+        }
+
+        _retireRange(poolId, range.node);
+        range = moved;
+        _version++;
+    }
+
+    void _grow(uint32_t poolId, uint64_t required) {
+        Pool& pool = _pools[poolId];
+        uint64_t oldCount = pool.range.getSize();
+        // TLSF rounds requests up to the next size class, leave headroom
+        uint64_t newCount = std::max(oldCount * 2, oldCount + required * 2 + 256);
+
+        Buffer newBuffer = _createBuffer(newCount * pool.elementSize, _poolUsage(pool),
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        _growCopies.push_back({
+            .src = pool.buffer.vkBuffer,
+            .dst = newBuffer.vkBuffer,
+            .size = pool.buffer.size,
+        });
+        _deletions.retire([this, buffer = pool.buffer]() mutable {
+            _destroyBuffer(buffer);
+        });
+
+        pool.buffer = newBuffer;
+        pool.range.grow(newCount);
+
+        trc::log("Geometry buffer grown to " + std::to_string(newBuffer.size) + " bytes", trc::INFO);
+    }
+
+    void _queueUpload(uint32_t poolId, const void* data, uint64_t firstElement, uint64_t count) {
+        VkDeviceSize size = count * _pools[poolId].elementSize;
+        if (size == 0) {
+            return;
+        }
+
+        _uploads.push_back({
+            .pool = poolId,
+            .srcOffset = _uploadData.size(),
+            .dstOffset = firstElement * _pools[poolId].elementSize,
+            .size = size,
+        });
+
+        const char* bytes = static_cast<const char*>(data);
+        _uploadData.insert(_uploadData.end(), bytes, bytes + size);
+    }
+
+    // Moves the highest ranges of the pool into lower free ranges
+    void _compactPool(VkCommandBuffer commandBuffer, uint32_t poolId, bool& bRecorded) {
+        Pool& pool = _pools[poolId];
+
+        std::vector<GeometryRange*> ranges;
+        uint64_t end = 0;
+        for (auto& mesh : _meshes) {
+            if (poolId != VERTEX_POOL && poolId != _indexPool(mesh)) {
+                continue;
+            }
+            GeometryRange& range = poolId == VERTEX_POOL ? mesh.vertices : mesh.indices;
+            if (range.isValid()) {
+                ranges.push_back(&range);
+                end = std::max(end, range.offset + range.capacity);
+            }
+        }
+
+        // No holes below the last range
+        if (end <= pool.range.getUsedSize()) {
+            return;
+        }
+
+        size_t candidateCount = std::min(ranges.size(), COMPACTION_CANDIDATES);
+        std::partial_sort(ranges.begin(), ranges.begin() + candidateCount, ranges.end(),
+                          [](const GeometryRange* a, const GeometryRange* b) {
+                              return a->offset > b->offset;
+                          });
+
+        VkDeviceSize moved = 0;
+        for (size_t i = 0; i < candidateCount && moved < COMPACTION_BYTES_PER_FRAME; i++) {
+            GeometryRange& range = *ranges[i];
+
+            uint64_t offset;
+            uint32_t node;
+            if (!pool.range.alloc(range.capacity, 1, offset, node)) {
+                continue;
+            }
+            // The new range is not used yet, it can be returned right away
+            if (offset >= range.offset) {
+                pool.range.free(node);
+                continue;
+            }
+
+            // Sources are released with the frame, so no copy of this
+            // frame writes to a range another copy reads
+            VkBufferCopy region {
+                .srcOffset = range.offset * pool.elementSize,
+                .dstOffset = offset * pool.elementSize,
+                .size = range.count * pool.elementSize,
+            };
+            if (region.size > 0) {
+                _beginTransfer(commandBuffer, bRecorded);
+                vkCmdCopyBuffer(commandBuffer, pool.buffer.vkBuffer, pool.buffer.vkBuffer, 1, &region);
+            }
+
+            _retireRange(poolId, range.node);
+            range.offset = offset;
+            range.node = node;
+
+            moved += region.size;
+            _version++;
+        }
+    }
+
+    void _retireRange(uint32_t poolId, uint32_t node) {
+        _deletions.retire([this, poolId, node]() {
+            _pools[poolId].range.free(node);
+        });
+    }
+
+    // Earlier frames may still read ranges that are written in this one
+    void _beginTransfer(VkCommandBuffer commandBuffer, bool& bRecorded) {
+        if (!bRecorded) {
+            _barrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0);
+            bRecorded = true;
+        }
+    }
+
+    void _barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess) {
+        VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = srcAccess,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        };
+        vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    Buffer _createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+        Buffer buffer { .size = size, .usage = usage };
+
+        VkBufferCreateInfo bufferInfo {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = size,
+            .usage = usage,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+
+        if (vkCreateBuffer(_device, &bufferInfo, nullptr, &buffer.vkBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create geometry buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(_device, buffer.vkBuffer, &memRequirements);
+
+        buffer.allocation = _allocator->allocate(memRequirements, properties, ResourceKind::LINEAR);
+        vkBindBufferMemory(_device, buffer.vkBuffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    void _destroyBuffer(Buffer& buffer) {
+        if (buffer.vkBuffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyBuffer(_device, buffer.vkBuffer, nullptr);
+        _allocator->free(buffer.allocation);
+        buffer = {};
+    }
+};
+
+} // namespace vk
+} // namespace ale
+
+#endif // ALE_VK_GEOMETRY_HEAP
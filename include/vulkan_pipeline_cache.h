@@ -0,0 +1,228 @@
+#pragma once
+
+/*
+    Persistent VkPipelineCache. The cache blob is stored on disk with a small
+    header, so a blob from another driver, device or shader build is never fed
+    to vkCreatePipelineCache.
+
+    File layout: PipelineCacheFileHeader | raw vkGetPipelineCacheData() blob
+*/
+
+// ext
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef ALE_VK_PIPELINE_CACHE
+#define ALE_VK_PIPELINE_CACHE
+
+// int
+#include <tracer.h>
+
+namespace trc = ale::Tracer;
+
+namespace ale {
+namespace vk {
+
+// FNV-1a hash. Used to key the pipeline cache by shader code
+static uint64_t hashBytes(const void* data, size_t size,
+                          uint64_t hash = 14695981039346656037ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t shaderHash;
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+
+class PipelineCache {
+public:
+    // "ALPC" in little endian
+    static constexpr uint32_t MAGIC = 0x43504c41;
+    static constexpr uint32_t VERSION = 1;
+
+    // Creates a cache from the file by path. Falls back to an empty cache
+    // if the file is missing or was written for another device or shaders
+    void init(VkPhysicalDevice physicalDevice, VkDevice device,
+              const std::string& path, uint64_t shaderHash) {
+        _device = device;
+        _path = path;
+        _shaderHash = shaderHash;
+        vkGetPhysicalDeviceProperties(physicalDevice, &_props);
+
+        std::vector<char> data;
+        if (!_readValidated(data)) {
+            data.clear();
+        }
+
+        VkPipelineCacheCreateInfo info {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .initialDataSize = data.size(),
+            .pInitialData = data.empty() ? nullptr : data.data(),
+        };
+
+        if (vkCreatePipelineCache(_device, &info, nullptr, &_cache) != VK_SUCCESS) {
+            // Drivers may still reject the blob, retry with an empty cache
+            info.initialDataSize = 0;
+            info.pInitialData = nullptr;
+            if (vkCreatePipelineCache(_device, &info, nullptr, &_cache) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create pipeline cache!");
+            }
+        }
+    }
+
+    // Writes the cache to a temporary file and renames it over the old one,
+    // so an interrupted write never leaves a broken cache behind
+    bool save() {
+        if (_cache == VK_NULL_HANDLE) {
+            return false;
+        }
+
+        size_t size = 0;
+        if (vkGetPipelineCacheData(_device, _cache, &size, nullptr) != VK_SUCCESS) {
+            return false;
+        }
+        std::vector<char> data(size);
+        if (vkGetPipelineCacheData(_device, _cache, &size, data.data()) != VK_SUCCESS) {
+            return false;
+        }
+        data.resize(size);
+
+        PipelineCacheFileHeader header = _makeHeader();
+        header.dataSize = data.size();
+        header.dataHash = hashBytes(data.data(), data.size());
+
+        std::string tmpPath = _path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                trc::log("Cannot write pipeline cache: " + tmpPath, trc::WARNING);
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), data.size());
+            if (!file) {
+                trc::log("Cannot write pipeline cache: " + tmpPath, trc::WARNING);
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, _path, ec);
+        if (ec) {
+            trc::log("Cannot replace pipeline cache: " + ec.message(), trc::WARNING);
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+        return true;
+    }
+
+    void destroy() {
+        vkDestroyPipelineCache(_device, _cache, nullptr);
+        _cache = VK_NULL_HANDLE;
+    }
+
+    VkPipelineCache get() const {
+        return _cache;
+    }
+
+private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPipelineCache _cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties _props{};
+    std::string _path;
+    uint64_t _shaderHash = 0;
+
+    PipelineCacheFileHeader _makeHeader() const {
+        PipelineCacheFileHeader header {
+            .magic = MAGIC,
+            .version = VERSION,
+            .vendorID = _props.vendorID,
+            .deviceID = _props.deviceID,
+            .driverVersion = _props.driverVersion,
+            .shaderHash = _shaderHash,
+            .dataSize = 0,
+            .dataHash = 0,
+        };
+        memcpy(header.pipelineCacheUUID, _props.pipelineCacheUUID, VK_UUID_SIZE);
+        return header;
+    }
+
+    bool _readValidated(std::vector<char>& out_data) const {
+        std::ifstream file(_path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            trc::log("No pipeline cache found, pipelines will be built from scratch", trc::INFO);
+            return false;
+        }
+
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        PipelineCacheFileHeader header;
+        if (fileSize < sizeof(header)) {
+            trc::log("Pipeline cache file is truncated", trc::WARNING);
+            return false;
+        }
+
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+        PipelineCacheFileHeader expected = _makeHeader();
+        if (header.magic != expected.magic || header.version != expected.version) {
+            trc::log("Pipeline cache has unknown format", trc::WARNING);
+            return false;
+        }
+
+        if (header.vendorID != expected.vendorID ||
+            header.deviceID != expected.deviceID ||
+            header.driverVersion != expected.driverVersion ||
+            memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            trc::log("Pipeline cache was written by another driver, discarding", trc::INFO);
+            return false;
+        }
+
+        if (header.shaderHash != expected.shaderHash) {
+            trc::log("Shaders changed since the last run, discarding pipeline cache", trc::INFO);
+            return false;
+        }
+
+        if (header.dataSize != fileSize - sizeof(header)) {
+            trc::log("Pipeline cache file is truncated", trc::WARNING);
+            return false;
+        }
+
+        out_data.resize(header.dataSize);
+        file.read(out_data.data(), out_data.size());
+
+        if (!file || hashBytes(out_data.data(), out_data.size()) != header.dataHash) {
+            trc::log("Pipeline cache data is corrupted", trc::WARNING);
+            return false;
+        }
+
+        return true;
+    }
+};
+
+} // namespace vk
+} // namespace ale
+
+#endif // ALE_VK_PIPELINE_CACHE
@@ -91,11 +91,12 @@ static VkShaderModule createShaderModule(VkDevice device, const std::vector<char
 // Creates a binding description based on binding location and its stride in bytes
 static VkVertexInputBindingDescription getVertBindingDescription(
                                                         unsigned int binding,
-                                                        unsigned int stride) {
+                                                        unsigned int stride,
+                                                        VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX) {
     return {
         .binding = binding,
         .stride = stride,
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+        .inputRate = inputRate,
     };
 }
 
@@ -113,6 +114,19 @@ static VkPipelineVertexInputStateCreateInfo getVertexInputInfo(
 };
 
 
+static VkPipelineVertexInputStateCreateInfo getVertexInputInfo(
+                const std::vector<VkVertexInputBindingDescription>& bindingDescriptions,
+                const std::vector<VkVertexInputAttributeDescription>& attributeDescriptions) {
+    return {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size()),
+        .pVertexBindingDescriptions = bindingDescriptions.data(),
+        .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size()),
+        .pVertexAttributeDescriptions = attributeDescriptions.data(),
+    };
+};
+
+
 static VkPipelineDynamicStateCreateInfo getPipelineDynamicState(
                             const std::vector<VkDynamicState>& dynamicStates) {
 
@@ -133,7 +147,7 @@ static VkPipelineLayoutCreateInfo getPipelineLayout(
         .setLayoutCount = 1,
         .pSetLayouts = &descriptorSetLayout,
         .pushConstantRangeCount = static_cast<unsigned int>(pushConstantRanges.size()),
-        .pPushConstantRanges = &pushConstantRanges.at(0),
+        .pPushConstantRanges = pushConstantRanges.empty() ? nullptr : pushConstantRanges.data(),
     };
 };
 
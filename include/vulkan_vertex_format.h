@@ -0,0 +1,236 @@
+#pragma once
+
+/*
+    GPU vertex layouts. ViewMesh keeps full precision ale::Vertex data for
+    editing, meshes are converted to the GPU layout when they are uploaded.
+
+    VERTEX_FORMAT_PACKED (16 bytes, 20 with color):
+    - position: unorm16 xyz relative to the mesh bounds. The shader restores
+      it with the per-instance offset and scale of VertexQuantization
+    - normal: octahedral encoding in snorm16 xy
+    - texCoord: half floats
+    - color: rgba8, only stored when a mesh has non white vertex colors.
+      Otherwise the color attribute reads a constant white vertex buffer
+
+    VERTEX_FORMAT_FULL is ale::Vertex as is.
+
+    Reference:
+    https://jcgt.org/published/0003/02/01/ (octahedral normal vectors)
+*/
+
+// ext
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+
+#ifndef GLM
+#define GLM
+#include <glm/glm.hpp>
+#endif //GLM
+
+#ifndef ALE_VK_VERTEX_FORMAT
+#define ALE_VK_VERTEX_FORMAT
+
+// int
+#include <primitives.h>
+
+namespace ale {
+namespace vk {
+
+enum VertexFormat {
+    VERTEX_FORMAT_FULL,
+    VERTEX_FORMAT_PACKED,
+    VERTEX_FORMAT_PACKED_COLOR,
+};
+
+struct PackedVertex {
+    // unorm16 x, y | z, unused
+    uint32_t posXY;
+    uint32_t posZ;
+    // snorm16 octahedral x, y
+    uint32_t normal;
+    // half x, y
+    uint32_t texCoord;
+    // rgba8, VERTEX_FORMAT_PACKED_COLOR only
+    uint32_t color;
+};
+
+// Maps unorm16 positions back to mesh space: pos = q * scale + offset
+struct VertexQuantization {
+    glm::vec3 offset = glm::vec3(0);
+    glm::vec3 scale = glm::vec3(1);
+};
+
+
+[[maybe_unused]]
+static uint32_t getVertexStride(VertexFormat format) {
+    switch (format) {
+        case VERTEX_FORMAT_PACKED:
+            return offsetof(PackedVertex, color);
+        case VERTEX_FORMAT_PACKED_COLOR:
+            return sizeof(PackedVertex);
+        default:
+            return sizeof(ale::Vertex);
+    }
+}
+
+
+[[maybe_unused]]
+static bool hasVertexColors(const std::vector<ale::Vertex>& vertices) {
+    for (auto& v : vertices) {
+        if (v.color != glm::vec3(1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Vertices moved out of the bounds repack the whole mesh. Bounds after
+// such a move grow by this share of their size on each side
+const float QUANTIZATION_EDIT_MARGIN = 0.1f;
+
+// Bounds of the mesh grown by margin times their size on each side. Flat
+// axes get a non zero scale
+[[maybe_unused]]
+static VertexQuantization getVertexQuantization(const std::vector<ale::Vertex>& vertices,
+                                                float margin = 0) {
+    if (vertices.empty()) {
+        return {};
+    }
+
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (auto& v : vertices) {
+        min = glm::min(min, v.pos);
+        max = glm::max(max, v.pos);
+    }
+
+    glm::vec3 grow = (max - min) * margin;
+    min -= grow;
+    max += grow;
+    return {
+        .offset = min,
+        .scale = glm::max(max - min, glm::vec3(std::numeric_limits<float>::min())),
+    };
+}
+
+
+// True if every vertex can be quantized without clamping
+[[maybe_unused]]
+static bool isQuantizationValid(const VertexQuantization& q, const ale::Vertex* vertices, size_t count) {
+    glm::vec3 max = q.offset + q.scale;
+    for (size_t i = 0; i < count; i++) {
+        const auto& v = vertices[i];
+        if (glm::any(glm::lessThan(v.pos, q.offset)) || glm::any(glm::greaterThan(v.pos, max))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+[[maybe_unused]]
+static glm::vec2 octEncode(glm::vec3 n) {
+    float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0) {
+        return glm::vec2(0);
+    }
+    n /= sum;
+
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0) {
+        glm::vec2 signs(e.x >= 0 ? 1.0f : -1.0f, e.y >= 0 ? 1.0f : -1.0f);
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * signs;
+    }
+    return e;
+}
+
+
+// Same rounding as glm::packUnorm2x16() and packSnorm2x16() for values in
+// range, without std::round() that took most of the time of a vertex
+[[maybe_unused]]
+static uint32_t packUnorm16(float a, float b) {
+    return uint32_t(a * 65535.0f + 0.5f) | uint32_t(b * 65535.0f + 0.5f) << 16;
+}
+
+[[maybe_unused]]
+static uint32_t packSnorm16(glm::vec2 v) {
+    v = glm::clamp(v, glm::vec2(-1), glm::vec2(1)) * 32767.0f;
+    auto round = [](float x) { return uint32_t(uint16_t(int16_t(x + (x < 0 ? -0.5f : 0.5f)))); };
+    return round(v.x) | round(v.y) << 16;
+}
+
+
+// Writes vertices in the GPU layout to out_data. Returns the byte count
+[[maybe_unused]]
+static size_t packVertices(VertexFormat format, const VertexQuantization& q,
+                           const ale::Vertex* vertices, size_t count,
+                           std::vector<char>& out_data) {
+    uint32_t stride = getVertexStride(format);
+    out_data.resize(count * stride);
+
+    if (format == VERTEX_FORMAT_FULL) {
+        memcpy(out_data.data(), vertices, out_data.size());
+        return out_data.size();
+    }
+
+    glm::vec3 invScale = 1.0f / q.scale;
+    for (size_t i = 0; i < count; i++) {
+        const ale::Vertex& v = vertices[i];
+        glm::vec3 p = glm::clamp((v.pos - q.offset) * invScale, glm::vec3(0), glm::vec3(1));
+
+        PackedVertex packed {
+            .posXY = packUnorm16(p.x, p.y),
+            .posZ = packUnorm16(p.z, 0),
+            .normal = packSnorm16(octEncode(v.normal)),
+            .texCoord = glm::packHalf2x16(v.texCoord),
+            .color = format == VERTEX_FORMAT_PACKED_COLOR ? glm::packUnorm4x8(glm::vec4(v.color, 1)) : 0,
+        };
+        memcpy(out_data.data() + i * stride, &packed, stride);
+    }
+    return out_data.size();
+}
+
+
+// Attributes of binding 0 (vertices) and binding 2 (constant color, see
+// VERTEX_FORMAT_PACKED) for locations 0-3 of shader.vert
+[[maybe_unused]]
+static std::vector<VkVertexInputAttributeDescription> getVertexAttributeDescriptions(VertexFormat format) {
+    if (format == VERTEX_FORMAT_FULL) {
+        return {
+            {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(ale::Vertex, pos)},
+            {.location = 1, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(ale::Vertex, color)},
+            {.location = 2, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(ale::Vertex, texCoord)},
+            {.location = 3, .binding = 0, .format = VK_FORMAT_R32G32B32_SFLOAT, .offset = offsetof(ale::Vertex, normal)},
+        };
+    }
+
+    VkVertexInputAttributeDescription color = format == VERTEX_FORMAT_PACKED_COLOR ?
+        VkVertexInputAttributeDescription{.location = 1, .binding = 0, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(PackedVertex, color)} :
+        VkVertexInputAttributeDescription{.location = 1, .binding = 2, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = 0};
+
+    return {
+        {.location = 0, .binding = 0, .format = VK_FORMAT_R16G16B16A16_UNORM, .offset = offsetof(PackedVertex, posXY)},
+        color,
+        {.location = 2, .binding = 0, .format = VK_FORMAT_R16G16_SFLOAT, .offset = offsetof(PackedVertex, texCoord)},
+        // The shader reads (x, y, 0) and decodes it if OCT_NORMALS is set
+        {.location = 3, .binding = 0, .format = VK_FORMAT_R16G16_SNORM, .offset = offsetof(PackedVertex, normal)},
+    };
+}
+
+} // namespace vk
+} // namespace ale
+
+#endif // ALE_VK_VERTEX_FORMAT
@@ -1,16 +1,27 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(push_constant, std430) uniform pc {
-    layout(offset = 64) vec4 color_data;
+struct Material {
+    int baseColorTexIdx;
+    int normalTexIdx;
+    int emissiveTexIdx;
+    int occlusionTexIdx;
 };
 
-layout(binding = 1) uniform sampler2D texSampler;
+layout(std430, binding = 1) readonly buffer Materials {
+    Material materials[];
+};
+
+// All model textures
+layout(binding = 2) uniform sampler2D textures[];
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in vec3 fragNormal;
 layout(location = 3) in vec3 fragPos;
 layout(location = 4) in vec3 lightPos;
+// x: node id, y: material id
+layout(location = 5) flat in vec4 objData;
 
 layout(location = 0) out vec4 outColor;
 
@@ -26,7 +37,8 @@ void main() {
     vec3 diffuse = diff * lightColor;
 
     vec3 ambient = ambientVal * lightColor;
-    vec4 texColor = texture(texSampler, fragTexCoord);
+    Material mat = materials[int(objData.y)];
+    vec4 texColor = texture(textures[nonuniformEXT(mat.baseColorTexIdx)], fragTexCoord);
 
     vec3 result = (ambient + diffuse) * vec3(texColor);
 
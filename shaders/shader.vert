@@ -1,8 +1,7 @@
 #version 450
 
-layout(push_constant, std430) uniform pc {
-    mat4 objTr;
-};
+// Normals are octahedral encoded in xy, see vulkan_vertex_format.h
+layout(constant_id = 0) const bool OCT_NORMALS = false;
 
 layout(binding = 0) uniform UniformBufferObject {
     // TODO: remove model matrix (use mat instead)
@@ -17,18 +16,36 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 layout(location = 3) in vec3 inNormal;
+// Per-instance data
+layout(location = 4) in mat4 inObjTr;
+layout(location = 8) in vec4 inObjData;
+// Dequantization of packed positions
+layout(location = 9) in vec4 inPosOffset;
+layout(location = 10) in vec4 inPosScale;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 fragNormal;
 layout(location = 3) out vec3 fragPos;
 layout(location = 4) out vec3 lightPos;
+layout(location = 5) flat out vec4 fragObjData;
+
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+    return normalize(v);
+}
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * objTr * vec4(inPosition, 1.0);
+    vec3 position = inPosition * inPosScale.xyz + inPosOffset.xyz;
+    vec3 normal = OCT_NORMALS ? octDecode(inNormal.xy) : inNormal;
+
+    gl_Position = ubo.proj * ubo.view * inObjTr * vec4(position, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
-    fragNormal = (objTr * vec4(inNormal,1)).xyz;
-    fragPos = vec3(objTr * vec4(inPosition, 1.0));
+    fragNormal = (inObjTr * vec4(normal,1)).xyz;
+    fragPos = vec3(inObjTr * vec4(position, 1.0));
     lightPos = vec3(ubo.light);
+    fragObjData = inObjData;
 }
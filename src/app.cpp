@@ -42,6 +42,15 @@ int App::run() {
         loader.recordCommandLineArguments(_config.argc, _config.argv);
         loader.getFlaggedArgument("-f", model_path);
 
+        // Draws a number of frames (600 by default) with the GPU driven
+        // path while the camera turns, compares them with CPU culling and
+        // exits
+        size_t checkFrames = 0;
+        if (loader.cmdOptionExists("--check-gpu-cull")) {
+            checkFrames = std::strtoul(loader.getCmdOption("--check-gpu-cull").c_str(), nullptr, 10);
+            checkFrames = checkFrames > 0 ? checkFrames : 600;
+        }
+
 
         ale::Model model;
         // // You can use this to load a custom texture
@@ -63,8 +72,8 @@ int App::run() {
 
         // RENDERING
         // Create Vulkan renderer
-        ale::Renderer ren(model);
-        sp<ale::Renderer> renderer = std::make_shared<ale::Renderer>(ren);
+        // The renderer owns GPU resources and is not copyable
+        sp<ale::Renderer> renderer = std::make_shared<ale::Renderer>(model);
         renderer->initWindow();
 
         // Create a camera object that will be passed to the renderer
@@ -96,6 +105,8 @@ int App::run() {
 
         // Start renderer
         renderer->initRenderer();
+        renderer->setGpuCullCheck(checkFrames > 0);
+        size_t frame = 0;
 
 
         // Arbitrary ui events to execute
@@ -123,6 +134,9 @@ int App::run() {
             auto camYawPitch = _cam->getYawPitch();
 
             camYawPitch-= mouseMovement * _cam->getSensitivity();
+            if (checkFrames > 0) {
+                camYawPitch.x += 360.0f / static_cast<float>(checkFrames);
+            }
 
             _cam->setOrientation(camYawPitch.x,camYawPitch.y);
 
@@ -145,9 +159,21 @@ int App::run() {
             // disable this fps cap
             /* std::this_thread::sleep_for(remainder); */
 
+            if (checkFrames > 0 && ++frame >= checkFrames) {
+                break;
+            }
         }
         renderer->cleanup();
 
+        if (checkFrames > 0) {
+            size_t checked = renderer->getGpuCullCheckedFrames();
+            size_t mismatches = renderer->getGpuCullMismatches();
+            trc::log("GPU culling check: " + std::to_string(mismatches) + " of " +
+                     std::to_string(checked) + " frames differ from CPU culling",
+                     mismatches == 0 && checked > 0 ? trc::INFO : trc::ERROR);
+            return mismatches == 0 && checked > 0 ? 0 : 1;
+        }
+
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return -1;
@@ -23,6 +23,11 @@ void InputManager::init(GLFWwindow* window) {
 	_bindKey(GLFW_KEY_F,InputAction::RMV_SELECT_ALL);
 	_bindKey(GLFW_KEY_C,InputAction::CYCLE_MODE_OPERATION);
 	_bindKey(GLFW_KEY_1,InputAction::CYCLE_MODE_EDITOR);
+	_bindKey(GLFW_KEY_Z,InputAction::UNDO);
+	_bindKey(GLFW_KEY_Y,InputAction::REDO);
+	_bindKey(GLFW_KEY_O,InputAction::TOGGLE_PROPORTIONAL);
+	_bindKey(GLFW_KEY_RIGHT_BRACKET,InputAction::GROW_PROPORTIONAL);
+	_bindKey(GLFW_KEY_LEFT_BRACKET,InputAction::SHRINK_PROPORTIONAL);
 
     glfwSetKeyCallback(window, _keyCallback);
 }
@@ -100,6 +105,14 @@ glm::highp_vec2 InputManager::getMousePos() {
     return {_lastPosX, _lastPosY};
 }
 
+// True while the right button is held over the scene, not over the UI
+bool InputManager::isRightMousePressed() {
+    if (ImGui::GetIO().WantCaptureMouse) {
+        return false;
+    }
+    return glfwGetMouseButton(_window_p, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+}
+
 // Executes mouse actions
 // TODO: add mouse mode checks, enable only when over the model window
 bool InputManager::executeActiveMouseAcitons() {
@@ -20,6 +20,13 @@ using namespace ale;
 namespace trc = ale::Tracer;
 
 const bool COMPRESS_VERTEX_DUPLICATES = false;
+// Reorder triangles and vertices of imported meshes for the GPU vertex
+// cache, see ale_mesh_optimizer.h
+const bool OPTIMIZE_VERTEX_ORDER = true;
+// Build simplified levels of every primitive, see ale_mesh_lod.h
+const bool GENERATE_MESH_LODS = true;
+// Check the structure of imported REMeshes, see re_mesh_validate.h
+const bool VALIDATE_MESHES = true;
 
 Loader::Loader() { }
 
@@ -95,7 +102,8 @@ int Loader::loadModelOBJ(char *model_path, ViewMesh& _mesh) {
     return 0;
 }
 
-// Attempts to find and load indices for a primitive to a mesh
+// Attempts to find and load indices for a primitive to a mesh. Indices are
+// offset by the vertices of previous primitives
 int Loader::_tryLoadMeshIndices(const tinygltf::Model& in_model,
                                 const tinygltf::Primitive& primitive,
                                 ale::ViewMesh& out_mesh) {
@@ -109,12 +117,13 @@ int Loader::_tryLoadMeshIndices(const tinygltf::Model& in_model,
 
     const auto& accessor = in_model.accessors[indicesIdx];
     auto _type = accessor.componentType;
+    uint32_t baseVertex = static_cast<uint32_t>(out_mesh.vertices.size());
 
     if (_type == TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT) {
 
         const unsigned short* indices = reinterpret_cast<const unsigned short*>( _getDataByAccessor(accessor, in_model));
         for (size_t i = 0; i < accessor.count; i++) {
-            out_mesh.indices.push_back(*(indices + i));
+            out_mesh.indices.push_back(baseVertex + *(indices + i));
         }
 
         trc::log("Index type: short");
@@ -122,7 +131,7 @@ int Loader::_tryLoadMeshIndices(const tinygltf::Model& in_model,
 
         const unsigned int* indices = reinterpret_cast<const unsigned int*>( _getDataByAccessor(accessor, in_model));
         for (size_t i = 0; i < accessor.count; i++) {
-            out_mesh.indices.push_back(*(indices + i));
+            out_mesh.indices.push_back(baseVertex + *(indices + i));
         }
 
         trc::log("Index type: int");
@@ -130,30 +139,15 @@ int Loader::_tryLoadMeshIndices(const tinygltf::Model& in_model,
 
         const unsigned char* indices = reinterpret_cast<const unsigned char*>( _getDataByAccessor(accessor, in_model));
         for (size_t i = 0; i < accessor.count; i++) {
-            out_mesh.indices.push_back(*(indices + i));
+            out_mesh.indices.push_back(baseVertex + *(indices + i));
         }
 
         trc::log("Index type: char");
     } else {
         trc::log("Unknown index type!", trc::ERROR);
+        return false;
     }
 
-    switch (accessor.componentType) {
-    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-
-
-    }
-        break;
-    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
-        break;
-    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
-        trc::log("unsigned bytes not supported as indices!",trc::ERROR);
-    }
-
-    const unsigned short* indices = reinterpret_cast<const unsigned short*>( _getDataByAccessor(accessor, in_model));
-    for (size_t i = 0; i < accessor.count; i++) {
-        out_mesh.indices.push_back(*(indices + i));
-    }
     return true;
 }
 
@@ -171,11 +165,11 @@ int Loader::_loadMeshGLTF(const tinygltf::Model& in_model,
         return reinterpret_cast<const float*>(_getDataByAccessor(accessor, in_model));
     };
 
-    size_t currentPrimitiveIndexOffsetIdx = 0;
     size_t lastIndexedSize = 0;
 
     for (auto primitive : in_mesh.primitives) {
 
+        uint32_t baseVertex = static_cast<uint32_t>(out_mesh.vertices.size());
 
         // Load indices
         bool bHasIndices = _tryLoadMeshIndices(in_model, primitive, out_mesh);
@@ -281,7 +275,7 @@ int Loader::_loadMeshGLTF(const tinygltf::Model& in_model,
                 out_mesh.vertices.push_back(vertex);
 
                 if (!bHasIndices) {
-                    out_mesh.indices.push_back(i);
+                    out_mesh.indices.push_back(baseVertex + i);
                 }
             }
 
@@ -291,18 +285,17 @@ int Loader::_loadMeshGLTF(const tinygltf::Model& in_model,
         if (!normals) {
             trc::log("Normals not found in the model! Generating vertex normals",
                      trc::WARNING);
-            _generateVertexNormals(out_mesh);
+            _generateVertexNormals(out_mesh, lastIndexedSize);
         }
 
         ale::Primitive ale_primitive{
             .materialID = primitive.material,
-            .offsetIdx = currentPrimitiveIndexOffsetIdx,
+            .offsetIdx = lastIndexedSize,
             .size = out_mesh.indices.size() - lastIndexedSize,
         };
 
         lastIndexedSize = out_mesh.indices.size();
         out_mesh.primitives.push_back(ale_primitive);
-        currentPrimitiveIndexOffsetIdx += out_mesh.indices.size();
     }
 
     return 0;
@@ -343,6 +336,7 @@ int Loader::_loadMaterialsGLTF(const tinygltf::Model& in_model, ale::Model& out_
         out_mat.normalTexIdx = mat.normalTexture.index;
         out_mat.occlusionTexIdx = mat.occlusionTexture.index;
         out_mat.emissiveTexIdx = mat.emissiveTexture.index;
+        out_mat.bDoubleSided = mat.doubleSided;
 
         out_model.materials.push_back(out_mat);
 
@@ -433,6 +427,8 @@ void Loader::_bindNodeGLTF(const tinygltf::Model& in_model,
     ale_node.parentIdx = parent;
     ale_node.meshIdx = n.mesh;
 
+    _loadNodeInstancesGLTF(in_model, n, ale_node);
+
     // We know the size of .nodes and load every node
     // So we can use this trick with random writes
     out_model.nodes[current] = ale_node;
@@ -444,6 +440,82 @@ void Loader::_bindNodeGLTF(const tinygltf::Model& in_model,
 }
 
 
+// Reads per-instance TRS attributes of the EXT_mesh_gpu_instancing extension
+int Loader::_loadNodeInstancesGLTF(const tinygltf::Model& in_model,
+                                   const tinygltf::Node& n,
+                                   ale::Node& out_node) {
+    if (!n.extensions.contains("EXT_mesh_gpu_instancing")) {
+        return 0;
+    }
+
+    const auto& attributes = n.extensions.at("EXT_mesh_gpu_instancing").Get("attributes");
+    if (!attributes.IsObject()) {
+        trc::log("EXT_mesh_gpu_instancing has no attributes", trc::WARNING);
+        return -1;
+    }
+
+    // Returns the accessor of the attribute if it is stored as floats
+    auto getAccessor = [&](const std::string& name, int components) -> const tinygltf::Accessor* {
+        if (!attributes.Has(name)) {
+            return nullptr;
+        }
+        const auto& accessor = in_model.accessors[attributes.Get(name).GetNumberAsInt()];
+        if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT ||
+            tinygltf::GetNumComponentsInType(accessor.type) != components) {
+            trc::log("Unsupported instance attribute format: " + name, trc::WARNING);
+            return nullptr;
+        }
+        return &accessor;
+    };
+
+    const tinygltf::Accessor* tAcc = getAccessor("TRANSLATION", 3);
+    const tinygltf::Accessor* rAcc = getAccessor("ROTATION", 4);
+    const tinygltf::Accessor* sAcc = getAccessor("SCALE", 3);
+
+    size_t count = 0;
+    for (auto acc : {tAcc, rAcc, sAcc}) {
+        if (acc) {
+            count = count == 0 ? acc->count : std::min(count, acc->count);
+        }
+    }
+
+    if (count == 0) {
+        return -1;
+    }
+
+    // Accessor data may be interleaved
+    auto getElement = [&](const tinygltf::Accessor* acc, size_t i) {
+        const auto& bufferView = in_model.bufferViews[acc->bufferView];
+        size_t stride = acc->ByteStride(bufferView);
+        return reinterpret_cast<const float*>(_getDataByAccessor(*acc, in_model) + i * stride);
+    };
+
+    out_node.instanceTransforms.resize(count);
+
+    for (size_t i = 0; i < count; i++) {
+        glm::mat4 tr = glm::mat4(1);
+
+        if (tAcc) {
+            tr = glm::translate(tr, glm::make_vec3(getElement(tAcc, i)));
+        }
+
+        if (rAcc) {
+            const float* q = getElement(rAcc, i);
+            // glTF stores quaternions as xyzw
+            tr *= glm::mat4_cast(glm::quat(q[3], q[0], q[1], q[2]));
+        }
+
+        if (sAcc) {
+            tr = glm::scale(tr, glm::make_vec3(getElement(sAcc, i)));
+        }
+
+        out_node.instanceTransforms[i] = tr;
+    }
+
+    return 0;
+}
+
+
 int _checkNodeCollisions(const ale::Model& in_model) {
 
     std::unordered_map<std::string, int> nameMap;
@@ -551,7 +623,17 @@ int Loader::loadModelGLTF(const std::string model_path,
 
     auto loadREMesh = [&](int i) {
         out_model.reMeshes[i].id = i;
-        return populateREMesh(out_model.viewMeshes[i], out_model.reMeshes[i]);
+        int result = populateREMesh(out_model.viewMeshes[i], out_model.reMeshes[i]);
+
+        if (result == 0 && OPTIMIZE_VERTEX_ORDER) {
+            std::vector<uint32_t> remap;
+            geo::optimizeMesh(out_model.viewMeshes[i], remap);
+            geo::remapViewIds(out_model.reMeshes[i], remap);
+        }
+        if (result == 0 && GENERATE_MESH_LODS) {
+            geo::generateMeshLods(out_model.viewMeshes[i]);
+        }
+        return result;
     };
 
     for (int i = 0; i < out_model.reMeshes.size(); i++) {
@@ -566,6 +648,15 @@ int Loader::loadModelGLTF(const std::string model_path,
     }
     trc::log("REMeshes loaded");
 
+    if (VALIDATE_MESHES) {
+        ThreadPool threads;
+        for (size_t i = 0; i < out_model.reMeshes.size(); i++) {
+            auto report = geo::validate(out_model.reMeshes[i], threads);
+            trc::log("REMesh " + std::to_string(i) + ": " + report.toString(),
+                     report.isValid() ? trc::DEBUG : trc::ERROR);
+        }
+    }
+
     trc::log("Finished loading model");
     return 0;
 }
@@ -595,20 +686,24 @@ int Loader::populateREMesh(ViewMesh& _inpMesh, geo::REMesh& _outMesh ) {
     auto* lp = &_outMesh.loopsPool;
     auto* dp = &_outMesh.disksPool;
 
-
-    const bool TEST_2_MANIFOLD = false;
-
     // Only accepts manifold meshes consisting of triangles
     assert(_inpMesh.vertices.size() >= 3);
     assert(_inpMesh.indices.size() >= 3);
     assert(_inpMesh.indices.size() % 3 == 0);
 
+    // Primitive of each triangle
+    std::vector<size_t> triPrimitives(_inpMesh.indices.size() / 3, 0);
+    for (size_t p = 0; p < _inpMesh.primitives.size(); p++) {
+        auto& prim = _inpMesh.primitives[p];
+        size_t end = std::min((prim.offsetIdx + prim.size) / 3, triPrimitives.size());
+        for (size_t t = prim.offsetIdx / 3; t < end; t++) {
+            triPrimitives[t] = p;
+        }
+    }
+
 	// Hash tables for the mesh. Needed for debug, will optimize later
     std::unordered_map<geo::Vert, geo::Vert*> uniqueVerts;
     std::unordered_map<geo::Edge, geo::Edge*> uniqueEdges;
-	std::unordered_map<geo::Loop, geo::Loop*> uniqueLoops;
-    std::unordered_map<geo::Face, geo::Face*> uniqueFaces;
-    std::unordered_map<geo::Disk, geo::Disk*> uniqueDisks;
 
     // Helper binding funcitons to make the code DRY
 
@@ -621,10 +716,13 @@ int Loader::populateREMesh(ViewMesh& _inpMesh, geo::REMesh& _outMesh ) {
         v.viewId = _inpMesh.indices[i];
     };
 
-    auto bindLoop = [&](geo::Loop* l,
-                        geo::Vert* v, geo::Edge* e ){
+    // Loops keep the UVs of their corner, seams split them
+    auto bindLoop = [&](geo::Loop* l, geo::Vert* v,
+                        geo::Edge* e, unsigned int i){
         l->v = v;
         l->e = e;
+        l->viewId = _inpMesh.indices[i];
+        l->texCoord = _inpMesh.vertices[l->viewId].texCoord;
         // No loop == loops to itself
         l->radial_next = l;
         l->radial_prev = l;
@@ -638,22 +736,12 @@ int Loader::populateREMesh(ViewMesh& _inpMesh, geo::REMesh& _outMesh ) {
         l3->f = f;
 	};
 
-    auto try_get_edge = [&](geo::Edge* e) {
-        if (uniqueEdges.contains(*e)) {
-            auto result = uniqueEdges[*e];
-            return result;
-        } else {
-            return e;
-        }
-    };
-
     // Iterate over each face
     for (unsigned int i = 0; i < _inpMesh.indices.size(); i+=3) {
 
 		std::vector<geo::Vert*> verts = {nullptr,nullptr,nullptr};
 		std::vector<geo::Edge*> edges = {nullptr,nullptr,nullptr};
 		std::vector<geo::Loop*> loops = {nullptr,nullptr,nullptr};
-        std::vector<bool> contains = {false,false,false};
 
 
         // Create and bind verts
@@ -661,6 +749,7 @@ int Loader::populateREMesh(ViewMesh& _inpMesh, geo::REMesh& _outMesh ) {
         for (size_t j = 0; j < 3; j++) {
             geo::Vert v;
             v.id = -1;
+            v.edge = nullptr;
 
             bindVert(v, i + j);
             if (uniqueVerts.contains(v)) {
@@ -671,10 +760,16 @@ int Loader::populateREMesh(ViewMesh& _inpMesh, geo::REMesh& _outMesh ) {
                 *verts[j] = v;
                 verts[j]->id = id;
                 uniqueVerts[v] = verts[j];
+                _outMesh.verts.push_back(verts[j]);
             }
         }
 
-        // Bind edges
+        // Triangles with welded corners have no area and no valid edges
+        if (verts[0] == verts[1] || verts[1] == verts[2] || verts[2] == verts[0]) {
+            continue;
+        }
+
+        // Bind edges. New edges join the disk cycles of both vertices
 
         for (size_t j = 0; j < 3; j++) {
 			int next = (j + 1) % 3;
@@ -685,37 +780,24 @@ int Loader::populateREMesh(ViewMesh& _inpMesh, geo::REMesh& _outMesh ) {
 
             if (uniqueEdges.contains(e)) {
                 edges[j] = uniqueEdges[e];
-                contains[j] = true;
-            } else {
-                size_t id;
-                edges[j] = ep->request(id);
-                edges[j]->id = id;
-                *edges[j] = e;
+                continue;
             }
 
-            verts[j]->edge = edges[j];
-            edges[j]->v1 = verts[j];
-            edges[j]->v2 = verts[next];
-        }
-
-        // Bind disks
-
-        for (size_t j = 0; j < 3; j++) {
-			int next = (j + 1) % 3;
-			int prev = (3 + (j - 1)) % 3;
-
-            if (contains[j]) {
-                edges[j]->d1->next = try_get_edge(edges[prev]);
-                edges[j]->d2->prev = try_get_edge(edges[next]);
-            } else {
-                size_t id1, id2;
-                edges[j]->d1 = dp->request(id1);
-                edges[j]->d1->id = id1;
-                edges[j]->d2 = dp->request(id2);
-                edges[j]->d2->id = id2;
-                edges[j]->d1->prev = try_get_edge(edges[next]);
-                edges[j]->d2->next = try_get_edge(edges[prev]);
-            }
+            size_t id, id1, id2;
+            edges[j] = ep->request(id);
+            *edges[j] = e;
+            edges[j]->id = id;
+            edges[j]->d1 = dp->request(id1);
+            edges[j]->d1->id = id1;
+            edges[j]->d2 = dp->request(id2);
+            edges[j]->d2->id = id2;
+
+            geo::addEdgeToDisk(_outMesh, edges[j], verts[j]);
+            geo::addEdgeToDisk(_outMesh, edges[j], verts[next]);
+            uniqueEdges[*edges[j]] = edges[j];
+            _outMesh.edges.push_back(edges[j]);
+            _outMesh.disks.push_back(edges[j]->d1);
+            _outMesh.disks.push_back(edges[j]->d2);
         }
 
         // Time to create face boundary loooops
@@ -740,106 +822,27 @@ int Loader::populateREMesh(ViewMesh& _inpMesh, geo::REMesh& _outMesh ) {
 			int prev = (3 + (j - 1)) % 3;
 
             // Populate basic loop data
-        	bindLoop(loops[j], verts[j], edges[j]);
-
-            // Bind all three loops together
-            // FIXME: Seems like an overkill tho
-            loops[j]->prev    = loops[prev];
-            loops[j]->next    = loops[next];
-            loops[prev]->prev = loops[next];
-            loops[prev]->next = loops[j];
-            loops[next]->prev = loops[j];
-            loops[next]->next = loops[prev];
-        }
+        	bindLoop(loops[j], verts[j], edges[j], i + j);
 
+            loops[j]->prev = loops[prev];
+            loops[j]->next = loops[next];
+		}
 
 		for (size_t j = 0; j < 3; j++) {
-
-            auto _e = edges[j];
-            geo::addLoopToEdge(_e, loops[j]);
-
-            // Update the edge table with the new edge
-            uniqueEdges[*_e] = _e;
-            uniqueLoops[*loops[j]] = loops[j];
+            geo::addLoopToEdge(_outMesh, edges[j], loops[j]);
+            _outMesh.loops.push_back(loops[j]);
 		}
 
         // Bind the face afterwards
 		bindFace(f, l1, l2, l3);
 
         f->size = 3;
-        uniqueFaces[*f] = f;
+        f->primitiveId = triPrimitives[i / 3];
+        _outMesh.faces.push_back(f);
     }
 
-    for (auto v : uniqueVerts) {
-        auto _v = v.second;
-        assert(_v->edge);
-        assert(_v->edge->v1 == _v || _v->edge->v2 == _v);
-        _outMesh.verts.push_back(_v);
-    }
-
-    for (auto e : uniqueEdges) {
-        auto _e = e.second;
-        assert(_e->v1);
-        assert(_e->v2);
-        assert(_e->loop);
-        assert(_e->d1);
-        assert(_e->d2);
-
-        if (TEST_2_MANIFOLD) {
-            assert(_e->d2->next);
-            assert(_e->d2->prev);
-            assert(_e->d1->next);
-            assert(_e->d1->prev);
-        }
-        _outMesh.edges.push_back(_e);
-    }
-
-    for (auto l : uniqueLoops) {
-        auto _l = l.second;
-        assert(_l->e);
-        assert(_l->v);
-        assert(_l->f);
-
-        if (TEST_2_MANIFOLD) {
-            assert(_l->radial_next != _l);
-            assert(_l->radial_prev != _l);
-            assert(_l->radial_prev->radial_prev == _l);
-            assert(_l->radial_next->radial_next == _l);
-            assert(_l->next->next->next == _l);
-            assert(_l->prev->prev->prev == _l);
-        }
-        _outMesh.loops.push_back(_l);
-    }
-
-
-    for (auto f : uniqueFaces) {
-        auto _f = f.second;
-        _outMesh.faces.push_back(_f);
-        auto l = _f->loop;
-        for (int i = 0 ; i < 3; i++) {
-            assert(l->f == _f);
-            l = l->next;
-        }
-    }
-
-    for (auto d : uniqueDisks) {
-        auto _d = d.second;
-        if (!_d->prev || !_d->next) {
-            delete _d;
-        } else {
-            _outMesh.disks.push_back(_d);
-        }
-    }
-
-    /* trc::raw << "\n" */
-    /*     << uniqueVerts.size() <<  " vertices" << "\n" */
-    /*     << uniqueEdges.size() <<  " edges" << "\n" */
-    /*     << uniqueLoops.size() <<  " loops" << "\n" */
-    /*     << uniqueFaces.size() <<  " faces" << "\n" */
-    /*     << "REMesh E.P. characteristic: " */
-    /*     << uniqueVerts.size() - uniqueEdges.size() + uniqueFaces.size() << "\n" */
-    /*     << "All asserts passed somehow!" << "\n" */
-    /*     << "\n"; */
+    // Elements are stored in creation order, neighbours stay close in memory.
+    // The structure is checked by geo::validate() after the import
 
     return 0;
 }
@@ -998,31 +1001,11 @@ const unsigned char* Loader::_getDataByAccessor(tinygltf::Accessor accessor,
 	return &posBuffer.data[bufferView.byteOffset + accessor.byteOffset];
 }
 
-void Loader::_generateVertexNormals(ale::ViewMesh &_mesh) {
-
-    if (_mesh.indices.size() % 3 != 0) {
-        trc::log("Cannot calculate normals, input mesh is not manifold!", trc::ERROR);
-        return;
-    }
-
-    for (size_t i = 0; i < _mesh.indices.size(); i+=3) {
-        int i1 = _mesh.indices[i + 0];
-        int i2 = _mesh.indices[i + 1];
-        int i3 = _mesh.indices[i + 2];
-
-        glm::vec3 pos1 = _mesh.vertices[i1].pos;
-        glm::vec3 pos2 = _mesh.vertices[i2].pos;
-        glm::vec3 pos3 = _mesh.vertices[i3].pos;
-
-        glm::vec3 v1 = pos2 - pos1;
-        glm::vec3 v2 = pos3 - pos1;
-
-        glm::vec3 normal = glm::normalize(glm::cross(v1,v2));
-
-        _mesh.vertices[i1].normal = normal;
-        _mesh.vertices[i2].normal = normal;
-        _mesh.vertices[i3].normal = normal;
-    }
+// Normals of the triangles of the last primitive. Hard edges of models
+// without normals stay hard
+void Loader::_generateVertexNormals(ale::ViewMesh &_mesh, size_t firstIndex) {
+    geo::NormalSettings settings{.bSplit = true};
+    geo::generateViewNormals(_mesh, firstIndex, _mesh.indices.size() - firstIndex, settings);
 }
 
 
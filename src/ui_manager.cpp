@@ -130,9 +130,10 @@ void UIManager::drawVectorOfPrimitives(const std::vector<glm::vec3>& vec, UI_DRA
 }
 
 
-// Draws ImGuizmo gizmo that takes mvp, editor state, and a transform
+// Draws ImGuizmo gizmo that takes mvp, editor state, and a transform.
+// Returns true if the transform was changed
 // FIXME: How do i use this to manipulate sets of primitives?
-void UIManager::drawImGuiGizmo(glm::mat4& view, glm::mat4& proj, glm::mat4* model, GEditorState& state){
+bool UIManager::drawImGuiGizmo(glm::mat4& view, glm::mat4& proj, glm::mat4* model, GEditorState& state){
     UIManager::flipProjection(proj);
     float* _view = geo::glmMatToPtr(view);
     float* _proj = geo::glmMatToPtr(proj);
@@ -160,7 +161,7 @@ void UIManager::drawImGuiGizmo(glm::mat4& view, glm::mat4& proj, glm::mat4* mode
             break;
     }
 
-    ImGuizmo::Manipulate(_view, _proj, operation, space, _model);
+    return ImGuizmo::Manipulate(_view, _proj, operation, space, _model);
 }
 
 
@@ -206,6 +207,89 @@ void UIManager::drawMenuBarUI() {
 }
 
 
+// Settings of mesh operations. Returns the tool whose button was pressed or NO_MESH_TOOL
+GMeshTool UIManager::drawMeshToolsUI(GEditorState& state) {
+    auto& tools = state.meshTools;
+    GMeshTool tool = NO_MESH_TOOL;
+
+    ImGui::Begin("Mesh tools");
+    ImGui::SliderFloat("Face ratio", &tools.decimateRatio, 0.01f, 1.0f);
+    if (ImGui::Button("Decimate")) {
+        tool = DECIMATE_TOOL;
+    }
+
+    ImGui::Separator();
+    ImGui::SliderInt("Levels", &tools.subdivisionLevels, 1, geo::MAX_SUBDIVISION_LEVELS);
+    ImGui::Checkbox("Loop (triangles)", &tools.bLoopSubdivision);
+    if (ImGui::Button("Subdivide")) {
+        tool = SUBDIVIDE_TOOL;
+    }
+
+    ImGui::Separator();
+    ImGui::Checkbox("Proportional editing", &tools.bProportional);
+    ImGui::SliderFloat("Radius", &tools.proportionalRadius, 0.01f, 100.0f, "%.3f",
+                       ImGuiSliderFlags_Logarithmic);
+    int falloff = tools.proportionalFalloff;
+    if (ImGui::BeginCombo("Falloff", geo::ProportionalFalloff_Names[falloff].c_str())) {
+        for (int i = 0; i < geo::FALLOFF_MAX; i++) {
+            if (ImGui::Selectable(geo::ProportionalFalloff_Names[i].c_str(), i == falloff)) {
+                tools.proportionalFalloff = static_cast<geo::ProportionalFalloff>(i);
+            }
+        }
+        ImGui::EndCombo();
+    }
+
+    ImGui::Separator();
+    ImGui::Checkbox("Sculpt (right mouse)", &tools.bSculpt);
+    auto& brush = tools.sculptBrush;
+    int brushType = brush.type;
+    if (ImGui::BeginCombo("Brush", geo::SculptBrush_Names[brushType].c_str())) {
+        for (int i = 0; i < geo::SCULPT_BRUSH_MAX; i++) {
+            if (ImGui::Selectable(geo::SculptBrush_Names[i].c_str(), i == brushType)) {
+                brush.type = static_cast<geo::SculptBrush>(i);
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SliderFloat("Brush radius", &brush.radius, 0.001f, 100.0f, "%.3f",
+                       ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderFloat("Strength", &brush.strength, 0.0f, 1.0f);
+    ImGui::Checkbox("Invert", &brush.bInvert);
+
+    ImGui::Separator();
+    auto& normals = tools.normals;
+    int weight = normals.weight;
+    if (ImGui::BeginCombo("Normal weight", geo::NormalWeight_Names[weight].c_str())) {
+        for (int i = 0; i < geo::NORMAL_WEIGHT_MAX; i++) {
+            if (ImGui::Selectable(geo::NormalWeight_Names[i].c_str(), i == weight)) {
+                normals.weight = static_cast<geo::NormalWeight>(i);
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::Checkbox("Split normals", &normals.bSplit);
+    ImGui::SliderFloat("Crease angle", &normals.creaseAngle, 0.0f, 180.0f, "%.1f deg");
+    if (ImGui::Button("Recompute normals")) {
+        tool = NORMALS_TOOL;
+    }
+
+    ImGui::Separator();
+    auto sel = state.getCurrentSelection();
+    if (sel) {
+        ImGui::Text("Selected: %zu verts, %zu edges, %zu faces",
+                    sel->verts.count(), sel->edges.count(), sel->faces.count());
+    }
+    ImGui::BeginDisabled(!sel || !sel->faces.any());
+    if (ImGui::Button("Extrude faces")) {
+        tool = EXTRUDE_TOOL;
+    }
+    ImGui::EndDisabled();
+    ImGui::End();
+
+    return tool;
+}
+
+
 void _parseNode(const ale::Model& model, int id) {
 
     ImGuiTreeNodeFlags base_flags =